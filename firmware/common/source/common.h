@@ -9,6 +9,10 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+// Встроенные функции IAR
+#ifdef __IAR_SYSTEMS_ICC__
+    #include <intrinsics.h>
+#endif
 
 // Вещественные типы данных
 typedef float float32_t;
@@ -102,6 +106,16 @@ constexpr T div_ceil(T a, T b)
     return a / b + (((a % b) != 0) ? 1 : 0);
 }
 
+// Получает индекс младшего установленного бита (значение не ноль)
+inline uint8_t bit_lowest(uint32_t value)
+{
+#ifdef __GNUC__
+    return (uint8_t)__builtin_ctz(value);
+#else
+    return (uint8_t)__CLZ(__RBIT(value));
+#endif
+}
+
 // Прототип функции оповещения
 typedef void (* handler_cb_ptr)(void);
 
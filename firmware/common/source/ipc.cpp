@@ -1,6 +1,7 @@
 ﻿#include "ipc.h"
 
 RAM_GCC 
+RAM_IAR
 uint16_t ipc_packet_t::checksum_get(void) const
 {
     uint16_t result = 0;
@@ -13,9 +14,56 @@ uint16_t ipc_packet_t::checksum_get(void) const
     return result;
 }
 
-ipc_slots_t::ipc_slots_t(void)
+// Таблица CRC-16/CCITT (полином 0x1021)
+static const uint16_t IPC_CRC16_TABLE[256] =
 {
-    for (auto i = 0; i < array_length(slots); i++)
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0,
+};
+
+RAM_GCC 
+uint16_t ipc_packet_t::crc_get(void) const
+{
+    uint16_t result = 0xFFFF;
+    const uint8_t *data = (const uint8_t *)(&this->dll.checksum + 1);
+    for (auto i = sizeof(dll.checksum); i < IPC_PKT_SIZE; i++, data++)
+        result = (uint16_t)(result << 8) ^ IPC_CRC16_TABLE[(uint8_t)(result >> 8) ^ *data];
+    return result;
+}
+
+void ipc_slots_t::init(void)
+{
+    for (auto i = 0; i < count; i++)
         slots[i].link(unused);
 }
 
@@ -28,6 +76,10 @@ void ipc_slots_t::use(ipc_slot_t &slot)
     // Смена списков
     slot.unlink();
     slot.link(used);
+    
+    // Учет занятости
+    if (used.count() > used_peak)
+        used_peak = (uint8_t)used.count();
 }
 
 RAM_GCC 
@@ -44,8 +96,7 @@ void ipc_slots_t::free(ipc_slot_t &slot)
 void ipc_slots_t::clear(void)
 {
     phase = false;
-    while (!used.empty())
-        free(*used.last());
+    unused.splice(used);
 }
 
 bool ipc_processor_t::data_split(ipc_processor_t &processor, ipc_opcode_t opcode, ipc_dir_t dir, const void *source, size_t size)
@@ -89,16 +140,41 @@ bool ipc_processor_t::data_split(ipc_processor_t &processor, ipc_opcode_t opcode
 RAM_GCC 
 void ipc_link_t::transmit_flow(reset_reason_t reason)
 {
-    auto result = data_split(*this, IPC_OPCODE_FLOW, IPC_DIR_REQUEST, &reason, sizeof(reason));
+    const flow_t flow = { reason, options, IPC_PROTOCOL_VERSION };
+    auto result = data_split(*this, IPC_OPCODE_FLOW, IPC_DIR_REQUEST, &flow, sizeof(flow));
     assert(result);
     UNUSED(result);
 }
 
+RAM_GCC 
+bool ipc_link_t::packet_idle(const ipc_packet_t &packet)
+{
+    if (packet.dll.opcode != IPC_OPCODE_FLOW)
+        return false;
+    
+    flow_t flow;
+    memcpy(&flow, packet.apl, sizeof(flow));
+    return flow.reason == RESET_REASON_NOP;
+}
+
 void ipc_link_t::reset_layer(reset_reason_t reason, bool internal)
 {
     // Проверка аргументов
     assert(reason > RESET_REASON_NOP);
     
+    // Учет причины сброса
+    switch (reason)
+    {
+        case RESET_REASON_OVERFLOW:
+            (internal ? stat.overflow_local : stat.overflow_remote)++;
+            break;
+        case RESET_REASON_CORRUPTION:
+            (internal ? stat.corruption_local : stat.corruption_remote)++;
+            break;
+        default:
+            break;
+    }
+    
     // Сброс слотов, полей
     reset();
     
@@ -126,11 +202,81 @@ bool ipc_link_t::check_phase(const ipc_packet_t &packet)
     return true;
 }
 
+RAM_GCC 
+bool ipc_link_t::check_sum(const ipc_packet_t &packet)
+{
+    // CRC, если поддерживаем
+    if ((options & IPC_LINK_OPTION_CRC) != 0 && packet.dll.checksum == packet.crc_get())
+    {
+        // Другая сторона перешла на CRC, простую сумму больше не принимаем
+        crc.rx = true;
+        return true;
+    }
+    
+    // Простая сумма, пока другая сторона не перешла на CRC
+    return !crc.rx && packet.dll.checksum == packet.checksum_get();
+}
+
 void ipc_link_t::reset(void)
 {
     reseting = false;
+    crc.tx = crc.rx = false;
     tx.clear();
     rx.clear();
+    assembly_reset();
+}
+
+void ipc_link_t::stat_get(ipc_link_stat_t &dest) const
+{
+    dest = stat;
+    dest.tx_peak = tx.peak_get();
+    dest.rx_peak = rx.peak_get();
+}
+
+void ipc_link_t::assembly_reset(void)
+{
+    ready.head = ready.tail = IPC_SLOT_NONE;
+    for (auto i = 0; i < IPC_OPCODE_INDEX_COUNT; i++)
+        for (auto d = 0; d < 2; d++)
+            assembly[i][d].head = assembly[i][d].tail = IPC_SLOT_NONE;
+}
+
+RAM_GCC 
+void ipc_link_t::assembly_append(ipc_slot_t &slot)
+{
+    const auto &packet = slot.packet;
+    const auto index = rx.index(slot);
+    const auto opcode = ipc_opcode_index(packet.dll.opcode);
+    assert(opcode != IPC_OPCODE_INDEX_NONE);
+    auto &cursor = assembly[opcode][packet.dll.dir];
+    
+    // Присоединение к сборке
+    slot.chain = IPC_SLOT_NONE;
+    if (cursor.head == IPC_SLOT_NONE)
+    {
+        cursor.head = index;
+        slot.size = 0;
+    }
+    else
+        rx.slot(cursor.tail).chain = index;
+    cursor.tail = index;
+    
+    // Накопление размера
+    auto &head = rx.slot(cursor.head);
+    head.size += packet.dll.length;
+    if (packet.dll.more)
+        return;
+    
+    // Сообщение собрано, в очередь готовых
+    head.ready = IPC_SLOT_NONE;
+    if (ready.tail == IPC_SLOT_NONE)
+        ready.head = cursor.head;
+    else
+        rx.slot(ready.tail).ready = cursor.head;
+    ready.tail = cursor.head;
+    
+    // Курсор свободен
+    cursor.head = cursor.tail = IPC_SLOT_NONE;
 }
 
 void ipc_link_t::packet_output(ipc_packet_t &packet)
@@ -153,7 +299,9 @@ void ipc_link_t::packet_output(ipc_packet_t &packet)
     
     // Заполнение DLL полей
     packet.dll.phase = tx.phase_switch();
-    packet.dll.checksum = packet.checksum_get();
+    packet.dll.checksum = crc.tx ? 
+        packet.crc_get() : 
+        packet.checksum_get();
 }
 
 bool ipc_link_t::packet_input(const ipc_packet_t &packet)
@@ -181,7 +329,8 @@ bool ipc_link_t::packet_input(const ipc_packet_t &packet)
     // Валидация
     {
         if (packet.dll.length > IPC_APL_SIZE || 
-            packet.dll.checksum != packet.checksum_get())
+            packet.dll.opcode >= IPC_OPCODE_LIMIT ||
+            !check_sum(packet))
         {
             reset_layer(RESET_REASON_CORRUPTION);
             return false;
@@ -192,77 +341,76 @@ bool ipc_link_t::packet_input(const ipc_packet_t &packet)
     if (packet.dll.opcode == IPC_OPCODE_FLOW)
     {
         // Декодирование
-        auto reason = (reset_reason_t)packet.apl[0];
+        flow_t flow;
+        memcpy(&flow, packet.apl, sizeof(flow));
+        // Сторона без версии передает только причину и опции
+        const auto legacy = packet.dll.length == sizeof(flow) - sizeof(flow.version);
         if (packet.dll.more ||
             packet.dll.dir != IPC_DIR_REQUEST ||
-            packet.dll.length != sizeof(reason) ||
-            reason >= RESET_REASON_COUNT)
+            (packet.dll.length != sizeof(flow) && !legacy) ||
+            flow.reason >= RESET_REASON_COUNT)
         {
             reset_layer(RESET_REASON_CORRUPTION);
             return false;
         }
+        if (legacy)
+            flow.version = 0;
         
         // Обработка команды управления потоком
-        if (reason > RESET_REASON_NOP)
-            reset_layer(reason, false);
+        if (flow.reason > RESET_REASON_NOP)
+            reset_layer(flow.reason, false);
+        
+        // Передача с CRC, если обе стороны поддерживают
+        crc.tx = (options & flow.options & IPC_LINK_OPTION_CRC) != 0;
+        
+        // Опции другой стороны (после сброса)
+        options_receive(flow.options);
+        
+        // Версия протокола другой стороны
+        if (flow.version != version)
+        {
+            version = flow.version;
+            version_receive(version);
+        }
     }
     
     // Проверка фазы
     if (check_phase(packet))
         return false;
     
-    // Команда управления потоком уже обработана
-    if (packet.dll.opcode == IPC_OPCODE_FLOW)
+    // Команда управления потоком уже обработана, не известные команды и команды несовместимой версии отбрасываются
+    if (packet.dll.opcode == IPC_OPCODE_FLOW || ipc_opcode_index(packet.dll.opcode) == IPC_OPCODE_INDEX_NONE || version_drop(packet))
         return false;
     
     // Используем
     rx.use(slot);
     slot.packet = packet;
+    assembly_append(slot);
     return true;
 }
 
 void ipc_link_t::flush_packets(ipc_processor_t &receiver)
 {
-    // Цикл пока не закончатся конечные пакеты
-    for (;;)
+    // Цикл пока не закончатся собранные сообщения
+    while (ready.head != IPC_SLOT_NONE)
     {
-        // Поиск конечного пакета
-        const ipc_packet_t *found = NULL;
-        for (auto slot = rx.used.head(); slot != NULL; slot = LIST_ITEM_NEXT(slot))
-            if (!slot->packet.dll.more)
-            {
-                found = &slot->packet;
-                break;
-            }
-        
-        if (found == NULL)
-            break;
+        // Извлечение из очереди
+        auto &head = rx.slot(ready.head);
+        ready.head = head.ready;
+        if (ready.head == IPC_SLOT_NONE)
+            ready.tail = IPC_SLOT_NONE;
         
-        // Определение команды и направления
-        auto dir = found->dll.dir;
-        auto opcode = found->dll.opcode;
-        
-        // Подсчет общего количества байт
-        size_t size = 0;
-        for (auto slot = rx.used.head(); slot != NULL; slot = LIST_ITEM_NEXT(slot))
-            if (slot->packet.equals(opcode, dir))
-                size += slot->packet.dll.length;
-        
-        // Сборка
+        // Сборка за один проход по цепочке слотов
         auto skip = false;
-        args_t args(size);
-        for (auto s = rx.used.head(); s != NULL;)
+        args_t args(head.size);
+        for (auto index = rx.index(head); index != IPC_SLOT_NONE;)
         {
             // Ссылка на слот и пакет
-            auto &slot = *s;
+            auto &slot = rx.slot(index);
             const auto &packet = slot.packet;
             
             // Переход к следующему слоту
-            s = LIST_ITEM_NEXT(s);
-            
-            // Фильтрация по команде и направлению
-            if (!packet.equals(opcode, dir))
-                continue;
+            index = slot.chain;
             
             // Освобождение слота
             rx.free(slot);
@@ -281,6 +429,11 @@ bool ipc_link_t::packet_process(const ipc_packet_t &packet, const args_t &args)
 {
     if (args.first)
     {
+        // Несовместимой версии протокола команды не передаются (считаются переданными)
+        skip = version_drop(packet);
+        if (skip)
+            return true;
+        
         // Проверяем, вместятся ли все данные
         const auto slot_count = (args.size <= 0) ? 1 : div_ceil(args.size, IPC_APL_SIZE);
         if (tx.unused.count() < slot_count)
@@ -430,30 +583,42 @@ void ipc_responder_t::transmit(void)
 }
 
 RAM_GCC 
-ipc_handler_t * ipc_handler_host_t::handler_find(ipc_opcode_t opcode) const
+void ipc_handler_t::ready_set(void)
 {
-    // Поиск обработчика с такой командой
-    for (auto i = handlers.head(); i != NULL; i = LIST_ITEM_NEXT(i))
-        if (i->command_get().opcode == opcode)
-            return i;
-    
-    return NULL;
+    if (host != NULL)
+        host->ready_set(command_get().opcode);
 }
 
 RAM_GCC 
 void ipc_handler_host_t::pool(void)
 {
-    for (auto i = handlers.head(); i != NULL; i = LIST_ITEM_NEXT(i))
-        i->pool();
+    for (auto w = 0; w < READY_WORDS; w++)
+        // Обход только помеченных обработчиков
+        for (auto mask = ready[w]; mask != 0; mask &= mask - 1)
+        {
+            const auto bit = bit_lowest(mask);
+            auto &handler = *dispatch[w * 32 + bit];
+            handler.pool();
+            
+            // Снятие пометки если обработчику больше нечего делать
+            if (!handler.idle_pooling && !handler.pending_get())
+                ready[w] &= ~MASK_32(1, bit);
+        }
 }
 
 void ipc_handler_host_t::handler_add(ipc_handler_t &handler)
 {
+    const auto opcode = handler.command_get().opcode;
     // Поиск обработчика с такой командой
-    assert(handler_find(handler.command_get().opcode) == NULL);
+    assert(handler_find(opcode) == NULL && handler.host == NULL);
     
     // Добавление
-    handler.link(handlers);
+    const auto index = ipc_opcode_index(opcode);
+    assert(index != IPC_OPCODE_INDEX_NONE);
+    dispatch[index] = &handler;
+    handler.host = this;
+    // Первый опрос выполняется всегда
+    ready_set(opcode);
 }
 
 bool ipc_handler_host_t::packet_process(const ipc_packet_t &packet, const args_t &args)
@@ -493,7 +658,10 @@ bool ipc_handler_host_t::packet_process(const ipc_packet_t &packet, const args_t
     
     // Декодирование данных, оповещение обработчика
     if (command.decode(dir, processing.offset))
+    {
         processing.handler->notify(dir);
+        ready_set(command.opcode);
+    }
     return true;
 }
 
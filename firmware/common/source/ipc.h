@@ -11,8 +11,25 @@ constexpr const size_t IPC_APL_SIZE = 28;
 // Общий размер пакета
 constexpr const size_t IPC_PKT_SIZE = IPC_DLL_SIZE + IPC_APL_SIZE;
 
-// Количество слотов пакетов в одну сторону
-constexpr const auto IPC_SLOT_COUNT = 10;
+// Версия протокола связи (нумерация команд, форматы данных), повышается при любом их изменении
+constexpr const uint8_t IPC_PROTOCOL_VERSION = 1;
+
+// Количество слотов пакетов в одну сторону (по умолчанию)
+constexpr const uint8_t IPC_SLOT_COUNT = 10;
+// Индекс слота, указывающий на его отсутствие
+constexpr const uint8_t IPC_SLOT_NONE = UINT8_MAX;
+
+// Опции канального уровня (согласуются командой управления потоком)
+typedef uint8_t ipc_link_option_t;
+
+// Декларирование опции
+#define IPC_LINK_OPTION_DECLARE(n)      MASK(ipc_link_option_t, 1, n)
+// Маска опций пуста
+#define IPC_LINK_OPTION_NONE            ((ipc_link_option_t)0)
+// Кадр из нескольких пакетов за одну транзакцию
+#define IPC_LINK_OPTION_FRAME_LARGE     IPC_LINK_OPTION_DECLARE(0)
+// Контроль целостности пакета по CRC-16 вместо простой суммы
+#define IPC_LINK_OPTION_CRC             IPC_LINK_OPTION_DECLARE(1)
 
 // Поддерживаемые коды команды
 enum ipc_opcode_t : uint8_t
@@ -77,9 +94,29 @@ enum ipc_opcode_t : uint8_t
         IPC_OPCODE_STM_CNET_SETTINGS_GET,
         // Задает настройки сцены подключенной сети
         IPC_OPCODE_STM_CNET_SETTINGS_SET,
+
+        // Получает состояние датчиков температуры
+        IPC_OPCODE_STM_TEMP_STATE_GET,
+        // Получает настройки датчиков температуры
+        IPC_OPCODE_STM_TEMP_SETTINGS_GET,
+        // Задает настройки датчиков температуры
+        IPC_OPCODE_STM_TEMP_SETTINGS_SET,
+
+        // Получает таблицу профилирования
+        IPC_OPCODE_STM_PROFILE_GET,
+
+        // Получает счетчики состояния STM32
+        IPC_OPCODE_STM_METRICS_GET,
+
+        // Подготовка к запуску программатора STM32 (только от ESP8266)
+        // Проходит при любой версии протокола, код не должен меняться (новые команды - после нее)
+        IPC_OPCODE_STM_UPDATE_ARM,
+
+    // Не команда, конец команд STM32
+    IPC_OPCODE_STM_HANDLE_LIMIT,
         
-    // Не команда, база для команд, обрабатываемых модулем ESP8266
-    IPC_OPCODE_ESP_HANDLE_BASE = 25,
+    // Не команда, база для команд, обрабатываемых модулем ESP8266 (коды до нее - резерв STM32)
+    IPC_OPCODE_ESP_HANDLE_BASE = 48,
         // Запрос информации о сети
         IPC_OPCODE_ESP_WIFI_INFO_GET,
         // Поиск сетей с опросом состояния
@@ -92,10 +129,54 @@ enum ipc_opcode_t : uint8_t
         // Передача списка хостов SNTP
         IPC_OPCODE_ESP_TIME_HOSTLIST_SET,
 
+        // Получение списка найденных сетей
+        IPC_OPCODE_ESP_WIFI_SEARCH_LIST,
+
+    // Не команда, конец команд ESP8266
+    IPC_OPCODE_ESP_HANDLE_LIMIT,
+
     // Не команда, определяет лимит количества команд
-    IPC_OPCODE_LIMIT = 32,
+    IPC_OPCODE_LIMIT = 64,
+
+    // Не команда, база кодов туннеля обновления STM32 (вне канального уровня)
+    IPC_OPCODE_UPDATE_BASE = 0xF0,
+        // Запуск программатора (ESP -> STM)
+        IPC_OPCODE_UPDATE_BEGIN,
+        // Запрос блока образа (STM -> ESP)
+        IPC_OPCODE_UPDATE_READ,
+        // Блок образа (ESP -> STM)
+        IPC_OPCODE_UPDATE_DATA,
+        // Образ записан и проверен (STM -> ESP)
+        IPC_OPCODE_UPDATE_DONE,
+        // Программатор ждёт нового запуска (STM -> ESP)
+        IPC_OPCODE_UPDATE_WAIT,
 };
 
+// Количество кодов команд STM32 (включая управление потоком)
+constexpr const uint8_t IPC_OPCODE_STM_COUNT = IPC_OPCODE_STM_HANDLE_LIMIT;
+// Количество кодов команд ESP8266
+constexpr const uint8_t IPC_OPCODE_ESP_COUNT = IPC_OPCODE_ESP_HANDLE_LIMIT - IPC_OPCODE_ESP_HANDLE_BASE - 1;
+// Количество используемых кодов команд (размер таблиц по коду команды)
+constexpr const uint8_t IPC_OPCODE_INDEX_COUNT = IPC_OPCODE_STM_COUNT + IPC_OPCODE_ESP_COUNT;
+// Индекс, указывающий на отсутствие команды
+constexpr const uint8_t IPC_OPCODE_INDEX_NONE = UINT8_MAX;
+
+// Группы команд не должны пересекаться
+STATIC_ASSERT(IPC_OPCODE_STM_HANDLE_LIMIT <= IPC_OPCODE_ESP_HANDLE_BASE);
+// Код подготовки к обновлению закреплен с версии протокола 1
+STATIC_ASSERT(IPC_OPCODE_STM_UPDATE_ARM == 30);
+STATIC_ASSERT(IPC_OPCODE_ESP_HANDLE_LIMIT <= IPC_OPCODE_LIMIT);
+
+// Получает плотный индекс команды для таблиц (резерв между группами пропускается)
+constexpr uint8_t ipc_opcode_index(ipc_opcode_t opcode)
+{
+    return opcode < IPC_OPCODE_STM_HANDLE_LIMIT ?
+               (uint8_t)opcode :
+           opcode > IPC_OPCODE_ESP_HANDLE_BASE && opcode < IPC_OPCODE_ESP_HANDLE_LIMIT ?
+               (uint8_t)(IPC_OPCODE_STM_COUNT + opcode - IPC_OPCODE_ESP_HANDLE_BASE - 1) :
+               IPC_OPCODE_INDEX_NONE;
+}
+
 // Тип направления
 enum ipc_dir_t : bool
 {
@@ -133,7 +214,10 @@ struct ipc_packet_t
     uint8_t apl[IPC_APL_SIZE];
     
     // Подсчет контрольной суммы
+    RAM_IAR
     uint16_t checksum_get(void) const;
+    // Подсчет CRC-16/CCITT
+    uint16_t crc_get(void) const;
     
     // Получает признак последнего пакета
     bool last_get(void) const
@@ -164,24 +248,44 @@ struct ipc_packet_t
 // Проверка размера пакета
 STATIC_ASSERT(sizeof(ipc_packet_t) == IPC_PKT_SIZE);
 
+// Слот пакета
+struct ipc_slot_t : list_item_t
+{
+    // Исходный пакет
+    ipc_packet_t packet;
+    // Индекс следующего слота сборки
+    uint8_t chain;
+    // Индекс первого слота следующего собранного сообщения (для первого слота)
+    uint8_t ready;
+    // Накопленный размер данных сборки (для первого слота)
+    uint16_t size;
+};
+
 // Класс списка пакетов
 class ipc_slots_t
 {
     // Доступные слоты пакетов
-    struct ipc_slot_t : list_item_t
-    {
-        // Исходный пакет
-        ipc_packet_t packet;
-    } slots[IPC_SLOT_COUNT];
+    ipc_slot_t * const slots;
+    // Количество слотов
+    const uint8_t count;
     // Фаза передачи
     bool phase = false;
+    // Наибольшее количество используемых слотов
+    uint8_t used_peak = 0;
+protected:
+    // Конструктор по умолчанию
+    ipc_slots_t(ipc_slot_t *_slots, uint8_t _count) : slots(_slots), count(_count)
+    {
+        assert(slots != NULL);
+        assert(count > 0 && count < IPC_SLOT_NONE);
+    }
+    
+    // Начальное заполнение списка свободных (после конструирования слотов)
+    void init(void);
 public:
     // Списки свободных и используемых слотов
     list_template_t<ipc_slot_t> unused, used;
 
-    // Конструктор по умолчанию
-    ipc_slots_t(void);
-    
     // Перенос слота в используемые
     void use(ipc_slot_t &slot);
     // Перенос слота в свободные
@@ -195,6 +299,26 @@ public:
         return used.empty();
     }
 
+    // Получает наибольшее количество одновременно используемых слотов
+    uint8_t peak_get(void) const
+    {
+        return used_peak;
+    }
+    
+    // Получает индекс слота
+    uint8_t index(const ipc_slot_t &slot) const
+    {
+        assert(&slot >= slots && &slot < slots + count);
+        return (uint8_t)(&slot - slots);
+    }
+    
+    // Получает слот по индексу
+    ipc_slot_t & slot(uint8_t index) const
+    {
+        assert(index < count);
+        return slots[index];
+    }
+
     // Смена фазы передачи, возвращает старое значение
     bool phase_switch(void)
     {
@@ -204,6 +328,33 @@ public:
     }
 };
 
+// Шаблон списка пакетов с указанным количеством слотов
+template <uint8_t COUNT>
+class ipc_slots_template_t : public ipc_slots_t
+{
+    // Слоты пакетов
+    ipc_slot_t storage[COUNT];
+public:
+    // Конструктор по умолчанию
+    ipc_slots_template_t(void) : ipc_slots_t(storage, COUNT)
+    {
+        init();
+    }
+};
+
+// Счетчики канала связи
+struct ipc_link_stat_t
+{
+    // Сбросы, инициированные этой стороной (переполнение, искажение)
+    uint16_t overflow_local, corruption_local;
+    // Сбросы, инициированные другой стороной (переполнение, искажение)
+    uint16_t overflow_remote, corruption_remote;
+    // Наибольшее количество занятых слотов передачи/приёма
+    uint8_t tx_peak, rx_peak;
+    // Выравнивание
+    uint8_t reserved[2];
+};
+
 // Класс интерфейс процессора пакетов
 class ipc_processor_t
 {
@@ -266,11 +417,33 @@ protected:
         // Для определения количества значений
         RESET_REASON_COUNT
     };
-    
+
+    // Данные команды управления потоком
+    struct flow_t
+    {
+        // Причина сброса
+        reset_reason_t reason;
+        // Опции отправителя
+        ipc_link_option_t options;
+        // Версия протокола отправителя (0 - сторона без версии, 2 байта данных)
+        uint8_t version;
+    };
+
     // Признак пропуска пакетов
     bool skip;
+    // Счетчики сбросов (поля наибольшей занятости слотов не используются)
+    ipc_link_stat_t stat;
     // Слоты на приём/передачу
-    ipc_slots_t tx, rx;
+    ipc_slots_t &tx, &rx;
+    // Опции, передаваемые другой стороне
+    ipc_link_option_t options = IPC_LINK_OPTION_CRC;
+
+    // Конструктор по умолчанию
+    ipc_link_t(ipc_slots_t &_tx, ipc_slots_t &_rx) : tx(_tx), rx(_rx)
+    {
+        memory_clear(&stat, sizeof(stat));
+        assembly_reset();
+    }
     
     // Обработка входящих пакетов
     void flush_packets(ipc_processor_t &receiver);
@@ -278,15 +451,68 @@ protected:
     virtual bool check_phase(const ipc_packet_t &packet);
     // Сброс прикладного уровня
     virtual void reset_layer(reset_reason_t reason, bool internal = true);
+    // Обработка опций, полученных от другой стороны
+    virtual void options_receive(ipc_link_option_t remote)
+    {
+        UNUSED(remote);
+    }
+    // Обработка смены версии протокола другой стороны
+    virtual void version_receive(uint8_t remote)
+    {
+        UNUSED(remote);
+    }
+    
+    // Получает, является ли пакет командой бездействия (у стороны нет данных к передаче)
+    static bool packet_idle(const ipc_packet_t &packet);
 private:
     // Флаг, указывающий, что происходит сброс инициированый нами
     bool reseting = false;
+    // Версия протокола другой стороны (до первой команды управления потоком считается своей)
+    uint8_t version = IPC_PROTOCOL_VERSION;
+    // Курсоры сборки входящих сообщений (индексы первого и последнего слотов)
+    struct
+    {
+        uint8_t head, tail;
+    } assembly[IPC_OPCODE_INDEX_COUNT][2];
+    // Очередь собранных сообщений (индексы первых слотов)
+    struct
+    {
+        uint8_t head, tail;
+    } ready;
+    // Состояние CRC
+    struct
+    {
+        // Передача с CRC (другая сторона поддерживает)
+        bool tx = false;
+        // Приём с CRC (другая сторона перешла на CRC)
+        bool rx = false;
+    } crc;
     
+    // Проверка контрольной суммы полученного пакета
+    bool check_sum(const ipc_packet_t &packet);
+    // Сброс курсоров сборки
+    void assembly_reset(void);
+    // Добавление полученного слота к сборке его сообщения
+    void assembly_append(ipc_slot_t &slot);
     // Передача команды управления потоком
     void transmit_flow(reset_reason_t reason);
+    // Получает, отбрасывается ли пакет из-за несовместимой версии протокола (управление потоком и обновление проходят всегда)
+    bool version_drop(const ipc_packet_t &packet) const
+    {
+        return !compatible() && 
+            packet.dll.opcode != IPC_OPCODE_FLOW && 
+            packet.dll.opcode != IPC_OPCODE_STM_UPDATE_ARM;
+    }
 public:
+    // Получает, совместима ли версия протокола другой стороны
+    bool compatible(void) const
+    {
+        return version == IPC_PROTOCOL_VERSION;
+    }
     // Сброс слотов, полей
     void reset(void);
+    // Получение счетчиков канала
+    void stat_get(ipc_link_stat_t &dest) const;
     // Получение пакета к выводу
     virtual void packet_output(ipc_packet_t &packet);
     // Ввод полученного пакета
@@ -295,9 +521,22 @@ public:
     virtual bool packet_process(const ipc_packet_t &packet, const args_t &args) override;
 };
 
+// Шаблон контроллера пакетов с указанным количеством слотов в одну сторону
+template <uint8_t SLOT_COUNT = IPC_SLOT_COUNT>
+class ipc_link_template_t : public ipc_link_t
+{
+    // Слоты на приём/передачу
+    ipc_slots_template_t<SLOT_COUNT> tx_slots, rx_slots;
+protected:
+    // Конструктор по умолчанию (слоты только запоминаются базой)
+    ipc_link_template_t(void) : ipc_link_t(tx_slots, rx_slots)
+    { }
+};
+
 // Базовый класс команды
 class ipc_command_t
 {
+    friend class ipc_handler_t;
     friend class ipc_handler_host_t;
     
     // Код команды
@@ -534,7 +773,7 @@ protected:
 class ipc_handler_host_t;
 
 // Базовый класс обработчика команды
-class ipc_handler_t : list_item_t
+class ipc_handler_t
 {
     friend class ipc_handler_host_t;
 protected:
@@ -550,7 +789,15 @@ protected:
 private:
     // Время последней передачи
     tick_t transmit_time;
+    // Хост, в который добавлен обработчик
+    ipc_handler_host_t *host = NULL;
 protected:
+    // Признак опроса в простое (обработчик сам проверяет события в work(true))
+    bool idle_pooling = false;
+    
+    // Пометка обработчика к опросу хостом (однократный вызов work(true))
+    void ready_set(void);
+    
     // Получает текущее значение тиков (реализуется платформой)
     static tick_t tick_get(void);
     // Получает процессор для передачи (реализуется платформой)
@@ -604,10 +851,14 @@ protected:
     virtual void notify(ipc_dir_t dir) = 0;
     // Получает ссылку на команду
     virtual ipc_command_t & command_get(void) = 0;
+    // Получает, есть ли незавершенный обмен (ожидание, переотправка)
+    virtual bool pending_get(void) const = 0;
     
     // Передача команды (внутренний метод)
     bool transmit_internal(ipc_dir_t dir)
     {
+        // Дальнейшие переотправки/ожидание выполняются из опроса
+        ready_set();
         transmit_time = tick_get();
         return command_get().transmit(transmitter_get(), dir);
     }
@@ -653,6 +904,12 @@ protected:
         if (state == HANDLER_STATE_RESPONSE_WAIT)
             state = HANDLER_STATE_RESPONSE_PENDING;
     }
+    
+    // Получает, есть ли незавершенный обмен
+    virtual bool pending_get(void) const override final
+    {
+        return state != HANDLER_STATE_IDLE;
+    }
 
     // Конструктор по умолчанию
     ipc_requester_t(tick_t timeout_request = TIMEOUT_REPEAT_DEFAULT) : 
@@ -708,6 +965,12 @@ protected:
         if (state == HANDLER_STATE_IDLE)
             state = HANDLER_STATE_REQUEST_PENDING;
     }
+    
+    // Получает, есть ли незавершенный обмен
+    virtual bool pending_get(void) const override final
+    {
+        return state != HANDLER_STATE_IDLE;
+    }
 };
 
 // Шаблон класса обработчика команды (запроситель)
@@ -728,6 +991,11 @@ protected:
 // Класс хоста обработчиков команд
 class ipc_handler_host_t : public ipc_processor_t
 {
+    friend class ipc_handler_t;
+    
+    // Количество слов набора готовых обработчиков
+    static constexpr const uint8_t READY_WORDS = div_ceil<uint8_t>(IPC_OPCODE_INDEX_COUNT, 32);
+    
     // Данные связанные с текущей сборкой
     struct
     {
@@ -736,11 +1004,25 @@ class ipc_handler_host_t : public ipc_processor_t
         // Используемый обработчик
         ipc_handler_t *handler;
     } processing;
-    // Список обработчиков
-    list_template_t<ipc_handler_t> handlers;
+    // Обработчики по индексу команды
+    ipc_handler_t *dispatch[IPC_OPCODE_INDEX_COUNT] = { };
+    // Набор обработчиков к опросу (бит на индекс команды)
+    uint32_t ready[READY_WORDS] = { };
     
     // Поиск обработчика по команде
-    ipc_handler_t * handler_find(ipc_opcode_t opcode) const;
+    ipc_handler_t * handler_find(ipc_opcode_t opcode) const
+    {
+        const auto index = ipc_opcode_index(opcode);
+        return index != IPC_OPCODE_INDEX_NONE ? dispatch[index] : NULL;
+    }
+    
+    // Пометка обработчика к опросу
+    void ready_set(ipc_opcode_t opcode)
+    {
+        const auto index = ipc_opcode_index(opcode);
+        assert(index != IPC_OPCODE_INDEX_NONE);
+        ready[index / 32] |= MASK_32(1, index % 32);
+    }
 public:
     // Оповещение о обработке
     void pool(void);
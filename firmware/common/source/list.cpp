@@ -3,14 +3,6 @@
 // Возвращает обратную сторону
 #define OPPSIDE(p)      (LIST_SIDE_NEXT - (p))
 
-RAM_GCC
-size_t list_t::count(void) const
-{
-    if (sides[LIST_SIDE_HEAD] == NULL)
-        return 0;
-    return sides[LIST_SIDE_HEAD]->count(LIST_SIDE_NEXT) + 1;
-}
-
 RAM_GCC
 void list_t::clear(void)
 {
@@ -24,6 +16,68 @@ bool list_t::contains(const list_item_t &item) const
     return item.list() == this;
 }
 
+RAM_IAR
+list_item_t * list_t::pop(list_side_t side)
+{
+    auto result = sides[side];
+    if (result != NULL)
+        result->unlink();
+    return result;
+}
+
+RAM_IAR
+void list_t::move(list_item_t &first, list_item_t &last, list_t &dest, list_side_t side)
+{
+    // Проверка аргументов
+    assert(&dest != this);
+    assert(first.parent == this && last.parent == this);
+    
+    // Смена родителя и подсчет элементов (цепочка от first до last)
+    size_t moved = 0;
+    for (auto item = &first;; item = item->sides[LIST_SIDE_NEXT])
+    {
+        assert(item != NULL);
+        item->parent = &dest;
+        moved++;
+        if (item == &last)
+            break;
+    }
+    
+    // Удаление цепочки из текущего списка
+    auto prev = first.sides[LIST_SIDE_PREV];
+    auto next = last.sides[LIST_SIDE_NEXT];
+    if (prev != NULL)
+        prev->sides[LIST_SIDE_NEXT] = next;
+    else
+        sides[LIST_SIDE_HEAD] = next;
+    if (next != NULL)
+        next->sides[LIST_SIDE_PREV] = prev;
+    else
+        sides[LIST_SIDE_LAST] = prev;
+    size -= moved;
+    
+    // Вставка цепочки в другой список
+    first.sides[LIST_SIDE_PREV] = last.sides[LIST_SIDE_NEXT] = NULL;
+    if (dest.empty())
+    {
+        dest.sides[LIST_SIDE_HEAD] = &first;
+        dest.sides[LIST_SIDE_LAST] = &last;
+    }
+    else if (side == LIST_SIDE_LAST)
+    {
+        dest.sides[LIST_SIDE_LAST]->sides[LIST_SIDE_NEXT] = &first;
+        first.sides[LIST_SIDE_PREV] = dest.sides[LIST_SIDE_LAST];
+        dest.sides[LIST_SIDE_LAST] = &last;
+    }
+    else
+    {
+        dest.sides[LIST_SIDE_HEAD]->sides[LIST_SIDE_PREV] = &last;
+        last.sides[LIST_SIDE_NEXT] = dest.sides[LIST_SIDE_HEAD];
+        dest.sides[LIST_SIDE_HEAD] = &first;
+    }
+    dest.size += moved;
+}
+
 RAM_IAR
 void list_item_t::link(list_t &list, list_side_t side)
 {
@@ -40,6 +94,7 @@ void list_item_t::link(list_t &list, list_side_t side)
     for (auto i = 0; i < LIST_SIDE_COUNT; i++)
         list.sides[i] = this;
     parent = &list;
+    list.size = 1;
 }
 
 RAM_IAR
@@ -57,7 +112,10 @@ void list_item_t::link(list_item_t &item, list_side_t side)
     
     // Родительский список
     parent = item.parent;
-    if (parent != NULL && sides[side] == NULL)
+    if (parent == NULL)
+        return;
+    parent->size++;
+    if (sides[side] == NULL)
         parent->sides[side] = this;
 }
 
@@ -83,6 +141,9 @@ list_item_t * list_item_t::unlink(list_side_t side)
             parent->sides[i] = sides[OPPSIDE(i)];
         }
     
+    // Количество в родительском списке
+    if (parent != NULL)
+        parent->size--;
     parent = NULL;
     clear();
     return result;
@@ -66,6 +66,10 @@ protected:
 // Класс списка
 class list_t : public list_sides_t
 {
+    friend class list_item_t;
+    
+    // Количество элементов
+    size_t size = 0;
 public:
     // Получает указатель на первый элемент
     RAM_IAR
@@ -92,10 +96,30 @@ public:
     void clear(void);
 
     // Получает количество элементов
-    size_t count(void) const;
+    RAM_IAR
+    size_t count(void) const
+    {
+        return size;
+    }
     
     // Получает, есть ли указанный элемент в списке
     bool contains(const list_item_t &item) const;
+    
+    // Извлечение конечного элемента с указанной стороны (NULL если список пуст)
+    RAM_IAR
+    list_item_t * pop(list_side_t side = LIST_SIDE_HEAD);
+    
+    // Перенос цепочки элементов [first..last] в конец указанной стороны другого списка
+    RAM_IAR
+    void move(list_item_t &first, list_item_t &last, list_t &dest, list_side_t side = LIST_SIDE_LAST);
+    
+    // Перенос всех элементов другого списка в конец указанной стороны
+    RAM_IAR
+    void splice(list_t &source, list_side_t side = LIST_SIDE_LAST)
+    {
+        if (!source.empty())
+            source.move(*source.head(), *source.last(), *this, side);
+    }
 };
 
 // Шаблонный класс списка
@@ -116,11 +140,20 @@ public:
     {
         return (ITEM *)list_t::last();
     }
+    
+    // Извлечение конечного элемента с указанной стороны (NULL если список пуст)
+    RAM_IAR
+    ITEM * pop(list_side_t side = LIST_SIDE_HEAD)
+    {
+        return (ITEM *)list_t::pop(side);
+    }
 };
 
 // Элемент списка
 class list_item_t : public list_sides_t
 {
+    friend class list_t;
+    
     // Указатель на родительский список (опционально)
     list_t *parent = NULL;
     
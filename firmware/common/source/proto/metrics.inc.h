@@ -0,0 +1,44 @@
+﻿// Количество хранимых смещений часов при синхронизации
+#define METRICS_SYNC_HISTORY    4
+
+// Данные ответа запроса счетчиков STM32
+struct metrics_command_get_response_t
+{
+    // Время работы [сек]
+    uint32_t uptime;
+    // Переотправки пакетов (ESP пропустила пакет)
+    uint32_t retries;
+    // Счетчики канала связи с ESP
+    ipc_link_stat_t link;
+    // Принудительные сбросы ESP (связь не восстановилась)
+    uint16_t esp_resets;
+    // Количество примененных синхронизаций времени
+    uint16_t sync_count;
+    // Смещения часов при последних синхронизациях [сек] (первое - последнее)
+    int16_t sync_offsets[METRICS_SYNC_HISTORY];
+    // Кадры экрана
+    struct
+    {
+        // Количество обновлений
+        uint32_t count;
+        // Пропущенные обновления (предыдущее еще не выполнено)
+        uint32_t skipped;
+        // Среднее и наибольшее время обновления с прошлого запроса [мкС]
+        uint16_t avg, max;
+    } frame;
+    
+    // Проверка полей
+    bool check(void) const
+    {
+        return frame.avg <= frame.max;
+    }
+};
+
+// Команда получения счетчиков STM32
+class metrics_command_get_t : public ipc_command_get_t<metrics_command_get_response_t>
+{
+public:
+    // Конструктор по умолчанию
+    metrics_command_get_t(void) : ipc_command_get_t(IPC_OPCODE_STM_METRICS_GET)
+    { }
+};
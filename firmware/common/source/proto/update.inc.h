@@ -0,0 +1,160 @@
+﻿// Размер блока образа в пакете туннеля обновления
+constexpr const size_t UPDATE_BLOCK_SIZE = IPC_APL_SIZE - sizeof(uint32_t);
+// Размер ПЗУ STM32 (регион ROM_REGION линковщика)
+constexpr const uint32_t UPDATE_STM_ROM_SIZE = 64 * 1024;
+// Размер журнала хранилища в конце ПЗУ STM32 (блок STORAGE_LOG линковщика)
+constexpr const uint32_t UPDATE_STM_LOG_SIZE = 2 * 1024;
+// Предельный размер образа приложения STM32 (журнал хранилища не затирается)
+constexpr const uint32_t UPDATE_IMAGE_SIZE_MAX = UPDATE_STM_ROM_SIZE - UPDATE_STM_LOG_SIZE;
+// Начальное значение CRC-32 образа
+constexpr const uint32_t UPDATE_CRC_INIT = UINT32_MAX;
+// Признак запроса запуска программатора ("NCUP")
+constexpr const uint32_t UPDATE_MAGIC = 0x5055434E;
+// Окно запуска программатора после подготовки приложением STM32 (мС)
+constexpr const uint32_t UPDATE_ARM_WINDOW_MS = 3000;
+
+// Данные запуска программатора (ESP -> STM)
+struct update_begin_t
+{
+    // Признак запроса
+    uint32_t magic;
+    // Размер образа
+    uint32_t size;
+    // CRC-32 всего образа
+    uint32_t crc;
+    
+    // Проверка полей
+    bool check(void) const
+    {
+        return magic == UPDATE_MAGIC && size > 0 && size <= UPDATE_IMAGE_SIZE_MAX;
+    }
+};
+
+// Команда подготовки приложения STM32 к запуску программатора (по каналу связи)
+class update_command_arm_t : public ipc_command_set_t<update_begin_t>
+{
+public:
+    // Конструктор по умолчанию
+    update_command_arm_t(void) : ipc_command_set_t(IPC_OPCODE_STM_UPDATE_ARM)
+    { }
+};
+
+// Запрос блока образа (STM -> ESP)
+struct update_read_t
+{
+    // Смещение блока
+    uint32_t offset;
+};
+
+// Блок образа (ESP -> STM)
+struct update_data_t
+{
+    // Смещение блока
+    uint32_t offset;
+    // Данные (последний блок может быть неполным)
+    uint8_t data[UPDATE_BLOCK_SIZE];
+};
+
+// Блок образа занимает прикладной слой пакета целиком
+STATIC_ASSERT(sizeof(update_data_t) == IPC_APL_SIZE);
+
+/* Пакеты туннеля не проходят канальный уровень (коды вне IPC_OPCODE_LIMIT),
+ * поэтому функции ниже исполняются из ОЗУ программатора STM32 */
+
+// Подсчет CRC-32 части образа (полином 0xEDB88320, результат всего образа инвертируется)
+RAM_IAR
+static uint32_t update_crc(uint32_t crc, const void *data, size_t size)
+{
+    auto source = (const uint8_t *)data;
+    for (; size > 0; size--)
+    {
+        crc ^= *source++;
+        for (auto bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    return crc;
+}
+
+// Заполнение канального слоя пакета туннеля
+RAM_IAR
+static void update_packet_seal(ipc_packet_t &packet, ipc_opcode_t opcode, size_t length)
+{
+    packet.dll.opcode = opcode;
+    packet.dll.length = (uint8_t)length;
+    packet.dll.dir = IPC_DIR_REQUEST;
+    packet.dll.phase = false;
+    packet.dll.more = false;
+    packet.dll.checksum = packet.checksum_get();
+}
+
+// Проверка пакета туннеля
+RAM_IAR
+static bool update_packet_check(const ipc_packet_t &packet, ipc_opcode_t opcode)
+{
+    return packet.dll.opcode == opcode &&
+           packet.dll.length <= IPC_APL_SIZE &&
+           !packet.dll.more &&
+           packet.dll.checksum == packet.checksum_get();
+}
+
+// Ответ программатора туннелю
+enum update_reply_t
+{
+    // Ответа нет или он не распознан
+    UPDATE_REPLY_NONE,
+    // Запрос блока образа
+    UPDATE_REPLY_READ,
+    // Образ записан и проверен
+    UPDATE_REPLY_DONE,
+};
+
+// Сторона ESP туннеля обновления (без привязки к транспорту)
+struct update_tunnel_t
+{
+    // Параметры образа
+    update_begin_t begin;
+    // Смещение запрошенного блока (UINT32_MAX - программатор не запущен)
+    uint32_t offset;
+    
+    // Запуск туннеля: передача пакета запуска, пока программатор не запросит первый блок
+    void start(const update_begin_t &value)
+    {
+        begin = value;
+        offset = UINT32_MAX;
+    }
+    
+    // Подготовка исходящего пакета, результат - прочитан ли запрошенный блок из источника
+    template <typename SOURCE>
+    bool output(ipc_packet_t &out, SOURCE &source) const
+    {
+        if (offset == UINT32_MAX)
+        {
+            memcpy(out.apl, &begin, sizeof(begin));
+            update_packet_seal(out, IPC_OPCODE_UPDATE_BEGIN, sizeof(begin));
+            return true;
+        }
+        update_data_t data;
+        data.offset = offset;
+        auto length = minimum<size_t>(UPDATE_BLOCK_SIZE, begin.size - offset);
+        if (!source.read(data.data, length, offset))
+            return false;
+        memcpy(out.apl, &data, sizeof(data.offset) + length);
+        update_packet_seal(out, IPC_OPCODE_UPDATE_DATA, sizeof(data.offset) + length);
+        return true;
+    }
+    
+    // Разбор ответа программатора
+    update_reply_t input(const ipc_packet_t &in)
+    {
+        if (update_packet_check(in, IPC_OPCODE_UPDATE_READ) && in.dll.length == sizeof(update_read_t))
+        {
+            update_read_t read;
+            memcpy(&read, in.apl, sizeof(read));
+            if (read.offset >= begin.size)
+                return UPDATE_REPLY_NONE;
+            offset = read.offset;
+            return UPDATE_REPLY_READ;
+        }
+        return update_packet_check(in, IPC_OPCODE_UPDATE_DONE) ? UPDATE_REPLY_DONE : UPDATE_REPLY_NONE;
+    }
+};
@@ -112,12 +112,6 @@ public:
 // Данные запроса на поиск сетей с опросом
 struct wifi_command_search_pool_request_t
 {
-	enum
-	{
-		// Максимальное количество сетей
-		MAX_INDEX = 20,
-	};
-
     // Команда
     enum : uint8_t
     {
@@ -126,15 +120,11 @@ struct wifi_command_search_pool_request_t
         // Запуск поиска
         COMMAND_START,
     } command;
-    
-    // Индекс сети
-    uint8_t index;
 
     // Провера полей
     bool check(void) const
     {
-        return command <= COMMAND_START &&
-        		index <= MAX_INDEX;
+        return command <= COMMAND_START;
     }
 };
 
@@ -144,37 +134,16 @@ struct wifi_command_search_pool_response_t
     // Статус
     enum : uint8_t
     {
-        // Простой (или конец списка)
+        // Простой (список сетей готов)
         STATUS_IDLE = 0,
         // Запущен (идет поиск)
         STATUS_RUNNING,
-        // Информация о сети
-        STATUS_RECORD,
     } status;
     
-    // Информация о сети
-    struct
-    {
-        // Имя
-        wifi_ssid_t ssid;
-        // Уровень сигнала
-        int8_t rssi;
-        // Признак приватности
-        bool priv;
-    } record;
-    
     // Провера полей
     bool check(void) const
     {
-        if (status > STATUS_RECORD)
-            return false;
-
-        if (status != STATUS_RECORD)
-            return true;
-        
-        return wifi_ssid_check(record.ssid) && 
-               record.rssi < 0 &&
-               ipc_bool_check(record.priv);
+        return status <= STATUS_RUNNING;
     }
 };
 
@@ -187,6 +156,130 @@ public:
     { }
 };
 
+// Информация о найденной сети
+struct wifi_search_record_t
+{
+    // Имя
+    wifi_ssid_t ssid;
+    // Уровень сигнала
+    int8_t rssi;
+    // Канал
+    uint8_t channel;
+    // Режим аутентификации (0 - открытая сеть)
+    uint8_t auth;
+
+    // Провера полей
+    bool check(void) const
+    {
+        return wifi_ssid_check(ssid) &&
+               rssi < 0 &&
+               channel <= 14;
+    }
+};
+
+// Данные ответа списка найденных сетей (передаются только заполненные записи)
+struct wifi_command_search_list_response_t
+{
+    enum
+    {
+        // Максимальное количество сетей (ответ умещается в кадр WebSocket)
+        MAX_COUNT = 14,
+    };
+
+    // Количество сетей
+    uint8_t count;
+    // Сети без повторов имени, по убыванию уровня сигнала
+    wifi_search_record_t records[MAX_COUNT];
+
+    // Получает размер заполненной части
+    size_t size_get(void) const
+    {
+        return sizeof(count) + sizeof(records[0]) * count;
+    }
+
+    // Провера полей
+    bool check(void) const
+    {
+        if (count > MAX_COUNT)
+            return false;
+
+        for (auto i = 0; i < count; i++)
+            if (!records[i].check())
+                return false;
+
+        return true;
+    }
+};
+
+// Команда получения списка найденных сетей одной передачей
+class wifi_command_search_list_t : public ipc_command_t
+{
+public:
+    // Поля ответа
+    wifi_command_search_list_response_t response;
+protected:
+    // Получает размер буфера
+    virtual size_t buffer_size(ipc_dir_t dir) const override final
+    {
+        switch (dir)
+        {
+            case IPC_DIR_RESPONSE:
+                return sizeof(response);
+
+            default:
+                return ipc_command_t::buffer_size(dir);
+        }
+    }
+
+    // Получает указатель буфера
+    virtual const void * buffer_pointer(ipc_dir_t dir) const override final
+    {
+        switch (dir)
+        {
+            case IPC_DIR_RESPONSE:
+                return &response;
+
+            default:
+                return ipc_command_t::buffer_pointer(dir);
+        }
+    }
+
+    // Кодирование данных, возвращает количество записанных данных
+    virtual size_t encode(ipc_dir_t dir) override final
+    {
+        switch (dir)
+        {
+            case IPC_DIR_RESPONSE:
+                // Проверка данных
+                assert(response.check());
+                return response.size_get();
+
+            default:
+                return ipc_command_t::encode(dir);
+        }
+    }
+
+    // Декодирование данных
+    virtual bool decode(ipc_dir_t dir, size_t size) override final
+    {
+        switch (dir)
+        {
+            case IPC_DIR_RESPONSE:
+                // Проверка данных (размер зависит от количества сетей)
+                return size >= sizeof(response.count) &&
+                       response.check() &&
+                       response.size_get() == size;
+
+            default:
+                return ipc_command_t::decode(dir, size);
+        }
+    }
+public:
+    // Конструктор по умолчанию
+    wifi_command_search_list_t(void) : ipc_command_t(IPC_OPCODE_ESP_WIFI_SEARCH_LIST)
+    { }
+};
+
 // Перечисление состояния интерфейса
 enum wifi_intf_state_t : uint8_t
 {
@@ -72,6 +72,30 @@ romfs_t::reader_t::handle_t romfs_t::reader_t::open(const char *path)
     return handle_t();
 }
 
+//   
+bool romfs_t::reader_t::verify(size_t limit)
+{
+    for (size_t offset = 0; sizeof(header_t) <= limit - offset;)
+    {
+        //  
+        if (!read(&header, sizeof(header), offset))
+            return false;
+        offset += sizeof(header_t);
+        //      
+        if (memchr(header.path, '\0', sizeof(header.path)) == NULL)
+            return false;
+        //  
+        if (strlen(header.path) <= 0)
+            return true;
+        //      
+        if (header.size_pads() > limit - offset)
+            return false;
+        offset += header.size_pads();
+    }
+    //    
+    return false;
+}
+
 bool romfs_t::builder_t::file_new(const char *path, size_t size)
 {
     //  
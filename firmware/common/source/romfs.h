@@ -69,6 +69,8 @@ public:
     {
         //  
         header_t header;
+        //    (   )
+        size_t handles = 0;
     protected:
         //     
         virtual bool read(void *dest, size_t size, size_t offset) = 0;
@@ -91,12 +93,41 @@ public:
                 this->base = base;
                 this->fsize = size;
                 this->reader = &reader;
+                reader.handles++;
             }
         public:
             //   
-            handle_t(void) : reader(NULL)
+            handle_t(void) : reader(NULL), base(0), fsize(0), offset(0)
             { }
 
+            //   (    )
+            handle_t(const handle_t &other) : reader(other.reader), base(other.base), fsize(other.fsize), offset(other.offset)
+            {
+                if (opened())
+                    reader->handles++;
+            }
+
+            // 
+            ~handle_t(void)
+            {
+                close();
+            }
+
+            // 
+            handle_t & operator = (const handle_t &other)
+            {
+                if (this == &other)
+                    return *this;
+                close();
+                reader = other.reader;
+                base = other.base;
+                fsize = other.fsize;
+                offset = other.offset;
+                if (opened())
+                    reader->handles++;
+                return *this;
+            }
+
             // ,   
             bool opened(void) const
             {
@@ -115,6 +146,8 @@ public:
             {
                 if (opened())
                 {
+                    assert(reader->handles > 0);
+                    reader->handles--;
                     reader = NULL;
                     return true;
                 }
@@ -130,6 +163,15 @@ public:
 
         //  
         handle_t open(const char *path);
+
+        // ,    
+        bool busy(void) const
+        {
+            return handles > 0;
+        }
+
+        //       
+        bool verify(size_t limit);
     };
 
     //     
@@ -75,18 +75,34 @@ app.opcode =
     STM_CNET_SETTINGS_GET: 23,
     // Задает настройки сцены подключенной сети
     STM_CNET_SETTINGS_SET: 24,
+
+    // Получает состояние датчиков температуры
+    STM_TEMP_STATE_GET: 25,
+    // Получает настройки датчиков температуры
+    STM_TEMP_SETTINGS_GET: 26,
+    // Задает настройки датчиков температуры
+    STM_TEMP_SETTINGS_SET: 27,
+
+    // Получает таблицу профилирования
+    STM_PROFILE_GET: 28,
+
+    // Получает счетчики состояния STM32
+    STM_METRICS_GET: 29,
     
     // Запрос информации о сети
-    ESP_WIFI_INFO_GET: 26,    
+    ESP_WIFI_INFO_GET: 49,    
     // Поиск сетей с опросом состояния
-    ESP_WIFI_SEARCH_POOL: 27,    
+    ESP_WIFI_SEARCH_POOL: 50,    
     // Оповещение, что настройки WiFi сменились
-    ESP_WIFI_SETTINGS_CHANGED: 28,
+    ESP_WIFI_SETTINGS_CHANGED: 51,
     
     // Запрос даты/времени из интернета
-    ESP_TIME_SYNC: 29,
+    ESP_TIME_SYNC: 52,
     // Передача списка хостов SNTP
-    ESP_TIME_HOSTLIST_SET: 30,
+    ESP_TIME_HOSTLIST_SET: 53,
+    
+    // Получение списка найденных сетей
+    ESP_WIFI_SEARCH_LIST: 54,
 };
 
 // Оверлей
@@ -1229,8 +1245,6 @@ app.page =
         // Поисковик сетей
         const searcher = new function ()
         {
-            // Индекс сети
-            let netIndex;
             // Признак запуска
             let running = false;
             
@@ -1266,7 +1280,6 @@ app.page =
                 // Подготовка пакета
                 const packet = new Packet(app.opcode.ESP_WIFI_SEARCH_POOL, message);
                 packet.data.uint8(command);
-                packet.data.uint8(netIndex);
                 
                 // Запрос
                 const data = await app.session.transmit(packet);
@@ -1295,8 +1308,8 @@ app.page =
                             return;
                         }
                         
-                        // Завершение
-                        finalize();
+                        // Поиск завершен, запрос списка
+                        requestList();
                         return;
                         
                     // Поиск
@@ -1304,27 +1317,37 @@ app.page =
                         // Опрос
                         sendPool();
                         return;
-                        
-                    // Запись
-                    case 0x02:
-                        {
-                            // Чтение записи
-                            const ssid = data.cstr(33);
-                            const rssi = data.int8();
-                            const priv = data.bool();
-                            // Лог
-                            log.info("Found WiFi network \"" + ssid + "\", rssi " + rssi + ", " + (priv ? "private" : "open"));
-                            
-                            appendStation(ssid, priv, rssi);
-                        }
-                        
-                        // Опрос
-                        netIndex++;
-                        sendPool();
-                        return;
                 }
             };
             
+            // Запрос списка найденных сетей (одной передачей)
+            async function requestList()
+            {
+                const data = await app.session.transmit(new Packet(app.opcode.ESP_WIFI_SEARCH_LIST, "запрос списка WiFi сетей"));
+                
+                // Игнор, если не запущенны
+                if (!running)
+                    return;
+                
+                // Разбор записей (по убыванию уровня сигнала)
+                if (data != null)
+                    for (let count = data.uint8(); count > 0; count--)
+                    {
+                        // Чтение записи
+                        const ssid = data.cstr(33);
+                        const rssi = data.int8();
+                        const channel = data.uint8();
+                        const priv = data.uint8() != 0;
+                        // Лог
+                        log.info("Found WiFi network \"" + ssid + "\", rssi " + rssi + ", channel " + channel + ", " + (priv ? "private" : "open"));
+                        
+                        appendStation(ssid, priv, rssi);
+                    }
+                
+                // Завершение
+                finalize();
+            };
+            
             // Сброс
             this.reset = () =>
             {
@@ -1347,7 +1370,6 @@ app.page =
                 
                 app.dom.wifi.sta.find.spinner(true);
                 log.info("WiFi finder running...");
-                netIndex = 0;
                 sendStart();
             };
             
@@ -2959,6 +2981,9 @@ app.session = new function ()
         {
             clearTimeout(connectTimeout);
             log.info("Socket connected!");
+            // В отладке подписываемся на лог ESP
+            if (app.debug)
+                ws.send("stream on");
             
             switch (wsPhase)
             {
@@ -3017,6 +3042,15 @@ app.session = new function ()
         // Обработчик получения данных
         ws.onmessage = event =>
         {
+            // Текстовые фреймы - трансляция лога ESP
+            if (typeof event.data == "string")
+            {
+                for (const line of event.data.split("\n"))
+                    if (line.length > 0)
+                        log.info("ESP " + line);
+                return;
+            }
+            
             // Сброс восстановления
             switch (wsPhase)
             {
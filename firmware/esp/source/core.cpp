@@ -7,7 +7,9 @@
 #include "ntime.h"
 
 #include "svc/wifi.h"
+#include "svc/ota.h"
 #include "svc/ntime.h"
+#include "svc/metrics.h"
 #include "svc/httpd.h"
 
 #include <esp_timer.h>
@@ -38,8 +40,113 @@ static const struct
     { &httpd_processor_in, "WEB" },
 };
 
-// Карта маршрутизации ответных пакетов
-static bool core_route_map[IPC_OPCODE_LIMIT][CORE_LINK_SIDE_COUNT];
+// Уровень логов маршрутизации (сообщения подробнее отсекаются при сборке)
+#ifndef CORE_ROUTE_LOG_LEVEL
+    #define CORE_ROUTE_LOG_LEVEL    ESP_LOG_WARN
+#endif
+
+// Логирование маршрутизации с учетом уровня
+#define CORE_ROUTE_LOG(level, log, format, ...) \
+    do { if (CORE_ROUTE_LOG_LEVEL >= (level)) log(format, ##__VA_ARGS__); } while (false)
+
+// Определение стороны обработки запроса по коду команды (у резервных кодов стороны нет)
+static constexpr core_link_side_t core_route_request(uint8_t opcode)
+{
+    return ipc_opcode_index((ipc_opcode_t)opcode) == IPC_OPCODE_INDEX_NONE ? CORE_LINK_SIDE_COUNT :
+           opcode > IPC_OPCODE_ESP_HANDLE_BASE ? CORE_LINK_SIDE_ESP :
+           opcode > IPC_OPCODE_STM_HANDLE_BASE ? CORE_LINK_SIDE_STM :
+           CORE_LINK_SIDE_COUNT;
+}
+
+// Последовательность кодов команд (std::index_sequence недоступен в C++11)
+template <uint8_t... O>
+struct core_opcode_sequence_t
+{ };
+
+// Построение последовательности кодов команд [0, N)
+template <uint8_t N, uint8_t... O>
+struct core_opcode_sequence_make_t : core_opcode_sequence_make_t<N - 1, N - 1, O...>
+{ };
+
+template <uint8_t... O>
+struct core_opcode_sequence_make_t<0, O...>
+{
+    typedef core_opcode_sequence_t<O...> type;
+};
+
+// Таблица маршрутизации запросов
+struct core_route_request_table_t
+{
+    // Сторона обработки по коду команды
+    core_link_side_t side[IPC_OPCODE_LIMIT];
+
+    // Получает сторону обработки по коду команды
+    constexpr core_link_side_t operator [] (uint8_t opcode) const
+    {
+        return side[opcode];
+    }
+};
+
+// Заполнение таблицы маршрутизации по последовательности кодов команд
+template <uint8_t... O>
+static constexpr core_route_request_table_t core_route_request_table(core_opcode_sequence_t<O...>)
+{
+    return { { core_route_request(O)... } };
+}
+
+// Таблица маршрутизации запросов (CORE_LINK_SIDE_COUNT - нет обработчика)
+static constexpr const core_route_request_table_t CORE_ROUTE_REQUEST =
+    core_route_request_table(core_opcode_sequence_make_t<IPC_OPCODE_LIMIT>::type());
+
+// Управление потоком, базовые и резервные коды не маршрутизируются
+STATIC_ASSERT(CORE_ROUTE_REQUEST[IPC_OPCODE_FLOW] == CORE_LINK_SIDE_COUNT);
+STATIC_ASSERT(CORE_ROUTE_REQUEST[IPC_OPCODE_STM_HANDLE_BASE] == CORE_LINK_SIDE_COUNT);
+STATIC_ASSERT(CORE_ROUTE_REQUEST[IPC_OPCODE_ESP_HANDLE_BASE] == CORE_LINK_SIDE_COUNT);
+STATIC_ASSERT(CORE_ROUTE_REQUEST[IPC_OPCODE_STM_HANDLE_LIMIT] == CORE_LINK_SIDE_COUNT);
+STATIC_ASSERT(IPC_OPCODE_ESP_HANDLE_LIMIT >= IPC_OPCODE_LIMIT ||
+    CORE_ROUTE_REQUEST[IPC_OPCODE_ESP_HANDLE_LIMIT] == CORE_LINK_SIDE_COUNT);
+// Рабочие коды групп попадают своей стороне
+STATIC_ASSERT(CORE_ROUTE_REQUEST[IPC_OPCODE_STM_HANDLE_LIMIT - 1] == CORE_LINK_SIDE_STM);
+STATIC_ASSERT(CORE_ROUTE_REQUEST[IPC_OPCODE_ESP_HANDLE_LIMIT - 1] == CORE_LINK_SIDE_ESP);
+
+// Время жизни токена без повторного запроса стороны (мС), после него запросившая сторона считается отказавшейся
+#define CORE_ROUTE_PENDING_TIMEOUT  5000
+
+// Ожидающие ответа стороны (токены запросов в порядке поступления)
+static struct core_route_pending_t
+{
+    // Количество токенов
+    uint8_t count;
+    // Стороны, отправившие запрос
+    core_link_side_t side[CORE_LINK_SIDE_COUNT];
+    // Время последнего запроса стороны
+    os_tick_t tick[CORE_LINK_SIDE_COUNT];
+
+    // Снятие токена по индексу
+    void remove(uint8_t index)
+    {
+        assert(index < count);
+        count--;
+        for (auto i = index; i < count; i++)
+        {
+            side[i] = side[i + 1];
+            tick[i] = tick[i + 1];
+        }
+    }
+
+    // Снятие токенов, стороны которых давно не повторяли запрос (ответ потерян)
+    void expire(os_tick_t now)
+    {
+        for (uint8_t i = 0; i < count;)
+            if (now - tick[i] >= OS_MS_TO_TICKS(CORE_ROUTE_PENDING_TIMEOUT))
+                remove(i);
+            else
+                i++;
+    }
+} core_route_pending[IPC_OPCODE_LIMIT];
+
+// Запросы сброса токенов сторон (выставляются без мьютекса ядра)
+static volatile bool core_route_drop_request[CORE_LINK_SIDE_COUNT];
 
 // Основная задача ядра
 static class core_main_task_t : public os_task_base_t
@@ -65,97 +172,125 @@ public:
     { }
 } core_main_task;
 
-RAM_GCC 
+RAM_GCC
 bool core_processor_out_t::side_t::transmit_to(const ipc_packet_t &packet, const args_t &args, core_link_side_t dest)
 {
-    // Определяем код команды
-    const auto opcode = packet.dll.opcode;
-    // Имя текущей стороны
-    const auto this_name = CORE_LINK_SIDE[side].name;
-    // Имя другой стороны
-    const auto other_name = CORE_LINK_SIDE[dest].name;
-    // Признак запроса
-    const auto request = packet.dll.dir != IPC_DIR_RESPONSE;
-
-    // Передача запроса
+    // Передача пакета
     if (CORE_LINK_SIDE[dest].in->packet_process(packet, args))
     {
-        // Если не пакет последний
-        if (packet.dll.more)
-            return false;
-
         // Пакет последний, лог
-        LOGI("%s - %s %d to %s (%d bytes)", this_name, request ? "request" : "response", opcode, other_name, args.size);
-        // Помечаем с какой стороны пришел запрос
-        core_route_map[opcode][request ? side : dest] = request;
+        if (!packet.dll.more)
+            CORE_ROUTE_LOG(ESP_LOG_INFO, LOGI, "%s - %s %d to %s (%d bytes)", CORE_LINK_SIDE[side].name,
+                packet.dll.dir != IPC_DIR_RESPONSE ? "request" : "response", packet.dll.opcode, CORE_LINK_SIDE[dest].name, args.size);
         return false;
     }
 
     // Не удалось передать пакет, лог
-    LOGW("%s - %s %d to %s failed!", this_name,  request ? "request" : "response", opcode, other_name);
+    CORE_ROUTE_LOG(ESP_LOG_WARN, LOGW, "%s - %s %d to %s failed!", CORE_LINK_SIDE[side].name,
+        packet.dll.dir != IPC_DIR_RESPONSE ? "request" : "response", packet.dll.opcode, CORE_LINK_SIDE[dest].name);
     return true;
 }
 
 RAM_GCC
-bool core_processor_out_t::side_t::packet_process(const ipc_packet_t &packet, const args_t &args)
+core_link_side_t core_processor_out_t::side_t::route_begin(const ipc_packet_t &packet) const
 {
-    // Результат выполнения
-    auto result = true;
     // Определяем код команды
     const auto opcode = packet.dll.opcode;
+    if (opcode >= IPC_OPCODE_LIMIT)
+        return CORE_LINK_SIDE_COUNT;
 
-    // Начало ввода
-    if (args.first)
-        core_main_task.mutex.enter();
+    // Снятие токенов сторон, переставших повторять запрос (по таймауту запроса)
+    auto &pending = core_route_pending[opcode];
+    pending.expire(os_tick_get());
+
+    // Запрос передаётся обработчику группы команд
+    if (packet.dll.dir != IPC_DIR_RESPONSE)
+        return CORE_ROUTE_REQUEST[opcode];
+
+    // Ответ передаётся первой ожидающей стороне
+    return pending.count > 0 ? pending.side[0] : CORE_LINK_SIDE_COUNT;
+}
 
-    // Первым делом проверка на направление
-    switch (packet.dll.dir)
+RAM_GCC
+void core_processor_out_t::side_t::route_end(const ipc_packet_t &packet) const
+{
+    auto &pending = core_route_pending[packet.dll.opcode];
+
+    // Ответ доставлен, снимаем токен
+    if (packet.dll.dir == IPC_DIR_RESPONSE)
     {
-        case IPC_DIR_REQUEST:
-            {
-                // Определяем кому передать
-                core_link_side_t dest;
-                if (opcode > IPC_OPCODE_ESP_HANDLE_BASE)
-                    dest = CORE_LINK_SIDE_ESP;
-                else if (opcode > IPC_OPCODE_STM_HANDLE_BASE)
-                    dest = CORE_LINK_SIDE_STM;
-                else
-                {
-                    // WTF?
-                    LOGE("Unknown opcode group %d!", opcode);
-                    return false;
-                }
-
-                // Передача
-                if (transmit_to(packet, args, dest))
-                    result = false;
-            }
-            break;
+        pending.remove(0);
+        return;
+    }
+
+    // Запрос доставлен, выдаём токен (повторный запрос стороны сохраняет её очередь)
+    const auto now = os_tick_get();
+    for (auto i = 0; i < pending.count; i++)
+        if (pending.side[i] == side)
+        {
+            pending.tick[i] = now;
+            return;
+        }
+    assert(pending.count < CORE_LINK_SIDE_COUNT);
+    pending.side[pending.count] = side;
+    pending.tick[pending.count++] = now;
+}
 
-        case IPC_DIR_RESPONSE:
-            // Определяем кому разослать
-            for (auto i = 0; i < CORE_LINK_SIDE_COUNT; i++)
+RAM_GCC
+void core_processor_out_t::side_t::route_drop(void) const
+{
+    for (auto s = 0; s < CORE_LINK_SIDE_COUNT; s++)
+    {
+        if (!core_route_drop_request[s])
+            continue;
+        core_route_drop_request[s] = false;
+        // Снимаем токены запросов стороны и токены запросов, ответ на которые она уже не даст
+        for (auto opcode = 0; opcode < IPC_OPCODE_LIMIT; opcode++)
+        {
+            auto &pending = core_route_pending[opcode];
+            if (CORE_ROUTE_REQUEST[opcode] == s)
             {
-                // Пропускаем того кто отвечает
-            	const auto dest = (core_link_side_t)i;
-                if (dest == side)
-                    continue;
-
-                // Нужно ли обрабатывать запрос
-                if (!core_route_map[opcode][dest])
-                    continue;
-
-                // Передача
-                if (transmit_to(packet, args, dest))
-                    result = false;
+                pending.count = 0;
+                continue;
             }
-            break;
+            for (uint8_t i = 0; i < pending.count;)
+                if (pending.side[i] == s)
+                    pending.remove(i);
+                else
+                    i++;
+        }
+        CORE_ROUTE_LOG(ESP_LOG_WARN, LOGW, "%s - pending tokens dropped", CORE_LINK_SIDE[s].name);
+    }
+}
+
+RAM_GCC
+bool core_processor_out_t::side_t::packet_process(const ipc_packet_t &packet, const args_t &args)
+{
+    // Результат выполнения
+    auto result = true;
 
-        default:
-            assert(false);
-            return false;
+    // Начало ввода
+    if (args.first)
+    {
+        core_main_task.mutex.enter();
+        // Сброс токенов отключившихся сторон
+        route_drop();
+        // Определяем кому передать сообщение
+        route = route_begin(packet);
+        if (route == CORE_LINK_SIDE_COUNT)
+            CORE_ROUTE_LOG(ESP_LOG_WARN, LOGW, "%s - no route for %s %d!", CORE_LINK_SIDE[side].name,
+                packet.dll.dir != IPC_DIR_RESPONSE ? "request" : "response", packet.dll.opcode);
     }
 
+    // Передача
+    if (route == CORE_LINK_SIDE_COUNT)
+        // Сообщение без маршрута отбрасывается
+        result = packet.dll.dir == IPC_DIR_RESPONSE;
+    else if (transmit_to(packet, args, route))
+        result = false;
+    else if (!packet.dll.more)
+        route_end(packet);
+
     // Завершение ввода
     if (!(packet.dll.more && result))
     {
@@ -175,21 +310,26 @@ extern "C" void app_main(void)
     // Старт софтовых таймеров
     ESP_ERROR_CHECK(esp_timer_init());
 
+    // Запуск вывода лога
+    log_init();
+
     // Приветствие
     LOGI("=== NixieClock communication backend ===");
     LOGI("IDF version: %s", esp_get_idf_version());
 
     // Вывод информации о памяти
     LOGH();
-    // Отчистка карты маршрутизации
-    memory_clear(core_route_map, sizeof(core_route_map));
+    // Отчистка токенов ожидающих ответа сторон
+    memory_clear(core_route_pending, sizeof(core_route_pending));
 
     // Инициализация модулей
     io_init();
     fs_init();
+    ota_init();
     wifi_init();
     ntime_init();
     httpd_init();
+    metrics_init();
 
     // Инициализация связи с STM
     stm_init();
@@ -213,3 +353,10 @@ void core_handler_add(ipc_handler_t &handler)
 {
     esp_processor_in.handler_add(handler);
 }
+
+void core_route_drop(core_link_side_t side)
+{
+    assert(side < CORE_LINK_SIDE_COUNT);
+    // Обработка при следующем сообщении, под мьютексом ядра
+    core_route_drop_request[side] = true;
+}
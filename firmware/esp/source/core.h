@@ -24,9 +24,17 @@ class core_processor_out_t
     {
         // Обрабатывающая сторона
         const core_link_side_t side;
+        // Сторона назначения текущего сообщения
+        core_link_side_t route = CORE_LINK_SIDE_COUNT;
 
         // Передача другой стороне
         bool transmit_to(const ipc_packet_t &packet, const args_t &args, core_link_side_t dest);
+        // Определение стороны назначения в начале сообщения
+        core_link_side_t route_begin(const ipc_packet_t &packet) const;
+        // Фиксация маршрута в конце сообщения
+        void route_end(const ipc_packet_t &packet) const;
+        // Сброс токенов отключившихся сторон
+        void route_drop(void) const;
     public:
         // Конструктор по умолчанию
         side_t(core_link_side_t _side) : side(_side)
@@ -49,5 +57,7 @@ extern core_processor_out_t core_processor_out;
 
 // Добавление обработчика команды в хост
 void core_handler_add(ipc_handler_t &handler);
+// Сброс ожидающих ответа токенов стороны (обрыв связи)
+void core_route_drop(core_link_side_t side);
 
 #endif // __CORE_H
@@ -2,60 +2,224 @@
 #include "os.h"
 #include "log.h"
 #include "tool.h"
-#include <esp_partition.h>
+#include <sha1.h>
 
 // Имя модуля для логирования
 LOG_TAG_DECL("FS");
 
-// Указатель на системный раздел в котором хранится ФС
-static const esp_partition_t *fs_partition;
+// Количество разделов с образами ФС (A/B)
+#define FS_PARTITION_COUNT      2
+// Признак записи о завершенном образе
+#define FS_COMMIT_MAGIC         0x53464D52
+// Размер блока чтения при проверке образа
+#define FS_VERIFY_BLOCK_SIZE    256
 
-// Реализация читальщика файловой системы
-static class fs_impl_t : public romfs_t::reader_t
+/* Запись о завершенном образе. Пишется в последний сектор раздела
+ * только после проверки образа, поэтому обрыв записи оставляет
+ * раздел без записи, и при старте выбирается прежний образ */
+struct fs_commit_t
 {
-    os_mutex_t fs_sync;
+    // Признак начала записи
+    uint32_t magic;
+    // Номер поколения образа (больший - новее)
+    uint32_t generation;
+    // Размер образа
+    uint32_t size;
+    // Хэш образа
+    uint8_t hash[SHA1_HASH_SIZE];
+    // Признак конца записи (инверсия признака начала)
+    uint32_t magic_end;
+};
+
+// Реализация читальщика файловой системы (по одному на раздел)
+class fs_impl_t : public romfs_t::reader_t
+{
+    // Синхронизация доступа к Flash
+    static os_mutex_t fs_sync;
 protected:
     // Низкоуровневое чтение по указанному смещению
     virtual bool read(void *dest, size_t size, size_t offset) override final
     {
-        if (fs_partition == NULL)
+        if (partition == NULL)
             return false;
         fs_sync.enter();
-            auto result = esp_partition_read(fs_partition, offset, dest, size) == ESP_OK;
+            auto result = esp_partition_read(partition, offset, dest, size) == ESP_OK;
         fs_sync.leave();
         return result;
     }
-} fs_impl;
+public:
+    // Раздел, в котором хранится ФС
+    const esp_partition_t *partition = NULL;
+    // Поколение образа (0 - образ без записи о завершении)
+    uint32_t generation = 0;
+
+    // Получает смещение записи о завершенном образе
+    size_t commit_offset(void) const
+    {
+        return partition->size - SPI_FLASH_SEC_SIZE;
+    }
+
+    // Чтение записи о завершенном образе
+    bool commit_read(fs_commit_t &commit)
+    {
+        return read(&commit, sizeof(commit), commit_offset()) &&
+            commit.magic == FS_COMMIT_MAGIC &&
+            commit.magic_end == ~FS_COMMIT_MAGIC &&
+            commit.size <= commit_offset();
+    }
+};
+
+os_mutex_t fs_impl_t::fs_sync;
+
+// Читальщики разделов
+static fs_impl_t fs_impl[FS_PARTITION_COUNT];
+// Используемый для чтения файлов читальщик
+static fs_impl_t * volatile fs_active = NULL;
+// Раздел, подготовленный к записи нового образа
+static fs_impl_t *fs_spare = NULL;
+
+// Вывод информации о разделе
+static void fs_partition_log(const char *prefix, const fs_impl_t &impl)
+{
+    tool_bts_buffer_t bts;
+    UNUSED(bts);
+    tool_byte_to_string(impl.partition->size, bts);
+    LOGI("%s partition %s, offset 0x%08x, size %s, generation %d", prefix, impl.partition->label, impl.partition->address, bts, impl.generation);
+}
 
 void fs_init(void)
 {
-    fs_partition = NULL;
-    // Поиск раздела по типу
+    fs_active = NULL;
+    // Поиск разделов по типу (первый - раздел образа без записи о завершении)
     auto prt_iterator = esp_partition_find((esp_partition_type_t)0x40, (esp_partition_subtype_t)0x00, NULL);
-    if (prt_iterator == NULL)
+    for (auto i = 0; i < FS_PARTITION_COUNT && prt_iterator != NULL; i++, prt_iterator = esp_partition_next(prt_iterator))
+    {
+        auto &impl = fs_impl[i];
+        // Получение указателя на раздел
+        impl.partition = esp_partition_get(prt_iterator);
+        assert(impl.partition != NULL);
+        // Выбор завершенного образа с наибольшим поколением
+        fs_commit_t commit;
+        impl.generation = impl.commit_read(commit) ? commit.generation : 0;
+        if (fs_active == NULL || impl.generation > fs_active->generation)
+            fs_active = &impl;
+    }
+    if (prt_iterator != NULL)
+        esp_partition_iterator_release(prt_iterator);
+    if (fs_active == NULL)
     {
         LOGE("Unable to find partition!");
         return;
     }
-    // Получение указателя на раздел
-    fs_partition = esp_partition_get(prt_iterator);
-    assert(fs_partition != NULL);
     // Вывод информации о разделе
-    tool_bts_buffer_t bts;
-    UNUSED(bts);
-    tool_byte_to_string(fs_partition->size, bts);
-    LOGI("Found partition %s, offset 0x%08x, size %s", fs_partition->label, fs_partition->address, bts);
+    fs_partition_log("Found", *fs_active);
 }
 
 fs_file_t fs_open(const char *path)
 {
     // Проверка аргументов
     assert(path != NULL);
-    // Пробуем открыть
-    auto result = fs_impl.open(path);
+    // Пробуем открыть (дескриптор остается привязан к разделу)
+    auto impl = fs_active;
+    auto result = impl != NULL ? impl->open(path) : fs_file_t();
     // Лог
     if (!result.opened())
         LOGW("Open file \"%s\" failed!", path);
     // Результат
     return result;
 }
+
+// Поиск свободного раздела - не используемого для чтения
+static fs_impl_t * fs_spare_find(void)
+{
+    fs_impl_t *result = NULL;
+    if (fs_active == NULL)
+        return result;
+    for (auto i = 0; i < FS_PARTITION_COUNT; i++)
+        if (&fs_impl[i] != fs_active && fs_impl[i].partition != NULL)
+            result = &fs_impl[i];
+    return result;
+}
+
+size_t fs_update_size_max(void)
+{
+    auto spare = fs_spare_find();
+    return spare != NULL ? spare->commit_offset() : 0;
+}
+
+bool fs_update_busy(void)
+{
+    // Файлы, открытые до переключения, дочитываются из прежнего раздела
+    auto spare = fs_spare_find();
+    return spare != NULL && spare->busy();
+}
+
+const esp_partition_t * fs_update_begin(size_t size)
+{
+    fs_spare = NULL;
+    auto spare = fs_spare_find();
+    if (spare == NULL)
+    {
+        LOGE("Spare partition not found!");
+        return NULL;
+    }
+    // Проверки до стирания, что бы отказ не затронул прежний образ
+    if (size > spare->commit_offset())
+        return NULL;
+    if (spare->busy())
+    {
+        LOGW("Spare partition %s has open files!", spare->partition->label);
+        return NULL;
+    }
+    // Снятие записи о завершении до начала записи образа
+    if (esp_partition_erase_range(spare->partition, spare->commit_offset(), SPI_FLASH_SEC_SIZE) != ESP_OK)
+        return NULL;
+    spare->generation = 0;
+    fs_spare = spare;
+    return spare->partition;
+}
+
+bool fs_update_commit(size_t size, const uint8_t *hash)
+{
+    assert(hash != NULL);
+    auto impl = fs_spare;
+    fs_spare = NULL;
+    if (impl == NULL || size > impl->commit_offset())
+        return false;
+    // Проверка записанного образа по хэшу потока
+    static sha1_t sha1;
+    static uint8_t buffer[FS_VERIFY_BLOCK_SIZE];
+    sha1.reset();
+    for (size_t offset = 0; offset < size; offset += FS_VERIFY_BLOCK_SIZE)
+    {
+        auto block = minimum<size_t>(FS_VERIFY_BLOCK_SIZE, size - offset);
+        if (esp_partition_read(impl->partition, offset, buffer, block) != ESP_OK)
+            return false;
+        sha1.update((const char *)buffer, block);
+    }
+    if (memcmp(sha1.final(), hash, SHA1_HASH_SIZE))
+    {
+        LOGE("Image hash mismatch!");
+        return false;
+    }
+    // Проверка структуры образа
+    if (!impl->verify(size))
+    {
+        LOGE("Image structure is broken!");
+        return false;
+    }
+    // Запись о завершении
+    fs_commit_t commit;
+    commit.magic = FS_COMMIT_MAGIC;
+    commit.generation = fs_active->generation + 1;
+    commit.size = size;
+    memcpy(commit.hash, hash, SHA1_HASH_SIZE);
+    commit.magic_end = ~FS_COMMIT_MAGIC;
+    if (esp_partition_write(impl->partition, impl->commit_offset(), &commit, sizeof(commit)) != ESP_OK)
+        return false;
+    // Переключение чтения, открытые файлы дочитываются из прежнего раздела
+    impl->generation = commit.generation;
+    fs_active = impl;
+    fs_partition_log("Switched to", *impl);
+    return true;
+}
@@ -2,6 +2,7 @@
 #define __FS_H
 
 #include <romfs.h>
+#include <esp_partition.h>
 
 // Дескрипатор файла
 typedef romfs_t::reader_t::handle_t fs_file_t;
@@ -11,4 +12,13 @@ void fs_init(void);
 // Открытие файла
 fs_file_t fs_open(const char *path);
 
+// Получает предельный размер нового образа ФС (0 - свободного раздела нет)
+size_t fs_update_size_max(void);
+// Получает, открыты ли еще файлы свободного раздела
+bool fs_update_busy(void);
+// Подготовка свободного раздела к записи нового образа ФС указанного размера
+const esp_partition_t * fs_update_begin(size_t size);
+// Проверка записанного образа ФС по хэшу и переключение на него
+bool fs_update_commit(size_t size, const uint8_t *hash);
+
 #endif // __FS_H
@@ -1,9 +1,281 @@
-﻿#include "log.h"
+﻿#include "os.h"
+#include "log.h"
 #include "tool.h"
 
+// Количество записей кольцевого буфера
+#define LOG_RING_SIZE       32
+// Количество записей, резервируемых под ошибки и предупреждения
+#define LOG_RING_RESERVE    (LOG_RING_SIZE / 4)
+// Размер текста записи (тэг и сообщение)
+#define LOG_TEXT_SIZE       96
+// Размер строки вывода (уровень, отметка времени, текст и перевод строки)
+#define LOG_LINE_SIZE       (LOG_TEXT_SIZE + 20)
+// Количество тэгов с индивидуальным уровнем
+#define LOG_TAG_COUNT       8
+// Предельный размер имени тэга
+#define LOG_TAG_SIZE        16
+// Размер буфера трансляции подписчику
+#define LOG_STREAM_SIZE     1024
+// Предельный размер текстовой команды
+#define LOG_COMMAND_SIZE    32
+
+// Запись кольцевого буфера
+struct log_record_t
+{
+    // Отметка времени в мС
+    uint32_t timestamp;
+    // Уровень
+    esp_log_level_t level;
+    // Длинна текста
+    uint8_t length;
+    // Флаг готовности текста
+    volatile bool ready;
+    // Текст в виде "тэг: сообщение"
+    char text[LOG_TEXT_SIZE];
+};
+
+// Кольцевой буфер сообщений
+static struct
+{
+    // Записи
+    log_record_t records[LOG_RING_SIZE];
+    // Счётчики записанных и выведенных записей
+    uint32_t head, tail;
+    // Количество отброшенных сообщений
+    uint32_t dropped;
+    // Мьютекс синхронизации
+    os_mutex_t mutex;
+    // Событие появления записей
+    os_event_auto_t event;
+} log_ring;
+
+// Уровни логирования
+static struct
+{
+    // Индивидуальные уровни тэгов
+    struct
+    {
+        // Имя тэга (пустое - не занят)
+        char name[LOG_TAG_SIZE];
+        // Уровень
+        esp_log_level_t level;
+    } tags[LOG_TAG_COUNT];
+    // Уровень по умолчанию
+    esp_log_level_t level = (esp_log_level_t)LOG_LOCAL_LEVEL;
+} log_levels;
+
+// Трансляция подписчику
+static struct
+{
+    // Буфер строк
+    char buffer[LOG_STREAM_SIZE];
+    // Счётчики записанных и извлеченных байт
+    uint32_t head, tail;
+    // Включена ли трансляция
+    bool enabled;
+} log_stream;
+
+// Символы уровней
+static const char LOG_LEVEL_CHARS[] = "NEWIDV";
+
+// Получает уровень для тэга (вызывается под мьютексом)
+static esp_log_level_t log_level_get(const char *tag)
+{
+    for (auto i = 0; i < LOG_TAG_COUNT && log_levels.tags[i].name[0] != '\0'; i++)
+        if (strcmp(log_levels.tags[i].name, tag) == 0)
+            return log_levels.tags[i].level;
+    return log_levels.level;
+}
+
+bool log_level_set(const char *tag, esp_log_level_t level)
+{
+    assert(level <= ESP_LOG_VERBOSE);
+    // Уровень по умолчанию
+    if (tag == NULL)
+    {
+        log_levels.level = level;
+        return true;
+    }
+    if (strlen(tag) >= LOG_TAG_SIZE)
+        return false;
+    auto result = false;
+    log_ring.mutex.enter();
+        for (auto i = 0; i < LOG_TAG_COUNT; i++)
+        {
+            auto &entry = log_levels.tags[i];
+            if (entry.name[0] != '\0' && strcmp(entry.name, tag) != 0)
+                continue;
+            // Уровень до имени, чтобы не получить не инициализированный уровень
+            entry.level = level;
+            strcpy(entry.name, tag);
+            result = true;
+            break;
+        }
+    log_ring.mutex.leave();
+    return result;
+}
+
+RAM_GCC
+void log_write_va(const char *tag, esp_log_level_t level, const char *format, va_list args)
+{
+    assert(tag != NULL && format != NULL);
+    log_record_t *record = NULL;
+    // Резервирование записи
+    log_ring.mutex.enter();
+        if (level <= log_level_get(tag))
+        {
+            // Последние записи отдаются только под ошибки и предупреждения
+            const uint32_t limit = level <= ESP_LOG_WARN ? LOG_RING_SIZE : LOG_RING_SIZE - LOG_RING_RESERVE;
+            if (log_ring.head - log_ring.tail < limit)
+            {
+                record = log_ring.records + log_ring.head++ % LOG_RING_SIZE;
+                record->ready = false;
+            }
+            else
+                log_ring.dropped++;
+        }
+    log_ring.mutex.leave();
+    if (record == NULL)
+        return;
+    // Форматирование вне мьютекса
+    auto length = snprintf(record->text, LOG_TEXT_SIZE, "%s: ", tag);
+    if (length < LOG_TEXT_SIZE)
+        length += vsnprintf(record->text + length, LOG_TEXT_SIZE - length, format, args);
+    record->length = (uint8_t)minimum(length, LOG_TEXT_SIZE - 1);
+    record->timestamp = esp_log_timestamp();
+    record->level = level;
+    record->ready = true;
+    // Оповещение задачи вывода
+    log_ring.event.set();
+}
+
+void log_write(const char *tag, esp_log_level_t level, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+        log_write_va(tag, level, format, args);
+    va_end(args);
+}
+
+void log_stream_enable(bool enable)
+{
+    log_ring.mutex.enter();
+        log_stream.enabled = enable;
+        log_stream.head = log_stream.tail = 0;
+    log_ring.mutex.leave();
+}
+
+// Добавление строки в трансляцию (строка не помещается - отбрасывается)
+static void log_stream_write(const char *line, size_t size)
+{
+    log_ring.mutex.enter();
+        if (log_stream.enabled && LOG_STREAM_SIZE - (log_stream.head - log_stream.tail) >= size)
+            for (size_t i = 0; i < size; i++)
+                log_stream.buffer[log_stream.head++ % LOG_STREAM_SIZE] = line[i];
+    log_ring.mutex.leave();
+}
+
+size_t log_stream_read(char *dest, size_t size)
+{
+    assert(dest != NULL);
+    size_t result = 0;
+    log_ring.mutex.enter();
+        // Копирование с запоминанием конца последней целой строки
+        size = minimum<size_t>(size, log_stream.head - log_stream.tail);
+        for (size_t i = 0; i < size; i++)
+            if ((dest[i] = log_stream.buffer[(log_stream.tail + i) % LOG_STREAM_SIZE]) == '\n')
+                result = i + 1;
+        log_stream.tail += result;
+    log_ring.mutex.leave();
+    return result;
+}
+
+bool log_command(const char *text, size_t size)
+{
+    assert(text != NULL);
+    char command[LOG_COMMAND_SIZE], tag[LOG_TAG_SIZE], level;
+    if (size >= sizeof(command))
+        return false;
+    memcpy(command, text, size);
+    command[size] = '\0';
+    // Управление трансляцией
+    if (strcmp(command, "stream on") == 0 || strcmp(command, "stream off") == 0)
+    {
+        log_stream_enable(command[8] == 'n');
+        return true;
+    }
+    // Уровень тэга: "level <тэг|*> <N|E|W|I|D|V>"
+    if (sscanf(command, "level %15s %c", tag, &level) != 2)
+        return false;
+    auto found = strchr(LOG_LEVEL_CHARS, level);
+    if (found == NULL || level == '\0')
+        return false;
+    return log_level_set(strcmp(tag, "*") != 0 ? tag : NULL, (esp_log_level_t)(found - LOG_LEVEL_CHARS));
+}
+
+// Задача вывода лога
+static class log_task_t : public os_task_base_t
+{
+    // Буфер строки вывода
+    char line[LOG_LINE_SIZE];
+
+    // Вывод строки в консоль и трансляцию
+    void output(esp_log_level_t level, uint32_t timestamp, const char *text, size_t length)
+    {
+        auto size = snprintf(line, sizeof(line), "%c (%u) %.*s\n", LOG_LEVEL_CHARS[level], timestamp, (int)length, text);
+        size = minimum<int>(size, sizeof(line) - 1);
+        fwrite(line, 1, size, stdout);
+        log_stream_write(line, size);
+    }
+protected:
+    // Обработчик задачи
+    virtual void execute(void) override final
+    {
+        // Вывод не должен мешать остальным задачам
+        priority_set(OS_TASK_PRIORITY_IDLE);
+        for (;;)
+        {
+            // Период на случай записи, не готовой к моменту события
+            log_ring.event.wait(OS_MS_TO_TICKS(100));
+            // Вывод готовых записей по порядку (слот не перезаписывается до сдвига хвоста)
+            for (;;)
+            {
+                auto &record = log_ring.records[log_ring.tail % LOG_RING_SIZE];
+                if (log_ring.tail == log_ring.head || !record.ready)
+                    break;
+                output(record.level, record.timestamp, record.text, record.length);
+                log_ring.mutex.enter();
+                    log_ring.tail++;
+                log_ring.mutex.leave();
+            }
+            // Отчёт об отброшенных сообщениях
+            log_ring.mutex.enter();
+                auto dropped = log_ring.dropped;
+                log_ring.dropped = 0;
+            log_ring.mutex.leave();
+            if (dropped > 0)
+            {
+                char text[32];
+                auto length = snprintf(text, sizeof(text), "LOG: %u dropped", dropped);
+                output(ESP_LOG_WARN, esp_log_timestamp(), text, length);
+            }
+        }
+    }
+public:
+    // Конструктор по умолчанию
+    log_task_t(void) : os_task_base_t("log", true)
+    { }
+} log_task;
+
 void log_heap(const char *module)
 {
     tool_bts_buffer_t buf;
     tool_byte_to_string(esp_get_free_heap_size(), buf);
-    ESP_LOGI(module, "Free heap size %s", buf);
+    log_write(module, ESP_LOG_INFO, "Free heap size %s", buf);
+}
+
+void log_init(void)
+{
+    // Запуск задачи вывода
+    log_task.start();
 }
@@ -7,15 +7,36 @@
 #define LOG_TAG             __module_tag
 // Декларирование тэга
 #define LOG_TAG_DECL(v)     static const char LOG_TAG[] = (v)
+// Запись в лог (уровни подробнее LOG_LOCAL_LEVEL отсекаются при сборке)
+#define LOG_WRITE(level, format, ...) \
+    do { if (LOG_LOCAL_LEVEL >= (level)) log_write(LOG_TAG, (level), format, ##__VA_ARGS__); } while (false)
 // Логирование
-#define LOGE(format, ...)   ESP_LOGE(LOG_TAG, format, ##__VA_ARGS__)
-#define LOGW(format, ...)   ESP_LOGW(LOG_TAG, format, ##__VA_ARGS__)
-#define LOGI(format, ...)   ESP_LOGI(LOG_TAG, format, ##__VA_ARGS__)
-#define LOGD(format, ...)   ESP_LOGD(LOG_TAG, format, ##__VA_ARGS__)
-#define LOGV(format, ...)   ESP_LOGV(LOG_TAG, format, ##__VA_ARGS__)
+#define LOGE(format, ...)   LOG_WRITE(ESP_LOG_ERROR, format, ##__VA_ARGS__)
+#define LOGW(format, ...)   LOG_WRITE(ESP_LOG_WARN, format, ##__VA_ARGS__)
+#define LOGI(format, ...)   LOG_WRITE(ESP_LOG_INFO, format, ##__VA_ARGS__)
+#define LOGD(format, ...)   LOG_WRITE(ESP_LOG_DEBUG, format, ##__VA_ARGS__)
+#define LOGV(format, ...)   LOG_WRITE(ESP_LOG_VERBOSE, format, ##__VA_ARGS__)
 #define LOGH()              log_heap(LOG_TAG);
 
+// Запись сообщения в кольцевой буфер (вывод выполняет фоновая задача)
+void log_write(const char *tag, esp_log_level_t level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+void log_write_va(const char *tag, esp_log_level_t level, const char *format, va_list args);
+
+// Установка уровня для тэга (NULL - уровень по умолчанию)
+bool log_level_set(const char *tag, esp_log_level_t level);
+
+// Обработка текстовой команды управления логом, результат - распознана ли команда
+bool log_command(const char *text, size_t size);
+
+// Включение трансляции лога подписчику
+void log_stream_enable(bool enable);
+// Извлечение целых строк трансляции, результат - размер данных
+size_t log_stream_read(char *dest, size_t size);
+
 // Вывод количества памяти
 void log_heap(const char *module);
 
+// Инициализация модуля
+void log_init(void);
+
 #endif // __LOG_H
@@ -2,11 +2,21 @@
 #include "log.h"
 #include "stm.h"
 #include "core.h"
+#include <proto/update.inc.h>
 
 // Номера модуля SPI
 #define STM_SPI             0
 #define STM_HSPI            1
 
+// Количество регистров буфера SPI на один пакет
+#define STM_PKT_REG_COUNT   (IPC_PKT_SIZE / SYSTEM_REG_SIZE)
+// Количество пакетов в большом кадре (весь аппаратный буфер)
+#define STM_FRAME_PKT_COUNT 2
+// Таймаут ответа программатора STM32 при обновлении (мС)
+#define STM_UPDATE_TIMEOUT_MS       3000
+// Таймаут подтверждения подготовки приложением STM32 (мС), затем туннель запускается без него
+#define STM_UPDATE_ARM_TIMEOUT_MS   1500
+
 // Имя модуля для логирования
 LOG_TAG_DECL("STM");
 
@@ -22,32 +32,152 @@ public:
     { }
 } stm_task;
 
+// Обработчик команды подготовки STM32 к обновлению
+static class stm_command_handler_update_arm_t : public ipc_requester_template_t<update_command_arm_t>
+{
+    // Параметры образа к передаче
+    update_begin_t begin;
+    // Признак запроса к передаче (выставляется из другой задачи)
+    volatile bool request = false;
+protected:
+    // Обработка данных
+    virtual void work(bool idle) override final
+    {
+        if (!idle)
+        {
+            // Приложение STM32 ждёт запуска программатора
+            confirmed = true;
+            return;
+        }
+        if (!request)
+            return;
+        request = false;
+        command.request = begin;
+        transmit();
+    }
+public:
+    // Признак подтверждения подготовки
+    volatile bool confirmed = false;
+
+    // Запрос подготовки под образ
+    void arm(const update_begin_t &value)
+    {
+        begin = value;
+        confirmed = false;
+        request = true;
+    }
+
+    // Конструктор по умолчанию
+    stm_command_handler_update_arm_t(void) : ipc_requester_template_t(1000)
+    {
+        // Запрос выставляется из другой задачи, проверка в простое
+        idle_pooling = true;
+    }
+} stm_command_handler_update_arm;
+
 // Связь с STM
-static class stm_link_t : public ipc_link_t
+static class stm_link_t : public ipc_link_template_t<>
 {
     // Буфер для пакетов приёма/передачи
-    union
+    union buffer_t
     {
-        // Пакеты приёма/передачи
-        struct
-        {
-            ipc_packet_t rx, tx;
-        };
+        // Пакеты кадра
+        ipc_packet_t packet[STM_FRAME_PKT_COUNT];
         // Для FIFO
-        uint32_t raw[IPC_PKT_SIZE  / sizeof(uint32_t) * 2];
-    } buffer;
+        uint32_t raw[STM_PKT_REG_COUNT * STM_FRAME_PKT_COUNT];
+    } frame_rx, frame_tx;
     // Событие готовности данных
     os_event_auto_t event_data_ready;
+    // Используемый режим кадра (большой ли)
+    bool frame_large = false;
+    // Режим кадра, под который настроен модуль
+    bool frame_large_hw = false;
+
+    // Состояние обновления STM32 (туннель мимо канального уровня)
+    struct
+    {
+        // Источник образа (NULL - туннель не запущен)
+        stm_update_source_t * volatile source;
+        // Источник образа, ожидающий подготовки приложения STM32 (NULL - нет)
+        stm_update_source_t * volatile arming;
+        // Пакеты туннеля
+        update_tunnel_t tunnel;
+        // Время последнего ответа программатора
+        os_tick_t tick;
+    } update;
+
+    // Настройка модуля под текущий режим кадра
+    void frame_setup(void);
+    // Запись пакетов кадра в регистры
+    void frame_write(void);
+    // Запуск туннеля по подготовке приложения STM32
+    void update_arm_check(void);
+    // Транзакция в режиме обновления
+    void update_transaction(void);
+    // Завершение обновления
+    void update_stop(void);
+    // Получает количество пакетов в кадре
+    uint8_t frame_packet_count(void) const
+    {
+        return frame_large ? STM_FRAME_PKT_COUNT : 1;
+    }
 protected:
     // Полный сброс прикладного уровня
     virtual void reset_layer(reset_reason_t reason, bool internal = true)
     {
+        // После сброса кадр обычный, пока STM не включит большой
+        frame_large = false;
         // Базовый метод
         ipc_link_t::reset_layer(reason, internal);
+        // Запросы в обе стороны потеряны, их токены больше не нужны
+        core_route_drop(CORE_LINK_SIDE_STM);
         // Вывод в лог
         LOGW("Layer reset, reason %d, internal %d", reason, internal);
     }
+
+    // Обработка опций, полученных от STM
+    virtual void options_receive(ipc_link_option_t remote) override final
+    {
+        // Режим кадра выбирает STM как ведущий
+        frame_large = (remote & IPC_LINK_OPTION_FRAME_LARGE) != 0;
+    }
+
+    // Обработка смены версии протокола STM
+    virtual void version_receive(uint8_t remote) override final
+    {
+        // Запросы к несовместимой стороне не будут обслужены
+        core_route_drop(CORE_LINK_SIDE_STM);
+        // Вывод в лог
+        if (compatible())
+            LOGI("Protocol version %d", remote);
+        else
+            LOGW("Protocol version %d, expected %d, only update allowed!", remote, IPC_PROTOCOL_VERSION);
+    }
 public:
+    // Конструктор по умолчанию
+    stm_link_t(void)
+    {
+        // Поддерживаем большой кадр
+        options |= IPC_LINK_OPTION_FRAME_LARGE;
+        // Обновление не идет
+        update.source = update.arming = NULL;
+    }
+
+    // Запуск обновления STM32
+    bool update_start(stm_update_source_t &source, uint32_t size, uint32_t crc);
+
+    // Получает, идет ли обновление STM32
+    bool update_active(void) const
+    {
+        return update.source != NULL || update.arming != NULL;
+    }
+
+    // Получает, используется ли большой кадр (вызывается из прерывания)
+    bool frame_large_get(void) const
+    {
+        return frame_large_hw;
+    }
+
     // Событие простоя линии связи
     os_event_auto_t event_spi_idle;
 
@@ -76,20 +206,164 @@ bool stm_link_t::packet_process(const ipc_packet_t &packet, const args_t &args)
     return result;
 }
 
+RAM_GCC
+void stm_link_t::frame_setup(void)
+{
+    if (frame_large_hw == frame_large)
+        return;
+    frame_large_hw = frame_large;
+
+    // Размер кадра в байтах
+    const uint32_t size = IPC_PKT_SIZE * frame_packet_count();
+    // USER (MISO on FIFO bottom только в обычном режиме)
+    if (frame_large_hw)
+        CLEAR_PERI_REG_MASK(SPI_USER(STM_HSPI), SPI_USR_MISO_HIGHPART);
+    else
+        SET_PERI_REG_MASK(SPI_USER(STM_HSPI), SPI_USR_MISO_HIGHPART);
+    // SLAVE1 (slave buffer size)
+    WRITE_PERI_REG(SPI_SLAVE1(STM_HSPI), ((size * 8 - 1) << SPI_SLV_BUF_BITLEN_S));
+    // Лог
+    LOGI("Frame size %d bytes", size);
+}
+
+RAM_GCC
+void stm_link_t::frame_write(void)
+{
+    /* Запись в регистры. В обычном режиме пакет дублируется в обе половины
+     * буфера, что бы STM в большом кадре (при рассогласовании режимов)
+     * получила корректный пакет, а не остатки приёма */
+    taskENTER_CRITICAL();
+        if (frame_large_hw)
+            for (auto i = 0; i < STM_PKT_REG_COUNT * STM_FRAME_PKT_COUNT; i++)
+                WRITE_PERI_REG(SPI_W0(STM_HSPI) + i * SYSTEM_REG_SIZE, frame_tx.raw[i]);
+        else
+            for (auto i = 0; i < STM_PKT_REG_COUNT * STM_FRAME_PKT_COUNT; i++)
+                WRITE_PERI_REG(SPI_W0(STM_HSPI) + i * SYSTEM_REG_SIZE, frame_tx.raw[i % STM_PKT_REG_COUNT]);
+    taskEXIT_CRITICAL();
+}
+
+bool stm_link_t::update_start(stm_update_source_t &source, uint32_t size, uint32_t crc)
+{
+    stm_task.mutex.enter();
+        auto result = !update_active();
+        if (result)
+        {
+            update_begin_t begin;
+            begin.magic = UPDATE_MAGIC;
+            begin.size = size;
+            begin.crc = crc;
+            update.tunnel.start(begin);
+            update.tick = os_tick_get();
+            // Сначала приложение STM32 подтверждает запуск по каналу связи
+            stm_command_handler_update_arm.arm(begin);
+            update.arming = &source;
+        }
+    stm_task.mutex.leave();
+    if (result)
+        LOGI("Update arming, %d bytes", size);
+    return result;
+}
+
+void stm_link_t::update_arm_check(void)
+{
+    // Без подтверждения туннель запускается по таймауту (программатор может ждать сам)
+    const auto confirmed = stm_command_handler_update_arm.confirmed;
+    const auto now = os_tick_get();
+    if (!confirmed && now - update.tick < OS_MS_TO_TICKS(STM_UPDATE_ARM_TIMEOUT_MS))
+        return;
+    if (confirmed)
+        LOGI("Update armed, starting programmer");
+    else
+        LOGW("Update not armed, trying programmer anyway");
+    stm_task.mutex.enter();
+        update.tunnel.start(update.tunnel.begin);
+        update.tick = now;
+        // Источник - признак запуска туннеля для задачи
+        update.source = update.arming;
+        update.arming = NULL;
+    stm_task.mutex.leave();
+}
+
+void stm_link_t::update_stop(void)
+{
+    stm_task.mutex.enter();
+        update.source = NULL;
+    stm_task.mutex.leave();
+}
+
+RAM_GCC
+void stm_link_t::update_transaction(void)
+{
+    // Программатор STM32 работает только обычным кадром
+    frame_large = false;
+    frame_setup();
+
+    // Подготовка исходящего пакета: запуск программатора или запрошенный блок образа
+    if (!update.tunnel.output(frame_tx.packet[0], *update.source))
+    {
+        // Повторные запросы блока продлевали бы туннель бесконечно, программатор дождется нового запуска
+        LOGE("Update source read failed at %d", update.tunnel.offset);
+        update_stop();
+        reset_layer(RESET_REASON_CORRUPTION);
+        return;
+    }
+    frame_write();
+
+    // Ожидание транзакции
+    event_data_ready.wait();
+
+    // Чтение ответа программатора
+    taskENTER_CRITICAL();
+        for (auto i = 0; i < STM_PKT_REG_COUNT; i++)
+            frame_rx.raw[i] = READ_PERI_REG(SPI_W0(STM_HSPI) + i * SYSTEM_REG_SIZE);
+    taskEXIT_CRITICAL();
+
+    auto now = os_tick_get();
+    switch (update.tunnel.input(frame_rx.packet[0]))
+    {
+        case UPDATE_REPLY_READ:
+            update.tick = now;
+            return;
+        case UPDATE_REPLY_DONE:
+            // STM32 перезапускается сама и начинает связь заново
+            LOGI("Update complete");
+            break;
+        default:
+            if (now - update.tick < OS_MS_TO_TICKS(STM_UPDATE_TIMEOUT_MS))
+                return;
+            // Программатор не отвечает (старая прошивка STM32 или обрыв)
+            LOGE("Update timeout, offset %d", update.tunnel.offset);
+            break;
+    }
+    update_stop();
+    reset_layer(RESET_REASON_CORRUPTION);
+}
+
 // Выполнение транзакции
 RAM_GCC
 void stm_link_t::transaction(void)
 {
-    // Вывод пакета
+    // Ожидание подготовки к обновлению STM32 (обмен идет по каналу связи)
+    if (update.arming != NULL)
+        update_arm_check();
+    // Режим обновления STM32
+    if (update.source != NULL)
+    {
+        update_transaction();
+        return;
+    }
+    // Режим кадра мог смениться в прошлой транзакции
+    frame_setup();
+    const auto count = frame_packet_count();
+
+    // Вывод пакетов
     stm_task.mutex.enter();
-        packet_output(buffer.tx);
+        for (auto i = 0; i < count; i++)
+            packet_output(frame_tx.packet[i]);
     stm_task.mutex.leave();
 
     // Запись в регистры
-    taskENTER_CRITICAL();
-        for (auto i = 8; i < 16; i++)
-            WRITE_PERI_REG(SPI_W0(STM_HSPI) + i * SYSTEM_REG_SIZE, buffer.raw[i]);
-    taskEXIT_CRITICAL();
+    frame_write();
 
     // Ожидание транзакции
     event_spi_idle.set();
@@ -97,19 +371,23 @@ void stm_link_t::transaction(void)
 
     // Чтение из регистров
     taskENTER_CRITICAL();
-        for (auto i = 0; i < 8; i++)
-            buffer.raw[i] = READ_PERI_REG(SPI_W0(STM_HSPI) + i * SYSTEM_REG_SIZE);
+        for (auto i = 0; i < STM_PKT_REG_COUNT * count; i++)
+            frame_rx.raw[i] = READ_PERI_REG(SPI_W0(STM_HSPI) + i * SYSTEM_REG_SIZE);
     taskEXIT_CRITICAL();
 
-    // Ввод пакета
-    stm_task.mutex.enter();
-        auto result = packet_input(buffer.rx);
-    stm_task.mutex.leave();
+    // Ввод пакетов
+    for (auto i = 0; i < count; i++)
+    {
+        const auto &packet = frame_rx.packet[i];
+        stm_task.mutex.enter();
+            auto result = packet_input(packet);
+        stm_task.mutex.leave();
 
-    // Обработка
-    if (result && !buffer.rx.dll.more)
-        // Синхронизация на приватный мьютекс не требуется
-        flush_packets(core_processor_out.stm);
+        // Обработка
+        if (result && !packet.dll.more)
+            // Синхронизация на приватный мьютекс не требуется
+            flush_packets(core_processor_out.stm);
+    }
 }
 
 // Адрес статусного регистра прерываний SPI (HSPI, I2S)
@@ -122,6 +400,7 @@ RAM_GCC
 void stm_link_t::spi_isr(void *dummy)
 {
     auto sr = READ_PERI_REG(STM_IRQ_SRC_REG);
+    auto slave = READ_PERI_REG(SPI_SLAVE(STM_HSPI));
     // SPI
     if (sr & STM_IRQ_SRC_SPI)
         // Сброс флагов, источников прерывания
@@ -134,6 +413,9 @@ void stm_link_t::spi_isr(void *dummy)
         SET_PERI_REG_MASK(SPI_SLAVE(STM_HSPI), SPI_SYNC_RESET);
         CLEAR_PERI_REG_MASK(SPI_SLAVE(STM_HSPI), SPI_TRANS_DONE);
     SET_PERI_REG_MASK(SPI_SLAVE(STM_HSPI), SPI_TRANS_DONE_EN);
+    // В большом кадре STM сначала читает буфер, затем пишет, ждем запись
+    if (stm_link.frame_large_get() && !(slave & SPI_SLV_WR_BUF_DONE))
+        return;
     // Вызов события
     stm_link.event_data_ready.set_isr();
 }
@@ -186,6 +468,8 @@ void stm_init(void)
     _xt_isr_attach(ETS_SPI_INUM, stm_link_t::spi_isr, NULL);
     _xt_isr_unmask(1 << ETS_SPI_INUM);
 
+    // Обработчики IPC
+    core_handler_add(stm_command_handler_update_arm);
     // Запуск задачи обработки пакетов
     stm_task.start();
 }
@@ -194,3 +478,20 @@ void stm_wait_idle(void)
 {
     stm_link.event_spi_idle.wait();
 }
+
+void stm_link_stat_get(ipc_link_stat_t &dest)
+{
+    stm_task.mutex.enter();
+        stm_link.stat_get(dest);
+    stm_task.mutex.leave();
+}
+
+bool stm_update_start(stm_update_source_t &source, uint32_t size, uint32_t crc)
+{
+    return stm_link.update_start(source, size, crc);
+}
+
+bool stm_update_active(void)
+{
+    return stm_link.update_active();
+}
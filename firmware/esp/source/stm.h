@@ -7,9 +7,24 @@
 // Процессор входящих пактов для STM
 extern ipc_processor_proxy_t stm_processor_in;
 
+// Источник образа для обновления STM32
+class stm_update_source_t
+{
+public:
+    // Чтение части образа по указанному смещению
+    virtual bool read(void *dest, size_t size, size_t offset) = 0;
+};
+
 // Инициализация модуля
 void stm_init(void);
 // Ожидание простоя потока связи
 void stm_wait_idle(void);
+// Получение счетчиков канала связи
+void stm_link_stat_get(ipc_link_stat_t &dest);
+
+// Запуск обновления STM32 образом указанного размера и CRC-32
+bool stm_update_start(stm_update_source_t &source, uint32_t size, uint32_t crc);
+// Получает, идет ли обновление STM32
+bool stm_update_active(void);
 
 #endif // __STM_H
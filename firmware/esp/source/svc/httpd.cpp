@@ -1,5 +1,7 @@
 #include "wifi.h"
 #include "httpd.h"
+#include "ota.h"
+#include "metrics.h"
 
 #include <os.h>
 #include <log.h>
@@ -23,6 +25,8 @@ LOG_TAG_DECL("HTTPD");
 
 //   IPC   WS  
 #define HTTPD_WS_IPC_OPCODE_SIZE    1
+//      
+#define HTTPD_WS_LOG_CHUNK_SIZE     256
 
 //   IPC
 enum httpd_ipc_state_t
@@ -60,7 +64,13 @@ protected:
             switch (httpd_ipc_data.state)
             {
                 case HTTPD_IPC_STATE_IDLE:
-                    // 
+                    // ,   ( )
+                    {
+                        char text[HTTPD_WS_LOG_CHUNK_SIZE];
+                        auto size = log_stream_read(text, sizeof(text));
+                        if (size > 0)
+                            transmit_text(text, size);
+                    }
                     break;
                 case HTTPD_IPC_STATE_ERROR:
                     // 
@@ -98,19 +108,45 @@ protected:
             socket->log("Invalid opcode: %d!", opcode);
             return;
         }
+        //   STM32 -     ESP
+        if (opcode == IPC_OPCODE_STM_UPDATE_ARM)
+        {
+            socket->log("Forbidden opcode: %d!", opcode);
+            return;
+        }
         //     IPC,    
         httpd_ipc_data.state = ipc_processor_t::data_split(core_processor_out.web, opcode, IPC_DIR_REQUEST, data + HTTPD_WS_IPC_OPCODE_SIZE, size - HTTPD_WS_IPC_OPCODE_SIZE) ?
                 HTTPD_IPC_STATE_IDLE :
                 HTTPD_IPC_STATE_ERROR;
     }
+
+    //     ( )
+    virtual void text_event(const char *text, size_t size) override final
+    {
+        if (!log_command(text, size))
+            socket->log("Unknown log command!");
+    }
+
+    //  
+    virtual void free(web_slot_free_reason_t reason) override final
+    {
+        //  
+        web_ws_handler_t::free(reason);
+        //      
+        core_route_drop(CORE_LINK_SIDE_WEB);
+    }
 public:
     //  
     virtual bool allocate(web_slot_socket_t &socket) override final
     {
         auto result = web_ws_handler_t::allocate(socket);
         if (result)
+        {
             //   
             httpd_ipc_data.state = HTTPD_IPC_STATE_IDLE;
+            //      
+            log_stream_enable(false);
+        }
         return result;
     }
 };
@@ -118,9 +154,11 @@ public:
 //   WS 
 static web_slot_handler_allocator_template_t<httpd_ws_handler_t, HTTPD_MAX_WEB_SOCKETS> httpd_ws_handlers;
 //   HTTP 
-static web_http_handler_allocator_template_t<HTTPD_MAX_HTTP_SOCKETS> httpd_web_handlers(httpd_ws_handlers);
+static web_http_handler_allocator_template_t<HTTPD_MAX_HTTP_SOCKETS> httpd_web_handlers(httpd_ws_handlers, ota_upload_get(), metrics_content_get());
 //   
 static web_slot_socket_allocator_template_t<HTTPD_MAX_ALL_SOCKETS> httpd_socket_handlers(httpd_web_handlers);
+//     (  )
+static volatile uint8_t httpd_sockets_used = 0, httpd_sockets_peak = 0;
 
 //    
 static class httpd_client_task_t : public os_task_base_t
@@ -155,6 +193,9 @@ protected:
             if (allocated_last != allocated)
             {
                 allocated_last = allocated;
+                httpd_sockets_used = allocated;
+                if (httpd_sockets_peak < allocated)
+                    httpd_sockets_peak = allocated;
                 LOGI("Slot count: %d", allocated);
                 LOGH();
             }
@@ -315,6 +356,12 @@ ipc_processor_proxy_t httpd_processor_in([](const ipc_packet_t &packet, const ip
     return true;
 });
 
+void httpd_sockets_get(uint8_t &used, uint8_t &peak)
+{
+    used = httpd_sockets_used;
+    peak = httpd_sockets_peak;
+}
+
 void httpd_init(void)
 {
     //     
@@ -8,5 +8,7 @@ extern ipc_processor_proxy_t httpd_processor_in;
 
 //   
 void httpd_init(void);
+//      (  )
+void httpd_sockets_get(uint8_t &used, uint8_t &peak);
 
 #endif // __HTTPD_H
@@ -0,0 +1,213 @@
+﻿#include <os.h>
+#include <stm.h>
+#include <core.h>
+#include "httpd.h"
+#include "metrics.h"
+#include <esp_timer.h>
+#include <proto/metrics.inc.h>
+
+// Период запроса счетчиков STM32 [мС]
+#define METRICS_STM_PERIOD_MS       10000
+// Количество хранимых времён ответа SNTP
+#define METRICS_SNTP_HISTORY        4
+// Размер буфера текста метрик
+#define METRICS_TEXT_SIZE           3072
+// Путь страницы метрик
+#define METRICS_PATH                "/metrics"
+// MIME тип страницы метрик (текстовый формат Prometheus)
+#define METRICS_MIME                "text/plain; version=0.0.4\r\n"
+
+// Собранные данные
+static struct
+{
+    // Последний ответ STM32
+    metrics_command_get_response_t stm;
+    // Получен ли ответ STM32
+    bool stm_valid = false;
+    // Наименьший замеченный объем свободной памяти
+    uint32_t heap_min = UINT32_MAX;
+    // Времена ответа SNTP [мС] (первое - последнее)
+    uint32_t sntp_rtt[METRICS_SNTP_HISTORY];
+    // Количество запросов SNTP
+    uint32_t sntp_count = 0;
+    // Мьютекс синхронизации
+    os_mutex_t mutex;
+} metrics_data;
+
+// Обработчик команды получения счетчиков STM32
+static class metrics_command_handler_get_t : public ipc_requester_template_t<metrics_command_get_t>
+{
+    // Время последнего запроса
+    tick_t request_tick = 0;
+protected:
+    // Обработка данных
+    virtual void work(bool idle) override final
+    {
+        if (idle)
+        {
+            // Учет наименьшего объема свободной памяти
+            const auto heap = esp_get_free_heap_size();
+            if (metrics_data.heap_min > heap)
+                metrics_data.heap_min = heap;
+            
+            // Периодический запрос
+            const auto now = tick_get();
+            if (now - request_tick < METRICS_STM_PERIOD_MS)
+                return;
+            request_tick = now;
+            transmit();
+            return;
+        }
+        
+        // Сохранение ответа
+        metrics_data.mutex.enter();
+            metrics_data.stm = command.response;
+            metrics_data.stm_valid = true;
+        metrics_data.mutex.leave();
+    }
+public:
+    // Конструктор по умолчанию
+    metrics_command_handler_get_t(void) : ipc_requester_template_t(METRICS_STM_PERIOD_MS)
+    {
+        // Запрос по времени, проверка в простое
+        idle_pooling = true;
+    }
+} metrics_command_handler_get;
+
+// Источник страницы метрик
+static class metrics_content_t : public web_http_content_t
+{
+    // Текст страницы
+    char text[METRICS_TEXT_SIZE];
+    // Размер текста
+    size_t length;
+    // Количество открытий (текст не формируется заново, пока читается)
+    uint8_t users = 0;
+    
+    // Добавление строки
+    void print(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        if (length >= sizeof(text) - 1)
+            return;
+        va_list args;
+        va_start(args, format);
+            auto printed = vsnprintf(text + length, sizeof(text) - length, format, args);
+        va_end(args);
+        // При нехватке места текст обрезается
+        length = minimum<size_t>(length + printed, sizeof(text) - 1);
+    }
+    
+    // Вывод счетчиков канала связи
+    void print_link(const char *side, const ipc_link_stat_t &link)
+    {
+        print("nixie_link_resets_total{side=\"%s\",origin=\"local\",reason=\"overflow\"} %u\n", side, link.overflow_local);
+        print("nixie_link_resets_total{side=\"%s\",origin=\"local\",reason=\"corruption\"} %u\n", side, link.corruption_local);
+        print("nixie_link_resets_total{side=\"%s\",origin=\"remote\",reason=\"overflow\"} %u\n", side, link.overflow_remote);
+        print("nixie_link_resets_total{side=\"%s\",origin=\"remote\",reason=\"corruption\"} %u\n", side, link.corruption_remote);
+        print("nixie_link_slots_peak{side=\"%s\",dir=\"tx\"} %u\n", side, link.tx_peak);
+        print("nixie_link_slots_peak{side=\"%s\",dir=\"rx\"} %u\n", side, link.rx_peak);
+    }
+    
+    // Формирование текста
+    void render(void);
+public:
+    // Открытие содержимого по пути
+    virtual bool content_open(const char *path, const char *&mime, const char *&data, size_t &size) override final
+    {
+        if (strcmp(path, METRICS_PATH) != 0)
+            return false;
+        if (users++ <= 0)
+            render();
+        mime = METRICS_MIME;
+        data = text;
+        size = length;
+        return true;
+    }
+    
+    // Закрытие содержимого
+    virtual void content_close(void) override final
+    {
+        assert(users > 0);
+        users--;
+    }
+} metrics_content;
+
+void metrics_content_t::render(void)
+{
+    length = 0;
+    
+    // ESP8266
+    print("nixie_esp_uptime_seconds %u\n", (uint32_t)(esp_timer_get_time() / 1000000));
+    print("nixie_esp_heap_free_bytes %u\n", esp_get_free_heap_size());
+    print("nixie_esp_heap_min_bytes %u\n", metrics_data.heap_min);
+    {
+        ipc_link_stat_t link;
+        stm_link_stat_get(link);
+        print_link("esp", link);
+    }
+    
+    // Веб сервер
+    {
+        uint8_t used, peak;
+        httpd_sockets_get(used, peak);
+        print("nixie_http_sockets %u\n", used);
+        print("nixie_http_sockets_peak %u\n", peak);
+        print("nixie_http_requests_total %u\n", web_http_stat.count);
+        print("nixie_http_errors_total %u\n", web_http_stat.errors);
+        print("nixie_http_request_ms_sum %u\n", (uint32_t)(web_http_stat.total_us / 1000));
+        print("nixie_http_request_ms_max %u\n", web_http_stat.max_us / 1000);
+    }
+    
+    // Копия ответа STM32 и истории SNTP
+    metrics_data.mutex.enter();
+        const auto stm = metrics_data.stm;
+        const auto stm_valid = metrics_data.stm_valid;
+        const auto sntp_count = metrics_data.sntp_count;
+        uint32_t sntp_rtt[METRICS_SNTP_HISTORY];
+        memcpy(sntp_rtt, metrics_data.sntp_rtt, sizeof(sntp_rtt));
+    metrics_data.mutex.leave();
+    
+    // SNTP
+    print("nixie_sntp_requests_total %u\n", sntp_count);
+    for (uint32_t i = 0; i < minimum<uint32_t>(sntp_count, METRICS_SNTP_HISTORY); i++)
+        print("nixie_sntp_rtt_ms{n=\"%u\"} %u\n", i, sntp_rtt[i]);
+    
+    // STM32
+    print("nixie_stm_up %d\n", stm_valid ? 1 : 0);
+    if (!stm_valid)
+        return;
+    print("nixie_stm_uptime_seconds %u\n", stm.uptime);
+    print_link("stm", stm.link);
+    print("nixie_link_retries_total %u\n", stm.retries);
+    print("nixie_esp_resets_total %u\n", stm.esp_resets);
+    print("nixie_frames_total %u\n", stm.frame.count);
+    print("nixie_frames_skipped_total %u\n", stm.frame.skipped);
+    print("nixie_frame_us_avg %u\n", stm.frame.avg);
+    print("nixie_frame_us_max %u\n", stm.frame.max);
+    print("nixie_sntp_syncs_total %u\n", stm.sync_count);
+    for (auto i = 0; i < minimum<int>(stm.sync_count, METRICS_SYNC_HISTORY); i++)
+        print("nixie_sntp_offset_seconds{n=\"%d\"} %d\n", i, stm.sync_offsets[i]);
+}
+
+void metrics_sntp_rtt(uint32_t ms)
+{
+    metrics_data.mutex.enter();
+        for (auto i = METRICS_SNTP_HISTORY - 1; i > 0; i--)
+            metrics_data.sntp_rtt[i] = metrics_data.sntp_rtt[i - 1];
+        metrics_data.sntp_rtt[0] = ms;
+        metrics_data.sntp_count++;
+    metrics_data.mutex.leave();
+}
+
+web_http_content_t * metrics_content_get(void)
+{
+    return &metrics_content;
+}
+
+void metrics_init(void)
+{
+    // Начальное значение минимума свободной памяти
+    metrics_data.heap_min = esp_get_free_heap_size();
+    // Обработчики IPC
+    core_handler_add(metrics_command_handler_get);
+}
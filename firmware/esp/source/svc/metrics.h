@@ -0,0 +1,15 @@
+﻿#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <web/web_http.h>
+
+// Инициализация модуля
+void metrics_init(void);
+
+// Учет времени ответа сервера SNTP
+void metrics_sntp_rtt(uint32_t ms);
+
+// Получает источник страницы метрик для веб сервера
+web_http_content_t * metrics_content_get(void);
+
+#endif // __METRICS_H
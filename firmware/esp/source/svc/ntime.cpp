@@ -6,6 +6,8 @@
 #include <core.h>
 #include "wifi.h"
 #include "ntime.h"
+#include "metrics.h"
+#include <esp_timer.h>
 #include <proto/time.inc.h>
 
 // Имя модуля для логирования
@@ -112,6 +114,7 @@ static bool ntime_try_host(const char *host)
             break;
 
         // Отправка запроса
+        const auto start = esp_timer_get_time();
         if (lwip_send(socket_fd, &packet, sizeof(packet), 0) != sizeof(packet))
         {
             LOGW("Send failed!");
@@ -124,6 +127,7 @@ static bool ntime_try_host(const char *host)
             LOGW("Not answered!");
             break;
         }
+        metrics_sntp_rtt((uint32_t)((esp_timer_get_time() - start) / 1000));
         fail = false;
     } while (false);
 
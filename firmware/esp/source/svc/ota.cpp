@@ -0,0 +1,258 @@
+﻿#include <fs.h>
+#include <os.h>
+#include <log.h>
+#include <stm.h>
+#include <tool.h>
+#include <sha1.h>
+#include <base64.h>
+#include "ota.h"
+#include "wifi.h"
+#include <esp_timer.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <proto/update.inc.h>
+
+// Имя модуля для логирования
+LOG_TAG_DECL("OTA");
+
+// Путь загрузки образа ESP8266
+#define OTA_PATH_ESP                "/ota/esp"
+// Путь загрузки образа STM32
+#define OTA_PATH_STM                "/ota/stm"
+// Путь загрузки образа файловой системы
+#define OTA_PATH_ROMFS              "/ota/romfs"
+// Тип и подтип раздела промежуточного хранения образа STM32
+#define OTA_STM_PARTITION_TYPE      0x40
+#define OTA_STM_PARTITION_SUBTYPE   0x01
+// Размер кэша чтения образа STM32
+#define OTA_STM_CACHE_SIZE          1024
+// Задержка перезапуска после обновления ESP8266 (мС), что бы успеть ответить
+#define OTA_RESTART_DELAY_MS        1000
+// Имя пользователя загрузки (пароль - пароль точки доступа часов)
+#define OTA_AUTH_USER               "ota"
+// Схема авторизации (пробелы заголовка отбрасываются при разборе)
+#define OTA_AUTH_SCHEME             "Basic"
+
+// Цель загрузки
+enum ota_target_t
+{
+    // Загрузка не идет
+    OTA_TARGET_NONE,
+    // Образ ESP8266
+    OTA_TARGET_ESP,
+    // Образ STM32
+    OTA_TARGET_STM,
+    // Образ файловой системы
+    OTA_TARGET_ROMFS,
+};
+
+/* Образ пишется в раздел потоком, сектора стираются по мере записи.
+ * Пока Flash занята, сеть продолжает принимать данные в окно TCP.
+ * Образ STM32 прошивается только после полной загрузки и проверки размера,
+ * поэтому обрыв соединения не затрагивает работающую STM32 */
+static class ota_upload_impl_t : public web_http_upload_t, public stm_update_source_t
+{
+    // Текущая цель
+    ota_target_t target = OTA_TARGET_NONE;
+    // Раздел приёмника
+    const esp_partition_t *partition;
+    // Размер образа и количество записанных байт
+    size_t size, offset;
+    // Граница стертой области раздела
+    size_t erased;
+    // CRC-32 образа STM32 (без итоговой инверсии)
+    uint32_t crc;
+    // Хэш образа файловой системы
+    sha1_t hash;
+    // Кэш чтения образа STM32 (программатор запрашивает блоки последовательно)
+    struct
+    {
+        // Данные
+        uint8_t data[OTA_STM_CACHE_SIZE];
+        // Смещение данных в разделе (SIZE_MAX - кэш пуст)
+        size_t offset;
+    } cache;
+
+    // Проверка учетных данных загрузки
+    static bool auth_check(const char *auth)
+    {
+        // Без пароля точки доступа загрузка не разрешается
+        char credentials[sizeof(OTA_AUTH_USER) + WIFI_PASSWORD_LENGTH_MAX + 1] = OTA_AUTH_USER ":";
+        if (!wifi_softap_password_get(credentials + sizeof(OTA_AUTH_USER)))
+        {
+            LOGW("Upload refused, SoftAP password not set!");
+            return false;
+        }
+        // Ожидаемое значение заголовка
+        char expected[sizeof(OTA_AUTH_SCHEME) + (sizeof(credentials) + 2) / 3 * 4];
+        strcpy(expected, OTA_AUTH_SCHEME);
+        base64_encode(expected + sizeof(OTA_AUTH_SCHEME) - 1, credentials, strlen(credentials));
+        // Сравнение за постоянное время
+        const auto len = strlen(expected);
+        auto diff = strlen(auth) ^ len;
+        for (size_t i = 0; i < len && auth[i] != 0; i++)
+            diff |= auth[i] ^ expected[i];
+        return diff == 0;
+    }
+public:
+    // Раздел промежуточного хранения образа STM32
+    const esp_partition_t *stm_partition = NULL;
+    // Таймер перезапуска
+    esp_timer_handle_t restart_timer = NULL;
+
+    // Начало загрузки данных указанного размера по пути
+    virtual web_http_upload_status_t upload_begin(const char *path, size_t size, const char *auth) override final
+    {
+        // Загрузка только с учетными данными
+        if (!auth_check(auth))
+            return WEB_HTTP_UPLOAD_STATUS_UNAUTHORIZED;
+        // Одновременно идет только одна загрузка
+        if (target != OTA_TARGET_NONE)
+            return WEB_HTTP_UPLOAD_STATUS_BUSY;
+        // Выбор цели
+        ota_target_t dest;
+        if (!strcmp(path, OTA_PATH_ESP))
+        {
+            dest = OTA_TARGET_ESP;
+            partition = esp_ota_get_next_update_partition(NULL);
+        }
+        else if (!strcmp(path, OTA_PATH_STM))
+        {
+            // Промежуточный раздел читается, пока идет обновление STM32
+            if (stm_update_active())
+                return WEB_HTTP_UPLOAD_STATUS_BUSY;
+            dest = OTA_TARGET_STM;
+            partition = stm_partition;
+            if (size > UPDATE_IMAGE_SIZE_MAX)
+                return WEB_HTTP_UPLOAD_STATUS_TOO_LARGE;
+        }
+        else if (!strcmp(path, OTA_PATH_ROMFS))
+        {
+            // Текущий образ продолжает обслуживать запросы
+            dest = OTA_TARGET_ROMFS;
+            // Прежний образ еще читается открытыми файлами
+            if (fs_update_busy())
+                return WEB_HTTP_UPLOAD_STATUS_BUSY;
+            // Размер проверяется до стирания записи о завершении
+            const auto limit = fs_update_size_max();
+            if (limit > 0 && size > limit)
+                return WEB_HTTP_UPLOAD_STATUS_TOO_LARGE;
+            partition = fs_update_begin(size);
+        }
+        else
+            return WEB_HTTP_UPLOAD_STATUS_NOT_FOUND;
+        if (partition == NULL)
+        {
+            LOGE("Partition for %s not found!", path);
+            return WEB_HTTP_UPLOAD_STATUS_FAILED;
+        }
+        if (size > partition->size)
+            return WEB_HTTP_UPLOAD_STATUS_TOO_LARGE;
+        // Начало загрузки
+        target = dest;
+        this->size = size;
+        offset = erased = 0;
+        crc = UPDATE_CRC_INIT;
+        hash.reset();
+        LOGI("Upload to %s, offset 0x%08x, %d bytes", partition->label, partition->address, size);
+        return WEB_HTTP_UPLOAD_STATUS_OK;
+    }
+
+    // Приём части данных
+    virtual bool upload_write(const uint8_t *data, size_t size) override final
+    {
+        assert(target != OTA_TARGET_NONE);
+        if (offset + size > this->size)
+            return false;
+        // Стирание секторов под новые данные
+        for (; erased < offset + size; erased += SPI_FLASH_SEC_SIZE)
+            if (esp_partition_erase_range(partition, erased, SPI_FLASH_SEC_SIZE) != ESP_OK)
+                return false;
+        if (esp_partition_write(partition, offset, data, size) != ESP_OK)
+            return false;
+        if (target == OTA_TARGET_STM)
+            crc = update_crc(crc, data, size);
+        else if (target == OTA_TARGET_ROMFS)
+            hash.update((const char *)data, size);
+        offset += size;
+        return true;
+    }
+
+    // Завершение загрузки
+    virtual web_http_upload_status_t upload_end(bool complete) override final
+    {
+        auto dest = target;
+        target = OTA_TARGET_NONE;
+        if (!complete || offset != size)
+        {
+            LOGW("Upload aborted at %d of %d bytes", offset, size);
+            return WEB_HTTP_UPLOAD_STATUS_FAILED;
+        }
+        switch (dest)
+        {
+            case OTA_TARGET_ESP:
+                // Проверка образа и смена раздела загрузки
+                if (esp_ota_set_boot_partition(partition) != ESP_OK)
+                {
+                    LOGE("Image verification failed!");
+                    return WEB_HTTP_UPLOAD_STATUS_FAILED;
+                }
+                LOGI("Boot partition %s, restarting...", partition->label);
+                esp_timer_start_once(restart_timer, OTA_RESTART_DELAY_MS * 1000);
+                return WEB_HTTP_UPLOAD_STATUS_OK;
+            case OTA_TARGET_STM:
+                // Программирование идет в фоне задачи связи с STM32
+                cache.offset = SIZE_MAX;
+                return stm_update_start(*this, size, ~crc) ? WEB_HTTP_UPLOAD_STATUS_OK : WEB_HTTP_UPLOAD_STATUS_BUSY;
+            case OTA_TARGET_ROMFS:
+                // Проверка по хэшу потока и переключение раздела
+                return fs_update_commit(size, (const uint8_t *)hash.final()) ? WEB_HTTP_UPLOAD_STATUS_OK : WEB_HTTP_UPLOAD_STATUS_FAILED;
+            default:
+                assert(false);
+                return WEB_HTTP_UPLOAD_STATUS_FAILED;
+        }
+    }
+
+    // Чтение части образа STM32 (из задачи связи с STM32)
+    virtual bool read(void *dest, size_t size, size_t offset) override final
+    {
+        if (size > OTA_STM_CACHE_SIZE)
+            return false;
+        // Загрузка кэша, если блок вне его
+        if (cache.offset == SIZE_MAX || offset < cache.offset || offset + size > cache.offset + OTA_STM_CACHE_SIZE)
+        {
+            cache.offset = SIZE_MAX;
+            if (esp_partition_read(stm_partition, offset, cache.data, minimum<size_t>(OTA_STM_CACHE_SIZE, stm_partition->size - offset)) != ESP_OK)
+                return false;
+            cache.offset = offset;
+        }
+        memcpy(dest, cache.data + (offset - cache.offset), size);
+        return true;
+    }
+} ota_upload_impl;
+
+void ota_init(void)
+{
+    // Раздел промежуточного хранения образа STM32
+    ota_upload_impl.stm_partition = esp_partition_find_first((esp_partition_type_t)OTA_STM_PARTITION_TYPE, (esp_partition_subtype_t)OTA_STM_PARTITION_SUBTYPE, NULL);
+    if (ota_upload_impl.stm_partition == NULL)
+        LOGE("Unable to find STM partition!");
+    // Текущий раздел приложения
+    auto running = esp_ota_get_running_partition();
+    assert(running != NULL);
+    LOGI("Running partition %s, offset 0x%08x", running->label, running->address);
+    // Таймер перезапуска после обновления
+    esp_timer_create_args_t args;
+    memory_clear(&args, sizeof(args));
+    args.name = "ota";
+    args.callback = [](void *arg)
+    {
+        esp_restart();
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&args, &ota_upload_impl.restart_timer));
+}
+
+web_http_upload_t * ota_upload_get(void)
+{
+    return &ota_upload_impl;
+}
@@ -0,0 +1,12 @@
+﻿#ifndef __OTA_H
+#define __OTA_H
+
+#include <web/web_http.h>
+
+// Инициализация модуля
+void ota_init(void);
+
+// Получает приёмник загрузки образов для веб сервера
+web_http_upload_t * ota_upload_get(void);
+
+#endif // __OTA_H
@@ -7,6 +7,9 @@
 #include <tool.h>
 #include <system.h>
 #include <esp_wifi.h>
+#include <nvs_flash.h>
+#include <esp_system.h>
+#include <lwip/dhcp.h>
 #include <tcpip_adapter.h>
 #include <esp_event_loop.h>
 #include <proto/wifi.inc.h>
@@ -18,19 +21,56 @@ LOG_TAG_DECL("WIFI");
 static wifi_info_t wifi_info;
 // Промежуточный буфер для настроек
 static wifi_settings_t wifi_settings;
+// Мьютекс чтения настроек из других задач
+static os_mutex_t wifi_settings_mutex;
+STATIC_ASSERT(sizeof(wifi_password_t) == WIFI_PASSWORD_LENGTH_MAX);
 
 // Класс поиска сетей
 static class wifi_net_finder_t
 {
-    // Количество точек
-    uint16_t count = 0;
+    // Количество точек в списке
+    uint8_t count = 0;
     // Признак запуска
     bool running = false;
+    // Результаты сканирования (с повторами имен)
+    wifi_ap_record_t ap_records[20];
+
+    // Сортировка результатов сканирования по убыванию уровня сигнала
+    static void sort(wifi_ap_record_t *list, uint16_t length)
+    {
+        for (auto i = 1; i < length; i++)
+            for (auto j = i; j > 0 && list[j - 1].rssi < list[j].rssi; j--)
+            {
+                const auto temp = list[j];
+                list[j] = list[j - 1];
+                list[j - 1] = temp;
+            }
+    }
+
+    // Добавление точки в список (без скрытых и повторов имени)
+    void append(const wifi_ap_record_t &ap)
+    {
+        const auto ssid = (const char *)ap.ssid;
+        // Скрытая сеть, нет уровня сигнала или список полон
+        if (ssid[0] == '\0' || ap.rssi >= 0 || count >= array_length(records))
+            return;
+        // Сеть с таким именем уже есть (с большим уровнем сигнала)
+        for (auto i = 0; i < count; i++)
+            if (strncmp(records[i].ssid, ssid, sizeof(wifi_ssid_t)) == 0)
+                return;
+        // Заполнение записи
+        auto &record = records[count++];
+        memcpy(record.ssid, ap.ssid, sizeof(wifi_ssid_t));
+        record.ssid[sizeof(wifi_ssid_t) - 1] = '\0';
+        record.rssi = ap.rssi;
+        record.channel = ap.primary;
+        record.auth = (uint8_t)ap.authmode;
+    }
 public:
     // Мьютекс для синхронизации
     const os_mutex_t mutex;
     // Список точек
-    wifi_ap_record_t ap_records[wifi_command_search_pool_request_t::MAX_INDEX];
+    wifi_search_record_t records[wifi_command_search_list_response_t::MAX_COUNT];
 
     // Запуск поиска
     void start(void)
@@ -64,16 +104,18 @@ public:
             assert(running);
 
             // Получаем точки
-            count = array_length(ap_records);
-            ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&count, ap_records));
+            uint16_t found = array_length(ap_records);
+            ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&found, ap_records));
 
             // Снимаем признак
             running = false;
 
             // Логирование
-            LOGI("[Finder] done. Found %d aps...", count);
+            LOGI("[Finder] done. Found %d aps...", found);
 
-            for (auto i = 0; i < count; i++)
+            // Сильные точки первыми, из повторов имени остается сильнейшая
+            sort(ap_records, found);
+            for (auto i = 0; i < found; i++)
             {
                 // Поиск сетки к которой подключены
                 const auto &ap = ap_records[i];
@@ -83,13 +125,15 @@ public:
                 tool_mac_to_string(ap.bssid, mac_str);
 
                 // Лог
-                LOGI("[Finder] ap \"%s\", mac %s, rssi %d, private %s.",
+                LOGI("[Finder] ap \"%s\", mac %s, rssi %d, channel %d, auth %d.",
                     ap.ssid,
                     mac_str,
                     ap.rssi,
-                    ap.authmode != WIFI_AUTH_OPEN ?
-                        "yes" :
-                        "no");
+                    ap.primary,
+                    ap.authmode);
+
+                // Добавление в список
+                append(ap);
             }
 
         mutex.leave();
@@ -109,8 +153,90 @@ public:
 
 } wifi_net_finder;
 
+// Начальная задержка переподключения к точке доступа [мС]
+#define WIFI_STATION_BACKOFF_MIN        500
+// Наибольшая задержка переподключения к точке доступа [мС]
+#define WIFI_STATION_BACKOFF_MAX        (60 * 1000)
+// Период отсчета времени аренды [С]
+#define WIFI_STATION_LEASE_PERIOD       60
+// Шаг сохранения времени до обновления аренды [С] (ограничивает износ Flash)
+#define WIFI_STATION_LEASE_STORE_STEP   (10 * 60)
+
+// Данные последнего удачного подключения (хранятся в NVS)
+static class wifi_station_cache_t
+{
+    // Имя пространства и ключа в NVS (ключ сменен вместе со смыслом поля renew)
+    static constexpr const char *NVS_NAMESPACE = "wifi";
+    static constexpr const char *NVS_KEY = "station2";
+
+    // Признак наличия данных
+    bool loaded = false;
+public:
+    // Сохраняемые данные
+    struct data_t
+    {
+        // Имя точки доступа
+        wifi_ssid_t ssid;
+        // MAC адрес точки доступа
+        uint8_t bssid[6];
+        // Канал
+        uint8_t channel;
+        // Признак наличия аренды IP адреса
+        bool leased;
+        // Аренда IP адреса
+        tcpip_adapter_ip_info_t lease;
+        // Время до обновления аренды (T1) на момент сохранения [С]
+        // Не меньше действительного и отстает не более чем на шаг сохранения и период отсчета
+        uint32_t renew;
+    } data;
+
+    // Загрузка из NVS
+    void load(void)
+    {
+        nvs_handle handle;
+        if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+            return;
+        size_t size = sizeof(data);
+        loaded = nvs_get_blob(handle, NVS_KEY, &data, &size) == ESP_OK && size == sizeof(data);
+        nvs_close(handle);
+    }
+
+    // Сохранение в NVS (только при изменении)
+    void store(const data_t &value)
+    {
+        if (loaded && memcmp(&data, &value, sizeof(data)) == 0)
+            return;
+        data = value;
+        loaded = true;
+
+        nvs_handle handle;
+        if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+            return;
+        if (nvs_set_blob(handle, NVS_KEY, &data, sizeof(data)) != ESP_OK || nvs_commit(handle) != ESP_OK)
+            LOGW("[Station] cache store failed!");
+        nvs_close(handle);
+    }
+
+    // Проверка данных для указанной точки доступа
+    bool valid(const wifi_ssid_t ssid) const
+    {
+        return loaded && strncmp(data.ssid, ssid, sizeof(wifi_ssid_t)) == 0;
+    }
+} wifi_station_cache;
+
 // Таймер переподключения к точке доступа
 static os_timer_t wifi_station_reconnect_timer;
+// Текущая задержка переподключения [мС]
+static uint32_t wifi_station_backoff = WIFI_STATION_BACKOFF_MIN;
+
+// Таймер отсчета времени аренды IP адреса
+static os_timer_t wifi_station_lease_timer;
+// Оставшееся время использования сохраненной аренды [С]
+static uint32_t wifi_station_lease_remain;
+// Признак использования сохраненной аренды вместо DHCP
+static bool wifi_station_lease_reused = false;
+// Признак направленного подключения по сохраненным данным
+static bool wifi_station_directed = false;
 
 // Переподключение к точке доступа
 static void wifi_station_reconnect(void)
@@ -120,6 +246,15 @@ static void wifi_station_reconnect(void)
     ESP_ERROR_CHECK(esp_wifi_connect());
 }
 
+// Планирование переподключения с удвоением задержки
+static void wifi_station_reconnect_schedule(void)
+{
+    os_timer_disarm(&wifi_station_reconnect_timer);
+    os_timer_arm(&wifi_station_reconnect_timer, wifi_station_backoff, false);
+    LOGI("[Station] reconnect in %u ms", wifi_station_backoff);
+    wifi_station_backoff = minimum<uint32_t>(wifi_station_backoff * 2, WIFI_STATION_BACKOFF_MAX);
+}
+
 // Обработчик переподключения к точке доступа
 static void wifi_station_reconnect_handler(void *arg)
 {
@@ -129,19 +264,192 @@ static void wifi_station_reconnect_handler(void *arg)
     if (!wifi_settings.intf[WIFI_INTF_STATION].use)
         return;
 
-    // Выход если запущен поиск
-    if (wifi_net_finder.running_get())
-        return;
-
     // Проверка состояния
     if (wifi_info.intf[WIFI_INTF_STATION].state != WIFI_INTF_STATE_ERROR)
         return;
 
+    // Если запущен поиск - повтор позже
+    if (wifi_net_finder.running_get())
+    {
+        wifi_station_reconnect_schedule();
+        return;
+    }
+
     // Переподключение
     LOGI("[Station] reconnecting...");
     wifi_station_reconnect();
 }
 
+// Получает, был ли сброс теплым (питание не пропадало, простой - секунды)
+static bool wifi_reset_warm(void)
+{
+    switch (esp_reset_reason())
+    {
+        case ESP_RST_SW:
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Сохранение времени до обновления аренды (при продлении или уменьшении на шаг)
+static void wifi_station_cache_renew(uint32_t remain)
+{
+    if (!wifi_station_cache.valid(wifi_settings.intf[WIFI_INTF_STATION].ssid) || !wifi_station_cache.data.leased)
+        return;
+    auto value = wifi_station_cache.data;
+    if (remain <= value.renew && value.renew - remain < WIFI_STATION_LEASE_STORE_STEP)
+        return;
+    value.renew = remain;
+    wifi_station_cache.store(value);
+}
+
+// Получает время до обновления аренды от DHCP клиента (false - аренды нет)
+static bool wifi_station_dhcp_renew_get(uint32_t &remain)
+{
+    struct netif *netif;
+    if (tcpip_adapter_get_netif(TCPIP_ADAPTER_IF_STA, (void **)&netif) != ESP_OK)
+        return false;
+    const auto dhcp = netif_dhcp_data(netif);
+    if (dhcp == NULL || dhcp->state != DHCP_STATE_BOUND)
+        return false;
+    // Счетчик перезапускается при каждом продлении аренды
+    remain = (uint32_t)dhcp->t1_renew_time * DHCP_COARSE_TIMER_SECS;
+    return true;
+}
+
+// Возврат к получению IP адреса по DHCP
+static void wifi_station_lease_release(void)
+{
+    if (!wifi_station_lease_reused)
+        return;
+    wifi_station_lease_reused = false;
+    tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
+    LOGI("[Station] lease reuse finished, DHCP started");
+}
+
+// Обработчик отсчета времени аренды
+static void wifi_station_lease_handler(void *arg)
+{
+    UNUSED(arg);
+
+    // Аренда по DHCP, сохранение времени до ее обновления
+    if (!wifi_station_lease_reused)
+    {
+        uint32_t remain;
+        if (wifi_station_dhcp_renew_get(remain))
+            wifi_station_cache_renew(remain);
+        return;
+    }
+
+    // Сохраненная аренда еще действительна
+    if (wifi_station_lease_remain > WIFI_STATION_LEASE_PERIOD)
+    {
+        wifi_station_lease_remain -= WIFI_STATION_LEASE_PERIOD;
+        wifi_station_cache_renew(wifi_station_lease_remain);
+        return;
+    }
+
+    // Время обновления аренды
+    wifi_station_cache_renew(0);
+    wifi_station_lease_release();
+}
+
+// Применение сохраненных данных подключения к конфигурации станции
+static void wifi_station_cache_apply(wifi_config_t &config)
+{
+    if (!wifi_station_cache.valid(wifi_settings.intf[WIFI_INTF_STATION].ssid))
+        return;
+    const auto &cache = wifi_station_cache.data;
+
+    // Направленное подключение к последней точке
+    wifi_station_directed = true;
+    config.sta.bssid_set = true;
+    memcpy(config.sta.bssid, cache.bssid, sizeof(cache.bssid));
+    config.sta.channel = cache.channel;
+    LOGI("[Station] directed to " MACSTR ", channel %d", MAC2STR(cache.bssid), cache.channel);
+
+    // Аренда используется только для первого подключения после теплого сброса,
+    // после пропадания питания время простоя неизвестно
+    static bool lease_tried = false;
+    if (!cache.leased || lease_tried)
+        return;
+    lease_tried = true;
+    if (!wifi_reset_warm())
+        return;
+    // Сохраненное время уменьшается на наибольшее отставание от действительного
+    const uint32_t margin = WIFI_STATION_LEASE_STORE_STEP + 2 * WIFI_STATION_LEASE_PERIOD;
+    if (cache.renew <= margin)
+        return;
+    const auto remain = cache.renew - margin;
+    tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_STA);
+    if (tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_STA, &cache.lease) != ESP_OK)
+    {
+        tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
+        return;
+    }
+    // До T1 сервер держит адрес за нами, уменьшенное время сохраняется сразу,
+    // что бы череда сбросов не продлевала аренду
+    wifi_station_lease_reused = true;
+    wifi_station_lease_remain = remain;
+    wifi_station_cache_renew(remain);
+    LOGI("[Station] reusing lease %s for %u s", ip4addr_ntoa(&cache.lease.ip), remain);
+}
+
+// Отказ от направленного подключения (точка могла сменить канал или MAC)
+static void wifi_station_undirect(void)
+{
+    if (!wifi_station_directed)
+        return;
+    wifi_station_directed = false;
+
+    wifi_config_t config;
+    ESP_ERROR_CHECK(esp_wifi_get_config(ESP_IF_WIFI_STA, &config));
+    config.sta.bssid_set = false;
+    config.sta.channel = wifi_settings.intf[WIFI_INTF_STATION].channel;
+    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &config));
+}
+
+// Сохранение данных удачного подключения
+static void wifi_station_cache_connected(const system_event_sta_connected_t &info)
+{
+    wifi_station_cache_t::data_t value;
+    const auto &ssid = wifi_settings.intf[WIFI_INTF_STATION].ssid;
+    // Смена точки доступа сбрасывает аренду
+    if (wifi_station_cache.valid(ssid))
+        value = wifi_station_cache.data;
+    else
+    {
+        memory_clear(&value, sizeof(value));
+        strncpy(value.ssid, ssid, sizeof(wifi_ssid_t));
+    }
+    memcpy(value.bssid, info.bssid, sizeof(value.bssid));
+    value.channel = info.channel;
+    wifi_station_cache.store(value);
+}
+
+// Сохранение аренды IP адреса, полученной по DHCP
+static void wifi_station_cache_leased(const tcpip_adapter_ip_info_t &lease)
+{
+    if (!wifi_station_cache.valid(wifi_settings.intf[WIFI_INTF_STATION].ssid))
+        return;
+
+    // Время до обновления аренды от DHCP клиента
+    struct netif *netif;
+    if (tcpip_adapter_get_netif(TCPIP_ADAPTER_IF_STA, (void **)&netif) != ESP_OK || netif_dhcp_data(netif) == NULL)
+        return;
+
+    auto value = wifi_station_cache.data;
+    value.renew = netif_dhcp_data(netif)->offered_t1_renew;
+    value.lease = lease;
+    value.leased = true;
+    wifi_station_cache.store(value);
+}
+
 // Обработчик команды репортирования о присвоении IP адреса
 static class wifi_command_handler_ip_report_t : public ipc_requester_template_t<wifi_command_ip_report_t>
 {
@@ -180,6 +488,8 @@ public:
     wifi_command_handler_ip_report_t(void) : ipc_requester_template_t(1000)
     {
     	memory_clear(changed, sizeof(changed));
+        // Признаки изменения выставляются из другой задачи, проверка в простое
+        idle_pooling = true;
     }
 
     // Передача для указанного интерфейса
@@ -245,6 +555,11 @@ static esp_err_t wifi_event_handler(void *ctx, system_event_t *event)
         case SYSTEM_EVENT_STA_GOT_IP:
             LOGI("[Station] got IP: %s", ip4addr_ntoa(&info.got_ip.ip_info.ip));
             wifi_update_intf_address(TCPIP_ADAPTER_IF_STA);
+            // Запоминание полученной аренды и отсчет ее времени
+            if (!wifi_station_lease_reused)
+                wifi_station_cache_leased(info.got_ip.ip_info);
+            os_timer_disarm(&wifi_station_lease_timer);
+            os_timer_arm(&wifi_station_lease_timer, WIFI_STATION_LEASE_PERIOD * 1000, true);
             // io_led_green.flash();
             break;
         case SYSTEM_EVENT_STA_LOST_IP:
@@ -255,15 +570,23 @@ static esp_err_t wifi_event_handler(void *ctx, system_event_t *event)
             LOGI("[Station] connected, channel: %d", info.connected.channel);
             // io_led_yellow.state_set(false);
             os_timer_disarm(&wifi_station_reconnect_timer);
+            wifi_station_backoff = WIFI_STATION_BACKOFF_MIN;
+            wifi_station_cache_connected(info.connected);
             break;
 
         case SYSTEM_EVENT_STA_DISCONNECTED:
             LOGI("[Station] disconnected, reason: %d", info.disconnected.reason);
+            // Сохраненная аренда только до первого разрыва
+            os_timer_disarm(&wifi_station_lease_timer);
+            wifi_station_lease_release();
             if (wifi_settings.intf[WIFI_INTF_STATION].use)
             {
             	// io_led_yellow.state_set(true);
                 wifi_info.intf[WIFI_INTF_STATION].state = WIFI_INTF_STATE_ERROR;
-                os_timer_arm(&wifi_station_reconnect_timer, 30 * 1000, true);
+                // Кроме собственного отключения при смене настроек
+                if (info.disconnected.reason != WIFI_REASON_ASSOC_LEAVE)
+                    wifi_station_undirect();
+                wifi_station_reconnect_schedule();
             }
             break;
 
@@ -331,7 +654,9 @@ protected:
                 wifi_settings.intf[WIFI_INTF_STATION] != command.response.intf[WIFI_INTF_STATION];
 
         // Копирование настроек в промежуточный буфер
-        wifi_settings = command.response;
+        wifi_settings_mutex.enter();
+            wifi_settings = command.response;
+        wifi_settings_mutex.leave();
 
         // Изменение интерфейса
         {
@@ -396,10 +721,14 @@ protected:
 
                 // Канал
                 config.sta.channel = intf.channel;
+                // Данные последнего подключения к этой точке
+                wifi_station_directed = false;
+                wifi_station_cache_apply(config);
 
                 // Применение
                 ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &config));
                 LOGI("Connecting to AP \"%s\"...", intf.ssid);
+                wifi_station_backoff = WIFI_STATION_BACKOFF_MIN;
                 wifi_station_reconnect();
             }
         }
@@ -413,6 +742,7 @@ public:
     void reset(void)
     {
         requesting = true;
+        ready_set();
     }
 } wifi_command_handler_settings_get;
 
@@ -467,31 +797,10 @@ protected:
         switch (command.request.command)
         {
             case wifi_command_search_pool_request_t::COMMAND_POOL:
-                // Если всё еще запущен
-                if (wifi_net_finder.running_get())
-                {
-                    command.response.status = wifi_command_search_pool_response_t::STATUS_RUNNING;
-                    break;
-                }
-
-                // Если всё отдали
-                if (command.request.index >= wifi_net_finder.count_get())
-                {
-                    command.response.status = wifi_command_search_pool_response_t::STATUS_IDLE;
-                    break;
-                }
-
-                command.response.status = wifi_command_search_pool_response_t::STATUS_RECORD;
-
-                // Записываем точку
-                {
-                    auto &record = command.response.record;
-                    const auto &ap = wifi_net_finder.ap_records[command.request.index];
-
-                    memcpy(record.ssid, ap.ssid, sizeof(ap.ssid));
-                    record.rssi = ap.rssi;
-                    record.priv = ap.authmode != WIFI_AUTH_OPEN;
-                }
+                // Запущен ли еще (список забирается командой списка)
+                command.response.status = wifi_net_finder.running_get() ?
+                    wifi_command_search_pool_response_t::STATUS_RUNNING :
+                    wifi_command_search_pool_response_t::STATUS_IDLE;
                 break;
 
             case wifi_command_search_pool_request_t::COMMAND_START:
@@ -516,6 +825,28 @@ protected:
     }
 } wifi_command_handler_search_pool;
 
+// Обработчик команды получения списка найденных сетей
+static class wifi_command_handler_search_list_t : public ipc_responder_template_t<wifi_command_search_list_t>
+{
+protected:
+    // Обработка данных
+    virtual void work(bool idle) override final
+    {
+        if (idle)
+            return;
+
+        // Копирование списка (во время поиска он пуст)
+        wifi_net_finder.mutex.enter();
+            auto &response = command.response;
+            response.count = wifi_net_finder.count_get();
+            memcpy(response.records, wifi_net_finder.records, sizeof(response.records[0]) * response.count);
+        wifi_net_finder.mutex.leave();
+
+        // Отправляем ответ
+        transmit();
+    }
+} wifi_command_handler_search_list;
+
 // Вывод в лог MAC адрес указанного интерфейса
 static void wifi_log_mac(const char name[], wifi_interface_t intf)
 {
@@ -552,6 +883,11 @@ void wifi_init(void)
     wifi_settings.clear();
     // Обработчик событий ядра WiFi
     ESP_ERROR_CHECK(esp_event_loop_init(wifi_event_handler, NULL));
+    // Данные последнего подключения станции (NVS нужен и для калибровки PHY)
+    if (nvs_flash_init() == ESP_OK)
+        wifi_station_cache.load();
+    else
+        LOGW("NVS init failed, station cache disabled!");
     // Инициализация подсистемы WiFi
     ESP_ERROR_CHECK(esp_wifi_init(&INIT_CONFIG));
     // Вся конфигурация в ОЗУ
@@ -578,15 +914,29 @@ void wifi_init(void)
     core_handler_add(wifi_command_handler_info_get);
     core_handler_add(wifi_command_handler_ip_report);
     core_handler_add(wifi_command_handler_search_pool);
+    core_handler_add(wifi_command_handler_search_list);
     core_handler_add(wifi_command_handler_settings_get);
     core_handler_add(wifi_command_handler_settings_changed);
 
     // Таймер переподключения к точке доступа
     memory_clear(&wifi_station_reconnect_timer, sizeof(wifi_station_reconnect_timer));
     os_timer_setfn(&wifi_station_reconnect_timer, wifi_station_reconnect_handler, NULL);
+    // Таймер использования сохраненной аренды
+    memory_clear(&wifi_station_lease_timer, sizeof(wifi_station_lease_timer));
+    os_timer_setfn(&wifi_station_lease_timer, wifi_station_lease_handler, NULL);
 }
 
 bool wifi_wait(os_tick_t ticks)
 {
     return wifi_intf_event.wait(WIFI_INTF_EVENT_STATION | WIFI_INTF_EVENT_SOFTAP, false, ticks);
 }
+
+bool wifi_softap_password_get(char dest[WIFI_PASSWORD_LENGTH_MAX + 1])
+{
+    wifi_settings_mutex.enter();
+        memcpy(dest, wifi_settings.intf[WIFI_INTF_SOFTAP].password, sizeof(wifi_password_t));
+    wifi_settings_mutex.leave();
+    // Пароль может занимать весь буфер без нуля в конце
+    dest[sizeof(wifi_password_t)] = 0;
+    return dest[0] != 0;
+}
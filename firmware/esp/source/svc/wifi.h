@@ -7,5 +7,9 @@
 void wifi_init(void);
 // Ожидание появления сетевого интерфейса
 bool wifi_wait(os_tick_t ticks = OS_TICK_MIN);
+// Максимальная длинна пароля точки доступа
+#define WIFI_PASSWORD_LENGTH_MAX    13
+// Получает пароль точки доступа с нулем в конце (false - пароль не задан)
+bool wifi_softap_password_get(char dest[WIFI_PASSWORD_LENGTH_MAX + 1]);
 
 #endif // __WIFI_H
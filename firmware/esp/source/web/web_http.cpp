@@ -1,10 +1,9 @@
 #include <sha1.h>
 #include <base64.h>
 #include <system.h>
+#include <esp_timer.h>
 #include "web_http.h"
 
-//  
-#define WEB_HTTP_STR_CLR(x)         (x)[0] = 0
 //    
 #define WEB_HTTP_STR_MAX(x)         (sizeof(x) - 1)
 //   WebSocket
@@ -13,6 +12,11 @@
 #define WEB_HTTP_CRLF               "\r\n"
 //   MIME     UTF-8
 #define WEB_HTTP_CHARSET_UTF8       "; charset=utf-8" WEB_HTTP_CRLF
+//   FNV-1a  
+#define WEB_HTTP_HASH_BASIS         2166136261u
+#define WEB_HTTP_HASH_PRIME         16777619u
+//       
+#define WEB_HTTP_CONTENT_LENGTH_MAX 99999999
 
 // ---   --- //
 
@@ -29,6 +33,7 @@ static const char WEB_HTTP_STR_CRLF[] = WEB_HTTP_CRLF;
 static const char WEB_HTTP_STR_ROOT[] = "/";
 static const char WEB_HTTP_STR_INDEX[] = "index.html";
 static const char WEB_HTTP_STR_METHOD_GET[] = "GET";
+static const char WEB_HTTP_STR_METHOD_POST[] = "POST";
 static const char WEB_HTTP_STR_PROTO_VERSION_0[] = "HTTP/1.0";
 static const char WEB_HTTP_STR_PROTO_VERSION_1[] = "HTTP/1.1";
 static const char WEB_HTTP_STR_CONTENT_LENGTH[] = "Content-Length: ";
@@ -40,11 +45,16 @@ static const char WEB_HTTP_STR_WEBSOCKET_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0
 
 static const char WEB_HTTP_STR_STATUS_OK[] = " 200 OK" WEB_HTTP_CRLF;
 static const char WEB_HTTP_STR_STATUS_BAD_REQUEST[] = " 400 Bad Request" WEB_HTTP_CRLF;
+static const char WEB_HTTP_STR_STATUS_UNAUTHORIZED[] = " 401 Unauthorized" WEB_HTTP_CRLF;
 static const char WEB_HTTP_STR_STATUS_NOT_FOUND[] = " 404 Not Found" WEB_HTTP_CRLF;
 static const char WEB_HTTP_STR_STATUS_METHOD_NOT_ALLOWED[] = " 405 Method Not Allowed" WEB_HTTP_CRLF;
+static const char WEB_HTTP_STR_STATUS_CONFLICT[] = " 409 Conflict" WEB_HTTP_CRLF;
+static const char WEB_HTTP_STR_STATUS_LENGTH_REQUIRED[] = " 411 Length Required" WEB_HTTP_CRLF;
+static const char WEB_HTTP_STR_STATUS_PAYLOAD_TOO_LARGE[] = " 413 Payload Too Large" WEB_HTTP_CRLF;
 static const char WEB_HTTP_STR_STATUS_URI_TOO_LONG[] = " 414 URI Too Long" WEB_HTTP_CRLF;
 static const char WEB_HTTP_STR_STATUS_IM_A_TEAPOT[] = " 418 Im a teapot" WEB_HTTP_CRLF;
 static const char WEB_HTTP_STR_STATUS_UPGRADE_REQUIRED[] = " 426 Upgrade Required" WEB_HTTP_CRLF;
+static const char WEB_HTTP_STR_STATUS_INTERNAL_SERVER_ERROR[] = " 500 Internal Server Error" WEB_HTTP_CRLF;
 static const char WEB_HTTP_STR_STATUS_SWITCHING_PROTOCOLS[] = " 101 Switching Protocols" WEB_HTTP_CRLF;
 
 // ---    --- //
@@ -76,6 +86,10 @@ static const char WEB_HTTP_STR_HEADER_UPGRADE[] = "upgrade";
 static const char WEB_HTTP_STR_HEADER_UPGRADE_WEBSOCKET[] = "websocket";
 static const char WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_LOWER[] = "sec-websocket-version";
 static const char WEB_HTTP_STR_HEADER_WEBSOCKET_KEY[] = "sec-websocket-key";
+static const char WEB_HTTP_STR_HEADER_CONTENT_LENGTH[] = "content-length";
+static const char WEB_HTTP_STR_HEADER_AUTHORIZATION[] = "authorization";
+static const char WEB_HTTP_STR_HEADER_AUTHENTICATE[] = "WWW-Authenticate: ";
+static const char WEB_HTTP_STR_HEADER_AUTHENTICATE_BASIC[] = "Basic realm=\"NixieClock\"" WEB_HTTP_CRLF;
 static const char WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_NORAML[] = "Sec-WebSocket-Version: ";
 static const char WEB_HTTP_STR_HEADER_WEBSOCKET_ACCEPT[] = "Sec-WebSocket-Accept: ";
 static const char WEB_HTTP_STR_HEADER_FINAL_DEFAULT[] =
@@ -87,16 +101,69 @@ static const char WEB_HTTP_STR_HEADER_FINAL_UPGRADE[] =
     "Upgrade: WebSocket" WEB_HTTP_CRLF
     "Connection: Upgrade" WEB_HTTP_CRLF WEB_HTTP_CRLF;
 
+// ---    --- //
+
+//  FNV-1a       
+static constexpr uint32_t web_http_hash(const char *s, uint32_t hash = WEB_HTTP_HASH_BASIS)
+{
+    return *s == WEB_HTTP_SYM_ZERO ? hash : web_http_hash(s + 1, (hash ^ (uint8_t)*s) * WEB_HTTP_HASH_PRIME);
+}
+
+//        
+#define WEB_HTTP_TOKEN(str)         { WEB_HTTP_STR_MAX(str), web_http_hash(str), str }
+
+//   
+static const struct web_http_token_t
+{
+    // 
+    size_t length;
+    // 
+    uint32_t hash;
+    //    
+    const char *str;
+}
+    WEB_HTTP_TOKEN_HEADER_CONNECTION = WEB_HTTP_TOKEN(WEB_HTTP_STR_HEADER_CONNECTION),
+    WEB_HTTP_TOKEN_HEADER_CONNECTION_CLOSED = WEB_HTTP_TOKEN(WEB_HTTP_STR_HEADER_CONNECTION_CLOSED),
+    WEB_HTTP_TOKEN_HEADER_CONNECTION_UPGRADE = WEB_HTTP_TOKEN(WEB_HTTP_STR_HEADER_CONNECTION_UPGRADE),
+    WEB_HTTP_TOKEN_HEADER_UPGRADE = WEB_HTTP_TOKEN(WEB_HTTP_STR_HEADER_UPGRADE),
+    WEB_HTTP_TOKEN_HEADER_UPGRADE_WEBSOCKET = WEB_HTTP_TOKEN(WEB_HTTP_STR_HEADER_UPGRADE_WEBSOCKET),
+    WEB_HTTP_TOKEN_HEADER_WEBSOCKET_VERSION = WEB_HTTP_TOKEN(WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_LOWER),
+    WEB_HTTP_TOKEN_HEADER_WEBSOCKET_KEY = WEB_HTTP_TOKEN(WEB_HTTP_STR_HEADER_WEBSOCKET_KEY),
+    WEB_HTTP_TOKEN_HEADER_CONTENT_LENGTH = WEB_HTTP_TOKEN(WEB_HTTP_STR_HEADER_CONTENT_LENGTH),
+    WEB_HTTP_TOKEN_HEADER_AUTHORIZATION = WEB_HTTP_TOKEN(WEB_HTTP_STR_HEADER_AUTHORIZATION);
+
+//      (  ,     )
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONNECTION) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_UPGRADE));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONNECTION) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_KEY));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONNECTION) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_LOWER));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_UPGRADE) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_KEY));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_UPGRADE) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_LOWER));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_KEY) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_LOWER));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONTENT_LENGTH) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONNECTION));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONTENT_LENGTH) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_UPGRADE));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONTENT_LENGTH) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_KEY));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONTENT_LENGTH) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_LOWER));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_AUTHORIZATION) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONNECTION));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_AUTHORIZATION) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_UPGRADE));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_AUTHORIZATION) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_KEY));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_AUTHORIZATION) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_LOWER));
+STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_AUTHORIZATION) != WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONTENT_LENGTH));
+
 //  HTTP 
 const web_http_handler_t::http_status_text_t web_http_handler_t::HTTP_STATUSES[] =
 {
     { HTTP_STATUS_OK,                   WEB_HTTP_STR_STATUS_OK },
     { HTTP_STATUS_BAD_REQUEST,          WEB_HTTP_STR_STATUS_BAD_REQUEST },
+    { HTTP_STATUS_UNAUTHORIZED,         WEB_HTTP_STR_STATUS_UNAUTHORIZED },
     { HTTP_STATUS_NOT_FOUND,            WEB_HTTP_STR_STATUS_NOT_FOUND },
     { HTTP_STATUS_METHOD_NOT_ALLOWED,   WEB_HTTP_STR_STATUS_METHOD_NOT_ALLOWED },
+    { HTTP_STATUS_CONFLICT,             WEB_HTTP_STR_STATUS_CONFLICT },
+    { HTTP_STATUS_LENGTH_REQUIRED,      WEB_HTTP_STR_STATUS_LENGTH_REQUIRED },
+    { HTTP_STATUS_PAYLOAD_TOO_LARGE,    WEB_HTTP_STR_STATUS_PAYLOAD_TOO_LARGE },
     { HTTP_STATUS_URI_TOO_LONG,         WEB_HTTP_STR_STATUS_URI_TOO_LONG },
     { HTTP_STATUS_IM_A_TEAPOT,          WEB_HTTP_STR_STATUS_IM_A_TEAPOT },
     { HTTP_STATUS_UPGRADE_REQUIRED,     WEB_HTTP_STR_STATUS_UPGRADE_REQUIRED },
+    { HTTP_STATUS_INTERNAL_SERVER_ERROR,WEB_HTTP_STR_STATUS_INTERNAL_SERVER_ERROR },
     { HTTP_STATUS_SWITCHING_PROTOCOLS,  WEB_HTTP_STR_STATUS_SWITCHING_PROTOCOLS },
 };
 
@@ -115,6 +182,9 @@ const web_http_handler_t::content_type_t web_http_handler_t::CONTENT_TYPES[] =
 //   WebSocket 
 static sha1_t web_hhtp_sha1;
 
+//   HTTP 
+web_http_stat_t web_http_stat;
+
 // ---  --- //
 
 const char * web_http_handler_t::http_status_text(http_status_t code)
@@ -127,6 +197,25 @@ const char * web_http_handler_t::http_status_text(http_status_t code)
     return NULL;
 }
 
+web_http_handler_t::http_status_t web_http_handler_t::upload_status(web_http_upload_status_t status)
+{
+    switch (status)
+    {
+        case WEB_HTTP_UPLOAD_STATUS_OK:
+            return HTTP_STATUS_OK;
+        case WEB_HTTP_UPLOAD_STATUS_NOT_FOUND:
+            return HTTP_STATUS_NOT_FOUND;
+        case WEB_HTTP_UPLOAD_STATUS_BUSY:
+            return HTTP_STATUS_CONFLICT;
+        case WEB_HTTP_UPLOAD_STATUS_TOO_LARGE:
+            return HTTP_STATUS_PAYLOAD_TOO_LARGE;
+        case WEB_HTTP_UPLOAD_STATUS_UNAUTHORIZED:
+            return HTTP_STATUS_UNAUTHORIZED;
+        default:
+            return HTTP_STATUS_INTERNAL_SERVER_ERROR;
+    }
+}
+
 const char * web_http_handler_t::content_type_mime(const char *ext)
 {
     for (auto i = 0; i < array_length(CONTENT_TYPES); i++)
@@ -135,26 +224,6 @@ const char * web_http_handler_t::content_type_mime(const char *ext)
     return NULL;
 }
 
-bool web_http_handler_t::str_cat(char *dest, char c, size_t n)
-{
-    auto len = strlen(dest);
-    if (len >= n)
-        return true;
-    dest[len++] = c;
-    dest[len] = WEB_HTTP_SYM_ZERO;
-    return false;
-}
-
-//      
-char * web_http_handler_t::str_lower(char *s)
-{
-    auto len = strlen(s);
-    for (size_t i = 0; i < len; i++)
-        if (s[i] >= 'A' && s[i] <= 'Z')
-            s[i] += 32;
-    return s;
-}
-
 bool web_http_handler_t::path_check(char c)
 {
     if ((c >= 'a' && c <= 'z') ||
@@ -176,53 +245,163 @@ bool web_http_handler_t::path_check(char c)
 void web_http_handler_t::request_t::clear(void)
 {
     state = STATE_METHOD;
-    WEB_HTTP_STR_CLR(headers.path);
-    WEB_HTTP_STR_CLR(headers.method);
-    WEB_HTTP_STR_CLR(headers.version);
+    header = HEADER_UNKNOWN;
+    token_reset();
+    body_offset = 0;
+    headers.method = HTTP_METHOD_GET;
+    headers.content_length = 0;
+    headers.path[0] = WEB_HTTP_SYM_ZERO;
+    headers.path_length = 0;
+    headers.authorization[0] = WEB_HTTP_SYM_ZERO;
+    headers.authorization_length = 0;
     headers.websocket.version = 0;
     headers.upgrade = HTTP_HEADER_UPGRADE_UNKNOWN;
     headers.connection = HTTP_HEADER_CONNECTION_UNKNOWN;
-    WEB_HTTP_STR_CLR(headers.websocket.key);
+    headers.websocket.key[0] = WEB_HTTP_SYM_ZERO;
+    headers.websocket.key_length = 0;
+}
+
+void web_http_handler_t::request_t::token_reset(void)
+{
+    length = 0;
+    hash = WEB_HTTP_HASH_BASIS;
+}
+
+void web_http_handler_t::request_t::token_append(char c)
+{
+    //    
+    if (c >= 'A' && c <= 'Z')
+        c += 32;
+    hash = (hash ^ (uint8_t)c) * WEB_HTTP_HASH_PRIME;
+    if (length < sizeof(token))
+        token[length] = c;
+    length++;
+}
+
+bool web_http_handler_t::request_t::token_match(const web_http_token_t &expected) const
+{
+    //    ,    
+    return length == expected.length && hash == expected.hash && !memcmp(token, expected.str, length);
+}
+
+web_http_handler_t::request_t::header_t web_http_handler_t::request_t::header_find(void) const
+{
+    //     
+    STATIC_ASSERT(WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_LOWER) <= sizeof(token));
+    
+    //    ,     
+    const web_http_token_t *token;
+    header_t result;
+    switch (length)
+    {
+        case WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONNECTION):
+            token = &WEB_HTTP_TOKEN_HEADER_CONNECTION;
+            result = HEADER_CONNECTION;
+            break;
+        case WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_UPGRADE):
+            token = &WEB_HTTP_TOKEN_HEADER_UPGRADE;
+            result = HEADER_UPGRADE;
+            break;
+        case WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_LOWER):
+            token = &WEB_HTTP_TOKEN_HEADER_WEBSOCKET_VERSION;
+            result = HEADER_WEBSOCKET_VERSION;
+            break;
+        case WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_WEBSOCKET_KEY):
+            token = &WEB_HTTP_TOKEN_HEADER_WEBSOCKET_KEY;
+            result = HEADER_WEBSOCKET_KEY;
+            break;
+        case WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_CONTENT_LENGTH):
+            token = &WEB_HTTP_TOKEN_HEADER_CONTENT_LENGTH;
+            result = HEADER_CONTENT_LENGTH;
+            break;
+        case WEB_HTTP_STR_MAX(WEB_HTTP_STR_HEADER_AUTHORIZATION):
+            token = &WEB_HTTP_TOKEN_HEADER_AUTHORIZATION;
+            result = HEADER_AUTHORIZATION;
+            break;
+        default:
+            return HEADER_UNKNOWN;
+    }
+    return token_match(*token) ? result : HEADER_UNKNOWN;
+}
+
+web_http_handler_t::http_status_t web_http_handler_t::request_t::header_apply(void)
+{
+    switch (header)
+    {
+        case HEADER_CONNECTION:
+            if (token_match(WEB_HTTP_TOKEN_HEADER_CONNECTION_CLOSED))
+                headers.connection = HTTP_HEADER_CONNECTION_CLOSED;
+            else if (token_match(WEB_HTTP_TOKEN_HEADER_CONNECTION_UPGRADE))
+                headers.connection = HTTP_HEADER_CONNECTION_UPGRADE;
+            break;
+        case HEADER_UPGRADE:
+            if (token_match(WEB_HTTP_TOKEN_HEADER_UPGRADE_WEBSOCKET))
+                headers.upgrade = HTTP_HEADER_UPGRADE_WEBSOCKET;
+            break;
+        case HEADER_WEBSOCKET_KEY:
+            headers.websocket.key[headers.websocket.key_length] = WEB_HTTP_SYM_ZERO;
+            break;
+        case HEADER_AUTHORIZATION:
+            headers.authorization[headers.authorization_length] = WEB_HTTP_SYM_ZERO;
+            break;
+        default:
+            //      ,   
+            break;
+    }
+    return HTTP_STATUS_NA;
 }
 
 web_http_handler_t::http_status_t web_http_handler_t::request_t::process(const web_slot_buffer_t data, size_t size)
 {
     for (size_t offset = 0; offset < size; offset++)
     {
-        auto c = data[offset];
+        auto c = (char)data[offset];
         switch (state)
         {
             case STATE_METHOD:
-                if (c == WEB_HTTP_SYM_SPACE)
                 {
-                    if (strcmp(headers.method, WEB_HTTP_STR_METHOD_GET))
+                    //     
+                    if (length <= 0)
+                        headers.method = (c == WEB_HTTP_STR_METHOD_POST[0]) ? HTTP_METHOD_POST : HTTP_METHOD_GET;
+                    auto method = (headers.method == HTTP_METHOD_POST) ? WEB_HTTP_STR_METHOD_POST : WEB_HTTP_STR_METHOD_GET;
+                    if (c == WEB_HTTP_SYM_SPACE)
+                    {
+                        if (length <= 0 || method[length] != WEB_HTTP_SYM_ZERO)
+                            return HTTP_STATUS_METHOD_NOT_ALLOWED;
+                        state = STATE_PATH;
+                    }
+                    else if (method[length] == WEB_HTTP_SYM_ZERO || c != method[length++])
                         return HTTP_STATUS_METHOD_NOT_ALLOWED;
-                    state = STATE_PATH;
                 }
-                else if (str_cat(headers.method, c, WEB_HTTP_STR_MAX(headers.method)))
-                    return HTTP_STATUS_METHOD_NOT_ALLOWED;
                 break;
             case STATE_PATH:
                 if (c == WEB_HTTP_SYM_SPACE)
                 {
-                    if (strlen(headers.path) <= 0)
+                    if (headers.path_length <= 0)
                         return HTTP_STATUS_BAD_REQUEST;
+                    headers.path[headers.path_length] = WEB_HTTP_SYM_ZERO;
+                    token_reset();
                     state = STATE_VERSION;
                 }
-                else if (path_check(c) || str_cat(headers.path, c, WEB_HTTP_STR_MAX(headers.path)))
+                else if (path_check(c) || headers.path_length >= WEB_HTTP_STR_MAX(headers.path))
                     return HTTP_STATUS_URI_TOO_LONG;
+                else
+                    headers.path[headers.path_length++] = c;
                 break;
             case STATE_VERSION:
                 if (c == WEB_HTTP_SYM_CR)
                 {
-                    if (strcmp(headers.version, WEB_HTTP_STR_PROTO_VERSION_1) &&
-                        strcmp(headers.version, WEB_HTTP_STR_PROTO_VERSION_0))
+                    if (length != WEB_HTTP_STR_MAX(WEB_HTTP_STR_PROTO_VERSION_1))
                         return HTTP_STATUS_BAD_REQUEST;
                     end_detect = 1;
                     state = STATE_END_LF;
                 }
-                else if (str_cat(headers.version, c, WEB_HTTP_STR_MAX(headers.version)))
+                //     
+                else if (length >= WEB_HTTP_STR_MAX(WEB_HTTP_STR_PROTO_VERSION_1) ||
+                    (c != WEB_HTTP_STR_PROTO_VERSION_1[length] && c != WEB_HTTP_STR_PROTO_VERSION_0[length]))
                     return HTTP_STATUS_BAD_REQUEST;
+                else
+                    length++;
                 break;
 
             case STATE_END_HN:
@@ -230,7 +409,7 @@ web_http_handler_t::http_status_t web_http_handler_t::request_t::process(const w
                 if (c == WEB_HTTP_SYM_CR)
                 {
                     //      -     
-                    if (strlen(headers.temp.name) > 0)
+                    if (length > 0)
                         return HTTP_STATUS_BAD_REQUEST;
                     state = STATE_END_LF;
                     break;
@@ -242,22 +421,16 @@ web_http_handler_t::http_status_t web_http_handler_t::request_t::process(const w
                 //   -  
                 if (c == WEB_HTTP_SYM_SP)
                 {
-                    str_lower(headers.temp.name);
-                    //    
-                    WEB_HTTP_STR_CLR(headers.temp.value);
-                    state = STATE_END_HV;
+                    header = header_find();
+                    token_reset();
+                    //     
+                    state = (header == HEADER_UNKNOWN) ? STATE_END_CR : STATE_END_HV;
                     break;
                 }
                 //     
                 if (c == WEB_HTTP_SYM_LF)
                     return HTTP_STATUS_BAD_REQUEST;
-                // 
-                if (str_cat(headers.temp.name, c, WEB_HTTP_STR_MAX(headers.temp.name)))
-                {
-                    //   -   ,      
-                    state = STATE_END_CR;
-                    break;
-                }
+                token_append(c);
                 break;
 
             case STATE_END_HV:
@@ -270,56 +443,79 @@ web_http_handler_t::http_status_t web_http_handler_t::request_t::process(const w
                 //   
                 if (c == WEB_HTTP_SYM_CR)
                 {
-                    //    
-                    if (!strcmp(headers.temp.name, WEB_HTTP_STR_HEADER_CONNECTION))
-                    {
-                        str_lower(headers.temp.value);
-                        if (!strcmp(headers.temp.value, WEB_HTTP_STR_HEADER_CONNECTION_CLOSED))
-                            headers.connection = HTTP_HEADER_CONNECTION_CLOSED;
-                        else if (!strcmp(headers.temp.value, WEB_HTTP_STR_HEADER_CONNECTION_UPGRADE))
-                            headers.connection = HTTP_HEADER_CONNECTION_UPGRADE;
-                    }
-                    else if (!strcmp(headers.temp.name, WEB_HTTP_STR_HEADER_UPGRADE))
-                    {
-                        str_lower(headers.temp.value);
-                        if (!strcmp(headers.temp.value, WEB_HTTP_STR_HEADER_UPGRADE_WEBSOCKET))
-                            headers.upgrade = HTTP_HEADER_UPGRADE_WEBSOCKET;
-                    }
-                    else if (!strcmp(headers.temp.name, WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_LOWER))
-                        sscanf(headers.temp.value, "%d", &headers.websocket.version);
-                    else if (!strcmp(headers.temp.name, WEB_HTTP_STR_HEADER_WEBSOCKET_KEY))
-                    {
-                        //  
-                        if (strlen(headers.temp.value) >= sizeof(headers.websocket.key))
-                            return HTTP_STATUS_BAD_REQUEST;
-                        strcpy(headers.websocket.key, headers.temp.value);
-                    }
-                    //   ,    
+                    //  ,    
+                    auto status = header_apply();
+                    if (status != HTTP_STATUS_NA)
+                        return status;
                     state = STATE_END_LF;
                     break;
                 }
-                // 
-                if (str_cat(headers.temp.value, c, WEB_HTTP_STR_MAX(headers.temp.value)))
+                switch (header)
                 {
-                    //   -   ,      
-                    state = STATE_END_CR;
-                    break;
+                    case HEADER_WEBSOCKET_KEY:
+                        //  
+                        if (headers.websocket.key_length >= WEB_HTTP_STR_MAX(headers.websocket.key))
+                            return HTTP_STATUS_BAD_REQUEST;
+                        headers.websocket.key[headers.websocket.key_length++] = c;
+                        break;
+                    case HEADER_AUTHORIZATION:
+                        //      , 
+                        if (headers.authorization_length >= WEB_HTTP_STR_MAX(headers.authorization))
+                        {
+                            headers.authorization[0] = WEB_HTTP_SYM_ZERO;
+                            headers.authorization_length = 0;
+                            state = STATE_END_CR;
+                            break;
+                        }
+                        headers.authorization[headers.authorization_length++] = c;
+                        break;
+                    case HEADER_WEBSOCKET_VERSION:
+                        //     
+                        if (c >= '0' && c <= '9' && headers.websocket.version < 1000)
+                            headers.websocket.version = headers.websocket.version * 10 + (c - '0');
+                        else
+                            state = STATE_END_CR;
+                        break;
+                    case HEADER_CONTENT_LENGTH:
+                        //     
+                        if (c < '0' || c > '9')
+                            state = STATE_END_CR;
+                        else if (headers.content_length > WEB_HTTP_CONTENT_LENGTH_MAX / 10)
+                            return HTTP_STATUS_PAYLOAD_TOO_LARGE;
+                        else
+                            headers.content_length = headers.content_length * 10 + (c - '0');
+                        break;
+                    default:
+                        token_append(c);
+                        break;
                 }
                 break;
 
             case STATE_END_CR:
-                if (c == WEB_HTTP_SYM_CR)
+                {
+                    //      
+                    auto cr = (const uint8_t *)memchr(data + offset, WEB_HTTP_SYM_CR, size - offset);
+                    if (cr == NULL)
+                    {
+                        offset = size;
+                        break;
+                    }
+                    offset = (size_t)(cr - data);
                     state = STATE_END_LF;
-                else
-                    end_detect++;
+                }
                 break;
             case STATE_END_LF:
                 if (c != WEB_HTTP_SYM_LF)
                     return HTTP_STATUS_BAD_REQUEST;
                 if (!end_detect)
+                {
+                    //     
+                    body_offset = offset + 1;
                     return HTTP_STATUS_OK;
-                //    
-                WEB_HTTP_STR_CLR(headers.temp.name);
+                }
+                //    
+                header = HEADER_UNKNOWN;
+                token_reset();
                 state = STATE_END_HN;
                 end_detect = 0;
                 break;
@@ -333,6 +529,8 @@ void web_http_handler_t::response_t::clear(void)
     total = 0;
     mime = NULL;
     file = fs_file_t();
+    body = NULL;
+    body_size = 0;
     state = STATE_INITIAL;
     header.dynamic.name = NULL;
     header.dynamic.value = NULL;
@@ -391,7 +589,7 @@ size_t web_http_handler_t::response_t::process(web_slot_buffer_t dest)
 
             // ---   --- //
             case STATE_CONTENT_LENGTH_HEAD:
-                if (!file.opened())
+                if (!file.opened() && body == NULL)
                 {
                     state = STATE_DYNAMIC_HEADER_NAME;
                     continue;
@@ -400,7 +598,7 @@ size_t web_http_handler_t::response_t::process(web_slot_buffer_t dest)
             case STATE_CONTENT_LENGTH_BODY:
                 {
                     char buf[9]; //  999999 
-                    auto size = file.size();
+                    auto size = body != NULL ? body_size : file.size();
                     assert(size <= 9999999);
                     sprintf(buf, WEB_HTTP_STR_FRM_NUMBER_CRLF, size);
                     return send_str(dest, buf, strlen(buf));
@@ -426,6 +624,15 @@ size_t web_http_handler_t::response_t::process(web_slot_buffer_t dest)
 
             // ---   --- //
             case STATE_CONTENT:
+                //  
+                if (body != NULL)
+                {
+                    if (offset <= 0)
+                        total = body_size;
+                    auto size = minimum(sizeof(web_slot_buffer_t), total);
+                    memcpy(dest, body + offset, size);
+                    return size;
+                }
                 //    -    
                 if (offset <= 0)
                     total = file.size();
@@ -447,20 +654,60 @@ void web_http_handler_t::clear(void)
     request.clear();
     response.clear();
     responsing = false;
+    uploading = false;
+    timing = false;
+    upload_remain = 0;
 }
 
 void web_http_handler_t::free(web_slot_free_reason_t reason)
 {
+    //  
+    if (uploading)
+    {
+        socket->log("Upload aborted, %d bytes remain", upload_remain);
+        upload->upload_end(false);
+    }
     //  
     web_slot_handler_t::free(reason);
     //  
     response.file.close();
+    //   
+    if (response.body != NULL)
+        content->content_close();
     //  
     clear();
 }
 
 void web_http_handler_t::process(web_slot_buffer_t buffer)
 {
+    //  
+    if (request.headers.method == HTTP_METHOD_POST)
+    {
+        if (upload == NULL)
+        {
+            response.status = HTTP_STATUS_METHOD_NOT_ALLOWED;
+            return;
+        }
+        if (request.headers.content_length <= 0)
+        {
+            response.status = HTTP_STATUS_LENGTH_REQUIRED;
+            return;
+        }
+        socket->log("Upload %s, %d bytes", request.headers.path, request.headers.content_length);
+        response.status = upload_status(upload->upload_begin(request.headers.path, request.headers.content_length, request.headers.authorization));
+        //     
+        if (response.status == HTTP_STATUS_UNAUTHORIZED)
+        {
+            response.header.dynamic.name = WEB_HTTP_STR_HEADER_AUTHENTICATE;
+            response.header.dynamic.value = WEB_HTTP_STR_HEADER_AUTHENTICATE_BASIC;
+        }
+        if (response.status != HTTP_STATUS_OK)
+            return;
+        //     
+        uploading = true;
+        upload_remain = request.headers.content_length;
+        return;
+    }
     //   WebSocket
     if (request.headers.connection == HTTP_HEADER_CONNECTION_UPGRADE)
     {
@@ -471,13 +718,13 @@ void web_http_handler_t::process(web_slot_buffer_t buffer)
             return;
         }
         //      
-        response.header.dynamic.value = request.headers.temp.value;
+        response.header.dynamic.value = response.buffer;
         //     WebSocket
         if (request.headers.websocket.version != WEB_HTTP_WEBSOCKET_VERSION)
         {
             response.status = HTTP_STATUS_UPGRADE_REQUIRED;
             response.header.dynamic.name = WEB_HTTP_STR_HEADER_WEBSOCKET_VERSION_NORAML;
-            sprintf(request.headers.temp.value, WEB_HTTP_STR_FRM_NUMBER_CRLF, WEB_HTTP_WEBSOCKET_VERSION);
+            sprintf(response.buffer, WEB_HTTP_STR_FRM_NUMBER_CRLF, WEB_HTTP_WEBSOCKET_VERSION);
             return;
         }
         //     
@@ -486,22 +733,27 @@ void web_http_handler_t::process(web_slot_buffer_t buffer)
         response.header.dynamic.name = WEB_HTTP_STR_HEADER_WEBSOCKET_ACCEPT;
         //  
         web_hhtp_sha1.reset();
-        web_hhtp_sha1.update(request.headers.websocket.key, strlen(request.headers.websocket.key));
+        web_hhtp_sha1.update(request.headers.websocket.key, request.headers.websocket.key_length);
         web_hhtp_sha1.update(WEB_HTTP_STR_WEBSOCKET_GUID, strlen(WEB_HTTP_STR_WEBSOCKET_GUID));
         //  base64
-        base64_encode(request.headers.temp.value, web_hhtp_sha1.final(), SHA1_HASH_SIZE);
-        socket->log("WebSocket handshake %s", request.headers.temp.value);
-        strcat(request.headers.temp.value, WEB_HTTP_STR_CRLF);
+        base64_encode(response.buffer, web_hhtp_sha1.final(), SHA1_HASH_SIZE);
+        socket->log("WebSocket handshake %s", response.buffer);
+        strcat(response.buffer, WEB_HTTP_STR_CRLF);
         return;
     }
     //   
-    if (!strcmp(request.headers.path, WEB_HTTP_STR_ROOT))
-        strcat(request.headers.path, WEB_HTTP_STR_INDEX);
+    if (request.headers.path_length == WEB_HTTP_STR_MAX(WEB_HTTP_STR_ROOT) && request.headers.path[0] == WEB_HTTP_STR_ROOT[0])
+    {
+        strcpy(request.headers.path + request.headers.path_length, WEB_HTTP_STR_INDEX);
+        request.headers.path_length += WEB_HTTP_STR_MAX(WEB_HTTP_STR_INDEX);
+    }
     socket->log("Request %s", request.headers.path);
+    //  
+    if (content != NULL && content->content_open(request.headers.path, response.mime, response.body, response.body_size))
+        return;
     //   
     size_t found = 0;
-    auto size = strlen(request.headers.path);
-    for (auto i = size - 1; i > 0; i--)
+    for (auto i = request.headers.path_length - 1; i > 0; i--)
         if (request.headers.path[i] == WEB_HTTP_SYM_DOT)
         {
             found = i + 1;
@@ -547,21 +799,48 @@ void web_http_handler_t::execute(web_slot_buffer_t buffer)
         if (size == 0)
             //   
             return;
-        //   
-        response.status = request.process(buffer, (size_t)size);
-        if (response.status == HTTP_STATUS_NA)
-            //    
+        //       
+        if (!timing)
+        {
+            timing = true;
+            request_time = (uint32_t)esp_timer_get_time();
+        }
+        //      
+        size_t offset = 0;
+        if (!uploading)
+        {
+            //   
+            response.status = request.process(buffer, (size_t)size);
+            if (response.status == HTTP_STATUS_NA)
+                //    
+                return;
+            //   
+            if (response.status == HTTP_STATUS_OK)
+                process(buffer);
+            offset = request.body_offset;
+        }
+        //   
+        if (uploading && !upload_process(buffer + offset, (size_t)size - offset))
             return;
         //  
         responsing = true;
-        //   
-        if (response.status == HTTP_STATUS_OK)
-            process(buffer);
     }
     //   
     size = response.process(buffer);
     if (size <= 0)
     {
+        //   
+        if (timing)
+        {
+            const auto elapsed = (uint32_t)esp_timer_get_time() - request_time;
+            timing = false;
+            web_http_stat.count++;
+            web_http_stat.total_us += elapsed;
+            if (web_http_stat.max_us < elapsed)
+                web_http_stat.max_us = elapsed;
+            if (response.status >= HTTP_STATUS_BAD_REQUEST)
+                web_http_stat.errors++;
+        }
         //   WebSocket 
         if (response.status == HTTP_STATUS_SWITCHING_PROTOCOLS)
         {
@@ -594,6 +873,28 @@ void web_http_handler_t::execute(web_slot_buffer_t buffer)
     response.process_feedback((size_t)size);
 }
 
+bool web_http_handler_t::upload_process(const uint8_t *data, size_t size)
+{
+    //      
+    size = minimum(size, upload_remain);
+    if (size > 0 && !upload->upload_write(data, size))
+    {
+        socket->log("Upload write failed!");
+        upload->upload_end(false);
+        uploading = false;
+        response.status = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+        return true;
+    }
+    upload_remain -= size;
+    if (upload_remain > 0)
+        return false;
+    //   
+    uploading = false;
+    response.status = upload_status(upload->upload_end(true));
+    socket->log("Upload complete, status %d", response.status);
+    return true;
+}
+
 bool web_http_handler_t::allocate(web_slot_socket_t &socket)
 {
     auto result = web_slot_handler_t::allocate(socket);
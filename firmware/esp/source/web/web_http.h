@@ -5,6 +5,64 @@
 #include <fs.h>
 #include "web_slot.h"
 
+//    ( )
+struct web_http_token_t;
+
+//    
+enum web_http_upload_status_t
+{
+    // 
+    WEB_HTTP_UPLOAD_STATUS_OK,
+    //    
+    WEB_HTTP_UPLOAD_STATUS_NOT_FOUND,
+    //    
+    WEB_HTTP_UPLOAD_STATUS_BUSY,
+    //    
+    WEB_HTTP_UPLOAD_STATUS_TOO_LARGE,
+    //    
+    WEB_HTTP_UPLOAD_STATUS_UNAUTHORIZED,
+    //  
+    WEB_HTTP_UPLOAD_STATUS_FAILED,
+};
+
+//    ( POST )
+class web_http_upload_t
+{
+public:
+    //        (auth -   Authorization  )
+    virtual web_http_upload_status_t upload_begin(const char *path, size_t size, const char *auth) = 0;
+    //   
+    virtual bool upload_write(const uint8_t *data, size_t size) = 0;
+    //   (complete -    )
+    virtual web_http_upload_status_t upload_end(bool complete) = 0;
+};
+
+//    (  )
+class web_http_content_t
+{
+public:
+    //     (false -   ), MIME    ,    
+    virtual bool content_open(const char *path, const char *&mime, const char *&data, size_t &size) = 0;
+    //  
+    virtual void content_close(void) = 0;
+};
+
+//   HTTP 
+struct web_http_stat_t
+{
+    //   
+    uint32_t count;
+    //     ( 400  )
+    uint32_t errors;
+    //    []
+    uint32_t max_us;
+    //    []
+    uint64_t total_us;
+};
+
+//   HTTP  (    )
+extern web_http_stat_t web_http_stat;
+
 //  HTTP 
 class web_http_handler_t : public web_slot_handler_t
 {
@@ -19,16 +77,35 @@ class web_http_handler_t : public web_slot_handler_t
         HTTP_STATUS_OK = 200,
         //   
         HTTP_STATUS_BAD_REQUEST = 400,
+        //  
+        HTTP_STATUS_UNAUTHORIZED = 401,
         //   
         HTTP_STATUS_NOT_FOUND = 404,
         //   
         HTTP_STATUS_METHOD_NOT_ALLOWED = 405,
+        //    
+        HTTP_STATUS_CONFLICT = 409,
+        //     
+        HTTP_STATUS_LENGTH_REQUIRED = 411,
+        //    
+        HTTP_STATUS_PAYLOAD_TOO_LARGE = 413,
         //    
         HTTP_STATUS_URI_TOO_LONG = 414,
         //  
         HTTP_STATUS_IM_A_TEAPOT = 418,
         //   
         HTTP_STATUS_UPGRADE_REQUIRED = 426,
+        //  
+        HTTP_STATUS_INTERNAL_SERVER_ERROR = 500,
+    };
+
+    //  
+    enum http_method_t
+    {
+        //  
+        HTTP_METHOD_GET,
+        //  
+        HTTP_METHOD_POST,
     };
 
     //      
@@ -53,8 +130,20 @@ class web_http_handler_t : public web_slot_handler_t
 
     // , ,   
     bool responsing;
+    // , ,     
+    bool uploading;
+    // , ,     
+    bool timing;
+    //     []
+    uint32_t request_time;
+    //    
+    size_t upload_remain;
     //  WebSocket
     web_slot_handler_allocator_t *ws;
+    //  
+    web_http_upload_t *upload;
+    //   
+    web_http_content_t *content;
     //  
     class request_t
     {
@@ -69,18 +158,52 @@ class web_http_handler_t : public web_slot_handler_t
             STATE_END_HN,
             STATE_END_HV,
         } state;
+        //  
+        enum header_t
+        {
+            HEADER_UNKNOWN,
+            HEADER_CONNECTION,
+            HEADER_UPGRADE,
+            HEADER_WEBSOCKET_VERSION,
+            HEADER_WEBSOCKET_KEY,
+            HEADER_CONTENT_LENGTH,
+            HEADER_AUTHORIZATION,
+        } header;
         //   
         size_t end_detect;
+        //    (, ,    )
+        size_t length;
+        //      
+        uint32_t hash;
+        //       (   )
+        char token[24];
+
+        //   
+        void token_reset(void);
+        //    
+        void token_append(char c);
+        // ,      
+        bool token_match(const web_http_token_t &expected) const;
+        //       
+        header_t header_find(void) const;
+        //      
+        http_status_t header_apply(void);
     public:
         //   
         struct
         {
             // 
-            char method[4];
+            http_method_t method;
+            //   
+            size_t content_length;
             //  
             char path[32];
-            //  HTTP 
-            char version[10];
+            //  
+            size_t path_length;
+            //   (    )
+            char authorization[48];
+            //   
+            size_t authorization_length;
             //    
             http_header_upgrade_t upgrade;
             //   
@@ -92,16 +215,12 @@ class web_http_handler_t : public web_slot_handler_t
                 int version;
                 // 
                 char key[26];
+                //  
+                size_t key_length;
             } websocket;
-            //     
-            struct
-            {
-                // 
-                char name[22];
-                // 
-                char value[32];
-            } temp;
         } headers;
+        //        
+        size_t body_offset;
 
         //  
         void clear(void);
@@ -146,8 +265,14 @@ class web_http_handler_t : public web_slot_handler_t
     public:
         //  
         http_status_t status;
+        //    
+        char buffer[32];
         //  
         fs_file_t file;
+        //   ( )
+        const char *body;
+        //   
+        size_t body_size;
         // MIME   
         const char *mime;
         //  
@@ -183,6 +308,8 @@ class web_http_handler_t : public web_slot_handler_t
     void clear(void);
     //  ,  
     void process(web_slot_buffer_t buffer);
+    //    ,  -   
+    bool upload_process(const uint8_t *data, size_t size);
 
     //  HTTP 
     static const struct http_status_text_t
@@ -205,17 +332,15 @@ class web_http_handler_t : public web_slot_handler_t
     //    HTTP  
     static const char * http_status_text(http_status_t code);
 
+    //   HTTP    
+    static http_status_t upload_status(web_http_upload_status_t status);
+
     //  MIME    
     static const char * content_type_mime(const char *ext);
 
     //   ,  
     static bool path_check(char c);
 
-    //      
-    static char * str_lower(char *s);
-        
-    //     ,  
-    static bool str_cat(char *dest, char c, size_t n);
 protected:
     //  
     virtual void free(web_slot_free_reason_t reason) override final;
@@ -224,13 +349,14 @@ protected:
     virtual void execute(web_slot_buffer_t buffer) override final;
 public:
     //   
-    web_http_handler_t(void) : ws(NULL)
+    web_http_handler_t(void) : ws(NULL), upload(NULL), content(NULL)
     {
         clear();
     }
 
-    //     WebSocket
-    web_http_handler_t(web_slot_handler_allocator_t &ws) : ws(&ws)
+    //     WebSocket,     
+    web_http_handler_t(web_slot_handler_allocator_t &ws, web_http_upload_t *upload = NULL, web_http_content_t *content = NULL) :
+        ws(&ws), upload(upload), content(content)
     {
         clear();
     }
@@ -245,10 +371,10 @@ class web_http_handler_allocator_template_t : public web_slot_handler_allocator_
 {
 public:
     //   
-    web_http_handler_allocator_template_t(web_slot_handler_allocator_t &ws_allocator)
+    web_http_handler_allocator_template_t(web_slot_handler_allocator_t &ws_allocator, web_http_upload_t *upload = NULL, web_http_content_t *content = NULL)
     {
         for (auto i = 0; i < COUNT; i++)
-            this->handlers[i] = web_http_handler_t(ws_allocator);
+            this->handlers[i] = web_http_handler_t(ws_allocator, upload, content);
     }
 };
 
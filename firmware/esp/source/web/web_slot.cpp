@@ -7,7 +7,7 @@ void web_slot_socket_t::log(const char *format, ...) const
     assert(busy());
     va_list args;
     va_start(args, format);
-        esp_log_write_va(ESP_LOG_INFO, address, format, args);
+        log_write_va(address, ESP_LOG_INFO, format, args);
     va_end(args);
 }
 
@@ -30,6 +30,7 @@ bool web_slot_socket_t::allocate(web_slot_handler_allocator_t &initial_allocator
         return false;
     //  
     this->socket = socket;
+    peeked = 0;
     //   
     sockaddr_in addr;
     auto len = (socklen_t)sizeof(addr);
@@ -142,10 +143,7 @@ int32_t web_slot_socket_t::check_io(int32_t fb)
         return -1;
     //   
     if (fb > 0)
-    {
-        timeout_reset();
         return fb;
-    }
     //  
     switch (errno)
     {
@@ -157,11 +155,34 @@ int32_t web_slot_socket_t::check_io(int32_t fb)
     return -1;
 }
 
-int32_t web_slot_socket_t::read(web_slot_buffer_t buffer)
+int32_t web_slot_socket_t::read(web_slot_buffer_t buffer, size_t size)
 {
-    assert(buffer != NULL);
+    assert(buffer != NULL && size <= sizeof(web_slot_buffer_t));
     // 
-    auto result = check_io(lwip_recv(socket, buffer, sizeof(web_slot_buffer_t), 0));
+    auto result = check_io(lwip_recv(socket, buffer, size, 0));
+    //  ,  
+    if (result > 0)
+    {
+        peeked -= minimum(peeked, (size_t)result);
+        timeout_reset();
+    }
+    //   
+    if (result < 0)
+        free(WEB_SLOT_FREE_REASON_NETWORK);
+    return result;
+}
+
+int32_t web_slot_socket_t::peek(web_slot_buffer_t buffer)
+{
+    assert(buffer != NULL);
+    //   
+    auto result = check_io(lwip_recv(socket, buffer, sizeof(web_slot_buffer_t), MSG_PEEK));
+    //  ,     (      )
+    if (result > 0 && (size_t)result > peeked)
+    {
+        peeked = (size_t)result;
+        timeout_reset();
+    }
     //   
     if (result < 0)
         free(WEB_SLOT_FREE_REASON_NETWORK);
@@ -173,6 +194,9 @@ int32_t web_slot_socket_t::write(const web_slot_buffer_t buffer, int size)
     assert(size > 0);
     // 
     auto result = check_io(lwip_send(socket, buffer, size, 0));
+    //  ,  
+    if (result > 0)
+        timeout_reset();
     //   
     if (result < 0)
         free(WEB_SLOT_FREE_REASON_NETWORK);
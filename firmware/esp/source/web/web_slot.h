@@ -104,6 +104,8 @@ class web_slot_socket_t
         //  
         os_tick_t period;
     } timeout;
+    //  ,    
+    size_t peeked = 0;
 
     //  
     void close(void);
@@ -134,8 +136,10 @@ public:
     //  
     void free(web_slot_free_reason_t reason);
 
-    //  
-    int32_t read(web_slot_buffer_t buffer);
+    //   (   )
+    int32_t read(web_slot_buffer_t buffer, size_t size = sizeof(web_slot_buffer_t));
+    //       
+    int32_t peek(web_slot_buffer_t buffer);
     //  
     int32_t write(const web_slot_buffer_t buffer, int size);
 
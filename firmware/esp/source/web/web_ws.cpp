@@ -8,103 +8,173 @@ void web_ws_handler_t::free(web_slot_free_reason_t reason)
     reset();
 }
 
+size_t web_ws_handler_t::header_parse(const uint8_t *data, size_t size, header_in_t &header)
+{
+    //  
+    if (size < WEB_WS_HEADER_CONTROL_SIZE)
+        return 0;
+    memcpy(&header.control.raw, data, WEB_WS_HEADER_CONTROL_SIZE);
+    size_t result = WEB_WS_HEADER_CONTROL_SIZE;
+    //   
+    size_t extend;
+    switch (header.control.length)
+    {
+        case 126:
+            // 16 
+            extend = WEB_WS_HEADER_EXTEND_LENGTH_SIZE;
+            break;
+        case 127:
+            // 64 
+            extend = WEB_WS_HEADER_EXTEND_LENGTH64_SIZE;
+            break;
+        default:
+            // 7 
+            extend = 0;
+            break;
+    }
+    //   
+    if (size < result + extend + (header.control.mask ? WEB_WS_HEADER_EXTEND_MASK_SIZE : 0))
+        return 0;
+    //  (Big-Endian)
+    header.length = header.control.length;
+    if (extend > 0)
+    {
+        header.length = 0;
+        for (auto end = result + extend; result < end; result++)
+            header.length = (header.length << 8) | data[result];
+    }
+    // 
+    header.mask = 0;
+    if (header.control.mask)
+    {
+        memcpy(&header.mask, data + result, WEB_WS_HEADER_EXTEND_MASK_SIZE);
+        result += WEB_WS_HEADER_EXTEND_MASK_SIZE;
+    }
+    return result;
+}
+
+void web_ws_handler_t::unmask(uint8_t *data, size_t size, uint32_t mask)
+{
+    //      (   )
+    for (; size > 0 && ((uintptr_t)data & (sizeof(uint32_t) - 1)) != 0; size--)
+    {
+        *data++ ^= (uint8_t)mask;
+        mask = (mask >> 8) | (mask << 24);
+    }
+    //  
+    for (; size >= sizeof(uint32_t); size -= sizeof(uint32_t), data += sizeof(uint32_t))
+        *(uint32_t *)data ^= mask;
+    // 
+    for (; size > 0; size--)
+    {
+        *data++ ^= (uint8_t)mask;
+        mask >>= 8;
+    }
+}
+
+bool web_ws_handler_t::process_frame(const header_in_t &header, uint8_t *payload)
+{
+    const auto size = (size_t)header.length;
+    //     (  )
+    if (!header.control.fin || header.control.code == WEB_WS_OPCODE_CONTINUATION)
+    {
+        socket->log("Received fragmented frame...skip");
+        return true;
+    }
+    //  
+    switch (header.control.code)
+    {
+        case WEB_WS_OPCODE_TEXT:
+            text_event((const char *)payload, size);
+            break;
+        case WEB_WS_OPCODE_BINARY:
+            receive_event(payload, size);
+            break;
+        case WEB_WS_OPCODE_CLOSE:
+            //  
+            socket->timeout_change(1000);
+            socket->free(WEB_SLOT_FREE_REASON_OUTSIDE);
+            return false;
+        case WEB_WS_OPCODE_PING:
+            // ,  
+            if (size <= WEB_WS_PAYLOAD_CONTROL_SIZE)
+                transmit(WEB_WS_OPCODE_PONG, payload, size);
+            socket->log("Received ping frame");
+            break;
+        default:
+            socket->log("Received unknown frame opcode: %d!", header.control.code);
+            break;
+    }
+    return true;
+}
+
 void web_ws_handler_t::process_in(web_slot_buffer_t buffer)
 {
     assert(busy());
-    //  
-    auto transfered = socket->read(buffer);
-    //       
-    if (transfered <= 0)
+    //     
+    if (frame.skip > 0)
+    {
+        auto transfered = socket->read(buffer, (size_t)minimum<uint64_t>(frame.skip, sizeof(web_slot_buffer_t)));
+        if (transfered > 0)
+            frame.skip -= (size_t)transfered;
+        return;
+    }
+    //     (      )
+    auto transfered = socket->peek(buffer);
+    //   ,        
+    if (transfered <= 0 || (size_t)transfered == frame.pending)
         return;
     auto readed = (size_t)transfered;
-    for (size_t offset = 0; readed > 0;)
+    //     
+    header_in_t header;
+    size_t complete = 0;
+    for (;;)
     {
-        //    
-        auto r = frame.in.remain;
-        if (r > readed)
-            r = readed;
-        //    
-        memcpy(frame.in.buffer + frame.in.offset.state, buffer + offset, r);
-        // 
-        offset += r;
-        readed -= r;
-        frame.in.remain -= r;
-        frame.in.offset.state += r;
-        //     
-        if (frame.in.remain > 0)
-            continue;
-        switch (frame.in.state)
+        auto header_size = header_parse(buffer + complete, readed - complete, header);
+        if (header_size <= 0)
+            break;
+        //       
+        if (header.length > WEB_WS_PAYLOAD_SIZE)
         {
-            case STATE_CONTROL:
-                switch (frame.in.header.control.length)
-                {
-                    case 126:
-                        // 16 
-                        frame.in.state_set(STATE_LENGTH);
-                        break;
-                    case 127:
-                        // 64 
-                        socket->free(WEB_SLOT_FREE_REASON_INSIDE);
-                        return;
-                    default:
-                        // 7 
-                        frame.in.header.extend[0] = 0;
-                        frame.in.header.extend[1] = frame.in.header.control.length;
-                        //     
-                        frame.in.mask_or_data(WEB_WS_HEADER_EXTEND_LENGTH_SIZE);
-                        break;
-                }
-                break;
-            case STATE_LENGTH:
-                //     
-                frame.in.mask_or_data(0);
-                break;
-            case STATE_MASK:
-                //   
-                frame.in.state_set(STATE_DATA);
-                break;
-            case STATE_DATA:
-                // XOR
-                for (r = 0; r < frame.in.offset.payload; r++)
-                    frame.in.payload[r] ^= frame.in.header.extend[WEB_WS_HEADER_EXTEND_LENGTH_SIZE + r % WEB_WS_HEADER_EXTEND_MASK_SIZE];
-                //  
-                frame.in.state_set(STATE_CONTROL);
-                //    
-                if (!frame.in.header.control.fin)
-                    break;
-                //  
-                switch (frame.in.header.control.code)
-                {
-                    case WEB_WS_OPCODE_TEXT:
-                        //    
-                        socket->log("Received text frame...skip");
-                        break;
-                    case WEB_WS_OPCODE_BINARY:
-                        receive_event(frame.in.payload, frame.in.offset.payload);
-                        break;
-                    case WEB_WS_OPCODE_CLOSE:
-                        //  
-                        socket->timeout_change(1000);
-                        socket->free(WEB_SLOT_FREE_REASON_OUTSIDE);
-                        return;
-                    case WEB_WS_OPCODE_PING:
-                        // ,  
-                        transmit(WEB_WS_OPCODE_PONG, frame.in.payload, frame.in.offset.payload);
-                        socket->log("Received ping frame");
-                        break;
-                    default:
-                        socket->log("Received unknown frame opcode: %d!", frame.in.header.control.code);
-                        break;
-                }
-                frame.in.offset.payload = 0;
+            //     
+            if (complete > 0)
                 break;
+            //  ,   
+            socket->log("Frame too long...skip");
+            if (socket->read(buffer, header_size) == (int32_t)header_size)
+                frame.skip = header.length;
+            frame.pending = 0;
+            return;
         }
-        //    
-        if (frame.in.offset.payload > WEB_WS_PAYLOAD_SIZE)
-        {
+        //     
+        if (header.length > readed - complete - header_size)
+            break;
+        complete += header_size + (size_t)header.length;
+    }
+    //   ,      
+    frame.pending = readed - complete;
+    if (complete <= 0)
+        return;
+    //    (  ,    )
+    if (socket->read(buffer, complete) != (int32_t)complete)
+    {
+        if (busy())
             socket->free(WEB_SLOT_FREE_REASON_INSIDE);
+        return;
+    }
+    //    
+    for (size_t offset = 0; offset < complete;)
+    {
+        auto header_size = header_parse(buffer + offset, complete - offset, header);
+        assert(header_size > 0);
+        auto payload = buffer + offset + header_size;
+        offset += header_size + (size_t)header.length;
+        //  
+        if (header.mask != 0)
+            unmask(payload, (size_t)header.length, header.mask);
+        // 
+        if (!process_frame(header, payload))
             return;
-        }
     }
 }
 
@@ -162,6 +232,12 @@ bool web_ws_handler_t::transmit(uint8_t code, const void *source, size_t size)
     return true;
 }
 
+void web_ws_handler_t::text_event(const char *text, size_t size)
+{
+    //      
+    socket->log("Received text frame...skip");
+}
+
 void web_ws_handler_t::execute(web_slot_buffer_t buffer)
 {
     process_in(buffer);
@@ -7,15 +7,19 @@
 #define WEB_WS_HEADER_CONTROL_SIZE          2
 //    
 #define WEB_WS_HEADER_EXTEND_LENGTH_SIZE    2
+//     (64 )
+#define WEB_WS_HEADER_EXTEND_LENGTH64_SIZE  8
 //   
 #define WEB_WS_HEADER_EXTEND_MASK_SIZE      4
-//   
-#define WEB_WS_HEADER_EXTEND_SIZE           (WEB_WS_HEADER_EXTEND_LENGTH_SIZE + WEB_WS_HEADER_EXTEND_MASK_SIZE)
 //   
 #define WEB_WS_PAYLOAD_SIZE                 512
+//      
+#define WEB_WS_PAYLOAD_CONTROL_SIZE         125
 
 // ---    --- //
 
+//   
+#define WEB_WS_OPCODE_CONTINUATION  0x00
 //  
 #define WEB_WS_OPCODE_TEXT      0x01
 //  
@@ -30,18 +34,36 @@
 //  WebSocket
 class web_ws_handler_t : public web_slot_handler_t
 {
-    //  / 
-    enum state_t
+    //  
+    union control_t
     {
-        STATE_CONTROL,
-        STATE_LENGTH,
-        STATE_MASK,
-        STATE_DATA,
+        struct
+        {
+            // 1 
+            uint8_t code : 4;
+            uint8_t rsv : 3;
+            uint8_t fin : 1;
+            // 2 
+            uint8_t length : 7;
+            uint8_t mask : 1;
+        };
+        //  
+        uint16_t raw;
+    };
+
+    //   
+    struct header_in_t
+    {
+        //  
+        control_t control;
+        //   (   )
+        uint32_t mask;
+        //   
+        uint64_t length;
     };
 
-    //  
-    template <int EXTSIZE>
-    struct frame_t
+    //  
+    struct frame_out_t
     {
         union
         {
@@ -51,101 +73,16 @@ class web_ws_handler_t : public web_slot_handler_t
                 struct
                 {
                     //  
-                    union
-                    {
-                        struct
-                        {
-                            // 1 
-                            uint8_t code : 4;
-                            uint8_t rsv : 3;
-                            uint8_t fin : 1;
-                            // 2 
-                            uint8_t length : 7;
-                            uint8_t mask : 1;
-                        };
-                        //  
-                        uint16_t raw;
-                    } control;
+                    control_t control;
                     //  
-                    uint8_t extend[EXTSIZE];
+                    uint8_t extend[WEB_WS_HEADER_EXTEND_LENGTH_SIZE];
                 } header;
                 // 
                 uint8_t payload[WEB_WS_PAYLOAD_SIZE];
             };
             //  
-            uint8_t buffer[WEB_WS_HEADER_CONTROL_SIZE + EXTSIZE + WEB_WS_PAYLOAD_SIZE];
+            uint8_t buffer[WEB_WS_HEADER_CONTROL_SIZE + WEB_WS_HEADER_EXTEND_LENGTH_SIZE + WEB_WS_PAYLOAD_SIZE];
         };
-    };
-    //  
-    struct frame_in_t : frame_t<WEB_WS_HEADER_EXTEND_SIZE>
-    {
-        // 
-        struct
-        {
-            // 
-            size_t state;
-            //  
-            size_t payload;
-        } offset;
-        //  
-        size_t remain;
-        //  
-        state_t state;
-
-        //  
-        void reset(void)
-        {
-            offset.payload = 0;
-            state_set(STATE_CONTROL);
-        }
-
-        //       
-        void mask_or_data(size_t o = 0)
-        {
-            if (header.control.mask)
-            {
-                state_set(STATE_MASK, o);
-                return;
-            }
-            memset(header.extend + WEB_WS_HEADER_EXTEND_LENGTH_SIZE, 0, WEB_WS_HEADER_EXTEND_MASK_SIZE);
-            state_set(STATE_DATA, o + WEB_WS_HEADER_EXTEND_MASK_SIZE);
-        }
-
-        //   
-        void state_set(state_t value, size_t o = 0)
-        {
-            state = value;
-            switch (value)
-            {
-            case STATE_CONTROL:
-                remain = WEB_WS_HEADER_CONTROL_SIZE;
-                offset.state = 0;
-                break;
-            case STATE_LENGTH:
-                remain = WEB_WS_HEADER_EXTEND_LENGTH_SIZE;
-                break;
-            case STATE_MASK:
-                remain = WEB_WS_HEADER_EXTEND_MASK_SIZE;
-                offset.state += o;
-                break;
-            case STATE_DATA:
-                //    (Big-Endian)
-                remain = header.extend[0];
-                remain <<= 8;
-                remain |= header.extend[1];
-                //     
-                offset.state += offset.payload + o;
-                offset.payload += remain;
-                break;
-            default:
-                assert(false);
-                break;
-            }
-        }
-    };
-    //  
-    struct frame_out_t : frame_t<WEB_WS_HEADER_EXTEND_LENGTH_SIZE>
-    {
         //   
         size_t offset;
         //     
@@ -170,8 +107,10 @@ class web_ws_handler_t : public web_slot_handler_t
     // 
     struct
     {
-        // 
-        frame_in_t in;
+        //      ( )
+        uint64_t skip;
+        //    ,   
+        size_t pending;
         // 
         frame_out_t out;
     } frame;
@@ -179,10 +118,18 @@ class web_ws_handler_t : public web_slot_handler_t
     //  
     void reset(void)
     {
-        frame.in.reset();
+        frame.skip = 0;
+        frame.pending = 0;
         frame.out.reset();
     }
 
+    //    ,    (0 -   )
+    static size_t header_parse(const uint8_t *data, size_t size, header_in_t &header);
+    //     
+    static void unmask(uint8_t *data, size_t size, uint32_t mask);
+
+    //   ,  -   
+    bool process_frame(const header_in_t &header, uint8_t *payload);
     //   
     void process_in(web_slot_buffer_t buffer);
     //   
@@ -192,7 +139,7 @@ class web_ws_handler_t : public web_slot_handler_t
     bool transmit(uint8_t code, const void *source, size_t size);
 protected:
     //  
-    virtual void free(web_slot_free_reason_t reason) override final;
+    virtual void free(web_slot_free_reason_t reason) override;
     //  
     virtual void execute(web_slot_buffer_t buffer) override final;
 
@@ -200,12 +147,20 @@ protected:
     virtual void transmit_event(void) = 0;
     //    ()
     virtual void receive_event(const uint8_t *data, size_t size) = 0;
+    //    
+    virtual void text_event(const char *text, size_t size);
 
     //   
     bool transmit(const void *source, size_t size)
     {
         return transmit(WEB_WS_OPCODE_BINARY, source, size);
     }
+
+    //   
+    bool transmit_text(const char *source, size_t size)
+    {
+        return transmit(WEB_WS_OPCODE_TEXT, source, size);
+    }
 public:
     //   
     web_ws_handler_t(void)
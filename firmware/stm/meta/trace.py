@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+# Декодер трассировки STM32 с отладочного UART (USART2, 921600 8N1)
+# Поток есть в отладочной сборке с DEBUG_TRACE_STREAM (скорость - DEBUG_TRACE_BAUDRATE),
+# события мультиплексирования включаются битами debug_trace_mask из отладчика.
+#
+# Записи [16 байт]: маркер 0xA5, id, номер, контрольная сумма, метка времени
+# (такты ядра), два аргумента. Форматы событий берутся из DEBUG_TRACE_EVENTS
+# в source/debug.h, в прошивке их нет. Байты вне записей выводятся как текст.
+#
+# Примеры:
+#   trace.py capture.bin
+#   trace.py --port /dev/ttyUSB0
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+# Маркер начала записи
+TRACE_SYNC = 0xA5
+# Размер записи
+TRACE_RECORD_SIZE = 16
+# Частота ядра по умолчанию [Гц]
+TRACE_CLOCK_HZ = 96000000
+
+
+# Загрузка списка событий из заголовка прошивки
+def events_load(path):
+    with open(path, encoding="utf-8-sig") as f:
+        text = f.read()
+
+    block = re.search(r"#define\s+DEBUG_TRACE_EVENTS\(E\)(.*?)\n\s*\n", text, re.S)
+    if block is None:
+        raise SystemExit("DEBUG_TRACE_EVENTS not found in " + path)
+
+    return [(name, fmt) for name, fmt in re.findall(r'E\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', block.group(1))]
+
+
+# Декодер потока
+class Decoder:
+    def __init__(self, events, clock_hz, out):
+        self.events = events
+        self.clock_hz = clock_hz
+        self.out = out
+        self.buffer = bytearray()
+        self.text = bytearray()
+        self.seq = None
+        self.timestamp = None
+        self.time = 0
+
+    # Проверка записи в начале буфера
+    def record_check(self):
+        if len(self.buffer) < TRACE_RECORD_SIZE:
+            return None
+        record = self.buffer[:TRACE_RECORD_SIZE]
+        if record[0] != TRACE_SYNC or record[1] >= len(self.events) or sum(record) & 0xFF != 0:
+            return False
+        return True
+
+    # Вывод накопленного текста
+    def text_flush(self):
+        if not self.text:
+            return
+        for line in self.text.decode("utf-8", "replace").splitlines():
+            if line:
+                self.out.write("    | " + line + "\n")
+        self.text.clear()
+
+    # Вывод записи
+    def record_print(self, record):
+        _, id, seq, _, timestamp, arg0, arg1 = struct.unpack("<BBBBIII", record)
+        name, fmt = self.events[id]
+
+        # Пропуски по порядковому номеру
+        if self.seq is not None and seq != (self.seq + 1) & 0xFF:
+            self.out.write("-- %u records lost --\n" % ((seq - self.seq - 1) & 0xFF))
+        self.seq = seq
+
+        # Развертка 32-битной метки времени
+        delta = 0 if self.timestamp is None else (timestamp - self.timestamp) & 0xFFFFFFFF
+        self.timestamp = timestamp
+        self.time += delta
+
+        try:
+            message = fmt % (arg0, arg1)
+        except TypeError:
+            message = fmt % (arg0,) if "%" in fmt else fmt
+
+        self.out.write("%14.3f us  +%10.3f us  %-16s %s\n" % (
+            self.time * 1e6 / self.clock_hz, delta * 1e6 / self.clock_hz, name, message))
+
+    # Обработка блока данных
+    def feed(self, data):
+        self.buffer += data
+        while self.buffer:
+            state = self.record_check()
+            if state is None and self.buffer[0] == TRACE_SYNC:
+                # Возможно, запись пришла не целиком
+                return
+            if state:
+                self.text_flush()
+                self.record_print(bytes(self.buffer[:TRACE_RECORD_SIZE]))
+                del self.buffer[:TRACE_RECORD_SIZE]
+            else:
+                self.text.append(self.buffer.pop(0))
+                if self.text[-1] == 0x0A:
+                    self.text_flush()
+
+    # Завершение потока
+    def finish(self):
+        self.text += self.buffer
+        self.buffer.clear()
+        self.text_flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="STM32 binary trace decoder")
+    parser.add_argument("input", nargs="?", help="capture file ('-' or none for stdin)")
+    parser.add_argument("--port", help="serial port to read from (needs pyserial)")
+    parser.add_argument("--baud", type=int, default=921600, help="serial baudrate")
+    parser.add_argument("--clock", type=int, default=TRACE_CLOCK_HZ, help="core clock [Hz]")
+    parser.add_argument("--header", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "source", "debug.h"),
+                        help="firmware header with DEBUG_TRACE_EVENTS")
+    args = parser.parse_args()
+
+    decoder = Decoder(events_load(args.header), args.clock, sys.stdout)
+
+    if args.port:
+        import serial
+        stream = serial.Serial(args.port, args.baud, timeout=0.1)
+        read = lambda: stream.read(4096)
+    else:
+        stream = sys.stdin.buffer if args.input in (None, "-") else open(args.input, "rb")
+        read = lambda: stream.read1(4096) if hasattr(stream, "read1") else stream.read(4096)
+
+    try:
+        while True:
+            data = read()
+            if not data:
+                if args.port:
+                    continue
+                break
+            decoder.feed(data)
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    decoder.finish()
+
+
+if __name__ == "__main__":
+    main()
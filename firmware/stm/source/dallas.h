@@ -0,0 +1,35 @@
+﻿#ifndef __DALLAS_H
+#define __DALLAS_H
+
+#include "typedefs.h"
+
+/* Протокол 1-Wire через UART: каждый бит передается байтом на скорости
+ * 115200 (0xFF - единица, 0x00 - ноль), чтение бита - байт 0xFF, который
+ * возвращается неизменным только для единицы */
+
+// Конвертирование бита в байт последовательности
+constexpr uint8_t dallas_bit_to_byte(uint8_t byte, uint8_t bit)
+{
+    return (byte & (1 << bit)) ? 0xFF : 0x00;
+}
+
+// Генерация байтового массива по байту
+#define DALLAS_BYTE_ARRAY_GEN(byte)     \
+    dallas_bit_to_byte(byte, 0),        \
+    dallas_bit_to_byte(byte, 1),        \
+    dallas_bit_to_byte(byte, 2),        \
+    dallas_bit_to_byte(byte, 3),        \
+    dallas_bit_to_byte(byte, 4),        \
+    dallas_bit_to_byte(byte, 5),        \
+    dallas_bit_to_byte(byte, 6),        \
+    dallas_bit_to_byte(byte, 7)
+
+// Расчет контрольной суммы CRC-8/MAXIM (ROM и данные датчиков)
+uint8_t dallas_crc(const void *data, size_t size);
+
+// Преобразование байтов в последовательность битов для передачи, получает конец последовательности
+uint8_t * dallas_bytes_to_bits(uint8_t *bits, const uint8_t *source, uint8_t size);
+// Сборка байтов из принятой последовательности битов (бит единица, если байт 0xFF)
+void dallas_bits_to_bytes(uint8_t *dest, const uint8_t *bits, uint8_t size);
+
+#endif // __DALLAS_H
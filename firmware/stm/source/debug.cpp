@@ -13,6 +13,55 @@ constexpr auto DEBUG_BUFFER_SIZE = 512;
 // Фаза заполняемого буфера
 static bool debug_buffer_phase = false;
 
+#ifdef DEBUG_TRACE_USED
+// Маркер начала записи трассировки
+constexpr const uint8_t DEBUG_TRACE_SYNC = 0xA5;
+// Количество записей в кольце трассировки (степень двойки)
+constexpr const uint16_t DEBUG_TRACE_RECORD_COUNT = 64;
+STATIC_ASSERT((DEBUG_TRACE_RECORD_COUNT & (DEBUG_TRACE_RECORD_COUNT - 1)) == 0);
+STATIC_ASSERT(DEBUG_TRACE_COUNT <= 32);
+
+// Скорость вывода для потока трассировки мультиплексирования (~20 КБ/с)
+#ifndef DEBUG_TRACE_BAUDRATE
+    #define DEBUG_TRACE_BAUDRATE    921600
+#endif
+
+// Маска включенных событий (мультиплексирование забивает поток, по умолчанию выключено)
+volatile uint32_t debug_trace_mask = ~(1UL << DEBUG_TRACE_NIXIE_MUX | 1UL << DEBUG_TRACE_NEON_MUX);
+
+// Запись трассировки [16 байт]
+struct debug_trace_record_t
+{
+    // Маркер начала
+    uint8_t sync;
+    // Идентификатор события
+    debug_trace_id_t id;
+    // Порядковый номер (пропуск - переполнение кольца)
+    uint8_t seq;
+    // Контрольная сумма (дополнение суммы остальных байт до нуля)
+    uint8_t sum;
+    // Метка времени [такты ядра]
+    uint32_t timestamp;
+    // Аргументы
+    uint32_t arg[2];
+};
+
+STATIC_ASSERT(sizeof(debug_trace_record_t) == 16);
+
+// Кольцо трассировки (передается по DMA, когда нет текстовых данных)
+static struct
+{
+    // Записи
+    debug_trace_record_t record[DEBUG_TRACE_RECORD_COUNT];
+    // Индексы записи и чтения (свободно растущие)
+    volatile uint16_t head, tail;
+    // Количество записей в текущей передаче DMA
+    uint16_t sending;
+    // Порядковый номер следующей записи
+    uint8_t seq;
+} debug_trace_ring;
+#endif
+
 // Буферы передачи
 static struct
 {
@@ -28,6 +77,13 @@ static event_t debug_buffer_pool_ev([]()
     if ((DEBUG_DMA_C7->CCR & DMA_CCR_EN) != 0)                                  // Check enable bit
         return;
     
+#ifdef DEBUG_TRACE_USED
+    // Переданные записи трассировки освобождаются
+    auto &ring = debug_trace_ring;
+    ring.tail += ring.sending;
+    ring.sending = 0;
+#endif
+    
     // Запуск DMA на текущем буфере
     auto &buffer = debug_buffer[debug_buffer_phase];
     if (buffer.size > 0)
@@ -37,6 +93,17 @@ static event_t debug_buffer_pool_ev([]()
         DEBUG_DMA_C7->CCR |= DMA_CCR_EN;                                        // Channel enable
         buffer.size = 0;
     }
+#ifdef DEBUG_TRACE_USED
+    else if (ring.head != ring.tail)
+    {
+        // Записи трассировки непрерывным куском до конца кольца
+        const auto index = ring.tail & (DEBUG_TRACE_RECORD_COUNT - 1);
+        ring.sending = minimum<uint16_t>(ring.head - ring.tail, DEBUG_TRACE_RECORD_COUNT - index);
+        mcu_dma_channel_setup_m(DEBUG_DMA_C7, ring.record + index);
+        DEBUG_DMA_C7->CNDTR = ring.sending * sizeof(debug_trace_record_t);      // Transfer size
+        DEBUG_DMA_C7->CCR |= DMA_CCR_EN;                                        // Channel enable
+    }
+#endif
     
     // Смена фазы
     debug_buffer_phase = !debug_buffer_phase;
@@ -49,10 +116,14 @@ void debug_init()
     RCC->APB1RSTR |= RCC_APB1RSTR_USART2RST;                                    // USART2 reset
     RCC->APB1RSTR &= ~RCC_APB1RSTR_USART2RST;                                   // USART2 unreset
     
-    // Конфигурирование USART (115200 @ PCLK1 48 МГц)
+    // Конфигурирование USART (115200 @ PCLK1 48 МГц, поток трассировки - DEBUG_TRACE_BAUDRATE)
     {
         // Конечная скорость передачи
+#ifdef DEBUG_TRACE_USED
+        constexpr uint32_t BAUDRATE = DEBUG_TRACE_BAUDRATE;
+#else
         constexpr uint32_t BAUDRATE = 115200;
+#endif
         
         // Отношение исходной частоты к скорости передачи
         constexpr auto RATIO = FPCLK1_HZ / (BAUDRATE * 16.0);
@@ -112,6 +183,50 @@ void debug_write(const void *source, size_t size)
     debug_buffer_pool_ev.raise();
 }
 
+#ifdef DEBUG_TRACE_USED
+// Сумма байт слова
+static inline uint8_t debug_trace_sum(uint32_t value)
+{
+    return (uint8_t)(value + (value >> 8) + (value >> 16) + (value >> 24));
+}
+
+RAM_IAR
+void debug_trace(debug_trace_id_t id, uint32_t arg0, uint32_t arg1)
+{
+    assert(id < DEBUG_TRACE_COUNT);
+    
+    const uint32_t timestamp = DWT->CYCCNT;
+    auto &ring = debug_trace_ring;
+    
+    // Резервирование записи (запись после резервирования завершается раньше, чем ее увидит передача в основной нити)
+    IRQ_SAFE_ENTER();
+        const uint16_t head = ring.head;
+        const uint8_t seq = ring.seq++;
+        const auto full = (uint16_t)(head - ring.tail) >= DEBUG_TRACE_RECORD_COUNT;
+        if (!full)
+            ring.head = head + 1;
+    IRQ_SAFE_LEAVE();
+    
+    // Переполнение, пропуск виден декодеру по номеру
+    if (full)
+        return;
+    
+    // Заполнение
+    auto &record = ring.record[head & (DEBUG_TRACE_RECORD_COUNT - 1)];
+    record.sync = DEBUG_TRACE_SYNC;
+    record.id = id;
+    record.seq = seq;
+    record.timestamp = timestamp;
+    record.arg[0] = arg0;
+    record.arg[1] = arg1;
+    record.sum = (uint8_t)-(uint8_t)(DEBUG_TRACE_SYNC + id + seq + 
+        debug_trace_sum(timestamp) + debug_trace_sum(arg0) + debug_trace_sum(arg1));
+    
+    // Вызов опроса
+    debug_buffer_pool_ev.raise();
+}
+#endif
+
 IRQ_ROUTINE
 void debug_interrupt_dma(void)
 {
@@ -3,6 +3,31 @@
 
 #include "typedefs.h"
 
+/* Список событий трассировки: имя и формат для декодера stm/meta/trace.py
+ * Формат в прошивку не попадает, аргументы - два 32-битных числа */
+#define DEBUG_TRACE_EVENTS(E)                                                   \
+    E(NIXIE_MUX,            "nixie mux: lamp %u, ccr %u")                       \
+    E(NEON_MUX,             "neon mux: lamp %u, ccr %u")                        \
+    E(ESP_IO_BEGIN,         "esp io begin: large %u, interval %u us")           \
+    E(ESP_IO_DONE,          "esp io done: large %u, write %u")                  \
+    E(ESP_IO_SCHEDULE,      "esp io schedule: traffic %u, interval %u us")
+
+// Идентификаторы событий трассировки
+enum debug_trace_id_t : uint8_t
+{
+#define DEBUG_TRACE_EVENT_ID(name, format)      DEBUG_TRACE_##name,
+    DEBUG_TRACE_EVENTS(DEBUG_TRACE_EVENT_ID)
+#undef DEBUG_TRACE_EVENT_ID
+    
+    // Количество событий
+    DEBUG_TRACE_COUNT
+};
+
+// Поток трассировки только в отладочной сборке с опцией DEBUG_TRACE_STREAM
+#if !defined(NDEBUG) && defined(DEBUG_TRACE_STREAM)
+    #define DEBUG_TRACE_USED
+#endif
+
 // Инициализация модуля
 void debug_init();
 
@@ -15,4 +40,23 @@ void debug_write(const void *source, size_t size);
 // Обработчик DMA
 void debug_interrupt_dma(void);
 
+#ifdef DEBUG_TRACE_USED
+    // Маска включенных событий (мультиплексирование выключено, включается из отладчика)
+    extern volatile uint32_t debug_trace_mask;
+
+    // Запись события трассировки (из любого приоритета)
+    void debug_trace(debug_trace_id_t id, uint32_t arg0, uint32_t arg1);
+    
+    // Трассировка события по имени из DEBUG_TRACE_EVENTS
+    #define DEBUG_TRACE(name, arg0, arg1)                                       \
+        do                                                                      \
+        {                                                                       \
+            if (debug_trace_mask & (1UL << DEBUG_TRACE_##name))                 \
+                debug_trace(DEBUG_TRACE_##name, (arg0), (arg1));                \
+        } while (false)
+#else
+    // В сборке без потока трассировки она отсутствует
+    #define DEBUG_TRACE(name, arg0, arg1)   ((void)0)
+#endif
+
 #endif // __DEBUG_H
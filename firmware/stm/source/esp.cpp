@@ -2,8 +2,11 @@
 #include "esp.h"
 #include "mcu.h"
 #include "nvic.h"
+#include "debug.h"
+#include "light.h"
 #include "event.h"
 #include "timer.h"
+#include "update.h"
 
 // Alias
 #define DMA1_C2                 DMA1_Channel2
@@ -11,8 +14,16 @@
 
 // Команда ESP8266 TX & RX подчиненного устройства
 #define ESP_SPI_CMD_RD_WR       0x06
-// Частота передачи пакетов IPC по SPI
-#define ESP_SPI_IPC_TX_HZ       75
+// Команда ESP8266 записи буфера подчиненного устройства
+#define ESP_SPI_CMD_WR          0x02
+// Команда ESP8266 чтения буфера подчиненного устройства
+#define ESP_SPI_CMD_RD          0x03
+// Количество пакетов в кадре (весь аппаратный буфер ESP8266)
+#define ESP_FRAME_PKT_COUNT     2
+// Пауза при активной линии датчика освещенности
+#define ESP_SPI_IPC_DEFER_US    100
+// Частота транзакций IPC по SPI в простое
+#define ESP_SPI_IPC_IDLE_HZ     (XM(1) / ESP_SPI_IPC_IDLE_US)
 // Время ожидания после смены состояния выводов ESP8266
 #define ESP_PIN_SWUTCH_US       XK(50)
 // Время ожидания инициализации чипа ESP8266
@@ -24,25 +35,40 @@ static void esp_reset_do(void);
 // Ввод/вывод
 static struct esp_io_t
 {
-    // Буфер пакета для DMA
-    struct
+    // Кадр для DMA
+    struct frame_t
     {
         // Для выравнивания к четному адресу
         uint8_t pads[3];
         // Байт команды для ESP8266
         uint8_t command;
-        // Пакет приёма и передачи
-        ipc_packet_t tx, rx;
-    } dma;
+        // Пакеты кадра
+        ipc_packet_t packet[ESP_FRAME_PKT_COUNT];
+    };
+    
+    /* Обычный режим: один полудуплексный обмен, в кадре out пакет 0 передается,
+     * пакет 1 принимается. Большой режим: чтение буфера ESP8266 в кадр in,
+     * затем запись кадра out, по два пакета в каждую сторону */
+    frame_t out, in;
     // Флаг активности транзакцими
     bool active = false;
+    // Согласован ли большой кадр
+    bool large = false;
+    // Большой ли кадр текущей транзакции
+    bool large_current = false;
+    // Ожидается ли фаза записи большого кадра
+    bool write_pending = false;
+    // Рассогласование фаз в последней транзакции (ESP не успел подготовить кадр)
+    bool unphase = false;
+    // Текущий период транзакций
+    uint32_t interval_us = ESP_SPI_IPC_BURST_US;
 } esp_io;
 
 // Хост обработчиков команд
 static ipc_handler_host_t esp_handler_host;
 
 // Класс связи с ESP
-static class esp_link_t : public ipc_link_t
+static class esp_link_t : public ipc_link_template_t<>
 {
     // Контроль переотправки исходящих данных
     struct retry_t
@@ -57,6 +83,10 @@ static class esp_link_t : public ipc_link_t
     uint16_t unphase_count = 0;
     // Счетчик ошибок передачи
     uint8_t corruption_count = 0;
+    // Большой кадр дал сбой, не используем до сброса чипа
+    bool frame_fault = false;
+    // Признак обмена данными с момента последнего запроса (не только бездействие)
+    bool traffic = false;
     
     // Событие массового сброса (другая сторона не отвечает)
     void reset_slave(void)
@@ -64,8 +94,13 @@ static class esp_link_t : public ipc_link_t
         // Сброс счетчиков
         unphase_count = 0;
         corruption_count = 0;
+        // Новый чип - новая попытка большого кадра
+        frame_fault = false;
+        options &= ~IPC_LINK_OPTION_FRAME_LARGE;
+        esp_io.large = false;
         
         // Сброс чипаа
+        resets++;
         esp_reset_do();
     }
 protected:
@@ -77,10 +112,12 @@ protected:
         {
             // Фаза не слошлась, на другой стороне пропущен пакет
             retry.index = 0;
+            retries++;
+            esp_io.unphase = true;
             
             // Обработка счетчика несовпадения фаз
             unphase_count += 2;
-            if (unphase_count < ESP_SPI_IPC_TX_HZ * 10) // ...на 10 секунд
+            if (unphase_count < ESP_SPI_IPC_IDLE_HZ * 10) // ...на 10 секунд
                 return false;
             
             // Жопа
@@ -98,6 +135,12 @@ protected:
     virtual void reset_layer(reset_reason_t reason, bool internal) override final
     {
         retry.index = array_length(retry.packet);
+        // Искажение в большом кадре - откат на обычный без повторов
+        if (internal && reason == RESET_REASON_CORRUPTION && esp_io.large)
+            frame_fault = true;
+        // Обычный кадр до повторного согласования
+        options &= ~IPC_LINK_OPTION_FRAME_LARGE;
+        esp_io.large = false;
         // Базовый метод
         ipc_link_t::reset_layer(reason, internal);
         // Обработка счетчика ошибок передачи
@@ -105,7 +148,26 @@ protected:
             corruption_count += 4;
     }
 
+    // Обработка опций, полученных от ESP
+    virtual void options_receive(ipc_link_option_t remote) override final
+    {
+        // Предлагаем большой кадр, если ESP его поддерживает
+        if ((remote & IPC_LINK_OPTION_FRAME_LARGE) != 0 && !frame_fault)
+        {
+            options |= IPC_LINK_OPTION_FRAME_LARGE;
+            return;
+        }
+        
+        // Отказ от большого кадра сразу
+        options &= ~IPC_LINK_OPTION_FRAME_LARGE;
+        esp_io.large = false;
+    }
 public:
+    // Количество переотправок пакетов
+    uint32_t retries = 0;
+    // Количество сбросов чипа
+    uint16_t resets = 0;
+    
     // Получение пакета к выводу
     virtual void packet_output(ipc_packet_t &packet) override final
     {
@@ -113,18 +175,37 @@ public:
         {
             // Переотправляем
             packet = retry.packet[retry.index++];
+            traffic = true;
             return;
         }
         
         // Выводим и кэшируем
         ipc_link_t::packet_output(packet);
+        if (!packet_idle(packet))
+            traffic = true;
         retry.packet[0] = retry.packet[1];
         retry.packet[1] = packet;
+        
+        // ESP переходит на большой кадр по приёму этого пакета, мы - со следующей транзакции
+        if (packet.dll.opcode == IPC_OPCODE_FLOW && (options & IPC_LINK_OPTION_FRAME_LARGE) != 0)
+            esp_io.large = true;
     }
 
     // Ввод полученного пакета
     virtual bool packet_input(const ipc_packet_t &packet) override final
     {
+        // Запуск программатора обновления (пакет туннеля, минуя канальный уровень)
+        if (packet.dll.opcode == IPC_OPCODE_UPDATE_BEGIN)
+        {
+            update_begin(packet);
+            // Запрос отклонен
+            return true;
+        }
+        
+        // Данные от ESP (сама ESP шлёт бездействие, только когда ей нечего передать)
+        if (!packet_idle(packet))
+            traffic = true;
+        
         // Базовый метод
         if (ipc_link_t::packet_input(packet))
         {
@@ -148,6 +229,14 @@ public:
         // Результат не проверяется
         return true;
     }
+    
+    // Получает и сбрасывает признак обмена данными (включая ожидающие передачи слоты)
+    bool traffic_take(void)
+    {
+        const auto result = traffic || !tx.empty();
+        traffic = false;
+        return result;
+    }
 } esp_link;
 
 // Инициализация канала DMA
@@ -158,38 +247,24 @@ static void esp_dma_channel_init(DMA_Channel_TypeDef *channel, uint32_t flags)
         // Из SPI
         SPI1->DR, 
         // В память
-        &esp_io.dma.command);
+        &esp_io.out.command);
     channel->CCR |= DMA_CCR_MINC | DMA_CCR_PL_1 | flags;                        // Direction (flags), Memory increment (8-bit), Peripheral size 8-bit, High priority
 }
 
-// Таймер начала ввода/вывода
-static timer_t esp_io_begin_timer([](void)
+// Запуск обмена кадром по DMA (приём поверх передаваемых данных)
+static void esp_dma_start(esp_io_t::frame_t &frame, uint8_t command, size_t packets)
 {
-    if (esp_io.active)
-        return;
-    esp_io.active = true;
-    
-    // Опрос команд
-    esp_handler_host.pool();
-    // Подготовка данных
-    esp_link.packet_output(esp_io.dma.tx);
-    esp_io.dma.command = ESP_SPI_CMD_RD_WR;
+    frame.command = command;
+    mcu_dma_channel_setup_m(DMA1_C2, &frame.command);
+    mcu_dma_channel_setup_m(DMA1_C3, &frame.command);
     // Начало передачи
     IO_PORT_RESET(IO_ESP_CS);                                                   // Slave select
     // DMA
     DMA1_C2->CNDTR = DMA1_C3->CNDTR = 
-        sizeof(esp_io.dma) - sizeof(esp_io.dma.pads);                           // Transfer data size
+        sizeof(frame.command) + IPC_PKT_SIZE * packets;                         // Transfer data size
     DMA1_C2->CCR |= DMA_CCR_EN;                                                 // Channel enable
     DMA1_C3->CCR |= DMA_CCR_EN;                                                 // Channel enable
-});
-
-// Событие завершения ввода/вывода
-static event_t esp_io_complete_event([](void)
-{
-    esp_io.active = false;
-    // Извлекаем пакет
-    esp_link.packet_input(esp_io.dma.rx);
-});
+}
 
 // Состояние сброса
 static enum
@@ -204,6 +279,73 @@ static enum
     ESP_RESET_STATE_INIT
 } esp_reset_state = ESP_RESET_STATE_IDLE;
 
+// Таймер начала ввода/вывода
+static timer_t esp_io_begin_timer([](void)
+{
+    if (esp_io.active)
+        return;
+    
+    /* Если активна линия датчика освещенности, то откладываем
+     * В Errata запрещено использование SPI1 и I2C в случае ремапа */
+    if (light_wire_active())
+    {
+        esp_io_begin_timer.start_us(ESP_SPI_IPC_DEFER_US);
+        return;
+    }
+    esp_io.active = true;
+    
+    // Опрос команд
+    esp_handler_host.pool();
+    
+    // Обычный кадр: передача пакета и приём в одной транзакции
+    esp_io.large_current = esp_io.large;
+    DEBUG_TRACE(ESP_IO_BEGIN, esp_io.large_current, esp_io.interval_us);
+    if (!esp_io.large_current)
+    {
+        esp_link.packet_output(esp_io.out.packet[0]);
+        esp_dma_start(esp_io.out, ESP_SPI_CMD_RD_WR, ESP_FRAME_PKT_COUNT);
+        return;
+    }
+    
+    // Большой кадр: подготовка данных, сначала чтение буфера
+    for (auto i = 0; i < ESP_FRAME_PKT_COUNT; i++)
+        esp_link.packet_output(esp_io.out.packet[i]);
+    esp_io.write_pending = true;
+    esp_dma_start(esp_io.in, ESP_SPI_CMD_RD, ESP_FRAME_PKT_COUNT);
+});
+
+// Планирование следующей транзакции по результату текущей
+static void esp_io_schedule(void)
+{
+    // Опрос запустится по завершению сброса
+    if (esp_reset_state != ESP_RESET_STATE_IDLE)
+        return;
+    
+    // Если ESP не успевает - частота затухает как в простое
+    const auto traffic = esp_link.traffic_take();
+    esp_io.interval_us = esp_io_interval_next(esp_io.interval_us, traffic && !esp_io.unphase);
+    esp_io.unphase = false;
+    DEBUG_TRACE(ESP_IO_SCHEDULE, traffic, esp_io.interval_us);
+    
+    esp_io_begin_timer.start_us(esp_io.interval_us);
+}
+
+// Событие завершения ввода/вывода
+static event_t esp_io_complete_event([](void)
+{
+    esp_io.active = false;
+    
+    // Извлекаем пакеты
+    if (!esp_io.large_current)
+        esp_link.packet_input(esp_io.out.packet[1]);
+    else
+        for (auto i = 0; i < ESP_FRAME_PKT_COUNT; i++)
+            esp_link.packet_input(esp_io.in.packet[i]);
+    
+    // Следующая транзакция
+    esp_io_schedule();
+});
+
 // Таймер обработки текущего состояния сброса
 static timer_t esp_reset_timer([](void)
 {
@@ -227,8 +369,10 @@ static timer_t esp_reset_timer([](void)
             esp_reset_state = ESP_RESET_STATE_INIT;
             return;
         case ESP_RESET_STATE_INIT:
-            // Запуск таймера опроса
-            esp_io_begin_timer.start_hz(ESP_SPI_IPC_TX_HZ, TIMER_FLAG_LOOP);
+            // Запуск опроса
+            esp_io.unphase = false;
+            esp_io.interval_us = ESP_SPI_IPC_BURST_US;
+            esp_io_begin_timer.start_us(esp_io.interval_us);
             // Завершение инициализации
             esp_reset_state = ESP_RESET_STATE_IDLE;
             return;
@@ -286,6 +430,13 @@ void esp_handler_add(ipc_handler_t &handler)
     esp_handler_host.handler_add(handler);
 }
 
+void esp_stat_get(ipc_link_stat_t &link, uint32_t &retries, uint16_t &resets)
+{
+    esp_link.stat_get(link);
+    retries = esp_link.retries;
+    resets = esp_link.resets;
+}
+
 // Получает текущее значение тиков (реализуется платформой)
 ipc_handler_t::tick_t ipc_handler_t::tick_get(void)
 {
@@ -298,6 +449,71 @@ ipc_processor_t & ipc_handler_t::transmitter_get(void)
     return esp_link;
 }
 
+// Копирование пакета (без библиотечных функций, исполняется из ОЗУ)
+RAM_IAR
+static void esp_update_packet_copy(ipc_packet_t &dest, const ipc_packet_t &source)
+{
+    auto d = (uint16_t *)&dest;
+    auto s = (const uint16_t *)&source;
+    for (auto i = 0; i < IPC_PKT_SIZE / sizeof(uint16_t); i++)
+        d[i] = s[i];
+}
+
+// Завершение обмена по DMA (без прерывания)
+RAM_IAR
+static void esp_update_dma_stop(void)
+{
+    // DMA
+    DMA1->IFCR = DMA_IFCR_CTCIF2;                                               // Clear CTCIF
+    DMA1_C2->CCR &= ~DMA_CCR_EN;                                                // Channel disable
+    DMA1_C3->CCR &= ~DMA_CCR_EN;                                                // Channel disable
+    // SPI
+    WAIT_WHILE(SPI1->SR & SPI_SR_BSY);                                          // Wait for idle
+    IO_PORT_SET(IO_ESP_CS);                                                     // Slave deselect
+}
+
+RAM_IAR
+void esp_update_prepare(void)
+{
+    // Завершение текущей транзакции (прерывание DMA уже не будет обработано)
+    if ((DMA1_C2->CCR & DMA_CCR_EN) != 0)                                       // Check channel enabled
+    {
+        WAIT_FOR(DMA1->ISR & DMA_ISR_TCIF2);                                    // Wait for transfer complete
+        esp_update_dma_stop();
+    }
+    // Режим обновления использует только обычный кадр
+    esp_io.write_pending = false;
+    esp_io.active = true;
+}
+
+RAM_IAR
+void esp_update_transfer_start(const ipc_packet_t &packet)
+{
+    esp_update_packet_copy(esp_io.out.packet[0], packet);
+    esp_io.out.command = ESP_SPI_CMD_RD_WR;
+    WARNING_SUPPRESS(Pa039)
+        DMA1_C2->CMAR = DMA1_C3->CMAR = (uint32_t)&esp_io.out.command;          // Memory address
+    WARNING_DEFAULT(Pa039)
+    // Начало передачи
+    IO_PORT_RESET(IO_ESP_CS);                                                   // Slave select
+    // DMA
+    DMA1_C2->CNDTR = DMA1_C3->CNDTR = 
+        sizeof(esp_io.out.command) + IPC_PKT_SIZE * ESP_FRAME_PKT_COUNT;        // Transfer data size
+    DMA1_C2->CCR |= DMA_CCR_EN;                                                 // Channel enable
+    DMA1_C3->CCR |= DMA_CCR_EN;                                                 // Channel enable
+}
+
+RAM_IAR
+bool esp_update_transfer_complete(ipc_packet_t &packet)
+{
+    if ((DMA1->ISR & DMA_ISR_TCIF2) == 0)                                       // Check transfer complete
+        return false;
+    esp_update_dma_stop();
+    // Приём поверх передачи, как в обычном кадре
+    esp_update_packet_copy(packet, esp_io.out.packet[1]);
+    return true;
+}
+
 IRQ_ROUTINE
 void esp_interrupt_dma(void)
 {
@@ -308,6 +524,16 @@ void esp_interrupt_dma(void)
     // SPI
     WAIT_WHILE(SPI1->SR & SPI_SR_BSY);                                          // Wait for idle
     IO_PORT_SET(IO_ESP_CS);                                                     // Slave deselect
+    DEBUG_TRACE(ESP_IO_DONE, esp_io.large_current, esp_io.write_pending);
+    
+    // Фаза записи большого кадра
+    if (esp_io.write_pending)
+    {
+        esp_io.write_pending = false;
+        esp_dma_start(esp_io.out, ESP_SPI_CMD_WR, ESP_FRAME_PKT_COUNT);
+        return;
+    }
+    
     // Event
     esp_io_complete_event.raise();
 }
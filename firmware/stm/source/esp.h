@@ -3,12 +3,35 @@
 
 #include <ipc.h>
 
+// Период транзакций IPC по SPI при обмене данными (ESP готовит ответ между транзакциями)
+#define ESP_SPI_IPC_BURST_US    XK(1)
+// Период транзакций IPC по SPI в простое
+#define ESP_SPI_IPC_IDLE_US     XK(25)
+
+// Получает период следующей транзакции: пока идут данные - сразу, в простое частота затухает вдвое до периода простоя
+constexpr inline uint32_t esp_io_interval_next(uint32_t interval_us, bool traffic)
+{
+    return traffic ? ESP_SPI_IPC_BURST_US : minimum<uint32_t>(interval_us * 2, ESP_SPI_IPC_IDLE_US);
+}
+
 // Инициализация модуля
 void esp_init(void);
 // Получает признак активности линии
 bool esp_wire_active(void);
 // Добавление обработчика команд
 void esp_handler_add(ipc_handler_t &handler);
+// Получение счетчиков связи (канал, переотправки пакетов, сбросы чипа)
+void esp_stat_get(ipc_link_stat_t &link, uint32_t &retries, uint16_t &resets);
+
+// Подготовка линии к обмену в режиме обновления (прерывания запрещены)
+RAM_IAR
+void esp_update_prepare(void);
+// Начало обмена пакетом в режиме обновления
+RAM_IAR
+void esp_update_transfer_start(const ipc_packet_t &packet);
+// Завершение обмена пакетом в режиме обновления, результат - завершен ли обмен
+RAM_IAR
+bool esp_update_transfer_complete(ipc_packet_t &packet);
 
 // Обработчик DMA
 void esp_interrupt_dma(void);
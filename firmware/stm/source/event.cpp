@@ -11,7 +11,7 @@ static struct event_list_t
 } event_list;
 
 RAM_IAR
-void event_t::raise(void)
+bool event_t::raise(void)
 {
     // Добавление в начало списка событий
     IRQ_SAFE_ENTER();
@@ -20,13 +20,14 @@ void event_t::raise(void)
         if (pending)
         {
             IRQ_SAFE_LEAVE();
-            return;
+            return false;
         }
         
         // Блокирование
         pending = true;
         this->link(*event_list.active, LIST_SIDE_HEAD);
     IRQ_SAFE_LEAVE();
+    return true;
 }
 
 void event_t::process(void)
@@ -47,22 +48,18 @@ void event_t::process(void)
         assert(event_list.active->empty());
     IRQ_SAFE_LEAVE();
     
-    // Обработка очереди
-    do
+    // Обработка очереди (флаг ожидания блокирует повторную генерацию до вызова)
+    for (event_t *event; (event = event_list.item[i].pop()) != NULL;)
     {
-        // Получаем первый элемент списка
-        auto &event = *event_list.item[i].head();
         // Проверка состояния
-        assert(event.pending);
+        assert(event->pending);
         // Вызов события
-        event.handler();
-        // Удаляем из списка
-        event.unlink();
+        event->handler();
         // Cбрасываем флаг ожидания
         IRQ_CTX_DISABLE();
-            event.pending = false;
+            event->pending = false;
         IRQ_CTX_RESTORE();
-    } while (!event_list.item[i].empty());
+    }
 }
 
 __noreturn void event_t::loop(void)
@@ -21,9 +21,9 @@ public:
         assert(handler != NULL);
     }
     
-    // Генерация события
+    // Генерация события, результат - поставлено ли (false - уже ожидает обработки)
     RAM_IAR
-    void raise(void);
+    bool raise(void);
     
     // Цикл обработки событий
     static __noreturn void loop(void);
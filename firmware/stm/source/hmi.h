@@ -139,6 +139,138 @@ constexpr hmi_hsv_t hmi_hsv_init(hmi_sat_t h, hmi_sat_t s, hmi_sat_t v)
     return result;
 }
 
+// Режим плавного изменения
+enum hmi_smooth_mode_t
+{
+    // Линейный
+    HMI_SMOOTH_MODE_LINEAR,
+    // С ускорением
+    HMI_SMOOTH_MODE_EASE_IN,
+    // С замедлением
+    HMI_SMOOTH_MODE_EASE_OUT,
+    // С ускорением и замедлением
+    HMI_SMOOTH_MODE_EASE_IN_OUT,
+};
+
+// Разрядность дробной части доли кривой плавности
+constexpr const uint8_t HMI_EASE_BITS = 15;
+// Единица доли кривой плавности
+constexpr const uint32_t HMI_EASE_ONE = 1 << HMI_EASE_BITS;
+// Количество отрезков таблиц кривых плавности
+constexpr const uint8_t HMI_EASE_SEGMENTS = 16;
+// Разрядность дробной части фазы кривой плавности
+constexpr const uint8_t HMI_EASE_PHASE_BITS = 16;
+// Полная фаза кривой плавности
+constexpr const uint32_t HMI_EASE_PHASE_FULL = HMI_EASE_SEGMENTS << HMI_EASE_PHASE_BITS;
+
+// Кривая с ускорением (t^2)
+constexpr const uint16_t HMI_EASE_IN_TABLE[HMI_EASE_SEGMENTS + 1] =
+{
+    0, 128, 512, 1152, 2048, 3200, 4608, 6272, 8192, 
+    10368, 12800, 15488, 18432, 21632, 25088, 28800, 32768
+};
+
+// Кривая с ускорением и замедлением (3t^2 - 2t^3)
+constexpr const uint16_t HMI_EASE_IN_OUT_TABLE[HMI_EASE_SEGMENTS + 1] =
+{
+    0, 368, 1408, 3024, 5120, 7600, 10368, 13328, 16384, 
+    19440, 22400, 25168, 27648, 29744, 31360, 32400, 32768
+};
+
+// Получает долю кривой плавности по таблице с линейной интерполяцией
+inline uint32_t hmi_ease_table(const uint16_t *table, uint32_t phase)
+{
+    const auto index = phase >> HMI_EASE_PHASE_BITS;
+    if (index >= HMI_EASE_SEGMENTS)
+        return table[HMI_EASE_SEGMENTS];
+    
+    const auto frac = phase & ((1 << HMI_EASE_PHASE_BITS) - 1);
+    return table[index] + (((uint32_t)(table[index + 1] - table[index]) * frac) >> HMI_EASE_PHASE_BITS);
+}
+
+// Получает долю кривой плавности по фазе
+inline uint32_t hmi_ease(hmi_smooth_mode_t mode, uint32_t phase)
+{
+    assert(phase <= HMI_EASE_PHASE_FULL);
+    switch (mode)
+    {
+        case HMI_SMOOTH_MODE_EASE_IN:
+            return hmi_ease_table(HMI_EASE_IN_TABLE, phase);
+        case HMI_SMOOTH_MODE_EASE_OUT:
+            // Зеркальная кривая с ускорением
+            return HMI_EASE_ONE - hmi_ease_table(HMI_EASE_IN_TABLE, HMI_EASE_PHASE_FULL - phase);
+        case HMI_SMOOTH_MODE_EASE_IN_OUT:
+            return hmi_ease_table(HMI_EASE_IN_OUT_TABLE, phase);
+        default:
+            assert(false);
+            return HMI_EASE_ONE;
+    }
+}
+
+// Шаговый интерполятор насыщенности без деления на кадрах (DDA)
+class hmi_sat_stepper_t
+{
+    // Начальное значение
+    hmi_sat_t from;
+    // Текущее значение
+    hmi_sat_t value;
+    // Модуль полного изменения
+    hmi_sat_t delta;
+    // Целая часть шага на кадр
+    hmi_sat_t step;
+    // Остаток шага на кадр (в долях количества кадров)
+    hmi_sat_t error_step;
+    // Направление изменения на уменьшение
+    bool down;
+    // Накопленная ошибка
+    uint32_t error;
+    
+public:
+    // Запуск для изменения по кривой плавности
+    void start(hmi_sat_t from, hmi_sat_t to)
+    {
+        this->from = value = from;
+        down = from > to;
+        delta = down ? from - to : to - from;
+    }
+    
+    // Запуск для линейного изменения за указанное количество кадров (единственное деление)
+    void start(hmi_sat_t from, hmi_sat_t to, uint32_t frame_count)
+    {
+        assert(frame_count > 0);
+        
+        start(from, to);
+        step = (hmi_sat_t)(delta / frame_count);
+        error_step = (hmi_sat_t)(delta % frame_count);
+        error = 0;
+    }
+    
+    // Линейный шаг на следующий кадр
+    hmi_sat_t linear(uint32_t frame_count)
+    {
+        auto offset = step;
+        error += error_step;
+        if (error >= frame_count)
+        {
+            error -= frame_count;
+            offset++;
+        }
+        
+        if (down)
+            value -= offset;
+        else
+            value += offset;
+        return value;
+    }
+    
+    // Значение по доле кривой плавности
+    hmi_sat_t eased(uint32_t ease) const
+    {
+        const auto offset = (hmi_sat_t)((delta * ease) >> HMI_EASE_BITS);
+        return down ? from - offset : from + offset;
+    }
+};
+
 // Класс модели фильтров
 template <typename DATA, hmi_rank_t COUNT>
 class hmi_model_t
@@ -161,6 +293,21 @@ public:
     using data_block_t = data_t[COUNT];
     // Количество разрядов
     static constexpr const hmi_rank_t RANK_COUNT = COUNT;
+    
+    // Тип данных для маски разрядов
+    using rank_mask_t = uint8_t;
+    STATIC_ASSERT(COUNT <= sizeof(rank_mask_t) * 8);
+    
+    // Маска без разрядов
+    static constexpr const rank_mask_t RANK_MASK_NONE = 0;
+    // Маска всех разрядов
+    static constexpr const rank_mask_t RANK_MASK_ALL = (rank_mask_t)((1 << COUNT) - 1);
+    
+    // Получает маску разряда
+    static constexpr rank_mask_t rank_mask(hmi_rank_t index)
+    {
+        return (rank_mask_t)(1 << index);
+    }
 
     // Приоритет захвата источника
     static constexpr const uint8_t PRIORITY_CAPTURE = PRIORITY_SOURCE + 1;
@@ -184,9 +331,26 @@ public:
             uint32_t frame = 0;
         } ranks[COUNT];
         
+        // Маска разрядов с незавершенным эффектом
+        rank_mask_t active = RANK_MASK_NONE;
+        
+    protected:
         // Общее количество фреймов
         uint32_t frame_count = 0;
         
+        // Переход разряда к следующему кадру, получает номер кадра
+        uint32_t frame_next(hmi_rank_t index)
+        {
+            index_check(index);
+            assert(process_needed(index));
+            
+            auto& frame = ranks[index].frame;
+            assert(frame < frame_count);
+            if (++frame >= frame_count)
+                active &= ~rank_mask(index);
+            return frame;
+        }
+        
     public:
         // Запуск на разряде
         void start(hmi_rank_t index, DATA from)
@@ -195,27 +359,26 @@ public:
             
             ranks[index].from = from;
             ranks[index].frame = 0;
+            active |= rank_mask(index);
         }
         
         // Получает необходимость обработки разряда
         bool process_needed(hmi_rank_t index) const
         {
             index_check(index);
-            return ranks[index].frame < frame_count;
+            return (active & rank_mask(index)) != 0;
+        }
+        
+        // Получает отсутствие незавершенных эффектов на всех разрядах
+        bool idle(void) const
+        {
+            return active == RANK_MASK_NONE;
         }
         
         // Обработка разряда
         DATA process(hmi_rank_t index, DATA to)
         {
-            index_check(index);
-            assert(process_needed(index));
-            
-            // Инкремент фрейма
-            auto& frame = ranks[index].frame;
-            assert(frame < frame_count);
-            frame++;
-
-            // Обработка
+            const auto frame = frame_next(index);
             return ranks[index].from.smooth(to, frame, frame_count);
         }
         
@@ -224,6 +387,7 @@ public:
         {
             for (hmi_rank_t i = 0; i < COUNT; i++)
                 ranks[i].frame = frame_count;
+            active = RANK_MASK_NONE;
         }
 
         // Устанвливает длительность в колчиестве кадров
@@ -249,6 +413,12 @@ public:
     {
         // Данные по разрядам конечного значения
         DATA to[COUNT];
+        // Интерполяторы каналов по разрядам
+        hmi_sat_stepper_t steppers[COUNT][DATA::SMOOTH_CHANNEL_COUNT];
+        // Режим плавного изменения
+        hmi_smooth_mode_t mode = HMI_SMOOTH_MODE_LINEAR;
+        // Приращение фазы кривой плавности на кадр
+        uint32_t phase_step = 0;
         
     public:
         // Запуск на разряде
@@ -256,12 +426,51 @@ public:
         {
             smoother_t::start(index, from);
             this->to[index] = to;
+            
+            // Все деления выполняются здесь, на кадрах только сложения и умножения
+            auto &stepper = steppers[index];
+            if (mode == HMI_SMOOTH_MODE_LINEAR)
+            {
+                for (uint8_t c = 0; c < DATA::SMOOTH_CHANNEL_COUNT; c++)
+                    stepper[c].start(from.smooth_channel(c), to.smooth_channel(c), this->frame_count);
+                return;
+            }
+            
+            for (uint8_t c = 0; c < DATA::SMOOTH_CHANNEL_COUNT; c++)
+                stepper[c].start(from.smooth_channel(c), to.smooth_channel(c));
+            phase_step = HMI_EASE_PHASE_FULL / this->frame_count;
         }
         
         // Обработка разряда
         DATA process(hmi_rank_t index)
         {
-            return smoother_t::process(index, to[index]);
+            const auto frame = smoother_t::frame_next(index);
+            // Последний кадр всегда точно в конечное значение
+            if (frame >= this->frame_count)
+                return to[index];
+            
+            auto result = to[index];
+            auto &stepper = steppers[index];
+            if (mode == HMI_SMOOTH_MODE_LINEAR)
+                for (uint8_t c = 0; c < DATA::SMOOTH_CHANNEL_COUNT; c++)
+                    result.smooth_channel(c) = stepper[c].linear(this->frame_count);
+            else
+            {
+                const auto ease = hmi_ease(mode, frame * phase_step);
+                for (uint8_t c = 0; c < DATA::SMOOTH_CHANNEL_COUNT; c++)
+                    result.smooth_channel(c) = stepper[c].eased(ease);
+            }
+            return result;
+        }
+        
+        // Устанавливает режим плавного изменения
+        void mode_set(hmi_smooth_mode_t value)
+        {
+            if (mode == value)
+                return;
+            
+            mode = value;
+            smoother_t::stop();
         }
     };
     
@@ -270,9 +479,20 @@ public:
     {
         friend class hmi_model_t;
         // Входящие данные
-        DATA in[COUNT];
+        data_block_t in;
+        
+        // Обновление данных с передачей измененных исходящих данных дальше
+        void refresh_flush(void)
+        {
+            refresh();
+            if (out_dirty != RANK_MASK_NONE)
+                output_flush();
+        }
         
     protected:
+        // Маска разрядов, исходящие данные которых не переданы следующему слою
+        rank_mask_t out_dirty = RANK_MASK_NONE;
+        
         // Обработчик события присоединения к цепочке
         virtual void attached(void)
         { }
@@ -280,6 +500,12 @@ public:
         // Обновление данных
         virtual void refresh(void)
         { }
+        
+        // Передача измененных исходящих данных следующему слою
+        virtual void output_flush(void)
+        {
+            out_dirty = RANK_MASK_NONE;
+        }
 
         // Получает, можно ли слой переносить в другую модель
         virtual bool moveable_get(void) const = 0;
@@ -300,20 +526,22 @@ public:
             return in[index];
         }
         
-        // Ввод данных
-        void input(hmi_rank_t index, DATA data)
+        // Ввод блока данных по маске разрядов (один вызов на слой)
+        virtual void input(const data_block_t &data, rank_mask_t mask)
         {
-            index_check(index);
-            // Изменились ли данные
-            if (in[index] == data)
-                return;
-            
-            // Обязательно скопировать
-            auto next = data;
-            // Обработка новых данных
-            data_changed(index, next);
-            // Установка новых данных
-            in[index] = data;
+            for (hmi_rank_t i = 0; mask != RANK_MASK_NONE; i++, mask >>= 1)
+            {
+                // Изменились ли данные
+                if ((mask & 1) == 0 || in[i] == data[i])
+                    continue;
+                
+                // Обязательно скопировать
+                auto next = data[i];
+                // Обработка новых данных
+                data_changed(i, next);
+                // Установка новых данных
+                in[i] = data[i];
+            }
         }
     };
 
@@ -321,7 +549,7 @@ public:
     class transceiver_t : public layer_t
     {
         // Исходящие данные
-        DATA out[COUNT];
+        data_block_t out;
         
         // Получает приведенный указательн на следующий слой
         layer_t * next_layer(void) const
@@ -329,25 +557,33 @@ public:
             return (layer_t *)list_item_t::next();
         }
         
-        // Вывод данных
-        void output(hmi_rank_t index, DATA data) const
+    protected:
+        // Передача измененных исходящих данных следующему слою (блоком)
+        virtual void output_flush(void) override
         {
-            index_check(index);
+            const auto mask = layer_t::out_dirty;
+            layer_t::output_flush();
             
             // Полуение следующего слоя
             const auto next = next_layer();
-            if (next != NULL)
-                next->input(index, data);
+            if (next != NULL && mask != RANK_MASK_NONE)
+                next->input(out, mask);
         }
         
-    protected:
-        // Установка выходных данных
+        // Ввод блока данных, изменения уходят дальше одним блоком
+        virtual void input(const data_block_t &data, rank_mask_t mask) override
+        {
+            layer_t::input(data, mask);
+            output_flush();
+        }
+        
+        // Установка выходных данных (передача при обновлении или вводе)
         void out_set(hmi_rank_t index, DATA data)
         {
             index_check(index);
             // Проверка на изменение не требуется
             out[index] = data;
-            output(index, data);
+            layer_t::out_dirty |= rank_mask(index);
         }
 
         // Получение выходных данных
@@ -368,8 +604,8 @@ public:
                     
                 case LIST_SIDE_NEXT:
                     // Передаем данные
-                    for (hmi_rank_t i = 0; i < COUNT; i++)
-                        output(i, out_get(i));
+                    layer_t::out_dirty = RANK_MASK_ALL;
+                    output_flush();
                     break;
                     
                 default:
@@ -386,6 +622,10 @@ public:
         // Обработка разрядов контроллером плавности
         bool smoother_process(smoother_to_t &smoother)
         {
+            // Простой без эффектов
+            if (smoother.idle())
+                return false;
+            
             auto transition = false;
             for (hmi_rank_t i = 0; i < COUNT; i++)
                 if (smoother.process_needed(i))
@@ -643,7 +883,7 @@ public:
     void refresh(void) const
     {
         for (auto i = list.head(); i != NULL; i = LIST_ITEM_NEXT(i))
-            i->refresh();
+            i->refresh_flush();
     }
     
     // Добавление слоя в цепочку (внутренний метод)
@@ -735,7 +975,7 @@ public:
             redirect = &to;
         
         // Последние выводиме данные дисплея
-        DATA data[COUNT];
+        data_block_t data;
         {
             const auto last = to.list.last();
             if (last != NULL)
@@ -765,8 +1005,7 @@ public:
         {
             const auto head = to.list.head();
             if (head != NULL)
-                for (hmi_rank_t i = 0; i < COUNT; i++)
-                    head->input(i, data[i]);
+                head->input(data, RANK_MASK_ALL);
         }
         
         // Событие присоединения
@@ -2,6 +2,7 @@
 #include "led.h"
 #include "nvic.h"
 #include "screen.h"
+#include "profile.h"
 
 // Используемый канал DMA
 static DMA_Channel_TypeDef * const LED_DMA_C6 = DMA1_Channel6;
@@ -131,6 +132,7 @@ void led_init(void)
 IRQ_ROUTINE
 void led_interrupt_dma(void)
 {
+    PROFILE_SCOPE(PROFILE_SITE_LED_DMA);
     TIM1->CR1 |= TIM_CR1_OPM;                                                   // OPM enable
     LED_DMA_C6->CCR &= ~DMA_CCR_EN;                                             // Channel disable
     DMA1->IFCR |= DMA_IFCR_CTCIF6;                                              // Clear CTCIF
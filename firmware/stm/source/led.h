@@ -33,6 +33,16 @@ struct led_data_t
         return rgb != other.rgb;
     }
     
+    // Количество каналов плавного изменения
+    static constexpr const uint8_t SMOOTH_CHANNEL_COUNT = sizeof(hmi_rgb_t::grb);
+    
+    // Получает канал плавного изменения
+    hmi_sat_t & smooth_channel(uint8_t index)
+    {
+        assert(index < SMOOTH_CHANNEL_COUNT);
+        return rgb.grb[index];
+    }
+    
     // Получает средний цвет к указанному в соотношении
     led_data_t smooth(led_data_t to, uint32_t ratio, uint32_t ratio_max) const
     {
@@ -169,6 +179,12 @@ public:
     led_source_t(const settings_t &_settings) : settings(_settings)
     { }
     
+    // Устанавливает режим смены цветов (по умолчанию линейный)
+    void smooth_mode_set(hmi_smooth_mode_t mode)
+    {
+        smoother.mode_set(mode);
+    }
+    
     // Обработчик секундного события
     void second(void)
     {
@@ -1,5 +1,6 @@
 ﻿#include "esp.h"
 #include "mcu.h"
+#include "nvic.h"
 #include "light.h"
 #include "timer.h"
 #include "xmath.h"
@@ -19,100 +20,128 @@ static light_settings_t light_settings @ STORAGE_SECTION =
     .nightmode = false,
 };
 
-// Генерация начала транзакции
-static bool light_wire_start(bool is_read)
+// Адрес датчика BH1750 на шине I2C
+#define LIGHT_WIRE_ADDRESS      0x46
+// Таймаут транзакции I2C
+#define LIGHT_WIRE_TIMEOUT_US   XK(10)
+// Пауза от завершения транзакции до отключения I2C (формирование стопа)
+#define LIGHT_WIRE_GAP_US       20
+// Пауза при активной линии ESP
+#define LIGHT_WIRE_DEFER_US     100
+// Период чтения результатов измерения
+#define LIGHT_MEASURE_US        XM(1)
+
+// Команды конфигурирования датчика
+static const uint8_t LIGHT_CONFIG_OPCODES[] =
 {
-    // Софтовый сброс I2C
-    I2C1->CR1 |= I2C_CR1_SWRST;                                                 // SW reset
-    I2C1->CR1 &= ~I2C_CR1_SWRST;                                                // SW unreset
+    0x01,                                                                       // Power On
+    0x47,                                                                       // Measurement time MSB
+    0x7E,                                                                       // Measurement time LSB
+    0x11,                                                                       // Continuously Hi-Res 2
+};
+
+// Фаза транзакции I2C
+enum light_wire_phase_t
+{
+    // Простой (I2C1 не тактируется)
+    LIGHT_WIRE_PHASE_IDLE = 0,
+    // Ожидание старта
+    LIGHT_WIRE_PHASE_START,
+    // Ожидание подтверждения адреса
+    LIGHT_WIRE_PHASE_ADDRESS,
+    // Ожидание передачи/приёма данных
+    LIGHT_WIRE_PHASE_DATA,
+    // Транзакция завершена успешно
+    LIGHT_WIRE_PHASE_DONE,
+    // Транзакция завершена с ошибкой
+    LIGHT_WIRE_PHASE_FAILED,
+};
+
+// Текущая транзакция I2C
+static struct
+{
+    // Фаза
+    volatile light_wire_phase_t phase;
+    // Чтение ли
+    bool read;
+    // Данные (код команды для записи, результат для чтения)
+    uint8_t data[2];
+} light_wire;
+
+// Сброс и конфигурирование I2C1 (тактирование включено)
+static void light_wire_setup(void)
+{
+    RCC->APB1RSTR |= RCC_APB1RSTR_I2C1RST;                                      // I2C1 reset
+    RCC->APB1RSTR &= ~RCC_APB1RSTR_I2C1RST;                                     // I2C1 unreset
 
-    // Конфигурирование I2C1
     I2C1->CR2 = I2C_CR2_FREQ_4 | I2C_CR2_FREQ_5;                                // APB 48 MHz
     I2C1->CCR = (I2C_CCR_CCR & 5) | I2C_CCR_DUTY | I2C_CCR_FS;                  // 400 KHz @ APB 48 MHz, FM, 16:9
     I2C1->CR1 = I2C_CR1_PE;                                                     // I2C on
-    
-    // Фаза старта
-    I2C1->CR1 |= I2C_CR1_START | I2C_CR1_ACK;                                   // Start, ACK
-    if (is_read)
-        I2C1->CR1 |= I2C_CR1_POS;                                               // NACK on 2nd byte
-    if (!mcu_pool_ms([](void) -> bool
-        {
-            return (I2C1->SR1 & I2C_SR1_SB) != 0;                               // Check SB
-        }))
-        return false;
-    
-    // Фаза адреса
-    I2C1->DR = 0x46 | is_read;                                                  // Send address
-    if (!mcu_pool_ms([](void) -> bool
-        {
-            return I2C1->SR1 != 0;                                              // Check SR1
-        }))
-        return false;
-
-    return ((I2C1->SR1 & I2C_SR1_AF) == 0) &&                                   // Check ACK
-           ((I2C1->SR2 & I2C_SR2_MSL) != 0);                                    // Check master mode
 }
 
-// Генерация завершения транзакции
-static bool light_wire_stop(void)
-{
-    // Ожидание передачи данных
-    if (!mcu_pool_ms([](void) -> bool
-        {
-            return (I2C1->SR1 & I2C_SR1_BTF) != 0;                              // Check BTF
-        }))
-        return false;
-    
-    // Фаза стопа
-    I2C1->CR1 |= I2C_CR1_STOP;
-    return mcu_pool_ms([](void) -> bool
-        {
-            return (I2C1->SR2 & I2C_SR2_BUSY) == 0;                             // Check BUSY
-        });
-}
+// Завершение транзакции из прерывания
+static void light_wire_finish(light_wire_phase_t phase);
+
+// Обработчик таймера транзакции (таймаут или отключение I2C после стопа)
+static void light_wire_timer_cb(void);
+// Таймер транзакции
+static timer_t light_wire_timer(light_wire_timer_cb);
 
-// Проверка завыершения транзакции
-static bool light_wire_finalize(void)
+// Событие завершения транзакции
+static event_t light_wire_event([](void)
 {
-    return (I2C1->SR2 == 0) && (I2C1->SR1 == 0);                                // Check SR1/2
-}
+    // Отключение после формирования стопа
+    if (light_wire.phase == LIGHT_WIRE_PHASE_DONE || light_wire.phase == LIGHT_WIRE_PHASE_FAILED)
+        light_wire_timer.start_us(LIGHT_WIRE_GAP_US);
+});
 
-// Чтение данных по I2C
-static bool light_wire_read(uint8_t &dr0, uint8_t &dr1)
+// Начало транзакции (без ожидания, далее в прерываниях)
+static void light_wire_begin(bool read, uint8_t opcode = 0)
 {
-    if (!light_wire_start(true))
-        return false;
+    assert(light_wire.phase == LIGHT_WIRE_PHASE_IDLE);
+    light_wire.read = read;
+    light_wire.data[0] = opcode;
+    light_wire.phase = LIGHT_WIRE_PHASE_START;
     
-    // Сброс подтверждения
-    I2C1->CR1 &= ~I2C_CR1_ACK;                                                  // Clear ACK
+    RCC->APB1ENR |= RCC_APB1ENR_I2C1EN;                                         // I2C1 clock enable
+    I2C1->CR2 |= I2C_CR2_ITEVTEN | I2C_CR2_ITERREN;                             // Event, error IRQ enable
+    I2C1->CR1 |= I2C_CR1_ACK | (read ? I2C_CR1_POS : 0);                        // ACK, NACK on 2nd byte for read
+    I2C1->CR1 |= I2C_CR1_START;                                                 // Start
     
-    if (!light_wire_stop())
-        return false;
-
-    dr0 = I2C1->DR;                                                             // Read first byte
-    dr1 = I2C1->DR;                                                             // Read second byte
-
-    return light_wire_finalize();
+    // Таймаут
+    light_wire_timer.start_us(LIGHT_WIRE_TIMEOUT_US);
 }
 
-// Запись байта данных по I2C
-static bool light_wire_write(uint8_t opcode)
+// Обработка завершения транзакции автоматом состояний (предварительное объявление)
+static void light_state_complete(bool success);
+
+static void light_wire_timer_cb(void)
 {
-    if (!light_wire_start(false))
-        return false;
+    const auto phase = light_wire.phase;
+    if (phase == LIGHT_WIRE_PHASE_IDLE)
+        return;
     
-    // Ожидание байта
-    if (!mcu_pool_ms([](void) -> bool
-        {
-            return (I2C1->SR1 & I2C_SR1_TXE) != 0;                              // Check TXE
-        }))
-        return false;
+    // Запрет прерываний транзакции (при таймауте еще включены)
+    I2C1->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);                          // Event, error IRQ disable
+    
+    // После сбоя, таймаута или незавершенного стопа - восстановление периферии
+    const auto success = phase == LIGHT_WIRE_PHASE_DONE;
+    if (!success || (I2C1->SR2 & I2C_SR2_BUSY) != 0)                            // Check BUSY
+        light_wire_setup();
     
-    I2C1->DR = opcode;                                                          // Write TX byte
+    // Отключение I2C1 до следующей транзакции
+    I2C1->CR1 &= ~I2C_CR1_POS;                                                  // Clear POS
+    RCC->APB1ENR &= ~RCC_APB1ENR_I2C1EN;                                        // I2C1 clock disable
+    light_wire.phase = LIGHT_WIRE_PHASE_IDLE;
     
-    // Завершение
-    return light_wire_stop() && 
-           light_wire_finalize();
+    light_state_complete(success);
+}
+
+static void light_wire_finish(light_wire_phase_t phase)
+{
+    I2C1->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);                          // Event, error IRQ disable
+    light_wire.phase = phase;
+    light_wire_event.raise();
 }
 
 // Обработчик таймера автомата состояний (предварительное объявление)
@@ -127,6 +156,8 @@ static __no_init enum light_state_t
     LIGHT_STATE_READING,
 } light_state;
 
+// Индекс передаваемой команды конфигурирования
+static __no_init uint8_t light_config_index;
 // Максимальное покзаание в люксах
 static __no_init float_t light_max_lux;
 // Текущее покзаание в люксах
@@ -164,10 +195,11 @@ static void light_level_update(void)
 }
 
 // Переход к состоянию конфигурирования
-static void light_state_config(void)
+static void light_state_config(uint32_t delay_us)
 {
-    light_state_timer.start_us(TIMER_US_MIN);
+    light_state_timer.start_us(delay_us);
     light_state = LIGHT_STATE_CONGIF;
+    light_config_index = 0;
 }
 
 // Обрабогтчик ошибки измерения
@@ -176,8 +208,49 @@ static void light_measure_error(void)
     // Текущее значение не известно
     light_current_lux = NAN;
     light_current_level = LIGHT_LEVEL_MAX;
-    // Переход к конфигурированию
-    light_state_config();
+    // Переконфигурирование с паузой (датчик может отсутствовать)
+    light_state_config(LIGHT_MEASURE_US);
+}
+
+// Обработка результата измерения
+static void light_measure_process(uint16_t raw)
+{
+    // В рандом младший бит
+    random_noise_bit((raw & 2) != 0);
+    
+    // Конвертирование
+    float_t lux;
+    {
+        // Точность
+        constexpr const auto ACCURACY = 1.2f;
+        // Значение регистра тайминга по умолчанию
+        constexpr const auto MTREG_DEF = 69.0f;
+        // Текущее значение регистра тайминга
+        constexpr const auto MTREG_CUR = 254.0f;
+        // Делитель при высокой точности
+        constexpr const auto HIRES_DIV = 2.0f;
+        // Коофициент трансформации
+        constexpr const auto COEFF = 1.0f / ACCURACY * (MTREG_DEF / MTREG_CUR) / HIRES_DIV;
+
+        // Пересчет
+        lux = raw * COEFF;
+    }
+    
+    // Если текущее значение не определенно или больше
+    if (isnan(light_current_lux) || light_current_lux < lux)
+    {
+        light_max_lux = lux;
+        light_level_update();
+        return;
+    }
+    
+    // Определение минимума
+    if (light_max_lux < lux)
+        light_max_lux = lux;
+    
+    // Прескалер обновления
+    if (++light_exposure_time > light_settings.exposure)
+        light_level_update();
 }
 
 // Обработчик таймера автомата состояний
@@ -187,99 +260,52 @@ static void light_state_timer_cb(void)
      * В Errata запрещено использование SPI1 и I2C в случае ремапа */
     if (esp_wire_active())
     {
-        light_state_config();
+        light_state_timer.start_us(LIGHT_WIRE_DEFER_US);
         return;
     }
     
-    // Включение I2C1
-    RCC->APB1ENR |= RCC_APB1ENR_I2C1EN;                                         // I2C1 clock enable
-    RCC->APB1RSTR |= RCC_APB1RSTR_I2C1RST;                                      // I2C1 reset
-    RCC->APB1RSTR &= ~RCC_APB1RSTR_I2C1RST;                                     // I2C1 unreset
+    switch (light_state)
+    {
+        case LIGHT_STATE_CONGIF:
+            light_wire_begin(false, LIGHT_CONFIG_OPCODES[light_config_index]);
+            break;
+            
+        case LIGHT_STATE_READING:
+            light_wire_begin(true);
+            break;
+    }
+}
+
+static void light_state_complete(bool success)
+{
+    if (!success)
+    {
+        // Опа...
+        light_measure_error();
+        return;
+    }
     
     switch (light_state)
     {
         case LIGHT_STATE_CONGIF:
-            // Питание, тайминг, измерение
-            if (light_wire_write(0x01) &&                                       // Power On
-                light_wire_write(0x47) &&                                       // Measurement time MSB
-                light_wire_write(0x7E) &&                                       // Measurement time LSB
-                light_wire_write(0x21))                                         // Single Hi-Res 2 
-                // Ожидание 200 мС
+            // Следующая команда
+            if (++light_config_index < array_length(LIGHT_CONFIG_OPCODES))
             {
-                // Переход к чтению
-                light_state = LIGHT_STATE_READING;
-                // Задержка обработки
-                light_state_timer.start_hz(1);
+                light_state_timer.start_us(TIMER_US_MIN);
                 break;
             }
             
-            // Опа...
-            light_measure_error();
+            // Датчик измеряет непрерывно, далее только чтение
+            light_state = LIGHT_STATE_READING;
+            light_state_timer.start_us(LIGHT_MEASURE_US);
             break;
             
         case LIGHT_STATE_READING:
-            {
-                // Чтение результатов
-                union
-                {
-                    uint16_t raw;
-                    struct
-                    {
-                        uint8_t lsb, msb;
-                    };
-                };
-                
-                if (!light_wire_read(msb, lsb))
-                {
-                    light_measure_error();
-                    break;
-                }
-
-                // В рандом младший бит
-                random_noise_bit((raw & 2) != 0);
-                
-                // Конвертирование
-                float_t lux;
-                {
-                    // Точность
-                    constexpr const auto ACCURACY = 1.2f;
-                    // Значение регистра тайминга по умолчанию
-                    constexpr const auto MTREG_DEF = 69.0f;
-                    // Текущее значение регистра тайминга
-                    constexpr const auto MTREG_CUR = 254.0f;
-                    // Делитель при высокой точности
-                    constexpr const auto HIRES_DIV = 2.0f;
-                    // Коофициент трансформации
-                    constexpr const auto COEFF = 1.0f / ACCURACY * (MTREG_DEF / MTREG_CUR) / HIRES_DIV;
-
-                    // Пересчет
-                    lux = raw * COEFF;
-                }
-                
-                // Следующее измерение
-                light_state_config();
-                
-                // Если текущее значение не определенно или больше
-                if (isnan(light_current_lux) || light_current_lux < lux)
-                {
-                    light_max_lux = lux;
-                    light_level_update();
-                    break;
-                }
-                
-                // Определение минимума
-                if (light_max_lux < lux)
-                    light_max_lux = lux;
-                
-                // Прескалер обновления
-                if (++light_exposure_time > light_settings.exposure)
-                    light_level_update();
-            }
+            // Следующее измерение
+            light_state_timer.start_us(LIGHT_MEASURE_US);
+            light_measure_process((uint16_t)(light_wire.data[0] << 8 | light_wire.data[1]));
             break;
     }
-    
-    // Отключение I2C1
-    RCC->APB1ENR &= ~RCC_APB1ENR_I2C1EN;                                        // I2C1 clock disable
 }
 
 // Признак нобходимости установки максимального уровня
@@ -297,6 +323,8 @@ protected:
 
     // Текущее значение яркости
     uint8_t level = LIGHT_LEVEL_MAX;
+    // Выходные данные доведены до конечных (обработка кадра не требуется)
+    bool settled = false;
     
     // Получает финальные данные относительно освещенности
     virtual data_t final_data_get(data_t source) const = 0;
@@ -313,6 +341,7 @@ public:
     // Сброс контроллера плавного изменения
     void reset_smoother(void)
     {
+        settled = false;
         smoother.time_set(light_settings.autoset && light_setup_maximum_count <= 0 ? 
             light_settings.smooth : 
             0);
@@ -341,7 +370,10 @@ protected:
         
         // Передача напрямую если подключились перед нами
         if (side == LIST_SIDE_PREV)
+        {
             smoother.stop();
+            settled = false;
+        }
     }
     
     // Обработчик изменения данных
@@ -368,6 +400,12 @@ protected:
         const bool start_effect = level != level_next;
         if (start_effect)
             level = level_next;
+        // Уровень прежний, переход завершен - выход поддерживает data_changed
+        else if (settled)
+            return;
+        
+        // Проход без активного перехода доводит все разряды до конечных данных
+        settled = !start_effect && smoother.idle();
         
         // Обработка разрядов
         for (hmi_rank_t i = 0; i < model_t::RANK_COUNT; i++)
@@ -494,6 +532,14 @@ protected:
 
 void light_init(void)
 {
+    // Конфигурирование I2C1 (тактирование только на время транзакций)
+    RCC->APB1ENR |= RCC_APB1ENR_I2C1EN;                                         // I2C1 clock enable
+    light_wire_setup();
+    RCC->APB1ENR &= ~RCC_APB1ENR_I2C1EN;                                        // I2C1 clock disable
+    // Прерывания I2C1
+    nvic_irq_enable(I2C1_EV_IRQn);
+    nvic_irq_enable(I2C1_ER_IRQn);
+    
     // Изначально в состояние ошибки
     light_measure_error();
     
@@ -524,3 +570,63 @@ void light_setup_maximum(bool state)
     
     light_control_reset_smoothers();
 }
+
+bool light_wire_active(void)
+{
+    return (RCC->APB1ENR & RCC_APB1ENR_I2C1EN) != 0;                            // Check I2C1 clock enabled
+}
+
+IRQ_ROUTINE
+void light_interrupt_i2c_event(void)
+{
+    const auto sr1 = I2C1->SR1;                                                 // Read SR1
+    switch (light_wire.phase)
+    {
+        case LIGHT_WIRE_PHASE_START:
+            if ((sr1 & I2C_SR1_SB) == 0)                                        // Check SB
+                break;
+            I2C1->DR = LIGHT_WIRE_ADDRESS | light_wire.read;                    // Send address
+            light_wire.phase = LIGHT_WIRE_PHASE_ADDRESS;
+            return;
+            
+        case LIGHT_WIRE_PHASE_ADDRESS:
+            if ((sr1 & I2C_SR1_ADDR) == 0)                                      // Check ADDR
+                break;
+            if (light_wire.read)
+                I2C1->CR1 &= ~I2C_CR1_ACK;                                      // Clear ACK (before ADDR clear)
+            (void)I2C1->SR2;                                                    // Clear ADDR
+            if (!light_wire.read)
+                I2C1->DR = light_wire.data[0];                                  // Write TX byte
+            light_wire.phase = LIGHT_WIRE_PHASE_DATA;
+            return;
+            
+        case LIGHT_WIRE_PHASE_DATA:
+            if ((sr1 & I2C_SR1_BTF) == 0)                                       // Check BTF
+                break;
+            I2C1->CR1 |= I2C_CR1_STOP;                                          // Stop
+            if (light_wire.read)
+            {
+                light_wire.data[0] = I2C1->DR;                                  // Read first byte
+                light_wire.data[1] = I2C1->DR;                                  // Read second byte
+            }
+            light_wire_finish(LIGHT_WIRE_PHASE_DONE);
+            return;
+            
+        default:
+            break;
+    }
+    
+    // Неожиданное событие
+    light_wire_finish(LIGHT_WIRE_PHASE_FAILED);
+}
+
+IRQ_ROUTINE
+void light_interrupt_i2c_error(void)
+{
+    // Нет подтверждения - освобождение шины
+    if ((I2C1->SR1 & I2C_SR1_AF) != 0)                                          // Check AF
+        I2C1->CR1 |= I2C_CR1_STOP;                                              // Stop
+    I2C1->SR1 &= ~(I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_OVR);     // Clear error flags
+    
+    light_wire_finish(LIGHT_WIRE_PHASE_FAILED);
+}
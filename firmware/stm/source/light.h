@@ -7,5 +7,12 @@
 void light_init(void);
 // Установка режима максимальной освещенности
 void light_setup_maximum(bool state);
+// Получает признак активности линии датчика
+bool light_wire_active(void);
+
+// Обработчик события I2C
+void light_interrupt_i2c_event(void);
+// Обработчик ошибки I2C
+void light_interrupt_i2c_error(void);
 
 #endif // __LIGHT_H
@@ -15,6 +15,9 @@
 #include "light.h"
 #include "timer.h"
 #include "screen.h"
+#include "update.h"
+#include "metrics.h"
+#include "profile.h"
 #include "display.h"
 #include "storage.h"
 
@@ -27,13 +30,16 @@ __task __noreturn void main(void)
     nvic_init();
     mcu_init();
     wdt_init();
+    storage_init();
     rtc_init();
     io_init();
     timer_init();
+    profile_init();
     debug_init();
     
     // Остальные модули
     esp_init();
+    metrics_init();
     led_init();
     neon_init();
     temp_init();
@@ -45,6 +51,7 @@ __task __noreturn void main(void)
     // Сервисы
     wifi_init();
     ntime_init();
+    update_init();
     
     // Обработка событий
     event_t::loop();
@@ -0,0 +1,65 @@
+﻿#include "esp.h"
+#include "rtc.h"
+#include "metrics.h"
+#include <proto/metrics.inc.h>
+
+// Перевод тактов ядра в мкС
+constexpr const uint32_t METRICS_CYCLES_PER_US = FMCU_NORMAL_MHZ;
+
+// Счетчики кадров экрана
+metrics_frame_t metrics_frame;
+
+// Обработчик команды получения счетчиков
+static class metrics_command_handler_get_t : public ipc_responder_template_t<metrics_command_get_t>
+{
+public:
+    // Учет смещения часов (история сдвигается, первое - последнее)
+    void sync_offset(int16_t seconds)
+    {
+        auto &response = command.response;
+        for (auto i = METRICS_SYNC_HISTORY - 1; i > 0; i--)
+            response.sync_offsets[i] = response.sync_offsets[i - 1];
+        response.sync_offsets[0] = seconds;
+        if (response.sync_count < UINT16_MAX)
+            response.sync_count++;
+    }
+protected:
+    // Событие обработки данных
+    virtual void work(bool idle) override final
+    {
+        if (idle)
+            return;
+
+        // Подготовка данных (история синхронизаций уже в ответе)
+        auto &response = command.response;
+        response.uptime = rtc_uptime_seconds;
+        esp_stat_get(response.link, response.retries, response.esp_resets);
+        
+        // Кадры экрана с закрытием окна
+        auto &frame = response.frame;
+        frame.count = metrics_frame.count;
+        frame.skipped = metrics_frame.skipped;
+        frame.max = (uint16_t)minimum<uint32_t>(metrics_frame.window_max / METRICS_CYCLES_PER_US, UINT16_MAX);
+        frame.avg = metrics_frame.window_count <= 0 ? 0 :
+            (uint16_t)minimum<uint64_t>(metrics_frame.window_total / metrics_frame.window_count / METRICS_CYCLES_PER_US, frame.max);
+        metrics_frame.window_count = 0;
+        metrics_frame.window_max = 0;
+        metrics_frame.window_total = 0;
+        
+        // Передача
+        transmit();
+    }
+} metrics_command_handler_get;
+
+void metrics_sync_offset(int64_t seconds)
+{
+    metrics_command_handler_get.sync_offset((int16_t)maximum<int64_t>(INT16_MIN, minimum<int64_t>(seconds, INT16_MAX)));
+}
+
+void metrics_init(void)
+{
+    // Счетчик тактов DWT запущен модулем профилирования
+    
+    // Обработчики IPC
+    esp_handler_add(metrics_command_handler_get);
+}
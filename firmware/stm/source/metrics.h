@@ -0,0 +1,46 @@
+﻿#ifndef __METRICS_H
+#define __METRICS_H
+
+#include "system.h"
+
+// Счетчики кадров экрана
+struct metrics_frame_t
+{
+    // Количество обновлений
+    uint32_t count;
+    // Пропущенные обновления (инкремент из прерывания)
+    volatile uint32_t skipped;
+    // Количество обновлений с прошлого запроса
+    uint32_t window_count;
+    // Наибольшее время обновления с прошлого запроса [такты]
+    uint32_t window_max;
+    // Суммарное время обновлений с прошлого запроса [такты]
+    uint64_t window_total;
+};
+
+// Счетчики кадров экрана
+extern metrics_frame_t metrics_frame;
+
+// Учет времени обновления экрана
+inline void metrics_frame_account(uint32_t cycles)
+{
+    metrics_frame.count++;
+    metrics_frame.window_count++;
+    metrics_frame.window_total += cycles;
+    if (metrics_frame.window_max < cycles)
+        metrics_frame.window_max = cycles;
+}
+
+// Учет пропущенного обновления экрана
+inline void metrics_frame_skip(void)
+{
+    metrics_frame.skipped++;
+}
+
+// Учет смещения часов при синхронизации времени
+void metrics_sync_offset(int64_t seconds);
+
+// Инициализация модуля
+void metrics_init(void);
+
+#endif // __METRICS_H
@@ -1,48 +1,52 @@
 ﻿#include "io.h"
+#include "nvic.h"
 #include "neon.h"
-#include "timer.h"
+#include "debug.h"
 #include "screen.h"
 #include "system.h"
 
-// Смещение насыщенности для сброс PWM после UEV
-constexpr const hmi_sat_t NEON_SAT_DX = 1;
+// Защитный интервал после UEV для переключения адресных линий [такты PWM]
+constexpr const hmi_sat_t NEON_SAT_GUARD = 2;
 // Частота мультиплексирования неонок [Гц]
 constexpr const uint32_t NEON_MUX_HZ = HMI_FRAME_RATE * NEON_COUNT;
 
-// Сброс адресной линии анодов
-RAM_IAR
-static void neon_sel_reset(void)
-{
-    IO_PORT_RESET_MASK(IO_SSEL0_PORT, 
-        IO_MASK(IO_SSEL0) | 
-        IO_MASK(IO_SSEL1));
-}
+// Маска адресной линии анодов
+constexpr const uint32_t NEON_SEL_MASK = IO_MASK(IO_SSEL0) | IO_MASK(IO_SSEL1);
 
 // Драйвер вывода неонок
 static class neon_display_t : public neon_model_t::display_t
 {
-    // Данные неонки (прерывание)
-    struct irq_t
+    // Шаг развертки неонки (таблица кадра, читается прерыванием)
+    struct scan_t
     {
-        // Ширина импульса
-        uint8_t pw = 0;
-    } irq[NEON_COUNT];
+        // Слово BSRR адресной линии анодов
+        uint32_t sel;
+        // Значение сравнения PWM (начало импульса)
+        uint16_t ccr;
+    } scan[NEON_COUNT];
 
-    // Данные лампы (вывод)
-    struct out_t
-    {
-        // Для определения обновления
-        bool unchanged = false;
-    } out[NEON_COUNT];
+    // Маска разрядов, данные которых изменились с прошлого обновления
+    neon_model_t::rank_mask_t dirty = neon_model_t::RANK_MASK_ALL;
     
     // Индекс выводимой дампы (мультиплексирование)
     uint8_t nmi = 0;
+    
+    // Формирование шага развертки неонки
+    static scan_t scan_calc(hmi_rank_t index, uint8_t pw)
+    {
+        scan_t result;
+        // Сброс и установка линий одним словом BSRR
+        result.sel = MASK_32(NEON_SEL_MASK, 16) | MASK_32(index, IO_SSEL0);
+        // Импульс от CCR до конца периода, длительность как HMI_SAT_MAX - pw
+        result.ccr = pw + NEON_SAT_GUARD;
+        return result;
+    }
 protected:
     // Обработчик изменения данных
     virtual void data_changed(hmi_rank_t index, neon_data_t &data) override final
     {
         // Установка данных
-        out[index].unchanged = false;
+        dirty |= neon_model_t::rank_mask(index);
     }
     
     // Обновление состояния неонок
@@ -51,77 +55,89 @@ protected:
         // Базовый метод
         display_t::refresh();
         
-        // Пересчет данных прерываний
-        for (hmi_rank_t i = 0; i < NEON_COUNT; i++)
+        // Пересчет данных прерываний только по измененным разрядам
+        auto mask = dirty;
+        dirty = neon_model_t::RANK_MASK_NONE;
+        for (hmi_rank_t i = 0; mask != neon_model_t::RANK_MASK_NONE; i++, mask >>= 1)
         {
-            if (out[i].unchanged)
+            if ((mask & 1) == 0)
                 continue;
-            out[i].unchanged = true;
             
             // Пересчет ширины импульса из насыщенности
             const auto pw = HMI_SAT_MAX - HMI_GAMMA_TABLE[in_get(i).sat];
+            const auto scan_data = scan_calc(i, pw);
             
             // Перенос данных с запретом прерываний
             IRQ_SAFE_ENTER();
-                irq[i].pw = pw;
+                scan[i] = scan_data;
             IRQ_SAFE_LEAVE();
         }
     }
 public:
-    // Мультиплексирование
+    // Конструктор по умолчанию
+    neon_display_t(void)
+    {
+        for (hmi_rank_t i = 0; i < NEON_COUNT; i++)
+            scan[i] = scan_calc(i, 0);
+    }
+    
+    // Мультиплексирование (по UEV таймера, PWM в защитном интервале неактивен)
     RAM_IAR
     void mux(void)
     {
         // Установка анодного напряжения
-        neon_sel_reset();
-        IO_PORT_SET_MASK(IO_SSEL0_PORT, MASK_32(nmi, IO_SSEL0));
-
-        // PWM
-        TIM2->CNT = (irq[nmi].pw >> 1) + NEON_SAT_DX;                           // Update counter (center aligned)
-        TIM2->CCR3 = irq[nmi].pw + NEON_SAT_DX;                                 // Update CC3 value
-        TIM2->CR1 |= TIM_CR1_CEN;                                               // TIM enable
-
+        IO_SSEL0_PORT->BSRR = scan[nmi].sel;
+        
         // Переход к следующей неонке
         if (++nmi >= NEON_COUNT)
             nmi = 0;
+        
+        // Импульс следующей неонки (CCR3 загрузится по UEV)
+        TIM2->CCR3 = scan[nmi].ccr;                                             // Update CC3 preload value
+        DEBUG_TRACE(NEON_MUX, nmi, scan[nmi].ccr);
     }
 } neon_display;
 
-// Обработчик таймера мультиплексирования неонок
-RAM_IAR
-static void neon_mux_timer_cb(void)
-{
-    neon_display.mux();
-}
-
-// Таймер мультиплексирования неонок
-static timer_t neon_mux_timer(neon_mux_timer_cb);
-
 void neon_init(void)
 {
     // Сброс адресных линий
-    neon_sel_reset();
+    IO_PORT_RESET_MASK(IO_SSEL0_PORT, NEON_SEL_MASK);
     
     // Тактирование и сброс таймера
     RCC->APB1ENR |= RCC_APB1ENR_TIM2EN;                                         // TIM clock enable
     RCC->APB1RSTR |= RCC_APB1RSTR_TIM2RST;                                      // TIM reset
     RCC->APB1RSTR &= ~RCC_APB1RSTR_TIM2RST;                                     // TIM unreset
     
-    // Базовое конфигурирование таймера без PWM
-    TIM2->CR1 = TIM_CR1_OPM;                                                    // TIM disable, UEV on, OPM on, Up, CMS edge, Clock /1, ARR preload off
-    TIM2->PSC = FMCU_NORMAL_HZ / (NEON_MUX_HZ * (HMI_SAT_COUNT + 1)) - 1;       // Prescaler (frequency)
-    TIM2->ARR = HMI_SAT_MAX + NEON_SAT_DX - 1;                                  // PWM Period
+    // Базовое конфигурирование таймера, период - шаг мультиплексирования
+    TIM2->CR1 = 0;                                                              // TIM disable, UEV on, OPM off, Up, CMS edge, Clock /1, ARR preload off
+    TIM2->PSC = FMCU_NORMAL_HZ / (NEON_MUX_HZ * (HMI_SAT_MAX + NEON_SAT_GUARD)) - 1; // Prescaler (frequency)
+    TIM2->ARR = HMI_SAT_MAX + NEON_SAT_GUARD - 1;                               // PWM Period
     TIM2->BDTR = TIM_BDTR_MOE;                                                  // Main Output enable
     
     // Настройка канала 3
-    TIM2->CCR3 = HMI_SAT_MAX;                                                   // Update CC3 value (prevent initial output high state)
-    TIM2->CCMR2 = TIM_CCMR2_OC3M_0 | TIM_CCMR2_OC3M_1 | TIM_CCMR2_OC3M_2;       // CC3 output, CC3 Fast off, CC3 preload off, CC3 mode PWM 2 (111)
+    TIM2->CCR3 = HMI_SAT_MAX + NEON_SAT_GUARD;                                  // Update CC3 value (prevent initial output high state)
+    TIM2->CCMR2 = TIM_CCMR2_OC3PE |                                             // CC3 output, CC3 Fast off, CC3 preload on,
+                  TIM_CCMR2_OC3M_0 | TIM_CCMR2_OC3M_1 | TIM_CCMR2_OC3M_2;       // CC3 mode PWM 2 (111)
     TIM2->CCER = TIM_CCER_CC3E;                                                 // CC3 output enable, CC3 Polarity high
+    TIM2->EGR = TIM_EGR_UG;                                                     // Load prescaler and preload values
+    TIM2->SR &= ~TIM_SR_UIF;                                                    // Clear IRQ update pending flag
+    TIM2->DIER = TIM_DIER_UIE;                                                  // Update IRQ enable
     
     // Добавление дисплея в цепочку
     screen.neon.attach(neon_display);
-    // Выставление задачи мультиплексирования
-    neon_mux_timer.start_hz(NEON_MUX_HZ, TIMER_PRI_CRITICAL | TIMER_FLAG_LOOP);
+    
+    // Мультиплексирование по UEV таймера без списка программных таймеров
+    nvic_irq_enable(TIM2_IRQn);                                                 // TIM2 IRQ enable
+    nvic_irq_priority_set(TIM2_IRQn, NVIC_IRQ_PRIORITY_HIGHEST);                // Highest TIM2 IRQ priority
+    TIM2->CR1 |= TIM_CR1_CEN;                                                   // TIM enable
+}
+
+RAM_IAR
+IRQ_ROUTINE
+void neon_interrupt_mux(void)
+{
+    TIM2->SR &= ~TIM_SR_UIF;                                                    // Clear IRQ update pending flag
+    neon_display.mux();
 }
 
 void neon_source_t::refresh(void)
@@ -30,6 +30,16 @@ struct neon_data_t
         return sat != other.sat;
     }
     
+    // Количество каналов плавного изменения
+    static constexpr const uint8_t SMOOTH_CHANNEL_COUNT = 1;
+    
+    // Получает канал плавного изменения
+    hmi_sat_t & smooth_channel(uint8_t index)
+    {
+        assert(index < SMOOTH_CHANNEL_COUNT);
+        return sat;
+    }
+    
     // Получает среднюю яркость к указанноой в соотношении
     neon_data_t smooth(neon_data_t to, uint32_t ratio, uint32_t ratio_max) const
     {
@@ -137,4 +147,7 @@ public:
 // Инициализация модуля
 void neon_init(void);
 
+// Обработчик таймера мультиплексирования
+void neon_interrupt_mux(void);
+
 #endif // __NEON_H
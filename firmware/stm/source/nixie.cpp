@@ -1,35 +1,22 @@
 ﻿#include "io.h"
-#include "timer.h"
+#include "nvic.h"
+#include "debug.h"
+#include "event.h"
 #include "nixie.h"
 #include "screen.h"
 #include "system.h"
+#include "metrics.h"
+#include "profile.h"
 
-// Смещение насыщенности для сброса PWM после UEV
-constexpr const hmi_sat_t NIXIE_SAT_DX = 1;
+// Защитный интервал после UEV для переключения адресных линий [такты PWM]
+constexpr const hmi_sat_t NIXIE_SAT_GUARD = 2;
 // Частота мультиплексирования ламп [Гц]
 constexpr const uint32_t NIXIE_MUX_HZ = HMI_FRAME_RATE * NIXIE_COUNT;
 
-// Сброс адресной линии анодов
-RAM_IAR
-static void nixie_sela_reset(void)
-{
-    IO_PORT_RESET_MASK(IO_TSELA0_PORT,
-        IO_MASK(IO_TSELA0) |
-        IO_MASK(IO_TSELA1) |
-        IO_MASK(IO_TSELA2));
-}
-
-// Сброс адресной линии катодов
-RAM_IAR
-static void nixie_selc_reset(void)
-{
-    IO_PORT_RESET_MASK(IO_TSELP_PORT,
-        IO_MASK(IO_TSELP) |
-        IO_MASK(IO_TSELC0) |
-        IO_MASK(IO_TSELC1) |
-        IO_MASK(IO_TSELC2) |
-        IO_MASK(IO_TSELC3));
-}
+// Маска адресной линии анодов
+constexpr const uint32_t NIXIE_SELA_MASK = IO_MASK(IO_TSELA0) | IO_MASK(IO_TSELA1) | IO_MASK(IO_TSELA2);
+// Маска адресной линии катодов
+constexpr const uint32_t NIXIE_SELC_MASK = IO_MASK(IO_TSELP) | IO_MASK(IO_TSELC0) | IO_MASK(IO_TSELC1) | IO_MASK(IO_TSELC2) | IO_MASK(IO_TSELC3);
 
 // Подсчет значения адресной линии катодов
 static constexpr uint8_t nixie_selc_calc(uint8_t index, bool dot)
@@ -40,35 +27,27 @@ static constexpr uint8_t nixie_selc_calc(uint8_t index, bool dot)
 // Событие одновления дисплея
 static event_t nixie_screen_refresh([](void)
 {
+    const uint32_t start = DWT->CYCCNT;
     screen.refresh();
+    metrics_frame_account(DWT->CYCCNT - start);
 });
 
 // Драйвер вывода ламп
 static class nixie_display_t : public nixie_model_t::display_t
 {
-    // Данные лампы (прерывание)
-    struct irq_t
+    // Шаг развертки лампы (таблица кадра, читается прерыванием)
+    struct scan_t
     {
-        // Ширина импульса
-        uint8_t pw;
-        // Адрес катода
-        uint8_t selc;
-        
-        // Конструктор по умолчанию
-        irq_t(void) : pw(0), selc(nixie_selc_calc(NIXIE_DIGIT_SPACE, false))
-        { }
-        
-        // Конструктор с данными
-        irq_t(uint8_t _pw, uint8_t _selc) : pw(_pw), selc(_selc)
-        { }
-    } irq[NIXIE_COUNT];
+        // Слово BSRR адресной линии анодов
+        uint32_t sela;
+        // Слово BSRR адресной линии катодов
+        uint32_t selc;
+        // Значение сравнения PWM (начало импульса)
+        uint16_t ccr;
+    } scan[NIXIE_COUNT];
 
-    // Данные лампы (вывод)
-    struct out_t
-    {
-        // Для определения обновления
-        bool unchanged = false;
-    } out[NIXIE_COUNT];
+    // Маска разрядов, данные которых изменились с прошлого обновления
+    nixie_model_t::rank_mask_t dirty = nixie_model_t::RANK_MASK_ALL;
     
     // Индекс выводимой дампы (мультиплексирование)
     uint8_t nmi = 0;
@@ -79,12 +58,24 @@ static class nixie_display_t : public nixie_model_t::display_t
         8, 3, 1, 6, 9, 0, 4, 2, 7, 5, 10
     };
     
+    // Формирование шага развертки лампы
+    static scan_t scan_calc(hmi_rank_t index, uint8_t pw, uint8_t selc)
+    {
+        scan_t result;
+        // Сброс и установка линий одним словом BSRR
+        result.sela = MASK_32(NIXIE_SELA_MASK, 16) | MASK_32(index, IO_TSELA0);
+        result.selc = MASK_32(NIXIE_SELC_MASK, 16) | MASK_32(selc, IO_TSELP);
+        // Импульс от CCR до конца периода, длительность как HMI_SAT_MAX - pw
+        result.ccr = pw + NIXIE_SAT_GUARD;
+        return result;
+    }
+    
 protected:
     // Обработчик изменения данных
     virtual void data_changed(hmi_rank_t index, nixie_data_t &data) override final
     {
         // Установка данных
-        out[index].unchanged = false;
+        dirty |= nixie_model_t::rank_mask(index);
     }
     
     // Обновление состояния ламп
@@ -93,12 +84,13 @@ protected:
         // Базовый метод
         display_t::refresh();
         
-        // Пересчет данных прерываний
-        for (hmi_rank_t i = 0; i < NIXIE_COUNT; i++)
+        // Пересчет данных прерываний только по измененным разрядам
+        auto mask = dirty;
+        dirty = nixie_model_t::RANK_MASK_NONE;
+        for (hmi_rank_t i = 0; mask != nixie_model_t::RANK_MASK_NONE; i++, mask >>= 1)
         {
-            if (out[i].unchanged)
+            if ((mask & 1) == 0)
                 continue;
-            out[i].unchanged = true;
             
             // Получаем данные
             const auto data = in_get(i);
@@ -115,79 +107,88 @@ protected:
             const auto selc = nixie_selc_calc(PIN_FIX[data.digit], data.dot);
             
             // Конечные данные к прерыванию
-            const irq_t irq_data(pw, selc);
+            const auto scan_data = scan_calc(i, pw, selc);
             
             // Перенос данных с запретом прерываний
             IRQ_SAFE_ENTER();
-                irq[i] = irq_data;
+                scan[i] = scan_data;
             IRQ_SAFE_LEAVE();
         }
     }
     
 public:
-    // Мультиплексирование
+    // Конструктор по умолчанию
+    nixie_display_t(void)
+    {
+        for (hmi_rank_t i = 0; i < NIXIE_COUNT; i++)
+            scan[i] = scan_calc(i, 0, nixie_selc_calc(NIXIE_DIGIT_SPACE, false));
+    }
+    
+    // Мультиплексирование (по UEV таймера, PWM в защитном интервале неактивен)
     RAM_IAR
     void mux(void)
     {
-        // Переключение катодного напряжения
-        nixie_selc_reset();
-        IO_PORT_SET_MASK(IO_TSELC0_PORT, MASK_32(irq[nmi].selc, IO_TSELP));
-        
-        // Переключение анодного напряжения
-        nixie_sela_reset();
-        IO_PORT_SET_MASK(IO_TSELA0_PORT, MASK_32(nmi, IO_TSELA0));
+        // Переключение катодного и анодного напряжения
+        IO_TSELC0_PORT->BSRR = scan[nmi].selc;
+        IO_TSELA0_PORT->BSRR = scan[nmi].sela;
         
-        // PWM
-        TIM4->CNT = (irq[nmi].pw >> 1) + NIXIE_SAT_DX;                          // Update counter (center aligned)
-        TIM4->CCR2 = irq[nmi].pw + NIXIE_SAT_DX;                                // Update CC2 value
-        TIM4->CR1 |= TIM_CR1_CEN;                                               // TIM enable
-
         // Переход к следующей лампе
-        if (++nmi < NIXIE_COUNT)
-            return;
-        nmi = 0;
+        if (++nmi >= NIXIE_COUNT)
+        {
+            nmi = 0;
+            // Обновление происходит здесь для улучшеной синхронизации
+            if (!nixie_screen_refresh.raise())
+                metrics_frame_skip();
+        }
         
-        // Обновление происходит здесь для улучшеной синхронизации
-        nixie_screen_refresh.raise();
+        // Импульс следующей лампы (CCR2 загрузится по UEV)
+        TIM4->CCR2 = scan[nmi].ccr;                                             // Update CC2 preload value
+        DEBUG_TRACE(NIXIE_MUX, nmi, scan[nmi].ccr);
     }
 } nixie_display;
 
-// Обработчик таймера мультиплексирования ламп
-RAM_IAR
-static void nixie_mux_timer_cb(void)
-{
-    nixie_display.mux();
-}
-
-// Таймер мультиплексирования ламп
-static timer_t nixie_mux_timer(nixie_mux_timer_cb);
-
 void nixie_init(void)
 {
     // Сброс адресных линий
-    nixie_sela_reset();
-    nixie_selc_reset();
+    IO_PORT_RESET_MASK(IO_TSELA0_PORT, NIXIE_SELA_MASK);
+    IO_PORT_RESET_MASK(IO_TSELC0_PORT, NIXIE_SELC_MASK);
     
     // Тактирование и сброс таймера
     RCC->APB1ENR |= RCC_APB1ENR_TIM4EN;                                         // TIM clock enable
     RCC->APB1RSTR |= RCC_APB1RSTR_TIM4RST;                                      // TIM reset
     RCC->APB1RSTR &= ~RCC_APB1RSTR_TIM4RST;                                     // TIM unreset
     
-    // Базовое конфигурирование таймера без PWM
-    TIM4->CR1 = TIM_CR1_OPM;                                                    // TIM disable, UEV on, OPM on, Up, CMS edge, Clock /1, ARR preload off
-    TIM4->PSC = FMCU_NORMAL_HZ / (NIXIE_MUX_HZ * (HMI_SAT_COUNT + 1)) - 1;      // Prescaler (frequency)
-    TIM4->ARR = HMI_SAT_MAX + NIXIE_SAT_DX - 1;                                 // PWM Period
+    // Базовое конфигурирование таймера, период - шаг мультиплексирования
+    TIM4->CR1 = 0;                                                              // TIM disable, UEV on, OPM off, Up, CMS edge, Clock /1, ARR preload off
+    TIM4->PSC = FMCU_NORMAL_HZ / (NIXIE_MUX_HZ * (HMI_SAT_MAX + NIXIE_SAT_GUARD)) - 1; // Prescaler (frequency)
+    TIM4->ARR = HMI_SAT_MAX + NIXIE_SAT_GUARD - 1;                              // PWM Period
     TIM4->BDTR = TIM_BDTR_MOE;                                                  // Main output enable
     
     // Настройка канала 2
-    TIM4->CCR2 = HMI_SAT_MAX;                                                   // Update CC2 value (prevent initial output high state)
-    TIM4->CCMR1 = TIM_CCMR1_OC2M_0 | TIM_CCMR1_OC2M_1 | TIM_CCMR1_OC2M_2;       // CC2 output, CC2 Fast off, CC2 preload off, CC2 mode PWM 2 (111)
+    TIM4->CCR2 = HMI_SAT_MAX + NIXIE_SAT_GUARD;                                 // Update CC2 value (prevent initial output high state)
+    TIM4->CCMR1 = TIM_CCMR1_OC2PE |                                             // CC2 output, CC2 Fast off, CC2 preload on,
+                  TIM_CCMR1_OC2M_0 | TIM_CCMR1_OC2M_1 | TIM_CCMR1_OC2M_2;       // CC2 mode PWM 2 (111)
     TIM4->CCER = TIM_CCER_CC2E;                                                 // CC2 output enable, CC2 Polarity high
+    TIM4->EGR = TIM_EGR_UG;                                                     // Load prescaler and preload values
+    TIM4->SR &= ~TIM_SR_UIF;                                                    // Clear IRQ update pending flag
+    TIM4->DIER = TIM_DIER_UIE;                                                  // Update IRQ enable
     
     // Добавление дисплея в цепочку
     screen.nixie.attach(nixie_display);
-    // Выставление задачи мультиплексирования
-    nixie_mux_timer.start_hz(NIXIE_MUX_HZ, TIMER_PRI_CRITICAL | TIMER_FLAG_LOOP);
+    
+    // Мультиплексирование по UEV таймера без списка программных таймеров
+    nvic_irq_enable(TIM4_IRQn);                                                 // TIM4 IRQ enable
+    nvic_irq_priority_set(TIM4_IRQn, NVIC_IRQ_PRIORITY_HIGHEST);                // Highest TIM4 IRQ priority
+    TIM4->CR1 |= TIM_CR1_CEN;                                                   // TIM enable
+}
+
+RAM_IAR
+IRQ_ROUTINE
+void nixie_interrupt_mux(void)
+{
+    PROFILE_SCOPE(PROFILE_SITE_NIXIE_MUX);
+    TIM4->SR &= ~TIM_SR_UIF;                                                    // Clear IRQ update pending flag
+    nixie_display.mux();
 }
 
 // Развязочная таблица, указаны цифры по убыванию в глубь лампы
@@ -38,6 +38,16 @@ struct nixie_data_t
         return !(*this == other);
     }
     
+    // Количество каналов плавного изменения
+    static constexpr const uint8_t SMOOTH_CHANNEL_COUNT = 1;
+    
+    // Получает канал плавного изменения
+    hmi_sat_t & smooth_channel(uint8_t index)
+    {
+        assert(index < SMOOTH_CHANNEL_COUNT);
+        return sat;
+    }
+    
     // Получает среднюю яркость к указанноой в соотношении
     nixie_data_t smooth(nixie_data_t to, uint32_t ratio, uint32_t ratio_max) const
     {
@@ -169,4 +179,7 @@ public:
 // Инициализация модуля
 void nixie_init(void);
 
+// Обработчик таймера мультиплексирования
+void nixie_interrupt_mux(void);
+
 #endif // __NIXIE_H
@@ -3,6 +3,7 @@
 #include "wifi.h"
 #include "ntime.h"
 #include "random.h"
+#include "metrics.h"
 #include "storage.h"
 #include <proto/time.inc.h>
 
@@ -56,7 +57,10 @@ protected:
 public:
     // Конструктор по умолчанию
     ntime_command_handler_time_sync_t(void) : ipc_requester_template_t(15000)
-    { }
+    {
+        // Таймер запроса проверяется в простое
+        idle_pooling = true;
+    }
 
     // Старт синхронизации
     bool go(void)
@@ -262,6 +266,8 @@ static void ntime_sync_apply(const datetime_t &fresh)
 {
     // Калибровка LSE
     ntime_lse_correction(fresh);
+    // Учет смещения часов
+    metrics_sync_offset((int64_t)(fresh.utc_to_seconds() - rtc_time.utc_to_seconds()));
     
     // Приминение времени
     ntime_sync_seconds = rtc_uptime_seconds;
@@ -6,7 +6,10 @@
 #include "mcu.h"
 #include "rtc.h"
 #include "led.h"
+#include "light.h"
 #include "temp.h"
+#include "neon.h"
+#include "nixie.h"
 #include "debug.h"
 #include "timer.h"
 #include "storage.h"
@@ -117,11 +120,11 @@ extern "C"
             nvic_interrupt_dummy,                   // TIM1 Update
             nvic_interrupt_dummy,                   // TIM1 Trigger and Commutation
             nvic_interrupt_dummy,                   // TIM1 Capture Compare
-            nvic_interrupt_dummy,                   // TIM2
+            neon_interrupt_mux,                     // TIM2
             timer_t::interrupt_htim,                // TIM3
-            nvic_interrupt_dummy,                   // TIM4
-            nvic_interrupt_dummy,                   // I2C1 Event
-            nvic_interrupt_dummy,                   // I2C1 Error
+            nixie_interrupt_mux,                    // TIM4
+            light_interrupt_i2c_event,              // I2C1 Event
+            light_interrupt_i2c_error,              // I2C1 Error
             nvic_interrupt_dummy,                   // I2C2 Event
             nvic_interrupt_dummy,                   // I2C2 Error
             nvic_interrupt_dummy,                   // SPI1
@@ -0,0 +1,99 @@
+﻿#include "esp.h"
+#include "timer.h"
+#include "profile.h"
+#include "proto/profile.inc.h"
+
+#ifndef NDEBUG
+    // Таблица профилирования
+    profile_site_data_t profile_sites[PROFILE_SITE_COUNT];
+
+    // Счетчик тактов, расширенный до 64 бит, и значение CYCCNT при последнем расширении
+    static uint64_t profile_cycles;
+    static uint32_t profile_cycles_last;
+    // Значение расширенного счетчика тактов на момент прошлого запроса
+    static uint64_t profile_window_start;
+
+    // Расширение счетчика тактов (вызывается с запрещенными прерываниями)
+    static uint64_t profile_cycles_update(void)
+    {
+        const uint32_t now = DWT->CYCCNT;
+        profile_cycles += now - profile_cycles_last;
+        profile_cycles_last = now;
+        return profile_cycles;
+    }
+
+    // Таймер расширения счетчика тактов (CYCCNT переполняется за ~44 с при 96 МГц)
+    static timer_t profile_cycles_timer([](void)
+    {
+        IRQ_SAFE_ENTER();
+            profile_cycles_update();
+        IRQ_SAFE_LEAVE();
+    });
+#endif
+
+// Обработчик команды получения таблицы профилирования
+static class profile_command_handler_get_t : public ipc_responder_template_t<profile_command_get_t>
+{
+protected:
+    // Событие обработки данных
+    virtual void work(bool idle) override final
+    {
+        if (idle)
+            return;
+
+        // Подготовка данных
+        auto &response = command.response;
+        memset(&response, 0, sizeof(response));
+        response.clock_hz = FMCU_NORMAL_HZ;
+    #ifndef NDEBUG
+        // Снимок таблицы с закрытием окна загрузки
+        profile_site_data_t sites[PROFILE_SITE_COUNT];
+        IRQ_SAFE_ENTER();
+            memcpy(sites, profile_sites, sizeof(sites));
+            for (auto i = 0; i < PROFILE_SITE_COUNT; i++)
+                profile_sites[i].window = 0;
+            const auto now = profile_cycles_update();
+        IRQ_SAFE_LEAVE();
+        const auto elapsed = now - profile_window_start;
+        profile_window_start = now;
+        
+        response.count = PROFILE_SITE_COUNT;
+        for (auto i = 0; i < PROFILE_SITE_COUNT; i++)
+        {
+            const auto &data = sites[i];
+            auto &stat = response.sites[i];
+            if (data.calls <= 0)
+                continue;
+            
+            stat.calls = data.calls;
+            stat.min = data.min;
+            stat.max = data.max;
+            stat.avg = (uint32_t)(data.total / data.calls);
+            stat.load = (uint32_t)(data.window * 10000 / elapsed);
+        }
+    #endif
+        
+        // Передача
+        transmit();
+    }
+} profile_command_handler_get;
+
+void profile_init(void)
+{
+    // Запуск счетчика тактов DWT (метки трассировки, метрики, профилирование)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;                             // Trace enable
+    DWT->CYCCNT = 0;                                                            // Reset cycle counter
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;                                        // Cycle counter enable
+
+#ifndef NDEBUG
+    // Начальные значения
+    for (auto i = 0; i < PROFILE_SITE_COUNT; i++)
+        profile_sites[i].min = UINT32_MAX;
+    profile_cycles = profile_window_start = 0;
+    profile_cycles_last = DWT->CYCCNT;
+    profile_cycles_timer.start_hz(1, TIMER_PRI_DEFAULT | TIMER_FLAG_LOOP);
+#endif
+    
+    // Обработчики IPC
+    esp_handler_add(profile_command_handler_get);
+}
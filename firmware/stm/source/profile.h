@@ -0,0 +1,85 @@
+﻿#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include "system.h"
+
+// Профилируемые участки
+enum profile_site_t : uint8_t
+{
+    // Мультиплексирование ламп (прерывание TIM4)
+    PROFILE_SITE_NIXIE_MUX,
+    // Обработка программных таймеров (прерывание TIM3)
+    PROFILE_SITE_TIMER_HTIM,
+    // Завершение передачи светодиодам (прерывание DMA)
+    PROFILE_SITE_LED_DMA,
+    // Обмен с датчиками температуры (событие)
+    PROFILE_SITE_TEMP_EVENT,
+    // Обновление экрана (событие)
+    PROFILE_SITE_SCREEN_REFRESH,
+    
+    // Количество участков
+    PROFILE_SITE_COUNT
+};
+
+// Инициализация модуля (запускает счетчик тактов DWT для остальных модулей)
+void profile_init(void);
+
+#ifndef NDEBUG
+    // Накопленные данные участка профилирования
+    struct profile_site_data_t
+    {
+        // Количество вызовов
+        uint32_t calls;
+        // Минимальное время [такты]
+        uint32_t min;
+        // Максимальное время [такты]
+        uint32_t max;
+        // Суммарное время [такты]
+        uint64_t total;
+        // Суммарное время с прошлого запроса таблицы [такты]
+        uint64_t window;
+    };
+
+    // Таблица профилирования
+    extern profile_site_data_t profile_sites[PROFILE_SITE_COUNT];
+
+    // Учет времени выполнения участка (каждый участок выполняется в одном приоритете)
+    inline void profile_account(profile_site_t site, uint32_t cycles)
+    {
+        auto &data = profile_sites[site];
+        data.calls++;
+        data.total += cycles;
+        data.window += cycles;
+        if (data.min > cycles)
+            data.min = cycles;
+        if (data.max < cycles)
+            data.max = cycles;
+    }
+
+    // Замер участка по счетчику тактов DWT до конца области видимости
+    class profile_scope_t
+    {
+        // Участок
+        const profile_site_t site;
+        // Значение счетчика на входе
+        const uint32_t start;
+    public:
+        // Конструктор по умолчанию
+        profile_scope_t(profile_site_t _site) : site(_site), start(DWT->CYCCNT)
+        { }
+        
+        // Деструктор
+        ~profile_scope_t()
+        {
+            profile_account(site, DWT->CYCCNT - start);
+        }
+    };
+
+    // Профилирование участка (время включает вытеснение прерываниями)
+    #define PROFILE_SCOPE(site)     profile_scope_t profile_scope(site)
+#else
+    // В сборке без отладки профилирование отсутствует
+    #define PROFILE_SCOPE(site)     ((void)0)
+#endif
+
+#endif // __PROFILE_H
@@ -0,0 +1,40 @@
+﻿// Статистика участка профилирования
+struct profile_site_stat_t
+{
+    // Количество вызовов
+    uint32_t calls;
+    // Минимальное время [такты]
+    uint32_t min;
+    // Среднее время [такты]
+    uint32_t avg;
+    // Максимальное время [такты]
+    uint32_t max;
+    // Доля времени ядра с прошлого запроса [0.01%]
+    uint32_t load;
+};
+
+// Структура ответа команды получения таблицы профилирования
+struct profile_command_get_response_t
+{
+    // Частота ядра [Гц]
+    uint32_t clock_hz;
+    // Количество участков (0 - профилирование исключено при сборке)
+    uint32_t count;
+    // Участки
+    profile_site_stat_t sites[PROFILE_SITE_COUNT];
+    
+    // Проверка полей
+    bool check(void) const
+    {
+        return count <= PROFILE_SITE_COUNT;
+    }
+};
+
+// Команда получения таблицы профилирования
+class profile_command_get_t : public ipc_command_get_t<profile_command_get_response_t>
+{
+public:
+    // Конструктор по умолчанию
+    profile_command_get_t(void) : ipc_command_get_t(IPC_OPCODE_STM_PROFILE_GET)
+    { }
+};
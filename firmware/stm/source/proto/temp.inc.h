@@ -0,0 +1,86 @@
+﻿// Максимальное количество датчиков температуры на шине
+constexpr const uint8_t TEMP_SENSOR_COUNT_MAX = 4;
+// Размер кода ROM датчика
+constexpr const uint8_t TEMP_ROM_SIZE = 8;
+// Минимальное разрешение преобразования (бит)
+constexpr const uint8_t TEMP_RESOLUTION_MIN = 9;
+// Максимальное разрешение преобразования (бит)
+constexpr const uint8_t TEMP_RESOLUTION_MAX = 12;
+
+// Структура настроек датчиков температуры
+struct temp_settings_t
+{
+    // Разрешение преобразования (бит, каждый бит удваивает время преобразования)
+    uint8_t resolution;
+    
+    // Проверка полей
+    bool check(void) const
+    {
+        return resolution >= TEMP_RESOLUTION_MIN &&
+               resolution <= TEMP_RESOLUTION_MAX;
+    }
+};
+
+// Команда получения настроек датчиков температуры
+class temp_command_settings_get_t : public ipc_command_get_t<temp_settings_t>
+{
+public:
+    // Конструктор по умолчанию
+    temp_command_settings_get_t(void) : ipc_command_get_t(IPC_OPCODE_STM_TEMP_SETTINGS_GET)
+    { }
+};
+
+// Команда установки настроек датчиков температуры
+class temp_command_settings_set_t : public ipc_command_set_t<temp_settings_t>
+{
+public:
+    // Конструктор по умолчанию
+    temp_command_settings_set_t(void) : ipc_command_set_t(IPC_OPCODE_STM_TEMP_SETTINGS_SET)
+    { }
+};
+
+// Структура состояния датчика температуры
+struct temp_sensor_state_t
+{
+    // Код ROM
+    uint8_t rom[TEMP_ROM_SIZE];
+    // Температура в сотых долях градуса
+    int16_t value;
+    // Достоверность показания
+    bool valid;
+};
+
+// Структура ответа команды получения состояния температуры
+struct temp_command_state_get_response_t
+{
+    // Количество найденных датчиков
+    uint8_t count;
+    // Разрешение последнего преобразования (бит)
+    uint8_t resolution;
+    // Датчики
+    temp_sensor_state_t sensors[TEMP_SENSOR_COUNT_MAX];
+    
+    // Проверка полей
+    bool check(void) const
+    {
+        if (count > TEMP_SENSOR_COUNT_MAX ||
+            resolution < TEMP_RESOLUTION_MIN ||
+            resolution > TEMP_RESOLUTION_MAX)
+            return false;
+        
+        for (auto i = 0; i < TEMP_SENSOR_COUNT_MAX; i++)
+            if (!ipc_bool_check(sensors[i].valid))
+                return false;
+        
+        return true;
+    }
+};
+
+// Команда получения состояния температуры
+class temp_command_state_get_t : public ipc_command_get_t<temp_command_state_get_response_t>
+{
+public:
+    // Конструктор по умолчанию
+    temp_command_state_get_t(void) : ipc_command_get_t(IPC_OPCODE_STM_TEMP_STATE_GET)
+    { }
+};
@@ -4,6 +4,7 @@
 #include "led.h"
 #include "neon.h"
 #include "nixie.h"
+#include "profile.h"
 
 // Класс модели экрана
 class screen_model_t
@@ -89,6 +90,8 @@ public:
     // Обновление сцены (повышение доступа)
     virtual void refresh(void) override final
     {
+        PROFILE_SCOPE(PROFILE_SITE_SCREEN_REFRESH);
+        
         // Базовый метод
         screen_model_t::refresh();
         
@@ -1,24 +1,186 @@
 ﻿#include "mcu.h"
-#include "nvic.h"
 #include "event.h"
 #include "timer.h"
 #include "system.h"
 #include "storage.h"
 
-// Секция инициализации хранилища (во flash)
-#define STORAGE_SECTION_RO  ".storage_init"
+// Секция значений хранилища по умолчанию (во flash)
+#define STORAGE_SECTION_RO      ".storage_init"
+// Блок журнала хранилища (страницы flash)
+#define STORAGE_SECTION_LOG     "STORAGE_LOG"
+
+// Размер страницы Flash
+#define STORAGE_PAGE_SIZE       1024
+// Количество страниц журнала (должно совпадать с размером блока в линковщике)
+#define STORAGE_PAGE_COUNT      2
+// Размер блока хранилища в записи журнала
+#define STORAGE_BLOCK_SIZE      16
+// Признак размеченной страницы журнала
+#define STORAGE_PAGE_MAGIC      0x4C53
+// Признак стертой Flash
+#define STORAGE_ERASED          0xFFFF
+// Период квантов сброса журнала [мкс]
+#define STORAGE_STEP_US         1000
+// Количество полуслов, программируемых за квант (~50 мкс каждое)
+#define STORAGE_STEP_HALFWORDS  4
 
 // Обявление секций
 SECTION_DECL(STORAGE_SECTION)
 SECTION_DECL(STORAGE_SECTION_RO)
+SECTION_DECL(STORAGE_SECTION_LOG)
+
+// Заголовок страницы журнала (пишется последним при уплотнении)
+struct storage_page_header_t
+{
+    // Признак размеченной страницы
+    uint16_t magic;
+    // Поколение страницы (большее - новее)
+    uint16_t generation;
+    // Отпечаток раскладки хранилища (CRC значений по умолчанию)
+    uint16_t layout;
+    // Контрольная сумма заголовка
+    uint16_t crc;
+};
+
+// Запись журнала - актуальное содержимое одного блока хранилища
+struct storage_record_t
+{
+    // Индекс блока (пишется первым, STORAGE_ERASED - свободная запись)
+    uint16_t index;
+    // Сквозной порядковый номер записи
+    uint16_t sequence;
+    // Данные блока (хвост последнего блока дополнен STORAGE_ERASED)
+    uint16_t data[STORAGE_BLOCK_SIZE / sizeof(uint16_t)];
+    // Контрольная сумма записи (пишется последней)
+    uint16_t crc;
+};
+
+// Количество записей на странице журнала
+#define STORAGE_RECORD_COUNT    ((STORAGE_PAGE_SIZE - sizeof(storage_page_header_t)) / sizeof(storage_record_t))
+
+// Страница журнала
+struct storage_page_t
+{
+    // Заголовок
+    storage_page_header_t header;
+    // Записи
+    storage_record_t records[STORAGE_RECORD_COUNT];
+};
+
+STATIC_ASSERT(sizeof(storage_page_t) <= STORAGE_PAGE_SIZE);
+STATIC_ASSERT(STORAGE_PAGE_SIZE * STORAGE_PAGE_COUNT == STORAGE_LOG_SIZE);
+
+// Состояние журнала
+static struct
+{
+    // Активная страница (NULL - журнал не размечен)
+    const storage_page_t *page;
+    // Индекс активной страницы
+    uint8_t page_index;
+    // Количество занятых записей на активной странице
+    uint8_t count;
+    // Количество блоков хранилища
+    uint8_t block_count;
+    // Следующий порядковый номер записи
+    uint16_t sequence;
+    // Отпечаток раскладки хранилища
+    uint16_t layout;
+    // Сохраненное содержимое блоков (запись журнала или значения по умолчанию)
+    const uint16_t *source[STORAGE_RECORD_COUNT];
+} storage;
+
+// Состояние сброса журнала во Flash
+enum storage_flush_state_t
+{
+    // Сброс не выполняется
+    STORAGE_FLUSH_STATE_IDLE,
+    // Дозапись измененных блоков на активную страницу
+    STORAGE_FLUSH_STATE_APPEND,
+    // Перенос блоков на новую страницу (после стирания)
+    STORAGE_FLUSH_STATE_COMPACT,
+    // Запись заголовка новой страницы
+    STORAGE_FLUSH_STATE_HEADER,
+};
+
+// Сброс журнала, выполняемый по квантам в основной нити
+static struct
+{
+    // Состояние
+    storage_flush_state_t state;
+    // Индекс следующего просматриваемого блока
+    uint8_t block;
+    // Данные изменились во время сброса - нужен повторный проход
+    bool again;
+    // Записываемая запись журнала (NULL - нет)
+    const storage_record_t *record;
+    // Приёмник, источник и количество оставшихся полуслов программирования
+    volatile uint16_t *dest;
+    const uint16_t *source;
+    size_t remain;
+} storage_flush;
 
-// Ожидание завершения операции
+// Буфер подготовки записи журнала
+static storage_record_t storage_record;
+// Буфер подготовки заголовка страницы
+static storage_page_header_t storage_header;
+
+// Подсчет CRC-16/CCITT по полусловам
+static uint16_t storage_crc(const uint16_t *data, size_t count, uint16_t crc = 0xFFFF)
+{
+    for (; count > 0; count--, data++)
+        for (auto i = 0; i < 16; i++)
+            crc = ((crc ^ (*data << i)) & 0x8000) != 0 ?
+                (uint16_t)((crc << 1) ^ 0x1021) :
+                (uint16_t)(crc << 1);
+    return crc;
+}
+
+// Получает страницу журнала по индексу
+static const storage_page_t * storage_page_get(uint8_t index)
+{
+    return (const storage_page_t *)((const uint8_t *)__sfb(STORAGE_SECTION_LOG) + index * STORAGE_PAGE_SIZE);
+}
+
+// Получает адрес блока хранилища в ОЗУ
+static uint16_t * storage_block_ram(uint8_t index)
+{
+    return (uint16_t *)((uint8_t *)__sfb(STORAGE_SECTION) + index * STORAGE_BLOCK_SIZE);
+}
+
+// Получает размер блока хранилища в байтах (последний может быть короче)
+static size_t storage_block_size(uint8_t index)
+{
+    return minimum<size_t>(STORAGE_BLOCK_SIZE, __sfs(STORAGE_SECTION) - index * STORAGE_BLOCK_SIZE);
+}
+
+// Получает значения блока хранилища по умолчанию
+static const uint16_t * storage_block_default(uint8_t index)
+{
+    return (const uint16_t *)((const uint8_t *)__sfb(STORAGE_SECTION_RO) + index * STORAGE_BLOCK_SIZE);
+}
+
+// Проверка заголовка страницы журнала
+static bool storage_page_check(const storage_page_t *page)
+{
+    return page->header.magic == STORAGE_PAGE_MAGIC &&
+           page->header.layout == storage.layout &&
+           page->header.crc == storage_crc(&page->header.magic, 3);
+}
+
+// Проверка записи журнала
+static bool storage_record_check(const storage_record_t &record)
+{
+    return record.index < storage.block_count &&
+           record.crc == storage_crc(&record.index, (sizeof(record) - sizeof(record.crc)) / sizeof(uint16_t));
+}
+
+// Проверка готовности FPEC к следующей операции (без ожидания)
 RAM_IAR
-static void storage_fpec_wait(void)
+static bool storage_fpec_ready(void)
 {
-    // Ожидание занятости
-    while ((FLASH->SR & FLASH_SR_BSY) != 0)                                     // Check busy flag
-    { }
+    // Операция еще идет - проверим в следующем кванте
+    if ((FLASH->SR & FLASH_SR_BSY) != 0)                                        // Check busy flag
+        return false;
     
     // Проверка ошибок по заврешению операций во Flash
     if ((FLASH->SR & (FLASH_SR_WRPRTERR | FLASH_SR_PGERR)) != 0)
@@ -26,62 +188,218 @@ static void storage_fpec_wait(void)
     
     // Сброс флагов прерывания
     FLASH->SR = FLASH_SR_EOP | FLASH_SR_WRPRTERR | FLASH_SR_PGERR;              // Clear interrupt pending flags
+    FLASH->CR &= ~(FLASH_CR_PER | FLASH_CR_PG);                                 // Page erase/programming end
+    return true;
 }
 
-// Обновляет данные хранилища во Flash
+// Запуск стирания страницы Flash (завершение проверяется в следующем кванте)
 RAM_IAR
-static void storage_flash_update(void)
+static void storage_flash_erase(const void *page)
 {
-    // Разблокировка FPEC
-    FLASH->KEYR = 0x45670123;                                                   // Write first unlock key
-    FLASH->KEYR = 0xCDEF89AB;                                                   // Write second unlock key
+    FLASH->CR |= FLASH_CR_PER;                                                  // Page erase
+    FLASH->AR = (uint32_t)page;                                                 // Taget page address
+    FLASH->CR |= FLASH_CR_STRT;                                                 // Start operation
+}
+
+// Программирование полуслов Flash (завершение последнего проверяется в следующем кванте)
+RAM_IAR
+static void storage_flash_program(volatile uint16_t *dest, const uint16_t *source, size_t count)
+{
+    FLASH->CR |= FLASH_CR_PG;                                                   // Flash programming
+    for (; count > 0; count--, dest++, source++)
+    {
+        // Ожидание предыдущего полуслова
+        while ((FLASH->SR & FLASH_SR_BSY) != 0)                                 // Check busy flag
+        { }
+        *dest = *source;
+    }
+}
 
-        // Стирание страницы
-        FLASH->CR |= FLASH_CR_PER;                                              // Page erase
+// Постановка в очередь программирования полуслов
+static void storage_flush_program(const void *dest, const uint16_t *source, size_t count)
+{
+    storage_flush.dest = (volatile uint16_t *)dest;
+    storage_flush.source = source;
+    storage_flush.remain = count;
+}
+
+// Подготовка записи блока в свободную запись активной страницы
+static void storage_record_write(uint8_t index)
+{
+    // Подготовка записи
+    auto size = storage_block_size(index);
+    storage_record.index = index;
+    storage_record.sequence = storage.sequence++;
+    memset(storage_record.data, 0xFF, sizeof(storage_record.data));
+    memcpy(storage_record.data, storage_block_ram(index), size);
+    storage_record.crc = storage_crc(&storage_record.index, (sizeof(storage_record) - sizeof(storage_record.crc)) / sizeof(uint16_t));
+    
+    // Полуслова идут по порядку: индекс первым, контрольная сумма последней - оборванная запись не пройдет проверку
+    storage_flush.record = &storage.page->records[storage.count++];
+    storage_flush_program(storage_flush.record, &storage_record.index, sizeof(storage_record) / sizeof(uint16_t));
+}
+
+/* Начало уплотнения журнала: на следующей странице пишутся только блоки,
+ * отличные от значений по умолчанию, заголовок страницы - последним. До
+ * записи заголовка при старте выбирается прежняя страница */
+static void storage_compact(void)
+{
+    storage_header.magic = STORAGE_PAGE_MAGIC;
+    storage_header.generation = storage.page != NULL ? (uint16_t)(storage.page->header.generation + 1) : 0;
+    storage_header.layout = storage.layout;
+    storage_header.crc = storage_crc(&storage_header.magic, 3);
+    
+    storage.page_index = (storage.page_index + 1) % STORAGE_PAGE_COUNT;
+    storage.page = storage_page_get(storage.page_index);
+    storage.count = 0;
+    
+    storage_flush.state = STORAGE_FLUSH_STATE_COMPACT;
+    storage_flush.block = 0;
+    storage_flash_erase(storage.page);
+}
+
+// Таймер квантов сброса журнала
+static timer_t storage_flush_step_timer([](void)
+{
+    // FPEC занят - ждем следующего кванта, прерывания не маскируются
+    if (!storage_fpec_ready())
+        return;
+    
+    // Запись завершена - блок сохранен
+    if (storage_flush.record != NULL && storage_flush.remain <= 0)
+    {
+        storage.source[storage_flush.record->index] = storage_flush.record->data;
+        storage_flush.record = NULL;
+    }
+    
+    for (;;)
+    {
+        // Программирование нескольких полуслов за квант
+        if (storage_flush.remain > 0)
         {
-            FLASH->AR = (uint32_t)__sfb(STORAGE_SECTION_RO);                    // Taget page address
-            FLASH->CR |= FLASH_CR_STRT;                                         // Start operation
-            
-            // Ожидаем завершения операции
-            storage_fpec_wait();
+            auto count = minimum<size_t>(storage_flush.remain, STORAGE_STEP_HALFWORDS);
+            storage_flash_program(storage_flush.dest, storage_flush.source, count);
+            storage_flush.dest += count;
+            storage_flush.source += count;
+            storage_flush.remain -= count;
+            return;
         }
-        FLASH->CR &= ~FLASH_CR_PER;                                             // Page erase end
-
-        // Программирование
-        FLASH->CR |= FLASH_CR_PG;                                               // Flash programming
+        
+        switch (storage_flush.state)
         {
-            // Размер секции хранилища
-            static volatile size_t SIZE = __sfs(STORAGE_SECTION);
-            
-            // Источник и приёмник данных
-            auto source = (uint16_t *)__sfb(STORAGE_SECTION);
-            auto dest = (volatile uint16_t *)__sfb(STORAGE_SECTION_RO);
-            
-            // Копирование
-            for (auto i = SIZE / sizeof(uint16_t); i > 0; i--, dest++, source ++)
-                *dest = *source;
-            
-            // Ожидаем завершения операции
-            storage_fpec_wait();
+            case STORAGE_FLUSH_STATE_APPEND:
+                // Поиск измененного блока
+                for (; storage_flush.block < storage.block_count; storage_flush.block++)
+                    if (memcmp(storage_block_ram(storage_flush.block), storage.source[storage_flush.block], storage_block_size(storage_flush.block)))
+                        break;
+                if (storage_flush.block >= storage.block_count)
+                    break;
+                // Нет места - уплотнение сохраняет все блоки разом
+                if (storage.page == NULL || storage.count >= STORAGE_RECORD_COUNT)
+                {
+                    storage_compact();
+                    return;
+                }
+                storage_record_write(storage_flush.block++);
+                continue;
+                
+            case STORAGE_FLUSH_STATE_COMPACT:
+                // Поиск блока, отличного от значений по умолчанию
+                for (; storage_flush.block < storage.block_count; storage_flush.block++)
+                    if (memcmp(storage_block_ram(storage_flush.block), storage_block_default(storage_flush.block), storage_block_size(storage_flush.block)))
+                        break;
+                    else
+                        storage.source[storage_flush.block] = storage_block_default(storage_flush.block);
+                if (storage_flush.block < storage.block_count)
+                {
+                    storage_record_write(storage_flush.block++);
+                    continue;
+                }
+                // Заголовок
+                storage_flush.state = STORAGE_FLUSH_STATE_HEADER;
+                storage_flush_program(&storage.page->header, &storage_header.magic, sizeof(storage_header) / sizeof(uint16_t));
+                continue;
+                
+            default:
+                break;
         }
-        FLASH->CR &= ~FLASH_CR_PG;                                              // End flash programming
+        
+        // Проход завершен, повтор при изменениях во время сброса
+        if (!storage_flush.again)
+            break;
+        storage_flush.again = false;
+        storage_flush.state = STORAGE_FLUSH_STATE_APPEND;
+        storage_flush.block = 0;
+    }
     
     // Блокировка FPEC
     FLASH->CR |= FLASH_CR_LOCK;                                                 // Set lock bit
-}
+    
+    storage_flush.state = STORAGE_FLUSH_STATE_IDLE;
+    storage_flush_step_timer.stop();
+});
 
 // Таймер отложенного обновления данных во Flash
 static timer_t storage_deffered_flush_timer([](void)
 {
-    // Маскирование прерываний до нормального приоритета включительно
-    nvic_irq_priority_mask(NVIC_IRQ_PRIORITY_DEFAULT);
-
-        storage_flash_update();
-
-    // Размаскирование всех прерываний
-    nvic_irq_priority_mask(NVIC_IRQ_PRIORITY_HIGHEST);
+    // Сброс уже идет - повторный проход по его завершении
+    if (storage_flush.state != STORAGE_FLUSH_STATE_IDLE)
+    {
+        storage_flush.again = true;
+        return;
+    }
+    
+    // Разблокировка FPEC
+    FLASH->KEYR = 0x45670123;                                                   // Write first unlock key
+    FLASH->KEYR = 0xCDEF89AB;                                                   // Write second unlock key
+    
+    storage_flush.state = STORAGE_FLUSH_STATE_APPEND;
+    storage_flush.block = 0;
+    storage_flush_step_timer.start_us(STORAGE_STEP_US, TIMER_PRI_DEFAULT | TIMER_FLAG_LOOP);
 });
 
+void storage_init(void)
+{
+    // Разбиение хранилища на блоки
+    storage.block_count = (uint8_t)((__sfs(STORAGE_SECTION) + STORAGE_BLOCK_SIZE - 1) / STORAGE_BLOCK_SIZE);
+    // Уплотненный журнал должен помещаться на страницу (хранилище до 736 байт)
+    if (storage.block_count > STORAGE_RECORD_COUNT)
+        mcu_halt(MCU_HALT_REASON_FLASH);
+    for (auto i = 0; i < storage.block_count; i++)
+        storage.source[i] = storage_block_default(i);
+    // Отпечаток раскладки - журнал другой прошивки не применяется
+    storage.layout = storage_crc((const uint16_t *)__sfb(STORAGE_SECTION_RO), __sfs(STORAGE_SECTION) / sizeof(uint16_t));
+    
+    // Поиск страницы с наибольшим поколением
+    storage.page = NULL;
+    for (auto i = 0; i < STORAGE_PAGE_COUNT; i++)
+    {
+        auto page = storage_page_get(i);
+        if (!storage_page_check(page))
+            continue;
+        if (storage.page != NULL && (int16_t)(page->header.generation - storage.page->header.generation) <= 0)
+            continue;
+        storage.page = page;
+        storage.page_index = i;
+    }
+    if (storage.page == NULL)
+        return;
+    
+    // Применение записей по порядку
+    for (storage.count = 0; storage.count < STORAGE_RECORD_COUNT; storage.count++)
+    {
+        auto &record = storage.page->records[storage.count];
+        if (record.index == STORAGE_ERASED)
+            break;
+        // Оборванная запись пропускается
+        if (!storage_record_check(record))
+            continue;
+        memcpy(storage_block_ram(record.index), record.data, storage_block_size(record.index));
+        storage.source[record.index] = record.data;
+        storage.sequence = record.sequence + 1;
+    }
+}
+
 void storage_modified(void)
 {
     // 5 секунд
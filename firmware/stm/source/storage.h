@@ -5,7 +5,11 @@
 
 // Имя секции хранилища
 #define STORAGE_SECTION     ".storage"
+// Размер журнала хранилища в конце ПЗУ (должен совпадать с блоком STORAGE_LOG в линковщике)
+#define STORAGE_LOG_SIZE    (2 * 1024)
 
+// Инициализация модуля (восстановление данных из журнала)
+void storage_init(void);
 // Сигнал о том, что данные изменились
 void storage_modified(void);
 
@@ -10,12 +10,14 @@
    led - TIM1 (CH3), DMA1 (CH6)
    wdt - IWDG (2 Hz)
    timer - TIM3 (CH1)
-   neon - TIM2 (CH3)
-   nixie - TIM4 (CH2)
+   neon - TIM2 (CH3, UEV)
+   nixie - TIM4 (CH2, UEV)
    esp - SPI1 (master), DMA1 (CH2, CH3)
    temp - USART1 (TX), DMA1 (CH4, CH5)
    light - I2C1
-   debug - USART2 (TX), DMA1 (CH7)
+   debug - USART2 (TX), DMA1 (CH7), DWT (CYCCNT, только поток трассировки)
+   profile - DWT (CYCCNT, запуск)
+   metrics - DWT (CYCCNT)
 */
 
 // Частота ядра при старте
@@ -1,20 +1,63 @@
-﻿#include "mcu.h"
+﻿#include "dallas.h"
+#include "esp.h"
+#include "mcu.h"
 #include "nvic.h"
 #include "temp.h"
 #include "timer.h"
 #include "xmath.h"
 #include "system.h"
+#include "storage.h"
+#include "profile.h"
+#include "proto/temp.inc.h"
 
 // Используемый канал DMA TX
 static DMA_Channel_TypeDef * const TEMP_DMA_C4 = DMA1_Channel4;
 // Используемый канал DMA RX
 static DMA_Channel_TypeDef * const TEMP_DMA_C5 = DMA1_Channel5;
 
+// Настройки датчиков температуры
+static temp_settings_t temp_settings @ STORAGE_SECTION =
+{
+    .resolution = TEMP_RESOLUTION_MAX,
+};
+
+// Время преобразования (каждый бит разрешения удваивает время, 750 мс для 12 бит)
+static inline uint32_t temp_convert_us(uint8_t resolution)
+{
+    return XK(750) >> (TEMP_RESOLUTION_MAX - resolution);
+}
+
+// Маска значащих битов сырого значения (младшие биты не определены при разрешении ниже 12 бит)
+static inline int16_t temp_raw_mask(uint8_t resolution)
+{
+    return (int16_t)~((1 << (TEMP_RESOLUTION_MAX - resolution)) - 1);
+}
+
+// Регистр конфигурации датчика
+static inline uint8_t temp_config_register(uint8_t resolution)
+{
+    return (uint8_t)(((resolution - TEMP_RESOLUTION_MIN) << 5) | 0x1F);
+}
+// Код семейства DS18B20
+constexpr const uint8_t TEMP_FAMILY_DS18B20 = 0x28;
+// Количество битов кода ROM
+constexpr const uint8_t TEMP_ROM_BITS = TEMP_ROM_SIZE * 8;
+
 // Текущее состояние автомата
 static __no_init enum
 {
     // Простой
     TEMP_STATE_IDLE,
+    // Старт прохода поиска ROM
+    TEMP_STATE_SEARCH_START,
+    // Шаг поиска ROM (выбор направления по очередному биту)
+    TEMP_STATE_SEARCH_STEP,
+    // Завершение прохода поиска ROM
+    TEMP_STATE_SEARCH_FIN,
+    // Конфигурирование датчиков
+    TEMP_STATE_CONFIG,
+    // Завершение конфигурирования датчиков
+    TEMP_STATE_CONFIG_FIN,
     // Старт измерения
     TEMP_STATE_MEASURE_START,
     // Ожидание измерения
@@ -29,8 +72,8 @@ static __no_init enum
 // Буферы DMA
 static __no_init struct
 {
-    // Прототип буфера DMA
-    typedef uint8_t buffer_t[88];
+    // Прототип буфера DMA (наибольший запрос - чтение с выбором ROM)
+    typedef uint8_t buffer_t[152];
     
     // Передача
     buffer_t tx;
@@ -41,8 +84,29 @@ static __no_init struct
 // Состояние сброса чипа
 static __no_init bool temp_reseting;
 
-// Текущее покзаание температуры
-static __no_init float_t temp_current;
+// Таблица найденных датчиков
+static __no_init temp_sensor_state_t temp_sensors[TEMP_SENSOR_COUNT_MAX];
+// Количество найденных датчиков
+static __no_init uint8_t temp_sensor_count;
+// Индекс читаемого датчика
+static __no_init uint8_t temp_sensor_index;
+// Разрешение текущего цикла измерения (фиксируется при конфигурировании)
+static __no_init uint8_t temp_resolution;
+
+// Состояние поиска ROM (алгоритм Maxim AN187)
+static __no_init struct
+{
+    // Собираемый код ROM (биты прошлого прохода используются до точки расхождения)
+    uint8_t rom[TEMP_ROM_SIZE];
+    // Количество найденных датчиков
+    uint8_t count;
+    // Номер текущего бита
+    uint8_t bit;
+    // Номер бита последнего расхождения прошлого прохода (с 1, 0 - нет)
+    uint8_t discrepancy;
+    // Номер бита последнего расхождения с выбором нуля в текущем проходе
+    uint8_t zero;
+} temp_search;
 
 // Обработчик таймера таймаута операций ввода вывода (предварительное объявление)
 static void temp_timeout_timer_cb(void);
@@ -111,10 +175,11 @@ static void temp_dma_stop(void)
     TEMP_DMA_C5->CCR &= ~DMA_CCR_EN;                                            // Channel disable
 }
 
-// Сброс текущего значения
+// Сброс показаний датчиков
 static void temp_current_reset(void)
 {
-    temp_current = 99.9f;
+    for (auto i = 0; i < TEMP_SENSOR_COUNT_MAX; i++)
+        temp_sensors[i].valid = false;
 }
 
 // Обработчик события ошибки чипа
@@ -172,15 +237,24 @@ static void temp_timeout_timer_cb(void)
     switch (temp_state)
     {
         case TEMP_STATE_IDLE:
+            // Подготовка поиска
+            temp_search.count = 0;
+            temp_search.discrepancy = 0;
             // Подготовка следующего состояния
-            temp_state = TEMP_STATE_MEASURE_START;
+            temp_state = TEMP_STATE_SEARCH_START;
             // Сброс
             temp_chip_reset();
             break;
             
         case TEMP_STATE_MEASURE_READING:
             // Ожидание измерения, тут таймаут используется для паузы
-            temp_chip_reset();
+            if (TEMP_DMA_IS_INACTIVE)
+            {
+                temp_chip_reset();
+                break;
+            }
+            // Истек таймаут сброса
+            temp_chip_error();
             break;
             
         default:
@@ -190,48 +264,175 @@ static void temp_timeout_timer_cb(void)
     }
 }
 
-// Конверитрование бита в байт
-constexpr uint8_t temp_bit_to_byte(uint8_t byte, uint8_t bit)
+// Завершение прохода поиска ROM
+static void temp_search_complete(void)
 {
-    return (byte & (1 << bit)) ? 0xFF : 0x00;
+    // Проверка контрольной суммы кода
+    if (dallas_crc(temp_search.rom, TEMP_ROM_SIZE - 1) != temp_search.rom[TEMP_ROM_SIZE - 1])
+    {
+        temp_chip_error();
+        return;
+    }
+    
+    // Учитываются только DS18B20
+    if (temp_search.rom[0] == TEMP_FAMILY_DS18B20)
+    {
+        auto &sensor = temp_sensors[temp_search.count++];
+        // Если на месте датчика оказался другой - прошлое показание не его
+        if (memcmp(sensor.rom, temp_search.rom, TEMP_ROM_SIZE) != 0)
+        {
+            memcpy(sensor.rom, temp_search.rom, TEMP_ROM_SIZE);
+            sensor.valid = false;
+        }
+    }
+    
+    // Следующий проход, если остались неперебранные ветви
+    temp_search.discrepancy = temp_search.zero;
+    if (temp_search.discrepancy > 0 && temp_search.count < TEMP_SENSOR_COUNT_MAX)
+    {
+        temp_state = TEMP_STATE_SEARCH_START;
+        temp_chip_reset();
+        return;
+    }
+    
+    // Поиск завершен
+    temp_sensor_count = temp_search.count;
+    if (temp_sensor_count <= 0)
+    {
+        // Датчиков нет
+        temp_current_reset();
+        temp_idle_state();
+        return;
+    }
+    
+    // Далее конфигурирование
+    temp_state = TEMP_STATE_CONFIG;
+    temp_chip_reset();
 }
 
-// Расчет контрольной суммы дныых датчика
-uint8_t temp_dallas_crc(const void *data)
+// Шаг поиска ROM по принятым битам кода и его дополнения
+static void temp_search_step(bool id, bool cmp)
 {
-	uint8_t crc = 0;
-    const uint8_t *u8 = (const uint8_t *)data;
-	
-	for (auto i = 0; i < 8; i++)
+    // Ответа нет - ведомые пропали с шины
+    if (id && cmp)
     {
-		auto temp = *u8++;
-		for (auto j = 0; j < 8; j++, temp >>= 1)
-        {
-			const auto mix = (crc ^ temp) & 0x01;
-			crc >>= 1;
-			
-            if (mix) 
-                crc ^= 0x8C;
-		}
-	}
+        temp_chip_error();
+        return;
+    }
+    
+    // Выбор направления
+    const auto index = temp_search.bit / 8;
+    const uint8_t mask = 1 << (temp_search.bit % 8);
+    const uint8_t number = temp_search.bit + 1;
+    bool dir;
+    if (id != cmp)
+        // Все ведомые имеют одинаковый бит
+        dir = id;
+    else
+    {
+        // Расхождение: до прошлой точки - прежний путь, в ней - единица, дальше - ноль
+        if (number < temp_search.discrepancy)
+            dir = (temp_search.rom[index] & mask) != 0;
+        else
+            dir = number == temp_search.discrepancy;
+        
+        if (!dir)
+            temp_search.zero = number;
+    }
+    
+    // Запоминание бита
+    if (dir)
+        temp_search.rom[index] |= mask;
+    else
+        temp_search.rom[index] &= ~mask;
+    
+    // Запись направления, с ней же чтение следующей пары битов
+    temp_dma.tx[0] = dir ? 0xFF : 0x00;
+    if (++temp_search.bit < TEMP_ROM_BITS)
+    {
+        temp_dma.tx[1] = temp_dma.tx[2] = 0xFF;
+        temp_dma_start(3);
+        return;
+    }
     
-	return crc;
+    // Код собран
+    temp_dma_start(1);
+    temp_state = TEMP_STATE_SEARCH_FIN;
 }
 
-// Генерация байтового массива по байту
-#define TEMP_BYTE_ARRAY_GEN(byte)       \
-    temp_bit_to_byte(byte, 0),          \
-    temp_bit_to_byte(byte, 1),          \
-    temp_bit_to_byte(byte, 2),          \
-    temp_bit_to_byte(byte, 3),          \
-    temp_bit_to_byte(byte, 4),          \
-    temp_bit_to_byte(byte, 5),          \
-    temp_bit_to_byte(byte, 6),          \
-    temp_bit_to_byte(byte, 7)
+// Обработка считанной карты памяти датчика
+static void temp_sensor_process(temp_sensor_state_t &sensor, const uint8_t *bits)
+{
+    // Индексы полей структуры данных датчика
+    enum
+    {
+        // Младшая часть значения
+        POS_LSB,
+        // Старшая часть значения
+        POS_MSB,
+        // Верхний аварийный порог
+        POS_TH,
+        // Нижний аварийный порог
+        POS_TL,
+        // Конфигурация
+        POS_CFG,
+        // Первое магическое значение
+        POS_MAGIC_1,
+        // Резерв
+        POS_RESERVED,
+        // Второе магическое значение
+        POS_MAGIC_2,
+        // Контрольная сумма
+        POS_CRC,
+        // Размер карты памяти
+        POS_COUNT
+    };
+    
+    // Сборка по битам
+    uint8_t raw[POS_COUNT];
+    dallas_bits_to_bytes(raw, bits, sizeof(raw));
+    
+    // Проверка контрольной суммы
+    if (raw[POS_MAGIC_1] != 0xFF || 
+        raw[POS_MAGIC_2] != 0x10 || 
+        dallas_crc(raw, POS_CRC) != raw[POS_CRC])
+    {
+        sensor.valid = false;
+        return;
+    }
+    
+    // Целое значение температуры в 1/16 градуса (дополнительный код)
+    const auto code = (int16_t)(((raw[POS_MSB] << 8) | raw[POS_LSB]) & temp_raw_mask(temp_resolution));
+    // Вещественное значение температуры
+    auto value = code / 16.0f;
+    
+    // Линеаризация
+    {
+        // Точка для линеаризации (взято из графика в даташите)
+        static const math_point2d_t<float_t, float_t> POINTS[] =
+        {
+            { 0.0f,     0.15f },
+            { 10.0f,    0.18f },
+            { 20.0f,    0.20f },
+            { 30.0f,    0.18f },
+            { 40.0f,    0.14f },
+            { 50.0f,    0.07f },
+            { 60.0f,    -0.01f },
+            { 70.0f,    -0.14f },
+        };
+        
+        value += math_linear_interpolation(value, POINTS, array_length(POINTS));
+    }
+    
+    // В сотых долях градуса с округлением
+    sensor.value = (int16_t)(value * 100.0f + (value < 0.0f ? -0.5f : 0.5f));
+    sensor.valid = true;
+}
 
 // Обработчик события завершения передачи по DMA
 static void temp_dma_event_cb(void)
 {
+    PROFILE_SCOPE(PROFILE_SITE_TEMP_EVENT);
     assert(temp_state != TEMP_STATE_IDLE);
     
     // Если сброс
@@ -255,16 +456,82 @@ static void temp_dma_event_cb(void)
             // Пропуск
             break;
             
+        case TEMP_STATE_SEARCH_START:
+            // Запрос
+            {
+                // Запрос поиска ROM с чтением первой пары битов
+                static const uint8_t REQUEST[] =
+                {
+                    // Поиск ROM
+                    DALLAS_BYTE_ARRAY_GEN(0xF0),
+                    // Бит кода и его дополнение
+                    0xFF, 0xFF,
+                };
+                
+                memcpy(temp_dma.tx, REQUEST, sizeof(REQUEST));
+                temp_dma_start(sizeof(REQUEST));
+            }
+            
+            // Новый проход с первого бита
+            temp_search.bit = 0;
+            temp_search.zero = 0;
+            temp_state = TEMP_STATE_SEARCH_STEP;
+            break;
+            
+        case TEMP_STATE_SEARCH_STEP:
+            {
+                // Пара битов в конце переданного блока
+                const auto pair = temp_dma.rx + (temp_search.bit > 0 ? 1 : 8);
+                temp_search_step(pair[0] == 0xFF, pair[1] == 0xFF);
+            }
+            break;
+            
+        case TEMP_STATE_SEARCH_FIN:
+            temp_search_complete();
+            break;
+            
+        case TEMP_STATE_CONFIG:
+            // Запрос
+            {
+                // Запрос записи конфигурации во все датчики
+                static const uint8_t REQUEST[] =
+                {
+                    // Пропуск ROM (широковещательно)
+                    DALLAS_BYTE_ARRAY_GEN(0xCC),
+                    // Запись карты памяти
+                    DALLAS_BYTE_ARRAY_GEN(0x4E),
+                    // Аварийные пороги не используются
+                    DALLAS_BYTE_ARRAY_GEN(0x7F), DALLAS_BYTE_ARRAY_GEN(0x80),
+                };
+                
+                // Разрешение из настроек до конца цикла
+                temp_resolution = temp_settings.resolution;
+                const auto config = temp_config_register(temp_resolution);
+                memcpy(temp_dma.tx, REQUEST, sizeof(REQUEST));
+                dallas_bytes_to_bits(temp_dma.tx + sizeof(REQUEST), &config, sizeof(config));
+                temp_dma_start(sizeof(REQUEST) + 8);
+            }
+            
+            // Далее завершение конфигурирования
+            temp_state = TEMP_STATE_CONFIG_FIN;
+            break;
+            
+        case TEMP_STATE_CONFIG_FIN:
+            // Сброс перед стартом измерения
+            temp_state = TEMP_STATE_MEASURE_START;
+            temp_chip_reset();
+            break;
+            
         case TEMP_STATE_MEASURE_START:
             // Запрос
             {
-                // Запрос к чипу для старта измерения
+                // Запрос к датчикам для старта измерения
                 static const uint8_t REQUEST[] =
                 {
-                    // Пропуск ROM (одно устройство на шине)
-                    TEMP_BYTE_ARRAY_GEN(0xCC),
+                    // Пропуск ROM (все датчики измеряют одновременно)
+                    DALLAS_BYTE_ARRAY_GEN(0xCC),
                     // Измерение
-                    TEMP_BYTE_ARRAY_GEN(0x44),
+                    DALLAS_BYTE_ARRAY_GEN(0x44),
                 };
                 
                 memcpy(temp_dma.tx, REQUEST, sizeof(REQUEST));
@@ -276,32 +543,39 @@ static void temp_dma_event_cb(void)
             break;
             
         case TEMP_STATE_MEASURE_WAIT:
-            // Запуск таймаута
-            temp_timeout_timer_restart();
-            // Далее чтение результатов
+            // Ожидание преобразования
+            temp_timeout_timer.start_us(temp_convert_us(temp_resolution));
+            // Далее чтение результатов с первого датчика
+            temp_sensor_index = 0;
             temp_state = TEMP_STATE_MEASURE_READING;
             break;
             
         case TEMP_STATE_MEASURE_READING:
             // Запрос
             {
-                // Запрос к чипу для чтения результатов измерения
-                static const uint8_t REQUEST[] =
+                // Начало запроса: выбор ROM
+                static const uint8_t REQUEST_HEAD[] =
+                {
+                    DALLAS_BYTE_ARRAY_GEN(0x55),
+                };
+                // Конец запроса: чтение карты памяти
+                static const uint8_t REQUEST_TAIL[] =
                 {
-                    // Пропуск ROM (одно устройство на шине)
-                    TEMP_BYTE_ARRAY_GEN(0xCC),
                     // Чтение карты памяти
-                    TEMP_BYTE_ARRAY_GEN(0xBE),
+                    DALLAS_BYTE_ARRAY_GEN(0xBE),
                     // Чтение 9 байт
-                    TEMP_BYTE_ARRAY_GEN(0xFF), TEMP_BYTE_ARRAY_GEN(0xFF),
-                    TEMP_BYTE_ARRAY_GEN(0xFF), TEMP_BYTE_ARRAY_GEN(0xFF),
-                    TEMP_BYTE_ARRAY_GEN(0xFF), TEMP_BYTE_ARRAY_GEN(0xFF),
-                    TEMP_BYTE_ARRAY_GEN(0xFF), TEMP_BYTE_ARRAY_GEN(0xFF),
-                    TEMP_BYTE_ARRAY_GEN(0xFF),
+                    DALLAS_BYTE_ARRAY_GEN(0xFF), DALLAS_BYTE_ARRAY_GEN(0xFF),
+                    DALLAS_BYTE_ARRAY_GEN(0xFF), DALLAS_BYTE_ARRAY_GEN(0xFF),
+                    DALLAS_BYTE_ARRAY_GEN(0xFF), DALLAS_BYTE_ARRAY_GEN(0xFF),
+                    DALLAS_BYTE_ARRAY_GEN(0xFF), DALLAS_BYTE_ARRAY_GEN(0xFF),
+                    DALLAS_BYTE_ARRAY_GEN(0xFF),
                 };
                 
-                memcpy(temp_dma.tx, REQUEST, sizeof(REQUEST));
-                temp_dma_start(sizeof(REQUEST));
+                auto tx = temp_dma.tx;
+                memcpy(tx, REQUEST_HEAD, sizeof(REQUEST_HEAD));
+                tx = dallas_bytes_to_bits(tx + sizeof(REQUEST_HEAD), temp_sensors[temp_sensor_index].rom, TEMP_ROM_SIZE);
+                memcpy(tx, REQUEST_TAIL, sizeof(REQUEST_TAIL));
+                temp_dma_start(sizeof(REQUEST_HEAD) + TEMP_ROM_BITS + sizeof(REQUEST_TAIL));
             }
             
             // Далее завершение чтения результатов
@@ -309,96 +583,15 @@ static void temp_dma_event_cb(void)
             break;
             
         case TEMP_STATE_MEASURE_READING_FIN:
-            {
-                // Индексы полей структуры данных датчика
-                enum
-                {
-                    // Младшая часть значения
-                    POS_LSB,
-                    // Старшая часть значения
-                    POS_MSB,
-                    // Верхний аварийный порог
-                    POS_TH,
-                    // Нижний аварийный порог
-                    POS_TL,
-                    // Конфигурация
-                    POS_CFG,
-                    // Первое магическое значение
-                    POS_MAGIC_1,
-                    // Резерв
-                    POS_RESERVED,
-                    // Второе магическое значение
-                    POS_MAGIC_2,
-                    // Контрольная сумма
-                    POS_CRC
-                };
-                
-                union
-                {
-                    // Сырое значение
-                    uint8_t u8;
-                    // Старшая часть значения
-                    struct
-                    {
-                        uint8_t value : 3;
-                        bool sign : 1;
-                    } msb;
-                } raw[9] = { 0 };
-                
-                // Сброка по битам
-                for (auto i = 0; i < sizeof(raw); i++)
-                {
-                    const auto base = i * 8 + 16;
-                    for (auto j = base; j < base + 8; j++)
-                    {
-                        raw[i].u8 >>= 1;
-                        if (temp_dma.rx[j] == 0xFF)
-                            raw[i].u8 |= 0x80;
-                    }
-                    
-                }
-                
-                // Проверка контрольной суммы
-                if (raw[POS_MAGIC_1].u8 != 0xFF || 
-                    raw[POS_MAGIC_2].u8 != 0x10 || 
-                    temp_dallas_crc(raw) != raw[POS_CRC].u8)
-                {
-                    // Ошибка и в начальное состояние
-                    temp_current_reset();
-                    temp_idle_state();
-                    break;
-                }
-                
-                // Целое значение температуры
-                uint16_t u16 = raw[POS_MSB].msb.value;
-                u16 <<= 8;
-                u16 |= raw[POS_LSB].u8;
-
-                // Вещественное значение температуры
-                temp_current = u16;
-                temp_current /= 16.0;
-
-                // Учет знака
-                if (raw[POS_MSB].msb.sign)
-                    temp_current = -temp_current;
-            }
+            // Карта памяти после выбора ROM и команды чтения
+            temp_sensor_process(temp_sensors[temp_sensor_index], temp_dma.rx + 8 + TEMP_ROM_BITS + 8);
             
-            // Линеаризация
+            // Следующий датчик
+            if (++temp_sensor_index < temp_sensor_count)
             {
-                // Точка для линеаризации (взято из графика в даташите)
-                static const math_point2d_t<float_t, float_t> POINTS[] =
-                {
-                    { 0.0f,     0.15f },
-                    { 10.0f,    0.18f },
-                    { 20.0f,    0.20f },
-                    { 30.0f,    0.18f },
-                    { 40.0f,    0.14f },
-                    { 50.0f,    0.07f },
-                    { 60.0f,    -0.01f },
-                    { 70.0f,    -0.14f },
-                };
-                
-                temp_current += math_linear_interpolation(temp_current, POINTS, array_length(POINTS));
+                temp_state = TEMP_STATE_MEASURE_READING;
+                temp_chip_reset();
+                break;
             }
             
             // В начальное состояние
@@ -410,6 +603,72 @@ static void temp_dma_event_cb(void)
 // Событие завершения передачи по DMA
 static event_t temp_dma_event(temp_dma_event_cb);
 
+// Обработчик команды получения состояния температуры
+static class temp_command_handler_state_get_t : public ipc_responder_template_t<temp_command_state_get_t>
+{
+protected:
+    // Событие обработки данных
+    virtual void work(bool idle) override final
+    {
+        if (idle)
+            return;
+
+        // Подготовка данных
+        command.response.count = temp_sensor_count;
+        command.response.resolution = temp_resolution;
+        memcpy(command.response.sensors, temp_sensors, sizeof(temp_sensors));
+        
+        // Передача
+        transmit();
+    }
+} temp_command_handler_state_get;
+
+// Обработчик команды получения настроек датчиков температуры
+static class temp_command_handler_settings_get_t : public ipc_responder_template_t<temp_command_settings_get_t>
+{
+protected:
+    // Событие обработки данных
+    virtual void work(bool idle) override final
+    {
+        if (idle)
+            return;
+
+        // Подготовка данных
+        command.response = temp_settings;
+        
+        // Передача
+        transmit();
+    }
+} temp_command_handler_settings_get;
+
+// Обработчик команды установки настроек датчиков температуры
+static class temp_command_handler_settings_set_t : public ipc_responder_template_t<temp_command_settings_set_t>
+{
+protected:
+    // Событие обработки данных
+    virtual void work(bool idle) override final
+    {
+        if (idle)
+            return;
+
+        // Применение настроек (идущий цикл измерения завершается с прежним разрешением)
+        const auto changed = temp_settings.resolution != command.request.resolution;
+        temp_settings = command.request;
+        storage_modified();
+        // Новое измерение сразу, если автомат простаивает (состояние меняется и из прерывания DMA)
+        if (changed)
+        {
+            IRQ_SAFE_ENTER();
+                if (temp_state == TEMP_STATE_IDLE)
+                    temp_idle_state(TIMER_US_MIN);
+            IRQ_SAFE_LEAVE();
+        }
+        
+        // Передача
+        transmit();
+    }
+} temp_command_handler_settings_set;
+
 void temp_init(void)
 {
     // Тактирование и сброс USART1
@@ -433,14 +692,23 @@ void temp_init(void)
     temp_dma_channel_init(TEMP_DMA_C5, temp_dma.rx, DMA_CCR_TCIE);              // Transfer complete IRQ enable
     
     // Начальное состояние
-    temp_current_reset();
+    temp_sensor_count = 0;
+    temp_resolution = temp_settings.resolution;
+    memset(temp_sensors, 0, sizeof(temp_sensors));
     // Форсирование первого измерения
     temp_idle_state(TIMER_US_MIN);
+    
+    // Обработчики IPC
+    esp_handler_add(temp_command_handler_state_get);
+    esp_handler_add(temp_command_handler_settings_get);
+    esp_handler_add(temp_command_handler_settings_set);
 }
 
 float_t temp_current_get(void)
 {
-    return temp_current;
+    // Показание первого датчика
+    const auto &sensor = temp_sensors[0];
+    return (temp_sensor_count > 0 && sensor.valid) ? sensor.value / 100.0f : 99.9f;
 }
 
 IRQ_ROUTINE
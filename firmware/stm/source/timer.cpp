@@ -1,6 +1,7 @@
 ﻿#include "nvic.h"
 #include "timer.h"
 #include "system.h"
+#include "profile.h"
 
 // Тип данных для хранения пероида в тиках
 typedef uint16_t timer_period_t;
@@ -116,14 +117,11 @@ void timer_t::call_event_cb(void)
     // Отключаем все прерывания
     IRQ_CTX_SAVE();
         IRQ_CTX_DISABLE();
-        for (auto wrap = timer_list.raised.head(); wrap != NULL;)
+        for (timer_wrap_t *wrap; (wrap = timer_list.raised.pop()) != NULL;)
         {
-            auto &timer = wrap->timer;
-            // Переход к следующему элементу
-            wrap = (timer_wrap_t *)wrap->unlink();
             // Обработка тика таймера
             IRQ_CTX_RESTORE();
-                timer.handler();
+                wrap->timer.handler();
             IRQ_CTX_DISABLE();
         }
     // Восстановление прерываний
@@ -134,6 +132,8 @@ RAM_IAR
 IRQ_ROUTINE
 void timer_t::interrupt_htim(void)
 {
+    PROFILE_SCOPE(PROFILE_SITE_TIMER_HTIM);
+    
     // Опрделеение разницы времени в тиках
     auto dx = (timer_period_t)TIM3->CNT;
     dx -= timer_ccr;
@@ -0,0 +1,336 @@
+﻿#include "esp.h"
+#include "mcu.h"
+#include "wdt.h"
+#include "system.h"
+#include "update.h"
+#include "storage.h"
+#include <proto/update.inc.h>
+
+// Начальный адрес образа приложения
+#define UPDATE_ROM_START        FLASH_BASE
+// Размер страницы Flash
+#define UPDATE_PAGE_SIZE        1024
+// Количество блоков в очереди программирования
+#define UPDATE_FIFO_COUNT       2
+// Количество попыток записи образа
+#define UPDATE_ATTEMPT_COUNT    3
+// Количество передач пакета завершения перед сбросом
+#define UPDATE_DONE_COUNT       10
+
+// Образ не должен затирать журнал хранилища в конце ПЗУ
+STATIC_ASSERT(UPDATE_STM_LOG_SIZE == STORAGE_LOG_SIZE);
+
+// Блок образа в очереди программирования
+struct update_block_t
+{
+    // Данные (по полуслову на операцию программирования)
+    uint16_t data[UPDATE_BLOCK_SIZE / sizeof(uint16_t)];
+    // Количество полуслов
+    uint8_t count;
+};
+
+// Состояние программатора
+static struct
+{
+    // Пакеты обмена с ESP
+    ipc_packet_t out, in;
+    // Очередь принятых блоков
+    update_block_t fifo[UPDATE_FIFO_COUNT];
+    // Принят ли во время записи новый запуск от ESP
+    bool restart;
+} update;
+
+// Обработчик команды подготовки к запуску программатора
+static class update_command_handler_arm_t : public ipc_responder_template_t<update_command_arm_t>
+{
+    // Подготовлен ли запуск
+    bool armed = false;
+    // Время подготовки
+    tick_t arm_tick;
+protected:
+    // Событие обработки данных
+    virtual void work(bool idle) override final
+    {
+        if (idle)
+            return;
+        
+        // Запуск разрешается только с этими параметрами и только в течение окна
+        armed = true;
+        arm_tick = tick_get();
+        transmit();
+    }
+public:
+    // Подтверждение запуска программатора (однократное)
+    bool confirm(const update_begin_t &begin)
+    {
+        const auto &request = command.request;
+        auto result = armed && tick_get() - arm_tick < UPDATE_ARM_WINDOW_MS &&
+            begin.magic == request.magic && begin.size == request.size && begin.crc == request.crc;
+        armed = false;
+        return result;
+    }
+} update_command_handler_arm;
+
+// Проверка пакета запуска программатора и извлечение его данных
+RAM_IAR
+static bool update_begin_check(const ipc_packet_t &packet, update_begin_t &begin)
+{
+    if (!update_packet_check(packet, IPC_OPCODE_UPDATE_BEGIN) || packet.dll.length != sizeof(begin))
+        return false;
+    // Побайтно, прикладной слой пакета не выровнен
+    auto dest = (uint8_t *)&begin;
+    for (size_t i = 0; i < sizeof(begin); i++)
+        dest[i] = packet.apl[i];
+    // Поля проверяются здесь же, код приложения во Flash может быть уже затерт
+    return begin.magic == UPDATE_MAGIC && begin.size > 0 && begin.size <= UPDATE_IMAGE_SIZE_MAX;
+}
+
+// Проверка результата операции FPEC, результат - успешна ли операция
+RAM_IAR
+static bool update_fpec_check(void)
+{
+    // Проверка ошибок по заврешению операций во Flash
+    auto result = (FLASH->SR & (FLASH_SR_WRPRTERR | FLASH_SR_PGERR)) == 0;
+    
+    // Сброс флагов
+    FLASH->SR = FLASH_SR_EOP | FLASH_SR_WRPRTERR | FLASH_SR_PGERR;              // Clear pending flags
+    return result;
+}
+
+// Получает, занят ли FPEC операцией
+RAM_IAR
+static bool update_fpec_busy(void)
+{
+    return (FLASH->SR & FLASH_SR_BSY) != 0;                                     // Check busy flag
+}
+
+// Стирание страницы посреди программирования, результат - успешна ли операция
+RAM_IAR
+static bool update_page_erase(uint32_t address)
+{
+    FLASH->CR &= ~FLASH_CR_PG;                                                  // Programming pause
+    FLASH->CR |= FLASH_CR_PER;                                                  // Page erase
+    FLASH->AR = address;                                                        // Taget page address
+    FLASH->CR |= FLASH_CR_STRT;                                                 // Start operation
+    
+    // Ожидаем завершения операции
+    while (update_fpec_busy())
+        wdt_pulse();
+    auto result = update_fpec_check();
+    FLASH->CR &= ~FLASH_CR_PER;                                                 // Page erase end
+    FLASH->CR |= FLASH_CR_PG;                                                   // Programming resume
+    return result;
+}
+
+// Получает, можно ли начать следующую транзакцию SPI (не чаще периода SysTick)
+RAM_IAR
+static bool update_wire_slot(void)
+{
+    return (SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk) != 0;                   // Check and clear count flag
+}
+
+/* Приём и программирование образа. Пока FPEC программирует полуслово
+ * текущего блока, DMA забирает у ESP следующий блок, запрос которого
+ * отправлен на транзакцию раньше (ESP готовит ответ между транзакциями).
+ * Страница стирается только перед записью её первого полуслова, то есть
+ * когда первый блок страницы уже принят и проверен. Пакет запуска другого
+ * образа (ESP оборвала передачу и начала новую) прерывает запись с его
+ * параметрами, тот же образ просто дописывается по запросам. Результат -
+ * не было ли ошибок FPEC и перезапуска */
+RAM_IAR
+static bool update_write(update_begin_t &begin)
+{
+    // Смещение следующего ожидаемого блока и блока последнего запроса
+    uint32_t expect = 0, request = UINT32_MAX;
+    // Индексы записи/чтения очереди и количество блоков в ней
+    uint8_t head = 0, tail = 0, count = 0;
+    // Индекс программируемого полуслова в блоке
+    uint8_t index = 0;
+    // Идет ли транзакция
+    bool wire = false;
+    // Нет ли ошибок FPEC
+    bool result = true;
+    // Приёмник
+    auto dest = (volatile uint16_t *)UPDATE_ROM_START;
+    const auto size = begin.size;
+    const auto end = (volatile uint16_t *)(UPDATE_ROM_START + size);
+    
+    FLASH->CR |= FLASH_CR_PG;                                                   // Flash programming
+    while (dest < end)
+    {
+        wdt_pulse();
+        
+        // Обмен с ESP
+        if (wire)
+        {
+            if (esp_update_transfer_complete(update.in))
+            {
+                wire = false;
+                // Передача другого образа
+                update_begin_t next;
+                if (update_begin_check(update.in, next) && (next.size != begin.size || next.crc != begin.crc))
+                {
+                    begin = next;
+                    update.restart = true;
+                    result = false;
+                    break;
+                }
+                // Прием ожидаемого блока
+                auto &data = *(const update_data_t *)update.in.apl;
+                if (update_packet_check(update.in, IPC_OPCODE_UPDATE_DATA) &&
+                    update.in.dll.length > sizeof(data.offset) &&
+                    data.offset == expect && count < UPDATE_FIFO_COUNT)
+                {
+                    auto length = update.in.dll.length - sizeof(data.offset);
+                    auto &block = update.fifo[head];
+                    auto source = data.data;
+                    // Побайтно, прикладной слой пакета не выровнен
+                    for (auto i = 0; i < length; i += sizeof(uint16_t))
+                        block.data[i / sizeof(uint16_t)] = (uint16_t)(source[i] | (i + 1 < length ? source[i + 1] << 8 : 0xFF00));
+                    block.count = (uint8_t)((length + 1) / sizeof(uint16_t));
+                    head = (head + 1) % UPDATE_FIFO_COUNT;
+                    count++;
+                    expect += length;
+                }
+            }
+        }
+        else if (count < UPDATE_FIFO_COUNT && expect < size && update_wire_slot())
+        {
+            // Запрос следующего блока, если ожидаемый уже запрошен
+            auto &read = *(update_read_t *)update.out.apl;
+            read.offset = (request == expect && expect + UPDATE_BLOCK_SIZE < size) ? expect + UPDATE_BLOCK_SIZE : expect;
+            request = read.offset;
+            update_packet_seal(update.out, IPC_OPCODE_UPDATE_READ, sizeof(read));
+            esp_update_transfer_start(update.out);
+            wire = true;
+        }
+        
+        // Программирование
+        if (count <= 0 || update_fpec_busy())
+            continue;
+        result = update_fpec_check();
+        // Начало страницы - сначала стирание
+        if (result && ((uint32_t)dest & (UPDATE_PAGE_SIZE - 1)) == 0)
+            result = update_page_erase((uint32_t)dest);
+        if (!result)
+            break;
+        auto &block = update.fifo[tail];
+        *dest++ = block.data[index++];
+        if (index < block.count)
+            continue;
+        index = 0;
+        tail = (tail + 1) % UPDATE_FIFO_COUNT;
+        count--;
+    }
+    
+    // Ожидаем завершения последней операции
+    while (update_fpec_busy())
+        wdt_pulse();
+    if (!update_fpec_check())
+        result = false;
+    FLASH->CR &= ~FLASH_CR_PG;                                                  // End flash programming
+    
+    // Завершение транзакции
+    while (wire && !esp_update_transfer_complete(update.in))
+        wdt_pulse();
+    return result;
+}
+
+// Ожидание нового запуска программатора от ESP (приложение уже затерто)
+RAM_IAR
+static void update_wait(update_begin_t &begin)
+{
+    update_packet_seal(update.out, IPC_OPCODE_UPDATE_WAIT, 0);
+    for (;;)
+    {
+        wdt_pulse();
+        if (!update_wire_slot())
+            continue;
+        esp_update_transfer_start(update.out);
+        while (!esp_update_transfer_complete(update.in))
+            wdt_pulse();
+        // Запуск принимается без подготовки: стирать уже нечего
+        if (update_begin_check(update.in, begin))
+            return;
+    }
+}
+
+// Программатор образа приложения
+RAM_IAR
+static __noreturn void update_program(update_begin_t begin)
+{
+    // Подготовка линии связи
+    esp_update_prepare();
+    
+    // Завершение операции сброса хранилища, прерванного обновлением (её ошибки не важны)
+    while (update_fpec_busy())
+        wdt_pulse();
+    update_fpec_check();
+    FLASH->CR &= ~(FLASH_CR_PER | FLASH_CR_PG);                                 // Page erase/programming end
+    
+    // Разблокировка FPEC (хранилище могло оставить его разблокированным)
+    if ((FLASH->CR & FLASH_CR_LOCK) != 0)                                       // Check lock bit
+    {
+        FLASH->KEYR = 0x45670123;                                               // Write first unlock key
+        FLASH->KEYR = 0xCDEF89AB;                                               // Write second unlock key
+    }
+    
+    for (auto attempt = 0; ; attempt++)
+    {
+        // Образ затирает само приложение, выхода нет - ждём повторного запуска от ESP
+        if (attempt >= UPDATE_ATTEMPT_COUNT)
+        {
+            update_wait(begin);
+            attempt = 0;
+        }
+        
+        // Запись и проверка образа
+        update.restart = false;
+        if (update_write(begin) &&
+            ~update_crc(UPDATE_CRC_INIT, (const void *)UPDATE_ROM_START, begin.size) == begin.crc)
+            break;
+        // Перезапуск от ESP - попытки отсчитываются заново
+        if (update.restart)
+            attempt = -1;
+    }
+    
+    // Блокировка FPEC
+    FLASH->CR |= FLASH_CR_LOCK;                                                 // Set lock bit
+    
+    // Оповещение ESP о завершении
+    update_packet_seal(update.out, IPC_OPCODE_UPDATE_DONE, 0);
+    for (auto i = 0; i < UPDATE_DONE_COUNT; i++)
+    {
+        WAIT_FOR(update_wire_slot());
+        esp_update_transfer_start(update.out);
+        WAIT_FOR(esp_update_transfer_complete(update.in));
+    }
+    
+    // Сброс
+    __DSB();
+    SCB->AIRCR = (0x5FA << SCB_AIRCR_VECTKEY_Pos) | SCB_AIRCR_SYSRESETREQ_Msk;  // System reset request
+    __DSB();
+    while (true)
+    { }
+}
+
+void update_init(void)
+{
+    // Обработчики IPC
+    esp_handler_add(update_command_handler_arm);
+}
+
+void update_begin(const ipc_packet_t &packet)
+{
+    // Проверка запроса
+    update_begin_t begin;
+    if (!update_begin_check(packet, begin))
+        return;
+    // Запуск только после подготовки приложением по каналу связи
+    if (!update_command_handler_arm.confirm(begin))
+        return;
+    
+    // Программатор не возвращает управление
+    IRQ_CTX_DISABLE();
+    update_program(begin);
+}
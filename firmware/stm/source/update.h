@@ -0,0 +1,15 @@
+﻿#ifndef __UPDATE_H
+#define __UPDATE_H
+
+#include <ipc.h>
+
+// Инициализация модуля
+void update_init(void);
+
+/* Запуск программатора образа приложения по пакету туннеля обновления.
+ * Запрос принимается, только если совпадает с подготовленным командой по
+ * каналу связи. При корректном запросе управление не возвращается: программатор
+ * исполняется из ОЗУ с запрещенными прерываниями и завершается сбросом */
+void update_begin(const ipc_packet_t &packet);
+
+#endif // __UPDATE_H
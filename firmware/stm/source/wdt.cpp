@@ -26,6 +26,7 @@ void wdt_init(void)
     wdt_pulse_timer.start_hz(WDT_PERIOD_HZ * 2, TIMER_PRI_DEFAULT | TIMER_FLAG_LOOP);
 }
 
+RAM_IAR
 void wdt_pulse(void)
 {
 #ifdef NDEBUG
@@ -1,9 +1,12 @@
 ﻿#ifndef __WDT_H
 #define __WDT_H
 
+#include "typedefs.h"
+
 // Инициализация модуля
 void wdt_init(void);
-// Сброс таймера
+// Сброс таймера (доступен из программатора обновления в ОЗУ)
+RAM_IAR
 void wdt_pulse(void);
 
 #endif // __WDT_H
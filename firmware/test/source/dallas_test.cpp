@@ -0,0 +1,160 @@
+﻿#include "test.h"
+#include <dallas.h>
+#include <time.h>
+
+// Размер ROM и памяти данных DS18B20
+constexpr const uint8_t ROM_SIZE = 8;
+constexpr const uint8_t SCRATCHPAD_SIZE = 9;
+
+// Код ROM из Maxim AN27 (контрольная сумма 0xA2)
+static const uint8_t ROM_AN27[ROM_SIZE] = { 0x02, 0x1C, 0xB8, 0x01, 0x00, 0x00, 0x00, 0xA2 };
+// Память данных DS18B20 после включения: 85 °C, 12 бит (контрольная сумма 0x1C)
+static const uint8_t SCRATCHPAD_POWER_ON[SCRATCHPAD_SIZE] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10, 0x1C };
+
+// Эталонный побитовый расчет CRC-8/MAXIM
+static uint8_t crc_reference(const uint8_t *data, size_t size)
+{
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        auto byte = data[i];
+        for (auto j = 0; j < 8; j++, byte >>= 1)
+        {
+            const auto mix = (crc ^ byte) & 1;
+            crc >>= 1;
+            if (mix)
+                crc ^= 0x8C;
+        }
+    }
+    return crc;
+}
+
+// Эталонная побайтовая сборка битов (сравнение и сдвиг)
+static void bits_reference(uint8_t *dest, const uint8_t *bits, uint8_t size)
+{
+    for (auto i = 0; i < size; i++)
+    {
+        dest[i] = 0;
+        for (auto j = 0; j < 8; j++)
+            if (*bits++ == 0xFF)
+                dest[i] |= 1 << j;
+    }
+}
+
+// Известные векторы
+static void dallas_crc_vectors(void)
+{
+    TEST_CHECK(dallas_crc(ROM_AN27, ROM_SIZE - 1) == ROM_AN27[ROM_SIZE - 1]);
+    TEST_CHECK(dallas_crc(SCRATCHPAD_POWER_ON, SCRATCHPAD_SIZE - 1) == SCRATCHPAD_POWER_ON[SCRATCHPAD_SIZE - 1]);
+    // Сумма с контрольной суммой на конце - ноль
+    TEST_CHECK(dallas_crc(ROM_AN27, ROM_SIZE) == 0);
+    TEST_CHECK(dallas_crc(SCRATCHPAD_POWER_ON, SCRATCHPAD_SIZE) == 0);
+}
+
+// Таблица совпадает с побитовым расчетом
+static void dallas_crc_reference(void)
+{
+    uint8_t data[64];
+    auto failed = 0;
+    srand(1);
+    for (auto n = 0; n < 1000; n++)
+    {
+        const auto size = (size_t)(rand() % sizeof(data));
+        for (size_t i = 0; i < size; i++)
+            data[i] = (uint8_t)rand();
+        if (dallas_crc(data, size) != crc_reference(data, size))
+            failed++;
+    }
+    TEST_CHECK(failed == 0);
+}
+
+// Преобразование в биты и обратно
+static void dallas_bits_round_trip(void)
+{
+    uint8_t bits[SCRATCHPAD_SIZE * 8], bytes[SCRATCHPAD_SIZE];
+    
+    // Байт на бит, младший бит первым
+    TEST_CHECK(dallas_bytes_to_bits(bits, SCRATCHPAD_POWER_ON, SCRATCHPAD_SIZE) == bits + sizeof(bits));
+    TEST_CHECK(bits[0] == 0x00 && bits[4] == 0xFF && bits[6] == 0xFF && bits[7] == 0x00);
+    
+    dallas_bits_to_bytes(bytes, bits, SCRATCHPAD_SIZE);
+    TEST_CHECK(!memcmp(bytes, SCRATCHPAD_POWER_ON, SCRATCHPAD_SIZE));
+    
+    // Все значения байта
+    auto failed = 0;
+    for (auto value = 0; value < 256; value++)
+    {
+        const auto source = (uint8_t)value;
+        dallas_bytes_to_bits(bits, &source, 1);
+        dallas_bits_to_bytes(bytes, bits, 1);
+        if (bytes[0] != source)
+            failed++;
+    }
+    TEST_CHECK(failed == 0);
+}
+
+// Принятые нули искажены: единица только для байта 0xFF
+static void dallas_bits_noise(void)
+{
+    uint8_t bits[SCRATCHPAD_SIZE * 8], bytes[SCRATCHPAD_SIZE], expected[SCRATCHPAD_SIZE];
+    auto failed = 0;
+    srand(2);
+    for (auto n = 0; n < 10000; n++)
+    {
+        // Ноль прижимает линию на произвольное время, единица - не искажается
+        for (auto &bit : bits)
+            if (rand() & 1)
+                bit = 0xFF;
+            else
+                do bit = (uint8_t)rand(); while (bit == 0xFF);
+        
+        dallas_bits_to_bytes(bytes, bits, SCRATCHPAD_SIZE);
+        bits_reference(expected, bits, SCRATCHPAD_SIZE);
+        if (memcmp(bytes, expected, sizeof(bytes)))
+            failed++;
+    }
+    TEST_CHECK(failed == 0);
+}
+
+// Скорость разбора памяти данных: сборка битов и контрольная сумма
+static void dallas_benchmark(void)
+{
+    uint8_t bits[SCRATCHPAD_SIZE * 8], bytes[SCRATCHPAD_SIZE];
+    dallas_bytes_to_bits(bits, SCRATCHPAD_POWER_ON, SCRATCHPAD_SIZE);
+    const auto count = 2000000;
+    unsigned sum = 0;
+    
+    auto start = clock();
+    for (auto n = 0; n < count; n++)
+    {
+        bits[n % sizeof(bits)] ^= 0x01;
+        bits_reference(bytes, bits, SCRATCHPAD_SIZE);
+        sum += crc_reference(bytes, SCRATCHPAD_SIZE - 1);
+    }
+    const auto reference_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    // Та же последовательность искажений
+    dallas_bytes_to_bits(bits, SCRATCHPAD_POWER_ON, SCRATCHPAD_SIZE);
+    start = clock();
+    for (auto n = 0; n < count; n++)
+    {
+        bits[n % sizeof(bits)] ^= 0x01;
+        dallas_bits_to_bytes(bytes, bits, SCRATCHPAD_SIZE);
+        sum -= dallas_crc(bytes, SCRATCHPAD_SIZE - 1);
+    }
+    const auto table_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    // Обе реализации дают одинаковую сумму
+    TEST_CHECK(sum == 0);
+    printf("    scratchpad decode: bitwise %.1f ns, table %.1f ns\n", reference_s * 1e9 / count, table_s * 1e9 / count);
+}
+
+int main(void)
+{
+    TEST_RUN(dallas_crc_vectors);
+    TEST_RUN(dallas_crc_reference);
+    TEST_RUN(dallas_bits_round_trip);
+    TEST_RUN(dallas_bits_noise);
+    TEST_RUN(dallas_benchmark);
+    return test_result("dallas");
+}
@@ -0,0 +1,209 @@
+﻿#include "test.h"
+#include <esp.h>
+
+// Получает текущее значение тиков (на хосте не используется)
+ipc_handler_t::tick_t ipc_handler_t::tick_get(void)
+{
+    return 0;
+}
+
+// Получает процессор для передачи (на хосте не используется)
+ipc_processor_t & ipc_handler_t::transmitter_get(void)
+{
+    assert(false);
+    return *(ipc_processor_t *)NULL;
+}
+
+// Доступ к команде управления потоком
+struct test_link_t : ipc_link_t
+{
+    using ipc_link_t::packet_idle;
+    
+    // Формирование пакета управления потоком
+    static ipc_packet_t flow(reset_reason_t reason, uint8_t version = IPC_PROTOCOL_VERSION)
+    {
+        ipc_packet_t packet;
+        memset(&packet, 0, sizeof(packet));
+        packet.dll.opcode = IPC_OPCODE_FLOW;
+        packet.dll.length = sizeof(flow_t);
+        
+        flow_t flow = { .reason = reason, .options = 0, .version = version };
+        memcpy(packet.apl, &flow, sizeof(flow));
+        return packet;
+    }
+    
+    // Причины сброса
+    static constexpr const reset_reason_t NOP = RESET_REASON_NOP;
+    static constexpr const reset_reason_t OVERFLOW = RESET_REASON_OVERFLOW;
+};
+
+// Сторона связи с доступом к вводу/выводу пакетов
+class test_peer_t : public ipc_link_template_t<>
+{
+protected:
+    // Обработка смены версии протокола другой стороны
+    virtual void version_receive(uint8_t remote) override
+    {
+        version = remote;
+    }
+    
+public:
+    // Последняя полученная версия другой стороны
+    uint8_t version = IPC_PROTOCOL_VERSION;
+    // Фаза следующего вводимого пакета
+    bool phase = false;
+    
+    // Ввод пакета с фазой и контрольной суммой другой стороны
+    bool input(ipc_packet_t packet)
+    {
+        packet.dll.phase = phase;
+        phase = !phase;
+        packet.dll.checksum = packet.checksum_get();
+        return packet_input(packet);
+    }
+    
+    // Получает код команды следующего выводимого пакета
+    ipc_opcode_t output(void)
+    {
+        ipc_packet_t packet;
+        packet_output(packet);
+        return packet.dll.opcode;
+    }
+};
+
+// Период фиксированного опроса до адаптивного [мкС]
+constexpr const uint32_t LINK_FIXED_US = XM(1) / 75;
+
+// Бездействие - только команда управления потоком без сброса
+static void esp_packet_idle(void)
+{
+    TEST_CHECK(test_link_t::packet_idle(test_link_t::flow(test_link_t::NOP)));
+    TEST_CHECK(!test_link_t::packet_idle(test_link_t::flow(test_link_t::OVERFLOW)));
+    
+    auto packet = test_link_t::flow(test_link_t::NOP);
+    packet.dll.opcode = IPC_OPCODE_STM_TIME_GET;
+    TEST_CHECK(!test_link_t::packet_idle(packet));
+}
+
+// Другая версия протокола: управление потоком и обновление проходят, остальное отбрасывается
+static void esp_version_mismatch(void)
+{
+    test_peer_t peer;
+    // Команда управления потоком обрабатывается сразу, в очередь приёма не попадает
+    peer.input(test_link_t::flow(test_link_t::NOP, IPC_PROTOCOL_VERSION + 1));
+    TEST_CHECK(!peer.compatible());
+    TEST_CHECK(peer.version == IPC_PROTOCOL_VERSION + 1);
+    
+    // Бездействие выводится, а не зацикливается
+    TEST_CHECK(peer.output() == IPC_OPCODE_FLOW);
+    
+    // Команда отбрасывается как переданная, в очередь не попадает
+    TEST_CHECK(ipc_processor_t::data_split(peer, IPC_OPCODE_STM_TIME_GET, IPC_DIR_REQUEST, NULL, 0));
+    TEST_CHECK(peer.output() == IPC_OPCODE_FLOW);
+    
+    // Команда перехода к обновлению проходит
+    TEST_CHECK(ipc_processor_t::data_split(peer, IPC_OPCODE_STM_UPDATE_ARM, IPC_DIR_REQUEST, NULL, 0));
+    TEST_CHECK(peer.output() == IPC_OPCODE_STM_UPDATE_ARM);
+    
+    // На приёме так же
+    ipc_packet_t packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.prepare(IPC_OPCODE_STM_TIME_GET, IPC_DIR_REQUEST);
+    TEST_CHECK(!peer.input(packet));
+    packet.prepare(IPC_OPCODE_STM_UPDATE_ARM, IPC_DIR_REQUEST);
+    TEST_CHECK(peer.input(packet));
+    
+    // Возврат своей версии
+    peer.input(test_link_t::flow(test_link_t::NOP));
+    TEST_CHECK(peer.compatible());
+    TEST_CHECK(ipc_processor_t::data_split(peer, IPC_OPCODE_STM_TIME_GET, IPC_DIR_REQUEST, NULL, 0));
+    TEST_CHECK(peer.output() == IPC_OPCODE_STM_TIME_GET);
+}
+
+// Затухание периода в простое и возврат к обмену подряд
+static void esp_interval_decay(void)
+{
+    const uint32_t expected[] = { XK(2), XK(4), XK(8), XK(16), ESP_SPI_IPC_IDLE_US, ESP_SPI_IPC_IDLE_US };
+    uint32_t interval = ESP_SPI_IPC_BURST_US;
+    auto failed = 0;
+    for (auto value : expected)
+    {
+        interval = esp_io_interval_next(interval, false);
+        if (interval != value)
+            failed++;
+    }
+    TEST_CHECK(failed == 0);
+    TEST_CHECK(esp_io_interval_next(interval, true) == ESP_SPI_IPC_BURST_US);
+    TEST_CHECK(esp_io_interval_next(XK(4), true) == ESP_SPI_IPC_BURST_US);
+    
+    // Расчет на этапе компиляции
+    STATIC_ASSERT(esp_io_interval_next(ESP_SPI_IPC_IDLE_US, false) == ESP_SPI_IPC_IDLE_US);
+}
+
+/* Модель линии: запрос UI уходит в первой транзакции после простоя
+ * (phase_us от запроса), ESP отвечает пакетом на транзакцию начиная со
+ * следующей. Получает время до последнего пакета ответа [мкС] */
+static uint32_t link_latency_us(uint32_t phase_us, unsigned reply, bool adaptive)
+{
+    auto interval = adaptive ? ESP_SPI_IPC_IDLE_US : LINK_FIXED_US;
+    auto now = phase_us;
+    auto request = true, answering = false;
+    for (;;)
+    {
+        auto traffic = false;
+        // Пакет ответа ESP
+        if (answering)
+        {
+            traffic = true;
+            if (--reply == 0)
+                return now;
+        }
+        // Запрос STM (ответ готовится между транзакциями)
+        if (request)
+        {
+            request = false;
+            answering = traffic = true;
+        }
+        interval = adaptive ? esp_io_interval_next(interval, traffic) : LINK_FIXED_US;
+        now += interval;
+    }
+}
+
+// Средняя задержка ответа по фазам опроса [мС]
+static double link_latency_ms(unsigned reply, bool adaptive)
+{
+    const auto period = adaptive ? ESP_SPI_IPC_IDLE_US : LINK_FIXED_US;
+    const auto step = 100;
+    uint64_t sum = 0;
+    unsigned count = 0;
+    for (uint32_t phase = 0; phase < period; phase += step, count++)
+        sum += link_latency_us(phase, reply, adaptive);
+    return sum / 1000.0 / count;
+}
+
+// Задержка типичных ответов UI и пропускная способность
+static void esp_link_model(void)
+{
+    const unsigned replies[] = { 1, 8, 10 };
+    for (auto reply : replies)
+    {
+        const auto fixed = link_latency_ms(reply, false);
+        const auto adaptive = link_latency_ms(reply, true);
+        TEST_CHECK(adaptive < fixed);
+        printf("    %2u packet reply: %.1f -> %.1f ms\n", reply, fixed, adaptive);
+    }
+    
+    // Данные в обе стороны подряд
+    printf("    payload %.1f -> %.1f KB/s, idle %u -> %u exchanges/s\n",
+        IPC_APL_SIZE * 1000.0 / LINK_FIXED_US, IPC_APL_SIZE * 1000.0 / ESP_SPI_IPC_BURST_US,
+        (unsigned)(XM(1) / LINK_FIXED_US), (unsigned)(XM(1) / ESP_SPI_IPC_IDLE_US));
+}
+
+int main(void)
+{
+    TEST_RUN(esp_packet_idle);
+    TEST_RUN(esp_version_mismatch);
+    TEST_RUN(esp_interval_decay);
+    TEST_RUN(esp_link_model);
+    return test_result("esp_link");
+}
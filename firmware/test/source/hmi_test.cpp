@@ -0,0 +1,331 @@
+﻿#include "test.h"
+#include <hmi.h>
+#include <xmath.h>
+#include <time.h>
+
+// Данные разряда для модели
+struct test_data_t
+{
+    uint8_t value;
+    
+    // Количество каналов плавного изменения
+    static constexpr const uint8_t SMOOTH_CHANNEL_COUNT = 1;
+    
+    // Получает канал плавного изменения
+    uint8_t & smooth_channel(uint8_t channel)
+    {
+        return value;
+    }
+    
+    // Оператор равенства
+    bool operator == (const test_data_t &a) const
+    {
+        return value == a.value;
+    }
+};
+
+// Модель на 6 разрядов
+typedef hmi_model_t<test_data_t, HMI_RANK_COUNT> test_model_t;
+
+// Источник: выставляет данные разрядов при обновлении
+static class test_source_t : public test_model_t::source_t
+{
+protected:
+    // Обновление данных
+    virtual void refresh(void) override
+    {
+        refreshes++;
+        for (hmi_rank_t i = 0; i < HMI_RANK_COUNT; i++)
+            if (pending & test_model_t::rank_mask(i))
+                out_set(i, { values[i] });
+        pending = test_model_t::RANK_MASK_NONE;
+    }
+    
+public:
+    // Значения к следующему обновлению
+    uint8_t values[HMI_RANK_COUNT];
+    // Маска разрядов к следующему обновлению
+    test_model_t::rank_mask_t pending;
+    // Количество обновлений
+    unsigned refreshes;
+    
+    // Установка значения разряда к следующему обновлению
+    void set(hmi_rank_t index, uint8_t value)
+    {
+        values[index] = value;
+        pending |= test_model_t::rank_mask(index);
+    }
+} test_source;
+
+// Фильтр: смещение значения
+static class test_filter_t : public test_model_t::filter_t
+{
+protected:
+    // Обработчик изменения данных
+    virtual void data_changed(hmi_rank_t index, test_data_t &data) override
+    {
+        changes++;
+        data.value += 100;
+        filter_t::data_changed(index, data);
+    }
+    
+public:
+    // Количество изменений данных
+    unsigned changes;
+    
+    // Конструктор по умолчанию
+    test_filter_t(void) : filter_t(test_model_t::PRIORITY_FILTER_MIN)
+    { }
+} test_filter;
+
+// Дисплей: учет вызовов ввода
+static class test_display_t : public test_model_t::display_t
+{
+protected:
+    // Обработчик изменения данных
+    virtual void data_changed(hmi_rank_t index, test_data_t &data) override
+    {
+        changes++;
+        values[index] = data.value;
+    }
+    
+    // Ввод блока данных по маске разрядов
+    virtual void input(const test_model_t::data_block_t &data, test_model_t::rank_mask_t mask) override
+    {
+        inputs++;
+        this->mask = mask;
+        display_t::input(data, mask);
+    }
+    
+public:
+    // Выводимые значения
+    uint8_t values[HMI_RANK_COUNT];
+    // Количество вызовов ввода и маска последнего
+    unsigned inputs;
+    test_model_t::rank_mask_t mask;
+    // Количество изменений данных
+    unsigned changes;
+} test_display;
+
+static test_model_t test_model;
+
+// Сброс счетчиков
+static void counters_reset(void)
+{
+    test_source.refreshes = 0;
+    test_filter.changes = 0;
+    test_display.inputs = 0;
+    test_display.mask = test_model_t::RANK_MASK_NONE;
+    test_display.changes = 0;
+}
+
+// Сборка цепочки: источник - фильтр - дисплей
+static void hmi_attach(void)
+{
+    test_model.attach(test_display);
+    test_model.attach(test_filter);
+    test_model.attach(test_source);
+    
+    // Присоединение передает все разряды
+    for (hmi_rank_t i = 0; i < HMI_RANK_COUNT; i++)
+        test_source.set(i, i);
+    counters_reset();
+    test_model.refresh();
+    TEST_CHECK(test_source.refreshes == 1);
+    TEST_CHECK(test_display.inputs == 1);
+    TEST_CHECK(test_display.mask == (test_model_t::RANK_MASK_ALL & ~test_model_t::rank_mask(0)));
+    TEST_CHECK(test_display.values[5] == 105);
+}
+
+// Кадр без изменений не доходит до дисплея
+static void hmi_idle_frame(void)
+{
+    counters_reset();
+    test_model.refresh();
+    TEST_CHECK(test_source.refreshes == 1);
+    TEST_CHECK(test_filter.changes == 0);
+    TEST_CHECK(test_display.inputs == 0);
+}
+
+// Изменения нескольких разрядов идут одним блоком
+static void hmi_rank_mask(void)
+{
+    counters_reset();
+    test_source.set(0, 50);
+    test_source.set(4, 54);
+    test_model.refresh();
+    TEST_CHECK(test_filter.changes == 2);
+    TEST_CHECK(test_display.inputs == 1);
+    TEST_CHECK(test_display.mask == (test_model_t::rank_mask(0) | test_model_t::rank_mask(4)));
+    TEST_CHECK(test_display.changes == 2);
+    TEST_CHECK(test_display.values[0] == 150);
+    TEST_CHECK(test_display.values[4] == 154);
+    
+    // Повтор тех же значений отсекается фильтром
+    counters_reset();
+    test_source.set(4, 54);
+    test_model.refresh();
+    TEST_CHECK(test_filter.changes == 0);
+    TEST_CHECK(test_display.inputs == 0);
+}
+
+// Удаление фильтра передает дисплею все разряды источника
+static void hmi_detach(void)
+{
+    counters_reset();
+    test_model.detach(test_filter);
+    TEST_CHECK(test_display.inputs == 1);
+    TEST_CHECK(test_display.mask == test_model_t::RANK_MASK_ALL);
+    TEST_CHECK(test_display.changes == HMI_RANK_COUNT);
+    TEST_CHECK(test_display.values[0] == 50);
+    TEST_CHECK(test_display.values[3] == 3);
+    
+    // Возврат фильтра, изменения снова идут через него
+    test_model.attach(test_filter);
+    counters_reset();
+    test_source.set(3, 33);
+    test_model.refresh();
+    TEST_CHECK(test_display.inputs == 1);
+    TEST_CHECK(test_display.mask == test_model_t::rank_mask(3));
+    TEST_CHECK(test_display.values[3] == 133);
+}
+
+// Стоимость кадра: простой и изменение всех разрядов
+static void hmi_frame_cost(void)
+{
+    const auto frames = 10000000;
+    
+    auto start = clock();
+    for (auto f = 0; f < frames; f++)
+        test_model.refresh();
+    const auto idle_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    start = clock();
+    for (auto f = 0; f < frames; f++)
+    {
+        for (hmi_rank_t i = 0; i < HMI_RANK_COUNT; i++)
+            test_source.set(i, (uint8_t)(f + i));
+        test_model.refresh();
+    }
+    const auto active_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    TEST_CHECK(test_display.values[5] == (uint8_t)(frames - 1 + 5 + 100));
+    printf("    idle %.1f ns/frame, all ranks %.1f ns/frame\n", idle_s * 1e9 / frames, active_s * 1e9 / frames);
+}
+
+// Шаговый интерполятор совпадает с делением на каждом кадре во всем диапазоне длительностей
+static void hmi_stepper_ratio(void)
+{
+    static const hmi_sat_t pairs[][2] = { { 0, 255 }, { 255, 0 }, { 37, 200 }, { 201, 38 }, { 90, 90 } };
+    const auto frame_count_max = hmi_time_to_frame_count(UINT8_MAX);
+    auto mismatch = 0u;
+    for (auto &pair : pairs)
+        for (uint32_t count = 1; count <= frame_count_max; count++)
+        {
+            hmi_sat_stepper_t stepper;
+            stepper.start(pair[0], pair[1], count);
+            for (uint32_t frame = 1; frame <= count; frame++)
+                if (stepper.linear(count) != math_value_ratio<hmi_sat_t>(pair[0], pair[1], frame, count))
+                    mismatch++;
+        }
+    TEST_CHECK(mismatch == 0);
+}
+
+// Кривые плавности точно проходят через концы и не убывают
+static void hmi_ease_endpoints(void)
+{
+    const hmi_smooth_mode_t modes[] = { HMI_SMOOTH_MODE_EASE_IN, HMI_SMOOTH_MODE_EASE_OUT, HMI_SMOOTH_MODE_EASE_IN_OUT };
+    for (auto mode : modes)
+    {
+        TEST_CHECK(hmi_ease(mode, 0) == 0);
+        TEST_CHECK(hmi_ease(mode, HMI_EASE_PHASE_FULL) == HMI_EASE_ONE);
+        auto monotonic = true;
+        for (uint32_t phase = 1, last = 0; phase <= HMI_EASE_PHASE_FULL; phase += 97)
+        {
+            const auto ease = hmi_ease(mode, phase);
+            monotonic = monotonic && ease >= last;
+            last = ease;
+        }
+        TEST_CHECK(monotonic);
+        
+        // Контроллер начинает от начального значения и приходит точно в конечное
+        test_model_t::smoother_to_t smoother;
+        smoother.mode_set(mode);
+        smoother.frame_count_set(HMI_SMOOTH_FRAME_COUNT);
+        smoother.start(0, { 10 }, { 250 });
+        uint32_t frames = 0;
+        auto value = smoother.process(0).value, first = value;
+        for (frames = 1; smoother.process_needed(0); frames++)
+        {
+            const auto next = smoother.process(0).value;
+            monotonic = monotonic && next >= value;
+            value = next;
+        }
+        TEST_CHECK(first >= 10 && first < 250);
+        TEST_CHECK(value == 250);
+        TEST_CHECK(frames == HMI_SMOOTH_FRAME_COUNT);
+        TEST_CHECK(monotonic);
+    }
+    
+    // Концы доли кривой - начальное и конечное значения
+    hmi_sat_stepper_t stepper;
+    stepper.start(200, 3);
+    TEST_CHECK(stepper.eased(0) == 200);
+    TEST_CHECK(stepper.eased(HMI_EASE_ONE) == 3);
+}
+
+// Смена длительности посреди изменения останавливает его, новый запуск идет с новой длительностью
+static void hmi_frame_count_change(void)
+{
+    const hmi_smooth_mode_t modes[] = { HMI_SMOOTH_MODE_LINEAR, HMI_SMOOTH_MODE_EASE_IN_OUT };
+    for (auto mode : modes)
+    {
+        test_model_t::smoother_to_t smoother;
+        smoother.mode_set(mode);
+        smoother.frame_count_set(10);
+        for (hmi_rank_t i = 0; i < HMI_RANK_COUNT; i++)
+            smoother.start(i, { 0 }, { 100 });
+        for (auto f = 0; f < 3; f++)
+            for (hmi_rank_t i = 0; i < HMI_RANK_COUNT; i++)
+                smoother.process(i);
+        
+        // Та же длительность не прерывает изменение
+        smoother.frame_count_set(10);
+        TEST_CHECK(!smoother.idle());
+        
+        smoother.frame_count_set(40);
+        TEST_CHECK(smoother.idle());
+        auto stopped = true;
+        for (hmi_rank_t i = 0; i < HMI_RANK_COUNT; i++)
+            stopped = stopped && !smoother.process_needed(i);
+        TEST_CHECK(stopped);
+        
+        smoother.start(2, { 0 }, { 100 });
+        uint32_t frames = 0;
+        uint8_t value = 0, middle = 0;
+        while (smoother.process_needed(2))
+        {
+            value = smoother.process(2).value;
+            if (++frames == 20)
+                middle = value;
+        }
+        TEST_CHECK(frames == 40);
+        TEST_CHECK(value == 100);
+        // Середина линейного изменения - ровно половина
+        TEST_CHECK(mode != HMI_SMOOTH_MODE_LINEAR || middle == 50);
+        TEST_CHECK(smoother.idle());
+    }
+}
+
+int main(void)
+{
+    TEST_RUN(hmi_attach);
+    TEST_RUN(hmi_idle_frame);
+    TEST_RUN(hmi_rank_mask);
+    TEST_RUN(hmi_detach);
+    TEST_RUN(hmi_stepper_ratio);
+    TEST_RUN(hmi_ease_endpoints);
+    TEST_RUN(hmi_frame_count_change);
+    TEST_RUN(hmi_frame_cost);
+    return test_result("hmi");
+}
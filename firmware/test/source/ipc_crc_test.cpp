@@ -0,0 +1,268 @@
+﻿#include "test.h"
+#include <ipc.h>
+#include <time.h>
+
+// Получает текущее значение тиков (на хосте не используется)
+ipc_handler_t::tick_t ipc_handler_t::tick_get(void)
+{
+    return 0;
+}
+
+// Получает процессор для передачи (на хосте не используется)
+ipc_processor_t & ipc_handler_t::transmitter_get(void)
+{
+    assert(false);
+    return *(ipc_processor_t *)NULL;
+}
+
+// Эталонный побитовый расчет CRC-16/CCITT-FALSE
+static uint16_t crc_reference(const uint8_t *data, size_t size)
+{
+    uint16_t crc = 0xFFFF;
+    for (; size > 0; size--, data++)
+    {
+        crc ^= (uint16_t)(*data << 8);
+        for (auto i = 0; i < 8; i++)
+            crc = (crc & 0x8000) != 0 ?
+                (uint16_t)((crc << 1) ^ 0x1021) :
+                (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+// Получает указатель на байты пакета, покрываемые контрольной суммой
+static uint8_t * packet_body(ipc_packet_t &packet)
+{
+    return (uint8_t *)&packet + sizeof(packet.dll.checksum);
+}
+
+// Размер покрываемых контрольной суммой байтов пакета
+constexpr const size_t PACKET_BODY_SIZE = IPC_PKT_SIZE - sizeof(uint16_t);
+
+// Заполнение пакета псевдослучайными байтами
+static void packet_random(ipc_packet_t &packet, uint32_t &seed)
+{
+    auto body = packet_body(packet);
+    for (size_t i = 0; i < PACKET_BODY_SIZE; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        body[i] = (uint8_t)(seed >> 24);
+    }
+}
+
+// Известные значения
+static void crc_vectors(void)
+{
+    ipc_packet_t packet;
+    
+    // Контрольная строка CRC каталога, дополненная нулями
+    memset(&packet, 0, sizeof(packet));
+    memcpy(packet_body(packet), "123456789", 9);
+    TEST_CHECK(packet.crc_get() == 0xF586);
+    
+    // Все нули
+    memset(&packet, 0, sizeof(packet));
+    TEST_CHECK(packet.crc_get() == 0x2A45);
+    
+    // Все единицы
+    memset(&packet, 0xFF, sizeof(packet));
+    TEST_CHECK(packet.crc_get() == 0x5FBD);
+    
+    // Поле контрольной суммы не учитывается
+    packet.dll.checksum = 0;
+    TEST_CHECK(packet.crc_get() == 0x5FBD);
+}
+
+// Совпадение табличного расчета с побитовым
+static void crc_reference_match(void)
+{
+    uint32_t seed = 1;
+    ipc_packet_t packet;
+    auto mismatch = 0;
+    for (auto i = 0; i < 10000; i++)
+    {
+        packet_random(packet, seed);
+        if (packet.crc_get() != crc_reference(packet_body(packet), PACKET_BODY_SIZE))
+            mismatch++;
+    }
+    TEST_CHECK(mismatch == 0);
+}
+
+// Перестановка соседних байтов (типичный сбой тактирования SPI) всегда обнаруживается
+static void crc_adjacent_swap(void)
+{
+    uint32_t seed = 2;
+    ipc_packet_t packet;
+    auto missed = 0;
+    for (auto i = 0; i < 1000; i++)
+    {
+        packet_random(packet, seed);
+        const auto crc = packet.crc_get();
+        auto body = packet_body(packet);
+        for (size_t j = 0; j + 1 < PACKET_BODY_SIZE; j++)
+        {
+            if (body[j] == body[j + 1])
+                continue;
+            auto swapped = packet;
+            auto sbody = packet_body(swapped);
+            sbody[j] = body[j + 1];
+            sbody[j + 1] = body[j];
+            if (swapped.crc_get() == crc)
+                missed++;
+        }
+    }
+    TEST_CHECK(missed == 0);
+}
+
+// Виды вносимых ошибок
+enum crc_error_t
+{
+    // Инверсия 1..3 случайных битов
+    CRC_ERROR_BITS,
+    // Пачка инвертированных битов длиной до 16
+    CRC_ERROR_BURST,
+    // Замена 2..4 случайных байтов
+    CRC_ERROR_BYTES,
+    // Обрыв: хвост пакета заменен нулями или единицами
+    CRC_ERROR_TAIL,
+    
+    CRC_ERROR_COUNT
+};
+
+// Следующее псевдослучайное число в диапазоне
+static uint32_t crc_random(uint32_t &seed, uint32_t range)
+{
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 8) % range;
+}
+
+// Внесение ошибки указанного вида (пакет гарантированно меняется)
+static void crc_error_inject(uint8_t *body, crc_error_t error, uint32_t &seed)
+{
+    constexpr const uint32_t BITS = PACKET_BODY_SIZE * 8;
+    switch (error)
+    {
+        case CRC_ERROR_BITS:
+            {
+                // Разные позиции, чтобы инверсии не погасили друг друга
+                uint32_t bits[3];
+                const auto count = 1 + crc_random(seed, 3);
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    bits[i] = crc_random(seed, BITS);
+                    for (uint32_t j = 0; j < i; j++)
+                        if (bits[j] == bits[i])
+                        {
+                            bits[i] = crc_random(seed, BITS);
+                            j = UINT32_MAX;
+                        }
+                    body[bits[i] / 8] ^= (uint8_t)(0x80 >> (bits[i] % 8));
+                }
+            }
+            break;
+        case CRC_ERROR_BURST:
+            {
+                // Крайние биты пачки инвертированы всегда
+                const auto length = 1 + crc_random(seed, 16);
+                const auto start = crc_random(seed, BITS - length + 1);
+                for (uint32_t i = 0; i < length; i++)
+                    if (i == 0 || i == length - 1 || crc_random(seed, 2) != 0)
+                        body[(start + i) / 8] ^= (uint8_t)(0x80 >> ((start + i) % 8));
+            }
+            break;
+        case CRC_ERROR_BYTES:
+            {
+                const auto count = 2 + crc_random(seed, 3);
+                for (uint32_t i = 0; i < count; i++)
+                    body[crc_random(seed, PACKET_BODY_SIZE)] ^= (uint8_t)(1 + crc_random(seed, UINT8_MAX));
+            }
+            break;
+        case CRC_ERROR_TAIL:
+            {
+                const auto start = crc_random(seed, PACKET_BODY_SIZE);
+                memset(body + start, crc_random(seed, 2) != 0 ? 0xFF : 0x00, PACKET_BODY_SIZE - start);
+            }
+            break;
+        default:
+            assert(false);
+            break;
+    }
+}
+
+// Случайное внесение ошибок: подсчет пропусков суммой и CRC
+static void crc_error_injection(void)
+{
+    static const char * const NAMES[CRC_ERROR_COUNT] = { "bits", "burst", "bytes", "tail" };
+    constexpr const auto COUNT = 20000;
+    uint32_t seed = 27;
+    ipc_packet_t packet;
+    
+    for (auto e = 0; e < CRC_ERROR_COUNT; e++)
+    {
+        auto injected = 0, sum_missed = 0, crc_missed = 0, regressed = 0;
+        for (auto i = 0; i < COUNT; i++)
+        {
+            packet_random(packet, seed);
+            const auto sum = packet.checksum_get();
+            const auto crc = packet.crc_get();
+            auto damaged = packet;
+            crc_error_inject(packet_body(damaged), (crc_error_t)e, seed);
+            // Ошибка, не изменившая пакет, не учитывается
+            if (memcmp(packet_body(damaged), packet_body(packet), PACKET_BODY_SIZE) == 0)
+                continue;
+            injected++;
+            const auto sum_miss = damaged.checksum_get() == sum;
+            const auto crc_miss = damaged.crc_get() == crc;
+            sum_missed += sum_miss;
+            crc_missed += crc_miss;
+            // CRC не должна пропускать то, что ловит сумма
+            regressed += crc_miss && !sum_miss;
+        }
+        printf("    %s: %d injected, sum missed %d, crc missed %d\n", NAMES[e], injected, sum_missed, crc_missed);
+        TEST_CHECK(injected > COUNT / 2);
+        TEST_CHECK(regressed == 0);
+        TEST_CHECK(crc_missed <= sum_missed);
+        // До трех битов и пачки до 16 битов CRC-16/CCITT обнаруживает всегда
+        if (e == CRC_ERROR_BITS || e == CRC_ERROR_BURST)
+            TEST_CHECK(crc_missed == 0);
+    }
+}
+
+// Пропускная способность расчета (только вывод, без проверки)
+static void crc_throughput(void)
+{
+    constexpr const auto COUNT = 1000000;
+    ipc_packet_t packet;
+    uint32_t seed = 3;
+    packet_random(packet, seed);
+    
+    volatile uint16_t sink = 0;
+    auto start = clock();
+    for (auto i = 0; i < COUNT; i++)
+    {
+        packet.apl[0] = (uint8_t)i;
+        sink = sink + packet.checksum_get();
+    }
+    const auto sum_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    start = clock();
+    for (auto i = 0; i < COUNT; i++)
+    {
+        packet.apl[0] = (uint8_t)i;
+        sink = sink + packet.crc_get();
+    }
+    const auto crc_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    const auto mb = (double)COUNT * IPC_PKT_SIZE / 1e6;
+    printf("    sum %.1f MB/s, crc %.1f MB/s\n", mb / sum_s, mb / crc_s);
+}
+
+int main(void)
+{
+    TEST_RUN(crc_vectors);
+    TEST_RUN(crc_reference_match);
+    TEST_RUN(crc_adjacent_swap);
+    TEST_RUN(crc_error_injection);
+    TEST_RUN(crc_throughput);
+    return test_result("ipc_crc");
+}
@@ -0,0 +1,363 @@
+﻿#include "test.h"
+#include <ipc.h>
+#include <time.h>
+
+// Модельное время [мС]
+static uint32_t test_tick;
+
+ipc_handler_t::tick_t ipc_handler_t::tick_get(void)
+{
+    return test_tick;
+}
+
+// Журнал событий обработчиков и передач
+struct test_log_t
+{
+    // Записи: вид события, код команды, значение запроса
+    uint32_t entry[4096];
+    // Количество записей
+    size_t count;
+    
+    // Добавление записи
+    void add(char kind, ipc_opcode_t opcode, uint32_t value = 0)
+    {
+        assert(count < array_length(entry));
+        entry[count++] = (uint32_t)kind << 24 | (uint32_t)opcode << 16 | (value & 0xFFFF);
+    }
+    
+    // Оператор равенства
+    bool operator == (const test_log_t &a) const
+    {
+        return count == a.count && !memcmp(entry, a.entry, count * sizeof(entry[0]));
+    }
+};
+
+// Приёмник передач обработчиков: журнал текущей модели, отказы канала
+static class test_sink_t : public ipc_processor_t
+{
+public:
+    // Журнал текущей модели (NULL - без учета)
+    test_log_t *log;
+    // Количество отказов в передаче
+    unsigned fail;
+    
+    // Обработка пакета
+    virtual bool packet_process(const ipc_packet_t &packet, const args_t &args) override final
+    {
+        if (fail > 0)
+        {
+            fail--;
+            return false;
+        }
+        if (log != NULL)
+            log->add('T', packet.dll.opcode);
+        return true;
+    }
+} test_sink;
+
+ipc_processor_t & ipc_handler_t::transmitter_get(void)
+{
+    return test_sink;
+}
+
+// Запрос из одного слова
+struct test_request_t
+{
+    // Значение
+    uint32_t value;
+    
+    // Проверка полей
+    bool check(void) const
+    {
+        return true;
+    }
+};
+
+// Команда с запросом из одного слова
+class test_command_t : public ipc_command_set_t<test_request_t>
+{
+public:
+    // Конструктор по коду команды
+    test_command_t(ipc_opcode_t opcode) : ipc_command_set_t(opcode)
+    { }
+};
+
+// Обработчик-ответчик с журналом вызовов
+class test_responder_t : public ipc_responder_t
+{
+    // Команда
+    test_command_t command;
+protected:
+    // Получает ссылку на команду
+    virtual ipc_command_t & command_get(void) override final
+    {
+        return command;
+    }
+    
+    // Событие обработки данных
+    virtual void work(bool idle) override final
+    {
+        if (idle)
+        {
+            idles++;
+            return;
+        }
+        if (log != NULL)
+            log->add('W', opcode, command.request.value);
+        transmit();
+    }
+public:
+    // Код команды
+    const ipc_opcode_t opcode;
+    // Количество вызовов в простое
+    unsigned idles = 0;
+    // Журнал модели
+    test_log_t *log = NULL;
+    
+    // Доступ для модели с линейным обходом
+    using ipc_responder_t::pool;
+    using ipc_responder_t::notify;
+    using ipc_handler_t::ready_set;
+    
+    // Конструктор по коду команды и признаку опроса в простое
+    test_responder_t(ipc_opcode_t _opcode, bool idle) : command(_opcode), opcode(_opcode)
+    {
+        idle_pooling = idle;
+    }
+    
+    // Запрос для модели с линейным обходом
+    void request_set(uint32_t value)
+    {
+        command.request.value = value;
+    }
+};
+
+// Прежний хост: список обработчиков в порядке добавления, опрос всех подряд
+class test_host_scan_t : public ipc_processor_t
+{
+    // Обработчики
+    test_responder_t *handlers[IPC_OPCODE_INDEX_COUNT];
+    // Количество обработчиков
+    size_t count = 0;
+    
+    // Поиск обработчика по команде
+    test_responder_t * handler_find(ipc_opcode_t opcode) const
+    {
+        for (size_t i = 0; i < count; i++)
+            if (handlers[i]->opcode == opcode)
+                return handlers[i];
+        return NULL;
+    }
+public:
+    // Оповещение о обработке
+    void pool(void)
+    {
+        for (size_t i = 0; i < count; i++)
+            handlers[i]->pool();
+    }
+    
+    // Добавление обработчика
+    void handler_add(test_responder_t &handler)
+    {
+        assert(handler_find(handler.opcode) == NULL);
+        handlers[count++] = &handler;
+    }
+    
+    // Обработка пакета (запрос в один пакет)
+    virtual bool packet_process(const ipc_packet_t &packet, const args_t &args) override final
+    {
+        auto handler = handler_find(packet.dll.opcode);
+        assert(handler != NULL && !packet.dll.more);
+        test_request_t value;
+        memcpy(&value, packet.apl, sizeof(value));
+        handler->request_set(value.value);
+        handler->notify(packet.dll.dir);
+        return true;
+    }
+};
+
+// Модель: обработчики на всех индексируемых кодах команд, часть опрашивается в простое
+struct test_model_t
+{
+    // Обработчики по индексу команды
+    test_responder_t *handler[IPC_OPCODE_INDEX_COUNT];
+    // Журнал
+    test_log_t log;
+    
+    // Создание обработчиков
+    test_model_t(void)
+    {
+        memset(&log, 0, sizeof(log));
+        for (auto opcode = 0; opcode < IPC_OPCODE_LIMIT; opcode++)
+        {
+            const auto index = ipc_opcode_index((ipc_opcode_t)opcode);
+            if (index == IPC_OPCODE_INDEX_NONE)
+                continue;
+            handler[index] = new test_responder_t((ipc_opcode_t)opcode, index % 5 == 0);
+            handler[index]->log = &log;
+        }
+    }
+    
+    // Запрос обработчику
+    void request(ipc_processor_t &host, uint8_t index, uint32_t value)
+    {
+        test_command_t command(handler[index]->opcode);
+        command.request.value = value;
+        command.transmit(host, IPC_DIR_REQUEST);
+    }
+};
+
+// Коды команд по индексу в порядке добавления (перемешанном)
+static void test_order_shuffle(uint8_t (&order)[IPC_OPCODE_INDEX_COUNT], uint32_t &seed)
+{
+    for (auto i = 0; i < IPC_OPCODE_INDEX_COUNT; i++)
+        order[i] = (uint8_t)i;
+    for (auto i = IPC_OPCODE_INDEX_COUNT - 1; i > 0; i--)
+    {
+        seed = seed * 1664525 + 1013904223;
+        const auto j = (seed >> 16) % (i + 1);
+        const auto t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+/* Случайная последовательность запросов, отказов канала и опросов: хост с
+ * набором готовых обработчиков вызывает их в порядке индекса команды
+ * независимо от порядка добавления, то есть так же, как прежний обход
+ * списка, заполненного по возрастанию кода */
+static void host_dispatch_order(void)
+{
+    uint32_t seed = 30;
+    test_model_t ready_model, scan_model;
+    ipc_handler_host_t ready_host;
+    test_host_scan_t scan_host;
+    
+    uint8_t order[IPC_OPCODE_INDEX_COUNT];
+    test_order_shuffle(order, seed);
+    for (auto i = 0; i < IPC_OPCODE_INDEX_COUNT; i++)
+    {
+        ready_host.handler_add(*ready_model.handler[order[i]]);
+        scan_host.handler_add(*scan_model.handler[i]);
+    }
+    
+    auto pools = 0u;
+    for (auto step = 0; step < 1000; step++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        const auto requests = (seed >> 8) % 4;
+        const auto fail = (seed >> 12) % 8 == 0 ? 1 + (seed >> 16) % 3 : 0;
+        uint8_t index[3];
+        for (auto r = 0u; r < requests; r++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            index[r] = (uint8_t)((seed >> 16) % IPC_OPCODE_INDEX_COUNT);
+        }
+        
+        // Один и тот же шаг в обеих моделях
+        test_model_t *model[] = { &ready_model, &scan_model };
+        for (auto m = 0; m < 2; m++)
+        {
+            test_sink.log = &model[m]->log;
+            for (auto r = 0u; r < requests; r++)
+                if (m == 0)
+                    model[m]->request(ready_host, index[r], step);
+                else
+                    model[m]->request(scan_host, index[r], step);
+            test_sink.fail = (unsigned)fail;
+            if (m == 0)
+                ready_host.pool();
+            else
+                scan_host.pool();
+        }
+        pools++;
+        // Переотправка после таймаута
+        test_tick += 20;
+    }
+    test_sink.log = NULL;
+    test_sink.fail = 0;
+    
+    TEST_CHECK(ready_model.log.count > 1000);
+    TEST_CHECK(ready_model.log == scan_model.log);
+    
+    // Опрос в простое: помеченные обработчики каждый раз, остальные не более раза после добавления
+    auto idle_ok = true;
+    for (auto i = 0; i < IPC_OPCODE_INDEX_COUNT; i++)
+        if (i % 5 == 0 ? ready_model.handler[i]->idles != scan_model.handler[i]->idles : ready_model.handler[i]->idles > 1)
+            idle_ok = false;
+    TEST_CHECK(idle_ok);
+    TEST_CHECK(scan_model.handler[0]->idles <= pools);
+}
+
+// Пометка обработчика дает ровно один опрос в простое
+static void host_ready_set(void)
+{
+    test_model_t model;
+    ipc_handler_host_t host;
+    auto &handler = *model.handler[1];
+    host.handler_add(handler);
+    
+    host.pool();
+    host.pool();
+    TEST_CHECK(handler.idles == 1);
+    handler.ready_set();
+    host.pool();
+    host.pool();
+    TEST_CHECK(handler.idles == 2);
+}
+
+// Опрос в простое: прежний обход и набор готовых обработчиков (только вывод)
+static void host_benchmark(void)
+{
+    constexpr const auto COUNT = 1000000;
+    // Ответчики на кодах STM32 2..24, как в прошивке, без опроса в простое
+    test_responder_t *handler[23];
+    ipc_handler_host_t ready_host;
+    test_host_scan_t scan_host;
+    for (auto i = 0; i < 23; i++)
+    {
+        handler[i] = new test_responder_t((ipc_opcode_t)(i + 2), false);
+        ready_host.handler_add(*handler[i]);
+        scan_host.handler_add(*handler[i]);
+    }
+    
+    auto start = clock();
+    for (auto i = 0; i < COUNT; i++)
+        scan_host.pool();
+    const auto scan_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    start = clock();
+    for (auto i = 0; i < COUNT; i++)
+        ready_host.pool();
+    const auto ready_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    // Запрос и опрос
+    test_model_t model;
+    start = clock();
+    for (auto i = 0; i < COUNT; i++)
+    {
+        model.request(scan_host, (uint8_t)(i % 23 + 2), i);
+        scan_host.pool();
+    }
+    const auto scan_round_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    start = clock();
+    for (auto i = 0; i < COUNT; i++)
+    {
+        model.request(ready_host, (uint8_t)(i % 23 + 2), i);
+        ready_host.pool();
+    }
+    const auto ready_round_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    const auto ns = 1e9 / COUNT;
+    printf("    idle pool: scan %.1f ns, ready %.1f ns\n", scan_s * ns, ready_s * ns);
+    printf("    request + pool: scan %.1f ns, ready %.1f ns\n", scan_round_s * ns, ready_round_s * ns);
+}
+
+int main(void)
+{
+    TEST_RUN(host_dispatch_order);
+    TEST_RUN(host_ready_set);
+    TEST_RUN(host_benchmark);
+    return test_result("ipc_host");
+}
@@ -0,0 +1,374 @@
+﻿#include "test.h"
+#include <list.h>
+#include <time.h>
+
+// Элемент с номером для проверки порядка
+struct item_t : list_item_t
+{
+    int value;
+};
+
+// Тестовые элементы
+static item_t items[8];
+
+// Подготовка элементов
+static void items_reset(void)
+{
+    for (auto i = 0; i < 8; i++)
+    {
+        if (items[i].linked())
+            items[i].unlink();
+        items[i].value = i;
+    }
+}
+
+// Проверка содержимого списка в обе стороны, связности и счетчика (values - номера по порядку, -1 в конце)
+static bool list_check(const list_template_t<item_t> &list, const int *values)
+{
+    size_t size = 0;
+    for (; values[size] >= 0; size++)
+    { }
+    
+    if (list.count() != size || list.empty() != (size == 0))
+        return false;
+    
+    // Вперед
+    const item_t *prev = NULL;
+    size_t index = 0;
+    for (auto i = list.head(); i != NULL; prev = i, i = LIST_ITEM_NEXT(i), index++)
+        if (index >= size || i->value != values[index] || i->list() != &list || i->prev() != prev)
+            return false;
+    if (index != size || list.last() != prev)
+        return false;
+    
+    // Назад
+    for (auto i = list.last(); i != NULL; i = LIST_ITEM_PREV(i))
+        if (i->value != values[--index])
+            return false;
+    return index == 0;
+}
+
+// Проверка списка по литералу номеров
+#define LIST_CHECK(list, ...)                               \
+    do {                                                    \
+        static const int __values[] = { __VA_ARGS__ };      \
+        TEST_CHECK(list_check(list, __values));             \
+    } while (false)
+
+// Счетчик при связке и расцеплении
+static void list_count(void)
+{
+    items_reset();
+    list_template_t<item_t> list;
+    LIST_CHECK(list, -1);
+    
+    items[0].link(list);
+    items[1].link(list);
+    items[2].link(list, LIST_SIDE_HEAD);
+    LIST_CHECK(list, 2, 0, 1, -1);
+    
+    // Вставка относительно элемента
+    items[3].link(items[0], LIST_SIDE_NEXT);
+    items[4].link(items[2], LIST_SIDE_PREV);
+    LIST_CHECK(list, 4, 2, 0, 3, 1, -1);
+    
+    // Расцепление из середины и с краев
+    items[0].unlink();
+    LIST_CHECK(list, 4, 2, 3, 1, -1);
+    items[4].unlink();
+    items[1].unlink();
+    LIST_CHECK(list, 2, 3, -1);
+    TEST_CHECK(items[1].unlinked());
+    
+    // Отчистка
+    list.clear();
+    LIST_CHECK(list, -1);
+    TEST_CHECK(items[2].unlinked() && items[3].unlinked());
+}
+
+// Извлечение с краев
+static void list_pop(void)
+{
+    items_reset();
+    list_template_t<item_t> list;
+    TEST_CHECK(list.pop() == NULL);
+    
+    for (auto i = 0; i < 4; i++)
+        items[i].link(list);
+    
+    TEST_CHECK(list.pop() == &items[0]);
+    TEST_CHECK(list.pop(LIST_SIDE_LAST) == &items[3]);
+    TEST_CHECK(items[0].unlinked() && items[3].unlinked());
+    LIST_CHECK(list, 1, 2, -1);
+    
+    TEST_CHECK(list.pop() == &items[1]);
+    TEST_CHECK(list.pop() == &items[2]);
+    TEST_CHECK(list.pop() == NULL);
+    LIST_CHECK(list, -1);
+}
+
+// Перенос цепочки между списками
+static void list_move(void)
+{
+    items_reset();
+    list_template_t<item_t> a, b;
+    for (auto i = 0; i < 5; i++)
+        items[i].link(a);
+    
+    // Из середины в пустой список
+    a.move(items[1], items[2], b);
+    LIST_CHECK(a, 0, 3, 4, -1);
+    LIST_CHECK(b, 1, 2, -1);
+    
+    // Голова в конец
+    a.move(items[0], items[0], b);
+    LIST_CHECK(a, 3, 4, -1);
+    LIST_CHECK(b, 1, 2, 0, -1);
+    
+    // Хвост в начало
+    a.move(items[4], items[4], b, LIST_SIDE_HEAD);
+    LIST_CHECK(a, 3, -1);
+    LIST_CHECK(b, 4, 1, 2, 0, -1);
+    
+    // Весь список
+    b.move(*b.head(), *b.last(), a);
+    LIST_CHECK(a, 3, 4, 1, 2, 0, -1);
+    LIST_CHECK(b, -1);
+    
+    // Перенесенные элементы принадлежат новому списку
+    items[1].unlink();
+    LIST_CHECK(a, 3, 4, 2, 0, -1);
+}
+
+// Перенос всех элементов списка
+static void list_splice(void)
+{
+    items_reset();
+    list_template_t<item_t> a, b;
+    items[0].link(a);
+    items[1].link(a);
+    items[2].link(b);
+    items[3].link(b);
+    
+    a.splice(b);
+    LIST_CHECK(a, 0, 1, 2, 3, -1);
+    LIST_CHECK(b, -1);
+    
+    // Пустой источник
+    a.splice(b);
+    LIST_CHECK(a, 0, 1, 2, 3, -1);
+    
+    // В начало
+    items[4].link(b);
+    a.splice(b, LIST_SIDE_HEAD);
+    LIST_CHECK(a, 4, 0, 1, 2, 3, -1);
+    
+    // В пустой список
+    b.splice(a);
+    LIST_CHECK(a, -1);
+    LIST_CHECK(b, 4, 0, 1, 2, 3, -1);
+}
+
+// Размер пула элементов случайной проверки
+constexpr const int LIST_POOL_SIZE = 16;
+
+// Эталонная модель списка: номера элементов по порядку (-1 в конце)
+struct list_model_t
+{
+    int values[LIST_POOL_SIZE + 1];
+    int size;
+    
+    void clear(void)
+    {
+        size = 0;
+        values[0] = -1;
+    }
+    
+    int find(int value) const
+    {
+        for (auto i = 0; i < size; i++)
+            if (values[i] == value)
+                return i;
+        return -1;
+    }
+    
+    void insert(int pos, int value)
+    {
+        memmove(values + pos + 1, values + pos, (size + 1 - pos) * sizeof(int));
+        values[pos] = value;
+        size++;
+    }
+    
+    void remove(int pos)
+    {
+        memmove(values + pos, values + pos + 1, (size - pos) * sizeof(int));
+        size--;
+    }
+};
+
+// Генератор псевдослучайных чисел
+static uint32_t list_random(uint32_t &seed, uint32_t range)
+{
+    seed = seed * 1664525 + 1013904223;
+    return (seed >> 16) % range;
+}
+
+// Случайная последовательность операций над двумя списками против эталонной модели
+static void list_random_ops(void)
+{
+    static item_t pool[LIST_POOL_SIZE];
+    list_template_t<item_t> lists[2];
+    list_model_t models[2];
+    for (auto i = 0; i < LIST_POOL_SIZE; i++)
+        pool[i].value = i;
+    models[0].clear();
+    models[1].clear();
+    
+    uint32_t seed = 31;
+    auto mismatch = 0, ops = 0;
+    for (auto step = 0; step < 50000; step++)
+    {
+        const auto l = list_random(seed, 2);
+        auto &list = lists[l];
+        auto &model = models[l];
+        const auto side = (list_side_t)list_random(seed, LIST_SIDE_COUNT);
+        auto &item = pool[list_random(seed, LIST_POOL_SIZE)];
+        const auto owner = item.list() == &lists[0] ? 0 : item.list() == &lists[1] ? 1 : -1;
+        
+        switch (list_random(seed, 7))
+        {
+            case 0:
+                // Связка с краем списка
+                if (owner >= 0)
+                    continue;
+                item.link(list, side);
+                model.insert(side == LIST_SIDE_HEAD ? 0 : model.size, item.value);
+                break;
+            case 1:
+                // Связка относительно элемента
+                {
+                    if (owner >= 0 || model.size == 0)
+                        continue;
+                    const auto pos = list_random(seed, model.size);
+                    item.link(pool[model.values[pos]], side);
+                    model.insert(side == LIST_SIDE_PREV ? pos : pos + 1, item.value);
+                }
+                break;
+            case 2:
+                // Расцепление
+                if (owner < 0)
+                    continue;
+                item.unlink();
+                models[owner].remove(models[owner].find(item.value));
+                break;
+            case 3:
+                // Извлечение с края
+                {
+                    const auto popped = list.pop(side);
+                    if (model.size == 0)
+                    {
+                        mismatch += popped != NULL;
+                        break;
+                    }
+                    const auto pos = side == LIST_SIDE_HEAD ? 0 : model.size - 1;
+                    mismatch += popped == NULL || popped->value != model.values[pos] || !popped->unlinked();
+                    model.remove(pos);
+                }
+                break;
+            case 4:
+                // Перенос цепочки в другой список
+                {
+                    if (model.size == 0)
+                        continue;
+                    const auto a = list_random(seed, model.size), b = list_random(seed, model.size);
+                    const auto first = a < b ? a : b, last = a < b ? b : a;
+                    auto &dest = models[1 - l];
+                    auto pos = side == LIST_SIDE_HEAD ? 0 : dest.size;
+                    list.move(pool[model.values[first]], pool[model.values[last]], lists[1 - l], side);
+                    for (auto i = first; i <= last; i++)
+                        dest.insert(pos++, model.values[i]);
+                    for (auto i = first; i <= last; i++)
+                        model.remove(first);
+                }
+                break;
+            case 5:
+                // Перенос всех элементов другого списка
+                {
+                    auto &source = models[1 - l];
+                    list.splice(lists[1 - l], side);
+                    auto pos = side == LIST_SIDE_HEAD ? 0 : model.size;
+                    for (auto i = 0; i < source.size; i++)
+                        model.insert(pos++, source.values[i]);
+                    source.clear();
+                }
+                break;
+            case 6:
+                // Отчистка (реже остальных операций)
+                if (list_random(seed, 8) != 0)
+                    continue;
+                list.clear();
+                model.clear();
+                break;
+        }
+        ops++;
+        
+        // Оба списка совпадают с моделью, расцепленные элементы не принадлежат спискам
+        for (auto i = 0; i < 2; i++)
+            mismatch += !list_check(lists[i], models[i].values);
+        for (auto i = 0; i < LIST_POOL_SIZE; i++)
+            mismatch += pool[i].unlinked() != (models[0].find(i) < 0 && models[1].find(i) < 0);
+    }
+    TEST_CHECK(mismatch == 0);
+    TEST_CHECK(ops > 10000);
+    lists[0].clear();
+    lists[1].clear();
+}
+
+// Время операций со списком
+static void list_benchmark(void)
+{
+    static item_t pool[LIST_POOL_SIZE];
+    list_template_t<item_t> list;
+    const auto rounds = 1000000;
+    volatile size_t sink = 0;
+    
+    auto start = clock();
+    for (auto r = 0; r < rounds; r++)
+    {
+        for (auto i = 0; i < LIST_POOL_SIZE; i++)
+            pool[i].link(list, (list_side_t)(i & 1));
+        while (list.pop() != NULL)
+        { }
+    }
+    const auto link_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    for (auto i = 0; i < LIST_POOL_SIZE; i++)
+        pool[i].link(list);
+    start = clock();
+    for (auto r = 0; r < rounds; r++)
+        sink = sink + list.count();
+    const auto count_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    // Прежний подсчет обходом цепочки
+    start = clock();
+    for (auto r = 0; r < rounds; r++)
+        sink = sink + list.head()->count(LIST_SIDE_NEXT) + 1;
+    const auto walk_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    
+    TEST_CHECK(list.count() == LIST_POOL_SIZE);
+    list.clear();
+    const auto ns = 1e9 / rounds;
+    printf("    link + pop %.1f ns/item, count %.1f ns, walk of %d %.1f ns\n",
+        link_s * ns / LIST_POOL_SIZE, count_s * ns, LIST_POOL_SIZE, walk_s * ns);
+}
+
+int main(void)
+{
+    TEST_RUN(list_count);
+    TEST_RUN(list_pop);
+    TEST_RUN(list_move);
+    TEST_RUN(list_splice);
+    TEST_RUN(list_random_ops);
+    TEST_RUN(list_benchmark);
+    return test_result("list");
+}
@@ -0,0 +1,194 @@
+﻿// Окружение модулей STM32 на хосте: таймеры, модель Flash (подключается один раз на тест)
+#ifndef __STM_HOST_H
+#define __STM_HOST_H
+
+// Класс таймера STM32 совпадает по имени с POSIX timer_t
+#include <sys/types.h>
+#define timer_t     stm_timer_t
+
+#include <mcu.h>
+#include <timer.h>
+
+// Регистры FPEC
+FLASH_TypeDef host_flash;
+// Обработчик записи в регистры FPEC (модель по таймерам обходится без него)
+void (*host_flash_write)(host_flash_reg_t &reg, uint32_t previous);
+// Количество маскирований прерываний
+unsigned host_irq_disable_count;
+
+// Модель Flash: область, стирание страниц, учет программирования
+static struct
+{
+    // Начало и размер моделируемой области
+    uint16_t *base;
+    size_t size;
+    // Размер страницы [байт]
+    size_t page_size;
+    // Снимок до кванта (проверка программирования только стертых полуслов)
+    uint16_t *shadow;
+    // Полуслов запрограммировано за последний квант
+    size_t programmed;
+    // Нарушения: запись в не стертое полуслово, без разблокировки или без PG
+    unsigned violations;
+    // Количество стираний страниц
+    unsigned erases;
+    // Завершение стирания [мкС]
+    uint64_t erase_end;
+} host_flash_model;
+
+// Худшее время программирования полуслова и стирания страницы F103 [мкС]
+constexpr const uint32_t HOST_FLASH_PROGRAM_US = 70;
+constexpr const uint32_t HOST_FLASH_ERASE_US = XK(40);
+
+// Модельное время [мкС]
+static inline uint64_t host_time_us(void);
+
+// Состояние FPEC к моменту срабатывания таймера (флаги SR сбрасываются записью единиц)
+static inline void host_flash_update(void)
+{
+    host_flash.SR = host_time_us() < host_flash_model.erase_end ? FLASH_SR_BSY : 0;
+}
+
+// Запущенные таймеры
+static list_template_t<timer_wrap_t> host_timer_active;
+// Модельное время [тики таймера]
+static uint64_t host_timer_ticks;
+
+void timer_t::start(uint32_t interval, timer_flag_t flags)
+{
+    assert(interval > 0);
+    if (active.unlinked())
+        active.link(host_timer_active, (flags & TIMER_FLAG_HEAD) ? LIST_SIDE_HEAD : LIST_SIDE_LAST);
+    current = interval;
+    reload = (flags & TIMER_FLAG_LOOP) ? interval : 0;
+    call_from_irq = (flags & TIMER_FLAG_CIRQ) > 0;
+}
+
+void timer_t::start_hz(float_t hz, timer_flag_t flags)
+{
+    assert(hz >= TIMER_HZ_MIN);
+    assert(hz <= TIMER_HZ_MAX);
+    start((uint32_t)(TIMER_FREQUENCY_HZ / hz), flags);
+}
+
+void timer_t::start_us(uint32_t us, timer_flag_t flags)
+{
+    assert(us >= TIMER_US_MIN);
+    start(us / TIMER_US_PER_TICK, flags);
+}
+
+bool timer_t::stop(void)
+{
+    if (active.unlinked())
+        return false;
+    active.unlink();
+    return true;
+}
+
+void timer_t::raise(void)
+{
+    handler();
+}
+
+// На хосте - переход к ближайшему таймеру и вызов его обработчика
+void timer_t::interrupt_htim(void)
+{
+    auto next = host_timer_active.head();
+    if (next == NULL)
+        return;
+    for (auto i = next; i != NULL; i = LIST_ITEM_NEXT(i))
+        if (i->timer.current < next->timer.current)
+            next = i;
+    
+    auto &timer = next->timer;
+    const auto elapsed = timer.current;
+    for (auto i = host_timer_active.head(); i != NULL; i = LIST_ITEM_NEXT(i))
+        i->timer.current -= elapsed;
+    host_timer_ticks += elapsed;
+    
+    if (timer.reload > 0)
+        timer.current = timer.reload;
+    else
+        timer.stop();
+    host_flash_update();
+    timer.handler();
+}
+
+// Останов всех таймеров (сброс питания)
+static inline void host_timer_reset(void)
+{
+    while (!host_timer_active.empty())
+        host_timer_active.pop();
+    host_flash_model.erase_end = 0;
+}
+
+static inline uint64_t host_time_us(void)
+{
+    return host_timer_ticks * TIMER_US_PER_TICK;
+}
+
+void mcu_halt(mcu_halt_reason_t reason)
+{
+    fprintf(stderr, "mcu_halt(%d)\n", reason);
+    abort();
+}
+
+// Подключение области моделируемой Flash
+static inline void host_flash_attach(uint16_t *base, size_t size, size_t page_size)
+{
+    host_flash_model.base = base;
+    host_flash_model.size = size;
+    host_flash_model.page_size = page_size;
+    host_flash_model.shadow = (uint16_t *)realloc(host_flash_model.shadow, size);
+    memset(base, 0xFF, size);
+    host_flash = FLASH_TypeDef();
+    host_flash.CR = FLASH_CR_LOCK;
+}
+
+// Шаг модели: срабатывание ближайшего таймера, проверка записей, выполнение стирания
+static inline void host_step(void)
+{
+    auto &model = host_flash_model;
+    const auto count = model.size / sizeof(uint16_t);
+    memcpy(model.shadow, model.base, model.size);
+    
+    const auto locked = (host_flash.CR & FLASH_CR_LOCK) != 0;
+    timer_t::interrupt_htim();
+    
+    // Полуслово Flash программируется только из стертого состояния и без блокировки FPEC
+    model.programmed = 0;
+    for (size_t i = 0; i < count; i++)
+        if (model.base[i] != model.shadow[i])
+        {
+            model.programmed++;
+            if (model.shadow[i] != 0xFFFF || locked || (host_flash.CR & FLASH_CR_PG) == 0)
+                model.violations++;
+        }
+    
+    // Разблокировка FPEC последним ключом
+    if (host_flash.KEYR == 0xCDEF89AB)
+    {
+        host_flash.CR &= ~FLASH_CR_LOCK;
+        host_flash.KEYR = 0;
+    }
+    
+    // Стирание выполняется сразу, FPEC занят до его завершения (адрес восстанавливается по младшим 32 битам)
+    if ((host_flash.CR & (FLASH_CR_PER | FLASH_CR_STRT)) == (FLASH_CR_PER | FLASH_CR_STRT))
+    {
+        const auto address = ((uintptr_t)model.base & ~(uintptr_t)UINT32_MAX) | host_flash.AR;
+        const auto offset = address - (uintptr_t)model.base;
+        assert(offset < model.size && offset % model.page_size == 0);
+        memset((uint8_t *)model.base + offset, 0xFF, model.page_size);
+        model.erases++;
+        model.erase_end = host_time_us() + HOST_FLASH_ERASE_US;
+        host_flash.CR &= ~FLASH_CR_STRT;
+    }
+}
+
+// Получает количество запущенных таймеров
+static inline size_t host_timer_count(void)
+{
+    return host_timer_active.count();
+}
+
+#endif // __STM_HOST_H
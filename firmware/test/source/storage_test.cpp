@@ -0,0 +1,352 @@
+﻿#include "test.h"
+#include "stm_host.h"
+#include <storage.cpp>
+
+// Хранилище в ОЗУ: три блока, последний неполный
+constexpr const size_t HOST_STORAGE_COUNT = 20;
+static uint16_t host_storage[HOST_STORAGE_COUNT];
+// Значения хранилища по умолчанию
+static uint16_t host_storage_init[HOST_STORAGE_COUNT];
+// Журнал хранилища (Flash)
+static uint16_t host_storage_log[STORAGE_LOG_SIZE / sizeof(uint16_t)];
+
+void * host_section_begin(const char *name)
+{
+    if (!strcmp(name, STORAGE_SECTION))
+        return host_storage;
+    if (!strcmp(name, STORAGE_SECTION_RO))
+        return host_storage_init;
+    assert(!strcmp(name, STORAGE_SECTION_LOG));
+    return host_storage_log;
+}
+
+size_t host_section_size(const char *name)
+{
+    return strcmp(name, STORAGE_SECTION_LOG) ? sizeof(host_storage) : sizeof(host_storage_log);
+}
+
+// Количество полуслов блока хранилища
+constexpr const size_t BLOCK_HALFWORDS = STORAGE_BLOCK_SIZE / sizeof(uint16_t);
+// Количество блоков хранилища
+constexpr const size_t BLOCK_COUNT = (HOST_STORAGE_COUNT + BLOCK_HALFWORDS - 1) / BLOCK_HALFWORDS;
+
+// Состояние хранилища
+typedef uint16_t state_t[HOST_STORAGE_COUNT];
+
+// Заполнение состояния по номеру (у блоков разные значения)
+static void state_fill(state_t &state, uint16_t seed)
+{
+    for (size_t i = 0; i < HOST_STORAGE_COUNT; i++)
+        state[i] = (uint16_t)(seed * 31 + i);
+}
+
+// Включение питания: сброс модуля, значения по умолчанию, восстановление из журнала
+static void power_on(void)
+{
+    host_timer_reset();
+    host_flash.SR = 0;
+    host_flash.CR = FLASH_CR_LOCK;
+    host_flash.KEYR = 0;
+    memset(&storage, 0, sizeof(storage));
+    memset(&storage_flush, 0, sizeof(storage_flush));
+    memcpy(host_storage, host_storage_init, sizeof(host_storage));
+    storage_init();
+}
+
+// Отчистка Flash и значения по умолчанию
+static void flash_blank(void)
+{
+    host_flash_attach(host_storage_log, sizeof(host_storage_log), STORAGE_PAGE_SIZE);
+    for (size_t i = 0; i < HOST_STORAGE_COUNT; i++)
+        host_storage_init[i] = (uint16_t)(0x1000 + i);
+    power_on();
+}
+
+// Сброс журнала до завершения (результат - количество квантов)
+static size_t flush(void)
+{
+    storage_modified();
+    size_t steps = 0;
+    for (; host_timer_count() > 0 && steps < 10000; steps++)
+        host_step();
+    return steps;
+}
+
+// Изменение хранилища с полным сбросом
+static void store(const state_t &state)
+{
+    memcpy(host_storage, state, sizeof(host_storage));
+    flush();
+}
+
+// Получает, совпадает ли блок хранилища с блоком состояния
+static bool block_equal(size_t block, const state_t &state)
+{
+    const auto offset = block * BLOCK_HALFWORDS;
+    const auto count = minimum<size_t>(BLOCK_HALFWORDS, HOST_STORAGE_COUNT - offset);
+    return !memcmp(host_storage + offset, state + offset, count * sizeof(uint16_t));
+}
+
+// Пустая Flash - значения по умолчанию, журнал не пишется
+static void storage_blank(void)
+{
+    flash_blank();
+    TEST_CHECK(!memcmp(host_storage, host_storage_init, sizeof(host_storage)));
+    TEST_CHECK(storage.page == NULL);
+    TEST_CHECK(storage.block_count == BLOCK_COUNT);
+    TEST_CHECK(host_timer_count() == 0);
+    
+    // Сброс без изменений ничего не пишет
+    flush();
+    TEST_CHECK(host_flash_model.erases == 0);
+    TEST_CHECK(storage.page == NULL);
+}
+
+// Дозапись изменённых блоков и восстановление
+static void storage_append(void)
+{
+    flash_blank();
+    
+    // Первое изменение размечает страницу
+    host_storage[9]++;
+    flush();
+    TEST_CHECK(storage.page != NULL);
+    TEST_CHECK(host_flash_model.erases == 1);
+    TEST_CHECK(storage.count == 1);
+    
+    // Следующие изменения дописываются без стирания
+    host_storage[0] = 0xABCD;
+    host_storage[19] = 0x1234;
+    flush();
+    TEST_CHECK(host_flash_model.erases == 1);
+    TEST_CHECK(storage.count == 3);
+    TEST_CHECK((host_flash.CR & FLASH_CR_LOCK) != 0);
+    
+    // Восстановление
+    state_t expected;
+    memcpy(expected, host_storage, sizeof(expected));
+    power_on();
+    TEST_CHECK(!memcmp(host_storage, expected, sizeof(expected)));
+    TEST_CHECK(storage.count == 3);
+    
+    // Последняя запись блока новее предыдущих
+    host_storage[9] = 0x5555;
+    flush();
+    expected[9] = 0x5555;
+    power_on();
+    TEST_CHECK(!memcmp(host_storage, expected, sizeof(expected)));
+    TEST_CHECK(host_flash_model.violations == 0);
+}
+
+// Уплотнение при заполнении страницы
+static void storage_compaction(void)
+{
+    flash_blank();
+    
+    state_t state;
+    uint16_t generation = 0;
+    for (uint16_t i = 0; i < 3 * STORAGE_RECORD_COUNT; i++)
+    {
+        state_fill(state, i);
+        // Блок 1 остается по умолчанию - при уплотнении не переносится
+        memcpy(state + BLOCK_HALFWORDS, host_storage_init + BLOCK_HALFWORDS, STORAGE_BLOCK_SIZE);
+        store(state);
+        
+        if (storage.page->header.generation != generation)
+        {
+            // Новая страница содержит только блоки, отличные от значений по умолчанию
+            TEST_CHECK(storage.page->header.generation == (uint16_t)(generation + 1));
+            TEST_CHECK(storage.count == BLOCK_COUNT - 1);
+            generation = storage.page->header.generation;
+        }
+    }
+    TEST_CHECK(host_flash_model.erases > 3);
+    TEST_CHECK(host_flash_model.violations == 0);
+    
+    // Восстановление с последней страницы
+    power_on();
+    TEST_CHECK(!memcmp(host_storage, state, sizeof(state)));
+    TEST_CHECK(storage.page->header.generation == generation);
+}
+
+// Журнал другой раскладки не применяется
+static void storage_layout(void)
+{
+    flash_blank();
+    
+    state_t state;
+    state_fill(state, 7);
+    store(state);
+    
+    // Новая прошивка с другими значениями по умолчанию
+    host_storage_init[3] ^= 0xFFFF;
+    power_on();
+    TEST_CHECK(storage.page == NULL);
+    TEST_CHECK(!memcmp(host_storage, host_storage_init, sizeof(host_storage)));
+    
+    // Журнал размечается заново
+    store(state);
+    power_on();
+    TEST_CHECK(!memcmp(host_storage, state, sizeof(state)));
+    TEST_CHECK(host_flash_model.violations == 0);
+}
+
+// Пропадание питания на каждом кванте сброса (prefill - записей на странице до сброса)
+static void power_cut_sweep(size_t prefill)
+{
+    state_t a, b, c;
+    state_fill(a, 1);
+    state_fill(b, 2);
+    state_fill(c, 3);
+    auto failed = 0;
+    
+    for (size_t cut = 0;; cut++)
+    {
+        // Исходное состояние A на странице с указанным заполнением
+        flash_blank();
+        store(a);
+        while (storage.count < prefill)
+        {
+            host_storage[0] ^= 1;
+            flush();
+            host_storage[0] ^= 1;
+            flush();
+        }
+        
+        // Сброс состояния B обрывается после cut квантов
+        memcpy(host_storage, b, sizeof(b));
+        storage_modified();
+        size_t steps = 0;
+        for (; host_timer_count() > 0 && steps < cut; steps++)
+            host_step();
+        const auto complete = host_timer_count() == 0;
+        power_on();
+        
+        // Каждый блок - целиком A или B
+        for (size_t block = 0; block < BLOCK_COUNT; block++)
+            if (!block_equal(block, a) && !block_equal(block, b))
+                failed++;
+        // Завершенный сброс сохранил B
+        if (complete && memcmp(host_storage, b, sizeof(b)))
+            failed++;
+        
+        // Журнал продолжает работать
+        store(c);
+        power_on();
+        if (memcmp(host_storage, c, sizeof(c)))
+            failed++;
+        
+        if (complete)
+            break;
+    }
+    TEST_CHECK(failed == 0);
+    TEST_CHECK(host_flash_model.violations == 0);
+}
+
+// Пропадание питания при дозаписи
+static void storage_power_cut_append(void)
+{
+    power_cut_sweep(0);
+}
+
+// Пропадание питания при уплотнении
+static void storage_power_cut_compaction(void)
+{
+    power_cut_sweep(STORAGE_RECORD_COUNT - 1);
+}
+
+// Сброс квантами: не более STORAGE_STEP_HALFWORDS полуслов, опрос BSY вместо ожидания стирания
+static void storage_flush_slices(void)
+{
+    flash_blank();
+    // Журнал почти заполнен - сохранение с уплотнением
+    while (storage.count < STORAGE_RECORD_COUNT - 1)
+    {
+        host_storage[0] ^= 1;
+        flush();
+    }
+    
+    state_t state;
+    state_fill(state, 5);
+    memcpy(host_storage, state, sizeof(state));
+    host_irq_disable_count = 0;
+    storage_modified();
+    // Отложенный сброс
+    host_step();
+    
+    size_t busy = 0, quanta = 0, programmed = 0;
+    auto last = host_time_us();
+    uint64_t interval_failed = 0;
+    while (host_timer_count() > 0)
+    {
+        const auto erasing = host_time_us() + STORAGE_STEP_US < host_flash_model.erase_end;
+        host_step();
+        quanta++;
+        if (host_time_us() - last != STORAGE_STEP_US)
+            interval_failed++;
+        last = host_time_us();
+        // Занятый FPEC не ожидается
+        if (erasing)
+        {
+            busy++;
+            TEST_CHECK(host_flash_model.programmed == 0);
+        }
+        programmed = maximum(programmed, host_flash_model.programmed);
+    }
+    TEST_CHECK(interval_failed == 0);
+    TEST_CHECK(busy >= HOST_FLASH_ERASE_US / STORAGE_STEP_US - 1);
+    TEST_CHECK(programmed <= STORAGE_STEP_HALFWORDS);
+    // Прерывания не маскируются
+    TEST_CHECK(host_irq_disable_count == 0);
+    TEST_CHECK(host_flash_model.violations == 0);
+    
+    // Худшая занятость цикла событий квантом (таймеры мультиплексора не задерживаются)
+    printf("    %u quanta, worst slice %u us, erase polled for %u quanta\n",
+        (unsigned)quanta, (unsigned)(programmed * HOST_FLASH_PROGRAM_US), (unsigned)busy);
+    
+    power_on();
+    TEST_CHECK(!memcmp(host_storage, state, sizeof(state)));
+}
+
+// Изменение во время сброса - повторный проход
+static void storage_flush_again(void)
+{
+    flash_blank();
+    
+    state_t a, b;
+    state_fill(a, 8);
+    state_fill(b, 9);
+    memcpy(host_storage, a, sizeof(a));
+    storage_modified();
+    host_step();
+    // Первый блок уже записан
+    while (storage.source[0] == storage_block_default(0))
+        host_step();
+    
+    // Отложенный сброс срабатывает во время записи
+    memcpy(host_storage, b, sizeof(b));
+    storage_deffered_flush_timer.raise();
+    TEST_CHECK(storage_flush.again);
+    while (host_timer_count() > 0)
+        host_step();
+    TEST_CHECK(!storage_flush.again);
+    TEST_CHECK(storage_flush.state == STORAGE_FLUSH_STATE_IDLE);
+    TEST_CHECK((host_flash.CR & FLASH_CR_LOCK) != 0);
+    
+    power_on();
+    TEST_CHECK(!memcmp(host_storage, b, sizeof(b)));
+    TEST_CHECK(host_flash_model.violations == 0);
+}
+
+int main(void)
+{
+    TEST_RUN(storage_blank);
+    TEST_RUN(storage_append);
+    TEST_RUN(storage_compaction);
+    TEST_RUN(storage_layout);
+    TEST_RUN(storage_power_cut_append);
+    TEST_RUN(storage_power_cut_compaction);
+    TEST_RUN(storage_flush_slices);
+    TEST_RUN(storage_flush_again);
+    return test_result("storage");
+}
@@ -0,0 +1,10 @@
+﻿// Заглушка таймера ESP8266 для сборки на хосте
+#ifndef __ESP_TIMER_H
+#define __ESP_TIMER_H
+
+#include "system.h"
+
+// Получает время с запуска [мкС]
+int64_t esp_timer_get_time(void);
+
+#endif // __ESP_TIMER_H
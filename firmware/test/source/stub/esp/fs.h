@@ -0,0 +1,13 @@
+﻿// Заглушка файловой системы для сборки на хосте (файлы не находятся)
+#ifndef __FS_H
+#define __FS_H
+
+#include <romfs.h>
+
+// Дескрипатор файла
+typedef romfs_t::reader_t::handle_t fs_file_t;
+
+// Открытие файла
+fs_file_t fs_open(const char *path);
+
+#endif // __FS_H
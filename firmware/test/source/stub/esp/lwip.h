@@ -0,0 +1,16 @@
+﻿// Заглушка стека LwIP для сборки на хосте
+#ifndef __LWIP_H
+#define __LWIP_H
+
+#include "system.h"
+
+// Тип сокета
+typedef int lwip_socket_t;
+// Не действительный сокет
+#define LWIP_INVALID_SOCKET             -1
+// Размер буфера строки IP адреса
+#define LWIP_IP_ADDRESS_BUFFER_SIZE     16
+// Размер буфера передачи TCP (из sdkconfig)
+#define CONFIG_TCP_SND_BUF_DEFAULT      2920
+
+#endif // __LWIP_H
@@ -0,0 +1,10 @@
+﻿// Заглушка ОС для сборки на хосте
+#ifndef __OS_H
+#define __OS_H
+
+#include "system.h"
+
+// Тип тиков ОС
+typedef uint32_t os_tick_t;
+
+#endif // __OS_H
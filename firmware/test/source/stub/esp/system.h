@@ -0,0 +1,10 @@
+﻿// Заглушка системных определений ESP8266 для сборки на хосте
+#ifndef __SYSTEM_H
+#define __SYSTEM_H
+
+#include <common.h>
+
+// Размер регистра в батйах
+#define SYSTEM_REG_SIZE             4
+
+#endif // __SYSTEM_H
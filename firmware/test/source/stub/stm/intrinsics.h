@@ -0,0 +1,41 @@
+﻿// Заглушка встроенных функций IAR для сборки на хосте
+#ifndef __INTRINSICS_H
+#define __INTRINSICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Модификаторы IAR
+#define __noreturn          __attribute__((noreturn))
+#define __no_init
+#define __ramfunc
+
+// Количество маскирований прерываний (учитывается тестом)
+extern unsigned host_irq_disable_count;
+
+// Состояние прерываний (на хосте прерываний нет)
+typedef uint32_t __istate_t;
+inline __istate_t __get_interrupt_state(void)
+{
+    return 0;
+}
+inline void __set_interrupt_state(__istate_t state)
+{ }
+inline void __enable_interrupt(void)
+{ }
+inline void __disable_interrupt(void)
+{
+    host_irq_disable_count++;
+}
+
+// Барьер памяти (реализуется тестом, видит запрос сброса)
+void host_dsb(void);
+#define __DSB()             host_dsb()
+
+// Начало и размер секции линковщика (реализуются тестом)
+void * host_section_begin(const char *name);
+size_t host_section_size(const char *name);
+#define __sfb(name)         host_section_begin(name)
+#define __sfs(name)         host_section_size(name)
+
+#endif // __INTRINSICS_H
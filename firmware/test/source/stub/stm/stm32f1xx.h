@@ -0,0 +1,119 @@
+﻿// Заглушка периферии STM32F1 для сборки на хосте (только используемые тестами регистры)
+#ifndef __STM32F1XX_H
+#define __STM32F1XX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Источники MCO
+#define RCC_CFGR_MCO_NOCLOCK        0x00000000U
+#define RCC_CFGR_MCO_SYSCLK         0x04000000U
+#define RCC_CFGR_MCO_HSI            0x05000000U
+#define RCC_CFGR_MCO_HSE            0x06000000U
+#define RCC_CFGR_MCO_PLLCLK_DIV2    0x07000000U
+
+// Канал DMA
+typedef struct
+{
+    volatile uint32_t CCR;
+    volatile uint32_t CNDTR;
+    volatile uint32_t CPAR;
+    volatile uint32_t CMAR;
+} DMA_Channel_TypeDef;
+
+// Регистр FPEC, запись в который видит модель теста
+struct host_flash_reg_t;
+// Обработчик записи в регистр FPEC (NULL - просто хранение значения)
+extern void (*host_flash_write)(host_flash_reg_t &reg, uint32_t previous);
+
+struct host_flash_reg_t
+{
+    volatile uint32_t value;
+    
+    operator uint32_t() const
+    {
+        return value;
+    }
+    
+    host_flash_reg_t & operator = (uint32_t v)
+    {
+        const uint32_t previous = value;
+        value = v;
+        if (host_flash_write != NULL)
+            host_flash_write(*this, previous);
+        return *this;
+    }
+    
+    host_flash_reg_t & operator |= (uint32_t v)
+    {
+        return *this = value | v;
+    }
+    
+    host_flash_reg_t & operator &= (uint32_t v)
+    {
+        return *this = value & v;
+    }
+};
+
+// Контроллер Flash (FPEC)
+typedef struct
+{
+    volatile uint32_t ACR;
+    host_flash_reg_t KEYR;
+    volatile uint32_t OPTKEYR;
+    host_flash_reg_t SR;
+    host_flash_reg_t CR;
+    volatile uint32_t AR;
+    volatile uint32_t RESERVED;
+    volatile uint32_t OBR;
+    volatile uint32_t WRPR;
+} FLASH_TypeDef;
+
+// Регистры FPEC моделируются тестом
+extern FLASH_TypeDef host_flash;
+#define FLASH                       (&host_flash)
+
+#define FLASH_SR_BSY                0x00000001U
+#define FLASH_SR_PGERR              0x00000004U
+#define FLASH_SR_WRPRTERR           0x00000010U
+#define FLASH_SR_EOP                0x00000020U
+
+#define FLASH_CR_PG                 0x00000001U
+#define FLASH_CR_PER                0x00000002U
+#define FLASH_CR_STRT               0x00000040U
+#define FLASH_CR_LOCK               0x00000080U
+
+// Начало ПЗУ - образ в ОЗУ теста
+extern uint16_t host_rom[];
+#define FLASH_BASE                  ((uintptr_t)host_rom)
+
+// Системный таймер
+typedef struct
+{
+    volatile uint32_t CTRL;
+    volatile uint32_t LOAD;
+    volatile uint32_t VAL;
+    volatile uint32_t CALIB;
+} SysTick_Type;
+
+// Системный таймер моделируется тестом
+extern SysTick_Type host_systick;
+#define SysTick                     (&host_systick)
+
+#define SysTick_CTRL_COUNTFLAG_Msk  0x00010000U
+
+// Блок управления системой (только используемые регистры)
+typedef struct
+{
+    volatile uint32_t VTOR;
+    volatile uint32_t AIRCR;
+} SCB_Type;
+
+// Блок управления системой моделируется тестом
+extern SCB_Type host_scb;
+#define SCB                         (&host_scb)
+
+#define SCB_AIRCR_VECTKEY_Pos       16U
+#define SCB_AIRCR_SYSRESETREQ_Msk   0x00000004U
+
+#endif // __STM32F1XX_H
@@ -0,0 +1,40 @@
+﻿// Каркас тестов модулей на хосте
+#ifndef __TEST_H
+#define __TEST_H
+
+#include <common.h>
+
+// Счетчики проверок
+static struct
+{
+    // Количество выполненных проверок
+    unsigned checks;
+    // Количество проваленных проверок
+    unsigned failures;
+} test_stat;
+
+// Учет результата проверки (выполнение продолжается)
+static inline void test_check(bool passed, const char *expr, const char *file, int line)
+{
+    test_stat.checks++;
+    if (passed)
+        return;
+    test_stat.failures++;
+    printf("%s:%d: check failed: %s\n", file, line, expr);
+}
+
+// Проверка условия
+#define TEST_CHECK(expr)        test_check((expr), #expr, __FILE__, __LINE__)
+
+// Запуск тестового случая
+#define TEST_RUN(name)          \
+    CODE_BLOCK(printf("  %s\n", #name); name())
+
+// Итог набора тестов, результат - код завершения процесса
+static inline int test_result(const char *suite)
+{
+    printf("%s: %u checks, %u failed\n", suite, test_stat.checks, test_stat.failures);
+    return test_stat.failures > 0 ? 1 : 0;
+}
+
+#endif // __TEST_H
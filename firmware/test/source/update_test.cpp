@@ -0,0 +1,494 @@
+﻿#include "test.h"
+#include "stm_host.h"
+#include <setjmp.h>
+#include <update.cpp>
+
+// ПЗУ STM32: образ приложения и журнал хранилища в конце
+alignas(UPDATE_PAGE_SIZE) uint16_t host_rom[UPDATE_STM_ROM_SIZE / sizeof(uint16_t)];
+// Системный таймер (счетчик всегда переполнен - слот транзакции есть всегда)
+SysTick_Type host_systick;
+// Блок управления системой (запрос сброса)
+SCB_Type host_scb;
+
+// Модельное время [мС] (транзакция SPI - период SysTick)
+static uint32_t test_tick;
+
+ipc_handler_t::tick_t ipc_handler_t::tick_get(void)
+{
+    return test_tick;
+}
+
+// Приёмник ответов обработчиков STM32 (к ESP по каналу связи)
+static class test_sink_t : public ipc_processor_t
+{
+public:
+    // Количество переданных пакетов
+    unsigned packets;
+    
+    // Обработка пакета
+    virtual bool packet_process(const ipc_packet_t &packet, const args_t &args) override final
+    {
+        packets++;
+        return true;
+    }
+} test_sink;
+
+ipc_processor_t & ipc_handler_t::transmitter_get(void)
+{
+    return test_sink;
+}
+
+// Хост обработчиков команд STM32
+static ipc_handler_host_t test_host;
+
+void esp_handler_add(ipc_handler_t &handler)
+{
+    test_host.handler_add(handler);
+}
+
+// Количество опросов занятости FPEC до завершения стирания
+static unsigned test_fpec_busy;
+// Количество стираний каждой страницы ПЗУ
+static unsigned test_page_erases[UPDATE_STM_ROM_SIZE / UPDATE_PAGE_SIZE];
+
+// Модель FPEC: сброс флагов записью единиц, разблокировка, стирание страницы
+static void test_flash_write(host_flash_reg_t &reg, uint32_t previous)
+{
+    auto &model = host_flash_model;
+    if (&reg == &host_flash.SR)
+    {
+        reg.value = previous & ~(reg.value & ~FLASH_SR_BSY);
+        return;
+    }
+    if (&reg == &host_flash.KEYR)
+    {
+        if (previous == 0x45670123 && reg.value == 0xCDEF89AB)
+            host_flash.CR.value &= ~FLASH_CR_LOCK;
+        return;
+    }
+    // Программирование и стирание только после разблокировки
+    if ((reg.value & FLASH_CR_LOCK) != 0 && (reg.value & (FLASH_CR_PG | FLASH_CR_PER)) != 0)
+        model.violations++;
+    if ((reg.value & (FLASH_CR_PER | FLASH_CR_STRT)) != (FLASH_CR_PER | FLASH_CR_STRT))
+        return;
+    // Адрес восстанавливается по младшим 32 битам
+    const auto address = ((uintptr_t)model.base & ~(uintptr_t)UINT32_MAX) | host_flash.AR;
+    const auto offset = address - (uintptr_t)model.base;
+    assert(offset < model.size && offset % model.page_size == 0);
+    memset((uint8_t *)model.base + offset, 0xFF, model.page_size);
+    model.erases++;
+    test_page_erases[offset / model.page_size]++;
+    reg.value &= ~FLASH_CR_STRT;
+    host_flash.SR.value |= FLASH_SR_BSY;
+    test_fpec_busy = 3;
+}
+
+// Программатор сбрасывает сторожевой таймер в каждом цикле ожидания
+void wdt_pulse(void)
+{
+    if (test_fpec_busy > 0 && --test_fpec_busy == 0)
+        host_flash.SR.value &= ~FLASH_SR_BSY;
+}
+
+// Выход из программатора
+enum test_exit_t
+{
+    // Программатор не запущен
+    TEST_EXIT_NONE,
+    // Сброс по завершении
+    TEST_EXIT_RESET,
+    // Сброса нет за отведенное время
+    TEST_EXIT_STUCK,
+};
+
+// Точка выхода из программатора
+static jmp_buf test_exit;
+
+void host_dsb(void)
+{
+    if (host_scb.AIRCR & SCB_AIRCR_SYSRESETREQ_Msk)
+        longjmp(test_exit, TEST_EXIT_RESET);
+}
+
+// Образ в промежуточном разделе ESP (доступно меньше байт - образ обрезан)
+struct test_source_t
+{
+    // Данные
+    const uint8_t *data;
+    // Количество доступных байт
+    size_t size;
+    
+    // Чтение части образа по указанному смещению
+    bool read(void *dest, size_t size, size_t offset)
+    {
+        if (offset + size > this->size)
+            return false;
+        memcpy(dest, data + offset, size);
+        return true;
+    }
+};
+
+// Таймаут ответа программатора ESP [мС]
+constexpr const uint32_t TEST_ESP_TIMEOUT_MS = 3000;
+// Задержка повторного запуска туннеля после его останова [мС]
+constexpr const uint32_t TEST_ESP_RETRY_MS = 500;
+// Предельное время работы программатора [мС]
+constexpr const uint32_t TEST_DEADLINE_MS = 30000;
+
+// Сторона ESP: туннель с таймаутом и остановом по ошибке чтения, как в задаче связи
+static struct
+{
+    // Туннель
+    update_tunnel_t tunnel;
+    // Источник образа
+    test_source_t source;
+    // Запущен ли туннель
+    bool active;
+    // Время последнего запроса блока и останова туннеля
+    uint32_t tick, stop_tick;
+    // Пакет от STM32 и пакет следующей транзакции
+    ipc_packet_t in, out;
+    // Обрыв передачи по запросу блока с этого смещения (0 - без обрыва)
+    uint32_t abort_offset;
+    // Повторный запуск туннеля после останова
+    struct
+    {
+        // Запланирован ли
+        bool pending;
+        // Параметры и источник
+        update_begin_t begin;
+        test_source_t source;
+    } retry;
+    // Счетчики: завершения, таймауты, ошибки чтения, обрывы
+    unsigned done, timeouts, failures, aborts;
+    // Завершение работы программатора
+    uint32_t deadline;
+} esp;
+
+// Запуск туннеля ESP
+static void test_esp_start(const update_begin_t &begin, const test_source_t &source)
+{
+    esp.tunnel.start(begin);
+    esp.source = source;
+    esp.tick = test_tick;
+    esp.active = true;
+}
+
+// Останов туннеля ESP
+static void test_esp_stop(unsigned &counter)
+{
+    counter++;
+    esp.active = false;
+    esp.stop_tick = test_tick;
+}
+
+// Подготовка пакета следующей транзакции ESP
+static void test_esp_output(void)
+{
+    if (!esp.active && esp.retry.pending && test_tick - esp.stop_tick >= TEST_ESP_RETRY_MS)
+    {
+        esp.retry.pending = false;
+        test_esp_start(esp.retry.begin, esp.retry.source);
+    }
+    if (esp.active && !esp.tunnel.output(esp.out, esp.source))
+        test_esp_stop(esp.failures);
+    // Без туннеля ESP передает пакеты канала связи, программатор их отбрасывает
+    if (!esp.active)
+        memset(&esp.out, 0, sizeof(esp.out));
+}
+
+void esp_update_prepare(void)
+{ }
+
+void esp_update_transfer_start(const ipc_packet_t &packet)
+{
+    esp.in = packet;
+}
+
+// Транзакция завершается сразу: STM32 получает подготовленный пакет ESP, ESP разбирает ответ
+bool esp_update_transfer_complete(ipc_packet_t &packet)
+{
+    if (++test_tick - esp.deadline < UINT32_MAX / 2)
+        longjmp(test_exit, TEST_EXIT_STUCK);
+    packet = esp.out;
+    if (esp.active)
+        switch (esp.tunnel.input(esp.in))
+        {
+            case UPDATE_REPLY_READ:
+                esp.tick = test_tick;
+                if (esp.abort_offset > 0 && esp.tunnel.offset >= esp.abort_offset)
+                {
+                    esp.abort_offset = 0;
+                    test_esp_stop(esp.aborts);
+                }
+                break;
+            case UPDATE_REPLY_DONE:
+                test_esp_stop(esp.done);
+                break;
+            default:
+                if (test_tick - esp.tick >= TEST_ESP_TIMEOUT_MS)
+                    test_esp_stop(esp.timeouts);
+                break;
+        }
+    test_esp_output();
+    return true;
+}
+
+// Размер тестового образа (нечетный - последнее полуслово дополняется)
+constexpr const uint32_t TEST_IMAGE_SIZE = 5001;
+// Количество страниц образа
+constexpr const size_t TEST_IMAGE_PAGES = (TEST_IMAGE_SIZE + UPDATE_PAGE_SIZE - 1) / UPDATE_PAGE_SIZE;
+// Тестовый образ и образ следующей загрузки
+static uint8_t test_image[TEST_IMAGE_SIZE], test_image_next[TEST_IMAGE_SIZE];
+// Заполнение ПЗУ старым приложением и журналом
+static const uint8_t TEST_ROM_OLD = 0x5A;
+
+// Параметры запуска тестовым образом
+static update_begin_t test_begin(const uint8_t *image = test_image)
+{
+    update_begin_t begin;
+    begin.magic = UPDATE_MAGIC;
+    begin.size = TEST_IMAGE_SIZE;
+    begin.crc = ~update_crc(UPDATE_CRC_INIT, image, TEST_IMAGE_SIZE);
+    return begin;
+}
+
+// Источник с тестовым образом целиком
+static test_source_t test_source(const uint8_t *image = test_image)
+{
+    test_source_t source = { image, TEST_IMAGE_SIZE };
+    return source;
+}
+
+// Включение питания STM32 со старым приложением, ESP без туннеля
+static void test_power_on(void)
+{
+    host_flash_attach(host_rom, sizeof(host_rom), UPDATE_PAGE_SIZE);
+    memset(host_rom, TEST_ROM_OLD, sizeof(host_rom));
+    host_flash_model.erases = host_flash_model.violations = 0;
+    memset(test_page_erases, 0, sizeof(test_page_erases));
+    host_flash_write = test_flash_write;
+    host_systick.CTRL = SysTick_CTRL_COUNTFLAG_Msk;
+    host_scb.AIRCR = 0;
+    test_fpec_busy = 0;
+    memset(&update, 0, sizeof(update));
+    memset(&esp, 0, sizeof(esp));
+    test_sink.packets = 0;
+    test_tick += UPDATE_ARM_WINDOW_MS;
+}
+
+// Подготовка приложения STM32 командой по каналу связи, результат - передан ли ответ
+static bool test_arm(const update_begin_t &begin)
+{
+    update_command_arm_t command;
+    command.request = begin;
+    const auto packets = test_sink.packets;
+    command.transmit(test_host, IPC_DIR_REQUEST);
+    test_host.pool();
+    return test_sink.packets > packets;
+}
+
+// Запуск туннеля ESP и передача первого пакета приложению STM32
+static test_exit_t test_run(const update_begin_t &begin, const test_source_t &source)
+{
+    test_esp_start(begin, source);
+    test_esp_output();
+    esp.deadline = test_tick + TEST_DEADLINE_MS;
+    const auto reason = (test_exit_t)setjmp(test_exit);
+    if (reason != TEST_EXIT_NONE)
+        return reason;
+    update_begin(esp.out);
+    return TEST_EXIT_NONE;
+}
+
+// Получает, записан ли образ целиком, с дополнением последнего полуслова и без затирания журнала
+static bool test_rom_check(const uint8_t *image = test_image)
+{
+    auto rom = (const uint8_t *)host_rom;
+    if (memcmp(rom, image, TEST_IMAGE_SIZE) || rom[TEST_IMAGE_SIZE] != 0xFF)
+        return false;
+    for (auto i = UPDATE_IMAGE_SIZE_MAX; i < UPDATE_STM_ROM_SIZE; i++)
+        if (rom[i] != TEST_ROM_OLD)
+            return false;
+    return true;
+}
+
+// Получает, стерта ли каждая страница образа указанное число раз, начатые до обрыва - на раз больше
+static bool test_erases_check(unsigned passes, uint32_t partial = 0)
+{
+    for (size_t i = 0; i < array_length(test_page_erases); i++)
+    {
+        auto expect = i < TEST_IMAGE_PAGES ? passes : 0;
+        if (i * UPDATE_PAGE_SIZE < partial)
+            expect++;
+        if (test_page_erases[i] != expect)
+            return false;
+    }
+    return true;
+}
+
+// Программатор запускается только после подготовки с теми же параметрами и в окне
+static void update_arm(void)
+{
+    test_power_on();
+    const auto begin = test_begin();
+    const auto irq = host_irq_disable_count;
+    
+    // Без подготовки
+    TEST_CHECK(test_run(begin, test_source()) == TEST_EXIT_NONE);
+    
+    // Подготовка другим размером
+    auto other = begin;
+    other.size--;
+    TEST_CHECK(test_arm(other));
+    TEST_CHECK(test_run(begin, test_source()) == TEST_EXIT_NONE);
+    
+    // Подготовка однократна
+    TEST_CHECK(test_arm(begin));
+    other = begin;
+    other.crc ^= 1;
+    TEST_CHECK(test_run(other, test_source()) == TEST_EXIT_NONE);
+    TEST_CHECK(test_run(begin, test_source()) == TEST_EXIT_NONE);
+    
+    // Окно запуска истекло
+    TEST_CHECK(test_arm(begin));
+    test_tick += UPDATE_ARM_WINDOW_MS;
+    TEST_CHECK(test_run(begin, test_source()) == TEST_EXIT_NONE);
+    
+    // ПЗУ не тронуто, прерывания не запрещались
+    TEST_CHECK(host_irq_disable_count == irq);
+    TEST_CHECK(host_flash_model.erases == 0);
+}
+
+// Подготовка, передача блоков, проверка CRC, сброс
+static void update_transfer(void)
+{
+    test_power_on();
+    const auto begin = test_begin();
+    TEST_CHECK(test_arm(begin));
+    TEST_CHECK(test_run(begin, test_source()) == TEST_EXIT_RESET);
+    TEST_CHECK(esp.done == 1);
+    TEST_CHECK(esp.timeouts + esp.failures + esp.aborts == 0);
+    TEST_CHECK(test_rom_check());
+    TEST_CHECK(test_erases_check(1));
+    TEST_CHECK(host_flash_model.violations == 0);
+    TEST_CHECK((host_flash.CR & FLASH_CR_LOCK) != 0);
+}
+
+// Неверная CRC: попытки исчерпаны, программатор ждет нового запуска без подготовки
+static void update_bad_crc(void)
+{
+    test_power_on();
+    auto begin = test_begin();
+    begin.crc ^= 1;
+    TEST_CHECK(test_arm(begin));
+    
+    // Без повторного запуска ESP программатор ждет бесконечно
+    TEST_CHECK(test_run(begin, test_source()) == TEST_EXIT_STUCK);
+    TEST_CHECK(esp.done == 0);
+    TEST_CHECK(esp.timeouts == 1);
+    TEST_CHECK(test_erases_check(UPDATE_ATTEMPT_COUNT));
+    
+    // Повторный запуск верным образом
+    test_power_on();
+    TEST_CHECK(test_arm(begin));
+    esp.retry.pending = true;
+    esp.retry.begin = test_begin();
+    esp.retry.source = test_source();
+    TEST_CHECK(test_run(begin, test_source()) == TEST_EXIT_RESET);
+    TEST_CHECK(esp.timeouts == 1);
+    TEST_CHECK(esp.done == 1);
+    TEST_CHECK(test_rom_check());
+    TEST_CHECK(test_erases_check(UPDATE_ATTEMPT_COUNT + 1));
+    TEST_CHECK(host_flash_model.violations == 0);
+}
+
+// Обрезанный образ: ESP останавливает туннель по ошибке чтения, сброса нет
+static void update_truncated(void)
+{
+    test_power_on();
+    const auto begin = test_begin();
+    auto truncated = test_source();
+    truncated.size -= UPDATE_BLOCK_SIZE * 3 / 2;
+    TEST_CHECK(test_arm(begin));
+    TEST_CHECK(test_run(begin, truncated) == TEST_EXIT_STUCK);
+    TEST_CHECK(esp.failures == 1);
+    TEST_CHECK(esp.done == 0);
+    
+    // Тот же образ дописывается по запросам программатора
+    test_power_on();
+    TEST_CHECK(test_arm(begin));
+    esp.retry.pending = true;
+    esp.retry.begin = begin;
+    esp.retry.source = test_source();
+    TEST_CHECK(test_run(begin, truncated) == TEST_EXIT_RESET);
+    TEST_CHECK(esp.failures == 1);
+    TEST_CHECK(esp.done == 1);
+    TEST_CHECK(test_rom_check());
+    TEST_CHECK(test_erases_check(1));
+    TEST_CHECK(host_flash_model.violations == 0);
+}
+
+// Обрыв передачи посреди образа: программатор ждет, новый запуск дописывает образ
+static void update_aborted(void)
+{
+    test_power_on();
+    const auto begin = test_begin();
+    TEST_CHECK(test_arm(begin));
+    esp.abort_offset = TEST_IMAGE_SIZE / 2;
+    TEST_CHECK(test_run(begin, test_source()) == TEST_EXIT_STUCK);
+    TEST_CHECK(esp.aborts == 1);
+    TEST_CHECK(esp.done == 0);
+    TEST_CHECK(!test_rom_check());
+    
+    test_power_on();
+    TEST_CHECK(test_arm(begin));
+    esp.abort_offset = TEST_IMAGE_SIZE / 2;
+    esp.retry.pending = true;
+    esp.retry.begin = begin;
+    esp.retry.source = test_source();
+    TEST_CHECK(test_run(begin, test_source()) == TEST_EXIT_RESET);
+    TEST_CHECK(esp.aborts == 1);
+    TEST_CHECK(esp.done == 1);
+    TEST_CHECK(test_rom_check());
+    TEST_CHECK(test_erases_check(1));
+    TEST_CHECK(host_flash_model.violations == 0);
+}
+
+// Обрыв и загрузка другого образа: запись начинается сначала с новыми параметрами
+static void update_aborted_next(void)
+{
+    test_power_on();
+    const auto begin = test_begin();
+    TEST_CHECK(test_arm(begin));
+    esp.abort_offset = TEST_IMAGE_SIZE / 2;
+    esp.retry.pending = true;
+    esp.retry.begin = test_begin(test_image_next);
+    esp.retry.source = test_source(test_image_next);
+    TEST_CHECK(test_run(begin, test_source()) == TEST_EXIT_RESET);
+    TEST_CHECK(esp.aborts == 1);
+    TEST_CHECK(esp.done == 1);
+    TEST_CHECK(test_rom_check(test_image_next));
+    // Без попыток проверить смесь образов по прежней CRC
+    TEST_CHECK(test_erases_check(1, TEST_IMAGE_SIZE / 2));
+    TEST_CHECK(host_flash_model.violations == 0);
+}
+
+int main(void)
+{
+    srand(34);
+    for (size_t i = 0; i < sizeof(test_image); i++)
+    {
+        test_image[i] = (uint8_t)rand();
+        test_image_next[i] = (uint8_t)(test_image[i] ^ (i % 7 == 0 ? 0xFF : 0));
+    }
+    update_init();
+    
+    TEST_RUN(update_arm);
+    TEST_RUN(update_transfer);
+    TEST_RUN(update_bad_crc);
+    TEST_RUN(update_truncated);
+    TEST_RUN(update_aborted);
+    TEST_RUN(update_aborted_next);
+    return test_result("update");
+}